@@ -606,34 +606,32 @@ void Thermal::dumpThermalData(int fd) {
     if (!thermal_helper_.isInitializedOk()) {
         dump_buf << "ThermalHAL not initialized properly." << std::endl;
     } else {
-        const auto &sensor_status_map = thermal_helper_.GetSensorStatusMap();
+        const auto sensor_status_snapshot = thermal_helper_.GetSensorStatusSnapshot();
         {
             dump_buf << "getCachedTemperatures:" << std::endl;
             boot_clock::time_point now = boot_clock::now();
-            for (const auto &sensor_status_pair : sensor_status_map) {
-                if ((sensor_status_pair.second.thermal_cached.timestamp) ==
-                    boot_clock::time_point::min()) {
+            for (const auto &sensor_status : sensor_status_snapshot->sensors) {
+                if ((sensor_status.thermal_cached.timestamp) == boot_clock::time_point::min()) {
                     continue;
                 }
-                dump_buf << " Name: " << sensor_status_pair.first
-                         << " CachedValue: " << sensor_status_pair.second.thermal_cached.temp
+                dump_buf << " Name: " << *sensor_status.name
+                         << " CachedValue: " << sensor_status.thermal_cached.temp
                          << " TimeToCache: "
                          << std::chrono::duration_cast<std::chrono::milliseconds>(
-                                    now - sensor_status_pair.second.thermal_cached.timestamp)
+                                    now - sensor_status.thermal_cached.timestamp)
                                     .count()
                          << "ms" << std::endl;
             }
         }
         {
             dump_buf << "getEmulTemperatures:" << std::endl;
-            for (const auto &sensor_status_pair : sensor_status_map) {
-                if (sensor_status_pair.second.emul_setting == nullptr) {
+            for (const auto &sensor_status : sensor_status_snapshot->sensors) {
+                if (!sensor_status.is_emulated) {
                     continue;
                 }
-                dump_buf << " Name: " << sensor_status_pair.first
-                         << " EmulTemp: " << sensor_status_pair.second.emul_setting->emul_temp
-                         << " EmulSeverity: "
-                         << sensor_status_pair.second.emul_setting->emul_severity << std::endl;
+                dump_buf << " Name: " << *sensor_status.name
+                         << " EmulTemp: " << sensor_status.emul_temp
+                         << " EmulSeverity: " << sensor_status.emul_severity << std::endl;
             }
         }
         {
@@ -641,7 +639,7 @@ void Thermal::dumpThermalData(int fd) {
             dump_buf << "getCurrentTemperatures:" << std::endl;
             Temperature temp_2_0;
             for (const auto &name_info_pair : map) {
-                thermal_helper_.readTemperature(name_info_pair.first, &temp_2_0, nullptr, true);
+                thermal_helper_.readTemperature(name_info_pair.first, &temp_2_0, nullptr, false);
                 dump_buf << " Type: " << toString(temp_2_0.type)
                          << " Name: " << name_info_pair.first << " CurrentValue: " << temp_2_0.value
                          << " ThrottlingStatus: " << toString(temp_2_0.throttlingStatus)
@@ -0,0 +1,295 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares the in-place energy_value parsing of PowerFiles with the parsing it replaced, which
+// concatenated every node into a string and split it with an istringstream, substr and strtoul.
+// Both run over the ODPM captures in tests/data, once from memory and once from the nodes.
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <benchmark/benchmark.h>
+#include <sys/stat.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "utils/power_files.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace implementation {
+
+class PowerFilesBenchmark {
+  public:
+    static bool FindEnergySource(PowerFiles *power_files) {
+        return power_files->findEnergySourceToWatch();
+    }
+    static bool UpdateEnergyValues(PowerFiles *power_files) {
+        return power_files->updateEnergyValues();
+    }
+    static void ParseEnergyValues(PowerFiles *power_files, std::string_view buf) {
+        size_t line_index = 0;
+        power_files->parseEnergyValues(buf, &line_index);
+    }
+    static const std::vector<PowerSample> &GetEnergySamples(const PowerFiles &power_files) {
+        return power_files.energy_samples_;
+    }
+    static size_t GetEnergySlot(const PowerFiles &power_files, const std::string &rail_name) {
+        return power_files.energy_rail_slot_map_.at(rail_name);
+    }
+};
+
+namespace {
+
+constexpr std::string_view kIioRootDir("/sys/bus/iio/devices");
+const std::vector<std::string> kCaptureNames = {
+        "odpm_main_energy_value.txt",
+        "odpm_sub_energy_value.txt",
+};
+
+using EnergyInfoMap = std::unordered_map<std::string, PowerSample>;
+
+// The energy_value parsing before it was done in place, kept verbatim as the baseline
+void LegacyParseEnergyValues(const std::string &deviceEnergyContents,
+                             EnergyInfoMap *energy_info_map) {
+    std::string line;
+    std::istringstream energyData(deviceEnergyContents);
+    while (std::getline(energyData, line)) {
+        uint64_t energy_counter = 0;
+        uint64_t duration = 0;
+
+        /* Format example: CH3(T=358356)[S2M_VDD_CPUCL2], 761330 */
+        auto start_pos = line.find("T=");
+        auto end_pos = line.find(')');
+        if (start_pos != std::string::npos) {
+            duration =
+                    strtoul(line.substr(start_pos + 2, end_pos - start_pos - 2).c_str(), NULL, 10);
+        } else {
+            continue;
+        }
+
+        start_pos = line.find(")[");
+        end_pos = line.find(']');
+        std::string railName;
+        if (start_pos != std::string::npos) {
+            railName = line.substr(start_pos + 2, end_pos - start_pos - 2);
+        } else {
+            continue;
+        }
+
+        start_pos = line.find("],");
+        if (start_pos != std::string::npos) {
+            energy_counter = strtoul(line.substr(start_pos + 2).c_str(), NULL, 10);
+        } else {
+            continue;
+        }
+
+        (*energy_info_map)[railName] = {
+                .energy_counter = energy_counter,
+                .duration = duration,
+        };
+    }
+}
+
+bool LegacyUpdateEnergyValues(const std::vector<std::string> &energy_paths,
+                              EnergyInfoMap *energy_info_map) {
+    std::string deviceEnergyContent;
+    std::string deviceEnergyContents;
+
+    for (const auto &path : energy_paths) {
+        if (!::android::base::ReadFileToString(path, &deviceEnergyContent)) {
+            LOG(ERROR) << "Failed to read energy content from " << path;
+            return false;
+        } else {
+            deviceEnergyContents.append(deviceEnergyContent);
+        }
+    }
+    LegacyParseEnergyValues(deviceEnergyContents, energy_info_map);
+    return true;
+}
+
+// The captures laid out as the iio devices PowerFiles scans
+class EnergyCapture {
+  public:
+    EnergyCapture() {
+        const std::string data_dir = ::android::base::GetExecutableDirectory() + "/tests/data/";
+        const std::string iio_root_dir = root_path_ + std::string(kIioRootDir);
+        for (size_t pos = iio_root_dir.find('/', root_path_.size() + 1);;
+             pos = iio_root_dir.find('/', pos + 1)) {
+            const std::string dir = iio_root_dir.substr(0, pos);
+            if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+                PLOG(ERROR) << "Failed to create " << dir;
+                return;
+            }
+            if (pos == std::string::npos) {
+                break;
+            }
+        }
+
+        for (size_t i = 0; i < kCaptureNames.size(); ++i) {
+            std::string content;
+            if (!::android::base::ReadFileToString(data_dir + kCaptureNames[i], &content)) {
+                PLOG(ERROR) << "Failed to read capture " << kCaptureNames[i];
+                return;
+            }
+            const std::string device_dir = iio_root_dir + "/iio:device" + std::to_string(i);
+            const std::string energy_path = device_dir + "/energy_value";
+            if (mkdir(device_dir.c_str(), 0755) != 0 ||
+                !::android::base::WriteStringToFile(content, energy_path)) {
+                PLOG(ERROR) << "Failed to write " << energy_path;
+                return;
+            }
+            contents_.append(content);
+            energy_paths_.push_back(energy_path);
+        }
+        ok_ = true;
+    }
+
+    bool isOk() const { return ok_; }
+    const std::string &rootDir() const { return root_path_; }
+    const std::string &contents() const { return contents_; }
+    const std::vector<std::string> &energyPaths() const { return energy_paths_; }
+
+  private:
+    ::android::base::TemporaryDir root_dir_;
+    const std::string root_path_ = root_dir_.path;
+    std::string contents_;
+    std::vector<std::string> energy_paths_;
+    bool ok_ = false;
+};
+
+const EnergyCapture &GetEnergyCapture() {
+    static const EnergyCapture *capture = new EnergyCapture();
+    return *capture;
+}
+
+// Both paths must agree on every rail of the capture, or the comparison is meaningless
+bool MatchesLegacy(const PowerFiles &power_files, const EnergyInfoMap &energy_info_map) {
+    const auto &energy_samples = PowerFilesBenchmark::GetEnergySamples(power_files);
+    if (energy_info_map.empty() || energy_samples.size() != energy_info_map.size()) {
+        return false;
+    }
+    for (const auto &[rail_name, legacy_sample] : energy_info_map) {
+        const PowerSample &sample =
+                energy_samples[PowerFilesBenchmark::GetEnergySlot(power_files, rail_name)];
+        if (sample.energy_counter != legacy_sample.energy_counter ||
+            sample.duration != legacy_sample.duration) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void BM_LegacyParseEnergyValues(benchmark::State &state) {
+    const EnergyCapture &capture = GetEnergyCapture();
+    if (!capture.isOk()) {
+        state.SkipWithError("failed to set up the energy capture");
+        return;
+    }
+
+    for (auto _ : state) {
+        EnergyInfoMap energy_info_map;
+        LegacyParseEnergyValues(capture.contents(), &energy_info_map);
+        benchmark::DoNotOptimize(energy_info_map);
+    }
+    state.SetBytesProcessed(state.iterations() * capture.contents().size());
+}
+BENCHMARK(BM_LegacyParseEnergyValues);
+
+void BM_ParseEnergyValues(benchmark::State &state) {
+    const EnergyCapture &capture = GetEnergyCapture();
+    if (!capture.isOk()) {
+        state.SkipWithError("failed to set up the energy capture");
+        return;
+    }
+
+    // The rail slots are interned on the first update, as registerPowerRailsToWatch does
+    PowerFiles power_files(capture.rootDir());
+    PowerFilesBenchmark::ParseEnergyValues(&power_files, capture.contents());
+    EnergyInfoMap energy_info_map;
+    LegacyParseEnergyValues(capture.contents(), &energy_info_map);
+    if (!MatchesLegacy(power_files, energy_info_map)) {
+        state.SkipWithError("in-place parsing disagrees with the legacy parsing");
+        return;
+    }
+
+    for (auto _ : state) {
+        PowerFilesBenchmark::ParseEnergyValues(&power_files, capture.contents());
+        benchmark::DoNotOptimize(PowerFilesBenchmark::GetEnergySamples(power_files).data());
+    }
+    state.SetBytesProcessed(state.iterations() * capture.contents().size());
+}
+BENCHMARK(BM_ParseEnergyValues);
+
+void BM_LegacyUpdateEnergyValues(benchmark::State &state) {
+    const EnergyCapture &capture = GetEnergyCapture();
+    if (!capture.isOk()) {
+        state.SkipWithError("failed to set up the energy capture");
+        return;
+    }
+
+    // The legacy map was a member, so only the first update inserted rails
+    EnergyInfoMap energy_info_map;
+    for (auto _ : state) {
+        if (!LegacyUpdateEnergyValues(capture.energyPaths(), &energy_info_map)) {
+            state.SkipWithError("failed to read the energy nodes");
+            return;
+        }
+        benchmark::DoNotOptimize(energy_info_map);
+    }
+}
+BENCHMARK(BM_LegacyUpdateEnergyValues);
+
+void BM_UpdateEnergyValues(benchmark::State &state) {
+    const EnergyCapture &capture = GetEnergyCapture();
+    if (!capture.isOk()) {
+        state.SkipWithError("failed to set up the energy capture");
+        return;
+    }
+
+    PowerFiles power_files(capture.rootDir());
+    if (!PowerFilesBenchmark::FindEnergySource(&power_files) ||
+        !PowerFilesBenchmark::UpdateEnergyValues(&power_files)) {
+        state.SkipWithError("failed to read the energy nodes");
+        return;
+    }
+
+    for (auto _ : state) {
+        if (!PowerFilesBenchmark::UpdateEnergyValues(&power_files)) {
+            state.SkipWithError("failed to read the energy nodes");
+            return;
+        }
+        benchmark::DoNotOptimize(PowerFilesBenchmark::GetEnergySamples(power_files).data());
+    }
+}
+BENCHMARK(BM_UpdateEnergyValues);
+
+}  // namespace
+
+}  // namespace implementation
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
+
+BENCHMARK_MAIN();
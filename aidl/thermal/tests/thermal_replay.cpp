@@ -0,0 +1,428 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "thermal_replay.h"
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/properties.h>
+#include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace {
+
+std::atomic<uint64_t> g_allocation_count(0);
+
+}  // namespace
+
+// Count the allocations of the whole process. replayTick() runs the watcher callback on the
+// calling thread, and no watcher thread is started for a replayed tree, so during a tick the
+// count is the watcher pass' own as long as the caller does not allocate from other threads.
+void *operator new(size_t size) {
+    g_allocation_count.fetch_add(1, std::memory_order_relaxed);
+    void *ptr = malloc(size ? size : 1);
+    if (ptr == nullptr) {
+        abort();
+    }
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    free(ptr);
+}
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace implementation {
+
+using ::android::base::StringPrintf;
+
+namespace {
+
+constexpr std::string_view kThermalSensorsRoot("/sys/devices/virtual/thermal");
+constexpr std::string_view kIioEnergyValue("/sys/bus/iio/devices/iio:device0/energy_value");
+constexpr std::string_view kConfigProperty("vendor.thermal.config");
+constexpr std::string_view kConfigDefaultFileName("thermal_info_config.json");
+constexpr std::string_view kThreadIo("/proc/thread-self/io");
+// The temperature the synthesized sensors start at, in degrees Celsius
+constexpr float kInitialTemp = 25.0;
+
+bool MakeDirs(const std::string &path) {
+    for (size_t pos = path.find('/', 1);; pos = path.find('/', pos + 1)) {
+        const std::string dir = path.substr(0, pos);
+        if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+            PLOG(ERROR) << "Failed to create " << dir;
+            return false;
+        }
+        if (pos == std::string::npos) {
+            return true;
+        }
+    }
+}
+
+bool WriteNode(const std::string &path, const std::string &content) {
+    if (!MakeDirs(path.substr(0, path.rfind('/')))) {
+        return false;
+    }
+    if (!::android::base::WriteStringToFile(content, path)) {
+        PLOG(ERROR) << "Failed to write " << path;
+        return false;
+    }
+    return true;
+}
+
+template <typename T>
+std::vector<std::string> SortedNames(const std::unordered_map<std::string, T> &map) {
+    std::vector<std::string> names;
+    names.reserve(map.size());
+    for (const auto &name_info_pair : map) {
+        names.push_back(name_info_pair.first);
+    }
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+// The highest state the sensors may request from cdev_name
+int GetCdevMaxState(std::string_view cdev_name, const CdevInfo &cdev_info,
+                    const std::unordered_map<std::string, SensorInfo> &sensor_info_map) {
+    if (!cdev_info.state2power.empty()) {
+        return static_cast<int>(cdev_info.state2power.size()) - 1;
+    }
+    int max_state = 1;
+    for (const auto &sensor_info_pair : sensor_info_map) {
+        const auto &throttling_info = sensor_info_pair.second.throttling_info;
+        if (throttling_info == nullptr) {
+            continue;
+        }
+        const auto binded_itr = throttling_info->binded_cdev_info_map.find(std::string(cdev_name));
+        if (binded_itr == throttling_info->binded_cdev_info_map.end()) {
+            continue;
+        }
+        const BindedCdevInfo &binded_cdev_info = binded_itr->second;
+        for (size_t i = 0; i < kThrottlingSeverityCount; ++i) {
+            max_state = std::max(max_state, binded_cdev_info.limit_info[i]);
+            max_state = std::max(max_state, binded_cdev_info.cdev_floor_with_power_link[i]);
+            if (binded_cdev_info.cdev_ceiling[i] != std::numeric_limits<int>::max()) {
+                max_state = std::max(max_state, binded_cdev_info.cdev_ceiling[i]);
+            }
+        }
+    }
+    return max_state;
+}
+
+}  // namespace
+
+bool ParseThermalTrace(std::string_view path, ThermalTrace *trace) {
+    std::string content;
+    if (!::android::base::ReadFileToString(std::string(path), &content)) {
+        PLOG(ERROR) << "Failed to read trace " << path;
+        return false;
+    }
+
+    trace->columns.clear();
+    trace->rows.clear();
+    size_t line_number = 0;
+    for (const auto &raw_line : ::android::base::Split(content, "\n")) {
+        ++line_number;
+        const std::string line = ::android::base::Trim(raw_line);
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        const auto fields = ::android::base::Split(line, ",");
+        if (trace->columns.empty()) {
+            for (const auto &field : fields) {
+                trace->columns.push_back(::android::base::Trim(field));
+            }
+            continue;
+        }
+        if (fields.size() != trace->columns.size()) {
+            LOG(ERROR) << path << ":" << line_number << ": " << fields.size()
+                       << " values for " << trace->columns.size() << " columns";
+            return false;
+        }
+        auto &row = trace->rows.emplace_back();
+        for (const auto &field : fields) {
+            const std::string value = ::android::base::Trim(field);
+            char *end = nullptr;
+            row.push_back(strtoll(value.c_str(), &end, 10));
+            if (value.empty() || *end != '\0') {
+                LOG(ERROR) << path << ":" << line_number << ": invalid value " << value;
+                return false;
+            }
+        }
+    }
+    return !trace->columns.empty();
+}
+
+bool ThermalReplay::SynthesizeTree(std::string_view config_path, std::string_view root_dir) {
+    std::string json_doc;
+    if (!::android::base::ReadFileToString(std::string(config_path), &json_doc)) {
+        PLOG(ERROR) << "Failed to read config " << config_path;
+        return false;
+    }
+    Json::Value config;
+    std::unordered_map<std::string, SensorInfo> sensor_info_map;
+    std::unordered_map<std::string, CdevInfo> cooling_device_info_map;
+    std::unordered_map<std::string, PowerRailInfo> power_rail_info_map;
+    if (!ParseThermalConfig(json_doc, &config) || !ParseSensorInfo(config, &sensor_info_map) ||
+        !ParseCoolingDevice(config, &cooling_device_info_map) ||
+        !ParsePowerRailInfo(config, &power_rail_info_map)) {
+        LOG(ERROR) << "Failed to parse config " << config_path;
+        return false;
+    }
+
+    const std::string root(root_dir);
+    const std::string config_name = ::android::base::GetProperty(kConfigProperty.data(),
+                                                                 kConfigDefaultFileName.data());
+    if (!WriteNode(root + "/vendor/etc/" + config_name, json_doc)) {
+        return false;
+    }
+    const std::string cache_path = GetThermalConfigCachePath(root);
+    if (!MakeDirs(cache_path.substr(0, cache_path.rfind('/')))) {
+        return false;
+    }
+
+    const std::string thermal_root = root + std::string(kThermalSensorsRoot);
+    size_t tz_id = 0;
+    for (const auto &name : SortedNames(sensor_info_map)) {
+        const SensorInfo &sensor_info = sensor_info_map.at(name);
+        if (sensor_info.virtual_sensor_info != nullptr) {
+            continue;
+        }
+        const std::string tz_path =
+                StringPrintf("%s/thermal_zone%zu", thermal_root.c_str(), tz_id++);
+        const float multiplier = sensor_info.multiplier != 0 ? sensor_info.multiplier : 1.0f;
+        const std::string temp = std::to_string(static_cast<int64_t>(kInitialTemp / multiplier));
+        if (!WriteNode(tz_path + "/type", name + "\n") || !WriteNode(tz_path + "/temp", temp) ||
+            !WriteNode(tz_path + "/policy", "user_space\n") ||
+            !WriteNode(tz_path + "/trip_point_0_temp", "0") ||
+            !WriteNode(tz_path + "/trip_point_0_hyst", "0")) {
+            return false;
+        }
+        if (!sensor_info.temp_path.empty() && !WriteNode(root + sensor_info.temp_path, temp)) {
+            return false;
+        }
+    }
+
+    size_t cdev_id = 0;
+    for (const auto &name : SortedNames(cooling_device_info_map)) {
+        const CdevInfo &cdev_info = cooling_device_info_map.at(name);
+        const std::string cdev_path =
+                StringPrintf("%s/cooling_device%zu", thermal_root.c_str(), cdev_id++);
+        const int max_state = GetCdevMaxState(name, cdev_info, sensor_info_map);
+        if (!WriteNode(cdev_path + "/type", name + "\n") ||
+            !WriteNode(cdev_path + "/cur_state", "0") ||
+            !WriteNode(cdev_path + "/max_state", std::to_string(max_state))) {
+            return false;
+        }
+        if (!cdev_info.read_path.empty() && !WriteNode(root + cdev_info.read_path, "0")) {
+            return false;
+        }
+        if (!cdev_info.write_path.empty() && !WriteNode(root + cdev_info.write_path, "0")) {
+            return false;
+        }
+    }
+
+    std::string energy_value = "t=0\n";
+    size_t channel = 0;
+    for (const auto &name : SortedNames(power_rail_info_map)) {
+        const PowerRailInfo &power_rail_info = power_rail_info_map.at(name);
+        if (power_rail_info.virtual_power_rail_info != nullptr) {
+            continue;
+        }
+        energy_value +=
+                StringPrintf("CH%zu(T=0)[%s], 0\n", channel++, name.c_str());
+    }
+    if (channel && !WriteNode(root + std::string(kIioEnergyValue), energy_value)) {
+        return false;
+    }
+    return true;
+}
+
+ThermalReplay::ThermalReplay(std::string_view root_dir)
+    : root_dir_(root_dir), helper_(NotificationCallback(), root_dir) {
+    for (const auto &power_rail_info_pair : helper_.GetPowerRailInfoMap()) {
+        if (power_rail_info_pair.second.virtual_power_rail_info == nullptr) {
+            energy_counters_.emplace_back(power_rail_info_pair.first, 0);
+        }
+    }
+    std::sort(energy_counters_.begin(), energy_counters_.end());
+    cdev_names_ = SortedNames(helper_.GetCdevInfoMap());
+
+    const auto snapshot = helper_.GetSensorStatusSnapshot();
+    if (snapshot != nullptr) {
+        for (const auto &sensor : snapshot->sensors) {
+            prev_severities_.push_back(sensor.severity);
+        }
+    }
+
+    io_fd_.reset(TEMP_FAILURE_RETRY(open(kThreadIo.data(), O_RDONLY | O_CLOEXEC)));
+    int64_t read_before, write_before, read_after, write_after;
+    if (!readSyscallCounts(&read_before, &write_before) ||
+        !readSyscallCounts(&read_after, &write_after)) {
+        LOG(WARNING) << "No task IO accounting, the syscalls will not be counted";
+        io_fd_.reset();
+        return;
+    }
+    io_read_overhead_ = read_after - read_before;
+    io_write_overhead_ = write_after - write_before;
+}
+
+bool ThermalReplay::readSyscallCounts(int64_t *read_syscalls, int64_t *write_syscalls) const {
+    if (io_fd_ == -1) {
+        return false;
+    }
+    char buf[512];
+    const ssize_t len = TEMP_FAILURE_RETRY(pread(io_fd_, buf, sizeof(buf) - 1, 0));
+    if (len <= 0) {
+        return false;
+    }
+    buf[len] = '\0';
+    const char *syscr = strstr(buf, "syscr:");
+    const char *syscw = strstr(buf, "syscw:");
+    if (syscr == nullptr || syscw == nullptr) {
+        return false;
+    }
+    *read_syscalls = strtoll(syscr + strlen("syscr:"), nullptr, 10);
+    *write_syscalls = strtoll(syscw + strlen("syscw:"), nullptr, 10);
+    return true;
+}
+
+bool ThermalReplay::writeEnergyValues() {
+    if (energy_counters_.empty()) {
+        return true;
+    }
+    std::string energy_value = StringPrintf("t=%" PRId64 "\n", energy_timestamp_ms_);
+    for (size_t channel = 0; channel < energy_counters_.size(); ++channel) {
+        energy_value += StringPrintf("CH%zu(T=%" PRId64 ")[%s], %" PRId64 "\n", channel,
+                                     energy_timestamp_ms_, energy_counters_[channel].first.c_str(),
+                                     energy_counters_[channel].second);
+    }
+    return WriteNode(root_dir_ + std::string(kIioEnergyValue), energy_value);
+}
+
+bool ThermalReplay::replayTick(const std::vector<std::string> &columns,
+                               const std::vector<int64_t> &values,
+                               std::chrono::milliseconds tick_period, ThermalReplayTick *out) {
+    if (values.size() != columns.size()) {
+        LOG(ERROR) << values.size() << " values for " << columns.size() << " columns";
+        return false;
+    }
+
+    // Stage the tick in sysfs
+    energy_timestamp_ms_ += tick_period.count();
+    for (size_t i = 0; i < columns.size(); ++i) {
+        const auto rail_itr = std::find_if(energy_counters_.begin(), energy_counters_.end(),
+                                           [&](const auto &rail_counter_pair) {
+                                               return rail_counter_pair.first == columns[i];
+                                           });
+        if (rail_itr != energy_counters_.end()) {
+            // mW over the tick period in ms, the energy counters are in uWs
+            rail_itr->second += values[i] * tick_period.count();
+            continue;
+        }
+        const std::string path = helper_.thermal_sensors_.getThermalFilePath(columns[i]);
+        if (path.empty()) {
+            LOG(ERROR) << "Unknown sensor or power rail " << columns[i];
+            return false;
+        }
+        if (!::android::base::WriteStringToFile(std::to_string(values[i]), path)) {
+            PLOG(ERROR) << "Failed to write " << path;
+            return false;
+        }
+    }
+    if (!writeEnergyValues()) {
+        return false;
+    }
+
+    // Every tick is a full sample: all the watched sensors are due and nothing is read from
+    // the cache, whatever their polling delay and time resolution
+    {
+        std::unique_lock<std::shared_mutex> _lock(helper_.sensor_status_map_mutex_);
+        for (auto &name_status_pair : helper_.sensor_status_map_) {
+            name_status_pair.second.thermal_cached.timestamp = boot_clock::time_point::min();
+        }
+    }
+    for (size_t node_index = 0; node_index < helper_.sensor_eval_nodes_.size(); ++node_index) {
+        if (helper_.sensor_eval_nodes_[node_index].info->is_watch) {
+            helper_.scheduleSensor(node_index, boot_clock::time_point::min());
+        }
+    }
+
+    int64_t read_before = 0, write_before = 0, read_after = 0, write_after = 0;
+    bool io_counted = readSyscallCounts(&read_before, &write_before);
+    const uint64_t allocations_before = GetAllocationCount();
+    const auto start = std::chrono::steady_clock::now();
+    helper_.thermalWatcherCallbackFunc({});
+    const auto end = std::chrono::steady_clock::now();
+    out->allocations = GetAllocationCount() - allocations_before;
+    io_counted = io_counted && readSyscallCounts(&read_after, &write_after);
+
+    out->latency = end - start;
+    out->read_syscalls = io_counted ? read_after - read_before - io_read_overhead_ : -1;
+    out->write_syscalls = io_counted ? write_after - write_before - io_write_overhead_ : -1;
+
+    out->severity_changes.clear();
+    const auto snapshot = helper_.GetSensorStatusSnapshot();
+    if (snapshot != nullptr) {
+        prev_severities_.resize(snapshot->sensors.size(), ThrottlingSeverity::NONE);
+        for (size_t i = 0; i < snapshot->sensors.size(); ++i) {
+            const auto &sensor = snapshot->sensors[i];
+            if (sensor.severity != prev_severities_[i]) {
+                out->severity_changes.emplace_back(*sensor.name, sensor.severity);
+                prev_severities_[i] = sensor.severity;
+            }
+        }
+    }
+
+    out->cdev_states.clear();
+    for (const auto &cdev_name : cdev_names_) {
+        std::string data;
+        int state = -1;
+        if (helper_.cooling_devices_.readThermalFile(cdev_name, &data)) {
+            state = atoi(data.c_str());
+        }
+        out->cdev_states.emplace_back(cdev_name, state);
+    }
+    return true;
+}
+
+uint64_t GetAllocationCount() {
+    return g_allocation_count.load(std::memory_order_relaxed);
+}
+
+}  // namespace implementation
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android-base/unique_fd.h>
+
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "thermal-helper.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace implementation {
+
+// A recorded temperature trace. Each column is a physical sensor, whose values are written
+// as-is to its temp node, or a physical power rail, whose values are its power in mW over the
+// tick.
+struct ThermalTrace {
+    std::vector<std::string> columns;
+    std::vector<std::vector<int64_t>> rows;
+};
+
+// Parse a CSV trace: '#' comments, a header line with the column names, then one line of
+// values per tick.
+bool ParseThermalTrace(std::string_view path, ThermalTrace *trace);
+
+// What one replayed tick cost and decided.
+struct ThermalReplayTick {
+    // Wall time of the watcher pass
+    std::chrono::nanoseconds latency;
+    // read()/write() family syscalls of the watcher pass, -1 without task IO accounting
+    int64_t read_syscalls;
+    int64_t write_syscalls;
+    // operator new calls of the watcher pass
+    uint64_t allocations;
+    // The sensors whose severity changed in this tick
+    std::vector<std::pair<std::string, ThrottlingSeverity>> severity_changes;
+    // The state of every cooling device after the tick, read back from sysfs
+    std::vector<std::pair<std::string, int>> cdev_states;
+};
+
+// Runs ThermalHelper against a synthesized sysfs tree and replays traces through it, one
+// watcher pass per tick.
+class ThermalReplay {
+  public:
+    // Build the tree the HAL expects for the config at config_path under root_dir: a thermal
+    // zone per physical sensor, a cooling device per cdev, an IIO energy node for the power
+    // rails, and the config itself under vendor/etc.
+    static bool SynthesizeTree(std::string_view config_path, std::string_view root_dir);
+
+    explicit ThermalReplay(std::string_view root_dir);
+    ~ThermalReplay() = default;
+    // Disallow copy and assign.
+    ThermalReplay(const ThermalReplay &) = delete;
+    void operator=(const ThermalReplay &) = delete;
+
+    bool isInitializedOk() const { return helper_.isInitializedOk(); }
+    const ThermalHelper &helper() const { return helper_; }
+
+    // Write one tick of values to sysfs and run a watcher pass over every watched sensor.
+    // tick_period is the time the tick stands for, used to integrate the power rail energy.
+    // The syscalls are counted for the calling thread, which must be the constructing one.
+    bool replayTick(const std::vector<std::string> &columns, const std::vector<int64_t> &values,
+                    std::chrono::milliseconds tick_period, ThermalReplayTick *out);
+
+  private:
+    // Read the task IO accounting of the calling thread
+    bool readSyscallCounts(int64_t *read_syscalls, int64_t *write_syscalls) const;
+    bool writeEnergyValues();
+
+    const std::string root_dir_;
+    ThermalHelper helper_;
+    ::android::base::unique_fd io_fd_;
+    // read/write syscalls made by readSyscallCounts() itself between two samples
+    int64_t io_read_overhead_ = 0;
+    int64_t io_write_overhead_ = 0;
+    // Energy counter and timestamp in ms of the physical power rails, by rail name
+    std::vector<std::pair<std::string, int64_t>> energy_counters_;
+    int64_t energy_timestamp_ms_ = 0;
+    std::vector<std::string> cdev_names_;
+    std::vector<ThrottlingSeverity> prev_severities_;
+};
+
+// Number of operator new calls made by the process so far.
+uint64_t GetAllocationCount();
+
+}  // namespace implementation
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Replay a temperature trace through the thermal HAL against a sysfs tree synthesized from a
+ * thermal config, and print what every tick cost and decided:
+ *
+ *   thermal_replay --config thermal_info_config.json --trace trace.csv \
+ *           [--root /data/local/tmp/thermal_replay] [--period_ms 1000] [--realtime]
+ *
+ * Each output line is a tick: latency in us, read and write syscalls, allocations, the
+ * sensors whose severity changed and the state of every cooling device. A summary of the
+ * latency percentiles and average costs follows the ticks.
+ */
+
+#include <android-base/logging.h>
+#include <getopt.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "thermal_replay.h"
+
+using ::aidl::android::hardware::thermal::implementation::ParseThermalTrace;
+using ::aidl::android::hardware::thermal::implementation::ThermalReplay;
+using ::aidl::android::hardware::thermal::implementation::ThermalReplayTick;
+using ::aidl::android::hardware::thermal::implementation::ThermalTrace;
+
+namespace {
+
+constexpr char kDefaultRootDir[] = "/data/local/tmp/thermal_replay";
+
+void PrintUsage(const char *argv0) {
+    fprintf(stderr,
+            "Usage: %s --config <thermal_info_config.json> --trace <trace.csv>"
+            " [--root <dir>] [--period_ms <ms>] [--realtime]\n",
+            argv0);
+}
+
+int64_t GetPercentileUs(const std::vector<int64_t> &sorted_us, double percentile) {
+    if (sorted_us.empty()) {
+        return 0;
+    }
+    const size_t index = static_cast<size_t>(percentile * (sorted_us.size() - 1) + 0.5);
+    return sorted_us[index];
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    std::string config_path;
+    std::string trace_path;
+    std::string root_dir = kDefaultRootDir;
+    std::chrono::milliseconds period(1000);
+    bool realtime = false;
+
+    static const struct option kOptions[] = {
+            {"config", required_argument, nullptr, 'c'},
+            {"trace", required_argument, nullptr, 't'},
+            {"root", required_argument, nullptr, 'r'},
+            {"period_ms", required_argument, nullptr, 'p'},
+            {"realtime", no_argument, nullptr, 'R'},
+            {nullptr, 0, nullptr, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", kOptions, nullptr)) != -1) {
+        switch (opt) {
+            case 'c':
+                config_path = optarg;
+                break;
+            case 't':
+                trace_path = optarg;
+                break;
+            case 'r':
+                root_dir = optarg;
+                break;
+            case 'p':
+                period = std::chrono::milliseconds(atoi(optarg));
+                break;
+            case 'R':
+                realtime = true;
+                break;
+            default:
+                PrintUsage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (config_path.empty() || trace_path.empty() || period.count() <= 0) {
+        PrintUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    ThermalTrace trace;
+    if (!ParseThermalTrace(trace_path, &trace)) {
+        LOG(ERROR) << "Failed to parse trace " << trace_path;
+        return EXIT_FAILURE;
+    }
+    if (!ThermalReplay::SynthesizeTree(config_path, root_dir)) {
+        LOG(ERROR) << "Failed to synthesize sysfs under " << root_dir;
+        return EXIT_FAILURE;
+    }
+    ThermalReplay replay(root_dir);
+    if (!replay.isInitializedOk()) {
+        LOG(ERROR) << "Thermal HAL failed to initialize against " << root_dir;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<int64_t> latencies_us;
+    int64_t total_read_syscalls = 0;
+    int64_t total_write_syscalls = 0;
+    uint64_t total_allocations = 0;
+    ThermalReplayTick tick;
+    printf("tick,latency_us,read_syscalls,write_syscalls,allocations,severity_changes,cdevs\n");
+    auto next_tick = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < trace.rows.size(); ++i) {
+        if (realtime) {
+            std::this_thread::sleep_until(next_tick);
+            next_tick += period;
+        }
+        if (!replay.replayTick(trace.columns, trace.rows[i], period, &tick)) {
+            LOG(ERROR) << "Failed to replay tick " << i;
+            return EXIT_FAILURE;
+        }
+
+        const int64_t latency_us =
+                std::chrono::duration_cast<std::chrono::microseconds>(tick.latency).count();
+        latencies_us.push_back(latency_us);
+        total_read_syscalls += tick.read_syscalls;
+        total_write_syscalls += tick.write_syscalls;
+        total_allocations += tick.allocations;
+
+        std::string severity_changes;
+        for (const auto &[name, severity] : tick.severity_changes) {
+            severity_changes += (severity_changes.empty() ? "" : ";") + name + "=" +
+                                ::aidl::android::hardware::thermal::toString(severity);
+        }
+        std::string cdevs;
+        for (const auto &[name, state] : tick.cdev_states) {
+            cdevs += (cdevs.empty() ? "" : ";") + name + "=" + std::to_string(state);
+        }
+        printf("%zu,%" PRId64 ",%" PRId64 ",%" PRId64 ",%" PRIu64 ",%s,%s\n", i, latency_us,
+               tick.read_syscalls, tick.write_syscalls, tick.allocations,
+               severity_changes.c_str(), cdevs.c_str());
+    }
+
+    if (latencies_us.empty()) {
+        return EXIT_SUCCESS;
+    }
+    const size_t ticks = latencies_us.size();
+    std::sort(latencies_us.begin(), latencies_us.end());
+    printf("# ticks=%zu latency_us p50=%" PRId64 " p90=%" PRId64 " p99=%" PRId64 " max=%" PRId64
+           "\n",
+           ticks, GetPercentileUs(latencies_us, 0.5), GetPercentileUs(latencies_us, 0.9),
+           GetPercentileUs(latencies_us, 0.99), latencies_us.back());
+    if (tick.read_syscalls >= 0) {
+        printf("# per tick: read_syscalls=%.1f write_syscalls=%.1f\n",
+               static_cast<double>(total_read_syscalls) / ticks,
+               static_cast<double>(total_write_syscalls) / ticks);
+    }
+    printf("# per tick: allocations=%.1f\n", static_cast<double>(total_allocations) / ticks);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+#include "thermal_replay.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace implementation {
+
+namespace {
+
+constexpr std::chrono::milliseconds kTickPeriod(1000);
+constexpr char kSkinSensor[] = "skin_therm";
+constexpr char kCpuCdev[] = "thermal-cpufreq-0";
+constexpr char kSocSensor[] = "soc_therm";
+constexpr char kGpuCdev[] = "thermal-gpufreq-0";
+
+std::string GetTestDataPath(const std::string &name) {
+    return ::android::base::GetExecutableDirectory() + "/tests/data/" + name;
+}
+
+class ThermalReplayTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        ASSERT_TRUE(ParseThermalTrace(GetTestDataPath("ramp_trace.csv"), &trace_));
+        ASSERT_TRUE(ThermalReplay::SynthesizeTree(GetTestDataPath("thermal_info_config.json"),
+                                                  root_dir_.path));
+    }
+
+    ::android::base::TemporaryDir root_dir_;
+    ThermalTrace trace_;
+};
+
+TEST_F(ThermalReplayTest, RampThrottlesAndReleases) {
+    ThermalReplay replay(root_dir_.path);
+    ASSERT_TRUE(replay.isInitializedOk());
+
+    ThrottlingSeverity peak_severity = ThrottlingSeverity::NONE;
+    ThrottlingSeverity skin_severity = ThrottlingSeverity::NONE;
+    ThrottlingSeverity peak_soc_severity = ThrottlingSeverity::NONE;
+    int peak_cdev_state = 0;
+    int cdev_state = -1;
+    int peak_gpu_state = 0;
+    int gpu_state = -1;
+    ThermalReplayTick tick;
+    for (const auto &row : trace_.rows) {
+        ASSERT_TRUE(replay.replayTick(trace_.columns, row, kTickPeriod, &tick));
+        EXPECT_GT(tick.latency.count(), 0);
+        if (tick.read_syscalls != -1) {
+            // At least the two physical sensors are read on every tick
+            EXPECT_GE(tick.read_syscalls, 2);
+        }
+
+        for (const auto &[name, severity] : tick.severity_changes) {
+            if (name == kSkinSensor) {
+                skin_severity = severity;
+                peak_severity = std::max(peak_severity, severity);
+            } else if (name == kSocSensor) {
+                peak_soc_severity = std::max(peak_soc_severity, severity);
+            }
+        }
+        for (const auto &[name, state] : tick.cdev_states) {
+            if (name == kCpuCdev) {
+                cdev_state = state;
+                peak_cdev_state = std::max(peak_cdev_state, state);
+            } else if (name == kGpuCdev) {
+                gpu_state = state;
+                peak_gpu_state = std::max(peak_gpu_state, state);
+            }
+        }
+    }
+
+    // 52C crosses the 50C EMERGENCY threshold, whose LimitInfo is state 5
+    EXPECT_EQ(peak_severity, ThrottlingSeverity::EMERGENCY);
+    EXPECT_EQ(peak_cdev_state, 5);
+    // The trace cools back down to 35C, which releases the cooling device
+    EXPECT_EQ(skin_severity, ThrottlingSeverity::NONE);
+    EXPECT_EQ(cdev_state, 0);
+
+    // The SoC peaks at 58C, past the 50C MODERATE PID target. The GPU cdev has no LimitInfo, so
+    // only the PID power budget can throttle it, and it is released once the SoC cools down.
+    EXPECT_EQ(peak_soc_severity, ThrottlingSeverity::SEVERE);
+    EXPECT_GT(peak_gpu_state, 0);
+    EXPECT_EQ(gpu_state, 0);
+}
+
+TEST_F(ThermalReplayTest, UnknownColumnIsRejected) {
+    ThermalReplay replay(root_dir_.path);
+    ASSERT_TRUE(replay.isInitializedOk());
+
+    ThermalReplayTick tick;
+    EXPECT_FALSE(replay.replayTick({"no_such_sensor"}, {42000}, kTickPeriod, &tick));
+}
+
+}  // namespace
+
+}  // namespace implementation
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
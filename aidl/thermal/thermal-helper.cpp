@@ -24,6 +24,8 @@
 #include <android-base/strings.h>
 #include <utils/Trace.h>
 
+#include <algorithm>
+#include <deque>
 #include <iterator>
 #include <set>
 #include <sstream>
@@ -56,9 +58,21 @@ constexpr std::string_view kThermalDisabledProperty("vendor.disable.thermalhal.c
 namespace {
 using ::android::base::StringPrintf;
 
-std::unordered_map<std::string, std::string> parseThermalPathMap(std::string_view prefix) {
+// SensorEvalState::flags
+constexpr uint8_t kSensorEvalNeeded = 1 << 0;
+constexpr uint8_t kSensorEvalNoCache = 1 << 1;
+// The value is read from sysfs or computed in this pass
+constexpr uint8_t kSensorEvalUpdate = 1 << 2;
+constexpr uint8_t kSensorEvalValid = 1 << 3;
+// The value is a real (not emulated) reading which goes to the sensor log
+constexpr uint8_t kSensorEvalLogged = 1 << 4;
+
+std::unordered_map<std::string, std::string> parseThermalPathMap(std::string_view root_dir,
+                                                                std::string_view prefix) {
     std::unordered_map<std::string, std::string> path_map;
-    std::unique_ptr<DIR, int (*)(DIR *)> dir(opendir(kThermalSensorsRoot.data()), closedir);
+    const std::string thermal_sensors_root =
+            std::string(root_dir) + std::string(kThermalSensorsRoot);
+    std::unique_ptr<DIR, int (*)(DIR *)> dir(opendir(thermal_sensors_root.c_str()), closedir);
     if (!dir) {
         return path_map;
     }
@@ -74,7 +88,7 @@ std::unordered_map<std::string, std::string> parseThermalPathMap(std::string_vie
             continue;
         }
 
-        std::string path = ::android::base::StringPrintf("%s/%s/%s", kThermalSensorsRoot.data(),
+        std::string path = ::android::base::StringPrintf("%s/%s/%s", thermal_sensors_root.c_str(),
                                                          dp->d_name, kThermalNameFile.data());
         std::string name;
         if (!::android::base::ReadFileToString(path, &name)) {
@@ -84,12 +98,66 @@ std::unordered_map<std::string, std::string> parseThermalPathMap(std::string_vie
 
         path_map.emplace(
                 ::android::base::Trim(name),
-                ::android::base::StringPrintf("%s/%s", kThermalSensorsRoot.data(), dp->d_name));
+                ::android::base::StringPrintf("%s/%s", thermal_sensors_root.c_str(), dp->d_name));
     }
 
     return path_map;
 }
 
+/*
+ * Load the parsed thermal config from the binary cache when it was built from the same
+ * config, otherwise parse the JSON config and refresh the cache for the next boot.
+ */
+bool loadThermalConfig(std::string_view config_path, std::string_view cache_path,
+                       ThermalConfig *thermal_config) {
+    ATRACE_CALL();
+    std::string json_doc;
+    if (!::android::base::ReadFileToString(config_path.data(), &json_doc)) {
+        LOG(ERROR) << "Failed to read JSON config from " << config_path;
+        return false;
+    }
+
+    const uint64_t config_key = GetThermalConfigKey(json_doc);
+    if (ReadThermalConfigCache(cache_path, config_key, thermal_config)) {
+        LOG(INFO) << "Loaded thermal config from " << cache_path;
+        return true;
+    }
+
+    bool ret = true;
+    Json::Value config;
+    if (!ParseThermalConfig(json_doc, &config)) {
+        LOG(ERROR) << "Failed to read JSON config";
+        ret = false;
+    }
+
+    if (!ParseCoolingDevice(config, &thermal_config->cooling_device_info_map)) {
+        LOG(ERROR) << "Failed to parse cooling device info config";
+        ret = false;
+    }
+
+    if (!ParseSensorInfo(config, &thermal_config->sensor_info_map)) {
+        LOG(ERROR) << "Failed to parse sensor info config";
+        ret = false;
+    }
+
+    if (!ParsePowerRailInfo(config, &thermal_config->power_rail_info_map)) {
+        LOG(ERROR) << "Failed to parse power rail info config";
+        ret = false;
+    }
+
+    if (!ParseStatsConfig(config, thermal_config->sensor_info_map,
+                          thermal_config->cooling_device_info_map,
+                          &thermal_config->stats_config)) {
+        LOG(FATAL) << "Failed to parse stats config";
+    }
+
+    // Only cache a config which parsed cleanly, so a broken one keeps reporting its errors
+    if (ret) {
+        WriteThermalConfigCache(cache_path, config_key, *thermal_config);
+    }
+    return ret;
+}
+
 }  // namespace
 
 /*
@@ -97,50 +165,43 @@ std::unordered_map<std::string, std::string> parseThermalPathMap(std::string_vie
  * reading the type file and assigning the temp file path to the map.  If we do
  * not succeed, abort.
  */
-ThermalHelper::ThermalHelper(const NotificationCallback &cb)
-    : thermal_watcher_(new ThermalWatcher(
+ThermalHelper::ThermalHelper(const NotificationCallback &cb, std::string_view root_dir)
+    : root_dir_(root_dir),
+      thermal_watcher_(new ThermalWatcher(
               std::bind(&ThermalHelper::thermalWatcherCallbackFunc, this, std::placeholders::_1))),
+      power_files_(root_dir),
       cb_(cb) {
     const std::string config_path =
-            "/vendor/etc/" +
+            root_dir_ + "/vendor/etc/" +
             ::android::base::GetProperty(kConfigProperty.data(), kConfigDefaultFileName.data());
     bool thermal_throttling_disabled =
             ::android::base::GetBoolProperty(kThermalDisabledProperty.data(), false);
     bool ret = true;
-    Json::Value config;
-    if (!ParseThermalConfig(config_path, &config)) {
-        LOG(ERROR) << "Failed to read JSON config";
+    ThermalConfig thermal_config;
+    if (!loadThermalConfig(config_path, GetThermalConfigCachePath(root_dir_), &thermal_config)) {
         ret = false;
     }
+    cooling_device_info_map_ = std::move(thermal_config.cooling_device_info_map);
+    sensor_info_map_ = std::move(thermal_config.sensor_info_map);
 
-    if (!ParseCoolingDevice(config, &cooling_device_info_map_)) {
-        LOG(ERROR) << "Failed to parse cooling device info config";
-        ret = false;
-    }
-
-    if (!ParseSensorInfo(config, &sensor_info_map_)) {
-        LOG(ERROR) << "Failed to parse sensor info config";
-        ret = false;
-    }
-
-    auto tz_map = parseThermalPathMap(kSensorPrefix.data());
+    auto tz_map = parseThermalPathMap(root_dir_, kSensorPrefix);
     if (!initializeSensorMap(tz_map)) {
         LOG(ERROR) << "Failed to initialize sensor map";
         ret = false;
     }
 
-    auto cdev_map = parseThermalPathMap(kCoolingDevicePrefix.data());
+    auto cdev_map = parseThermalPathMap(root_dir_, kCoolingDevicePrefix);
     if (!initializeCoolingDevices(cdev_map)) {
         LOG(ERROR) << "Failed to initialize cooling device map";
         ret = false;
     }
 
-    if (!power_files_.registerPowerRailsToWatch(config)) {
+    if (!power_files_.registerPowerRailsToWatch(std::move(thermal_config.power_rail_info_map))) {
         LOG(ERROR) << "Failed to register power rails";
         ret = false;
     }
 
-    if (!thermal_stats_helper_.initializeStats(config, sensor_info_map_,
+    if (!thermal_stats_helper_.initializeStats(thermal_config.stats_config, sensor_info_map_,
                                                cooling_device_info_map_)) {
         LOG(FATAL) << "Failed to initialize thermal stats";
     }
@@ -159,7 +220,7 @@ ThermalHelper::ThermalHelper(const NotificationCallback &cb)
         if (name_status_pair.second.throttling_info != nullptr) {
             if (!thermal_throttling_.registerThermalThrottling(
                         name_status_pair.first, name_status_pair.second.throttling_info,
-                        cooling_device_info_map_)) {
+                        cooling_device_info_map_, power_files_.GetPowerStatusMap())) {
                 LOG(ERROR) << name_status_pair.first << " failed to register thermal throttling";
                 ret = false;
                 break;
@@ -222,7 +283,19 @@ ThermalHelper::ThermalHelper(const NotificationCallback &cb)
         }
     }
 
-    if (!connectToPowerHal()) {
+    if (ret) {
+        if (buildSensorEvalGraph()) {
+            publishSensorStatusSnapshot();
+        } else {
+            LOG(ERROR) << "Failed to build sensor dependency graph";
+            ret = false;
+        }
+    }
+
+    // A replayed tree must not send power hints to the device's power HAL
+    if (!root_dir_.empty()) {
+        LOG(INFO) << "Skip connecting to Power Hal for " << root_dir_;
+    } else if (!connectToPowerHal()) {
         LOG(ERROR) << "Fail to connect to Power Hal";
     } else {
         updateSupportedPowerHints();
@@ -234,6 +307,8 @@ ThermalHelper::ThermalHelper(const NotificationCallback &cb)
             is_initialized_ = ret;
             return;
         } else {
+            sensor_eval_nodes_.clear();
+            sensor_eval_index_map_.clear();
             sensor_info_map_.clear();
             cooling_device_info_map_.clear();
             return;
@@ -248,6 +323,12 @@ ThermalHelper::ThermalHelper(const NotificationCallback &cb)
 
     std::set<std::string> monitored_sensors;
     initializeTrip(tz_map, &monitored_sensors, thermal_genl_enabled);
+    initializeSensorSchedule();
+
+    // The replay harness calls thermalWatcherCallbackFunc() itself, once per trace tick
+    if (!root_dir_.empty()) {
+        return;
+    }
 
     if (thermal_genl_enabled) {
         thermal_watcher_->registerFilesToWatchNl(monitored_sensors);
@@ -285,6 +366,13 @@ bool getThermalZoneTypeById(int tz_id, std::string *type) {
     return true;
 }
 
+void ThermalHelper::addEmulPendingSensor(std::string_view target_sensor) {
+    const auto node_itr = sensor_eval_index_map_.find(target_sensor.data());
+    if (node_itr != sensor_eval_index_map_.end()) {
+        emul_pending_nodes_.push_back(node_itr->second);
+    }
+}
+
 bool ThermalHelper::emulTemp(std::string_view target_sensor, const float value) {
     LOG(INFO) << "Set " << target_sensor.data() << " emul_temp "
               << "to " << value;
@@ -298,6 +386,7 @@ bool ThermalHelper::emulTemp(std::string_view target_sensor, const float value)
 
     sensor_status_map_.at(target_sensor.data())
             .emul_setting.reset(new EmulSetting{value, -1, true});
+    addEmulPendingSensor(target_sensor);
 
     thermal_watcher_->wake();
     return true;
@@ -321,6 +410,7 @@ bool ThermalHelper::emulSeverity(std::string_view target_sensor, const int sever
 
     sensor_status_map_.at(target_sensor.data())
             .emul_setting.reset(new EmulSetting{NAN, severity, true});
+    addEmulPendingSensor(target_sensor);
 
     thermal_watcher_->wake();
     return true;
@@ -334,16 +424,20 @@ bool ThermalHelper::emulClear(std::string_view target_sensor) {
         for (auto &sensor_status : sensor_status_map_) {
             if (sensor_status.second.emul_setting != nullptr) {
                 sensor_status.second.emul_setting.reset(new EmulSetting{NAN, -1, true});
+                addEmulPendingSensor(sensor_status.first);
             }
         }
     } else if (sensor_status_map_.count(target_sensor.data()) &&
                sensor_status_map_.at(target_sensor.data()).emul_setting != nullptr) {
         sensor_status_map_.at(target_sensor.data())
                 .emul_setting.reset(new EmulSetting{NAN, -1, true});
+        addEmulPendingSensor(target_sensor);
     } else {
         LOG(ERROR) << "Cannot find target emul sensor: " << target_sensor.data();
         return false;
     }
+
+    thermal_watcher_->wake();
     return true;
 }
 
@@ -373,13 +467,58 @@ bool ThermalHelper::readTemperature(
     // Return fail if the thermal sensor cannot be read.
     float temp;
     std::map<std::string, float> sensor_log_map;
-    auto &sensor_status = sensor_status_map_.at(sensor_name.data());
+    const auto snapshot = GetSensorStatusSnapshot();
+    const auto node_itr = sensor_eval_index_map_.find(sensor_name.data());
 
-    if (!readThermalSensor(sensor_name, &temp, force_no_cache, &sensor_log_map)) {
+    if (snapshot == nullptr || node_itr == sensor_eval_index_map_.end()) {
         LOG(ERROR) << "readTemperature: failed to read sensor: " << sensor_name;
         return false;
     }
+    const size_t node_index = node_itr->second;
+    const SensorStatusView &sensor_status = snapshot->sensors[node_index];
+
+    if (force_no_cache || refresh_requested_ == nullptr) {
+        // A fresh reading, judged against the severities and emulation setting of the last tick.
+        // Without throttling no watcher keeps the snapshot readings up to date.
+        if (!readThermalSensor(node_index, &temp, force_no_cache, &sensor_log_map)) {
+            LOG(ERROR) << "readTemperature: failed to read sensor: " << sensor_name;
+            return false;
+        }
+    } else if (sensor_status.is_emulated && !std::isnan(sensor_status.emul_temp)) {
+        temp = sensor_status.emul_temp;
+    } else {
+        const ThermalSample &thermal_cached = sensor_status.thermal_cached;
+        const auto &node = sensor_eval_nodes_[node_index];
+
+        if (!node.info->is_watch &&
+            (thermal_cached.timestamp == boot_clock::time_point::min() ||
+             boot_clock::now() - thermal_cached.timestamp >= node.info->time_resolution)) {
+            requestSensorRefresh(node_index);
+        }
+        if (thermal_cached.timestamp == boot_clock::time_point::min() ||
+            std::isnan(thermal_cached.temp)) {
+            LOG(ERROR) << "readTemperature: no reading of sensor yet: " << sensor_name;
+            return false;
+        }
+        temp = thermal_cached.temp;
+        sensor_log_map[sensor_name.data()] = temp;
+    }
+
+    fillTemperature(sensor_name, temp, sensor_status, sensor_log_map, out, throttling_status);
+    return true;
+}
 
+void ThermalHelper::requestSensorRefresh(size_t node_index) {
+    // Only the first reader of a stale sensor wakes the watcher
+    if (!refresh_requested_[node_index].exchange(true, std::memory_order_relaxed)) {
+        thermal_watcher_->wake();
+    }
+}
+
+void ThermalHelper::fillTemperature(
+        std::string_view sensor_name, float temp, const SensorStatusView &sensor_status,
+        const std::map<std::string, float> &sensor_log_map, Temperature *out,
+        std::pair<ThrottlingSeverity, ThrottlingSeverity> *throttling_status) {
     const auto &sensor_info = sensor_info_map_.at(sensor_name.data());
     out->type = sensor_info.type;
     out->name = sensor_name.data();
@@ -389,26 +528,18 @@ bool ThermalHelper::readTemperature(
             std::make_pair(ThrottlingSeverity::NONE, ThrottlingSeverity::NONE);
     // Only update status if the thermal sensor is being monitored
     if (sensor_info.is_watch) {
-        ThrottlingSeverity prev_hot_severity, prev_cold_severity;
-        {
-            // reader lock, readTemperature will be called in Binder call and the watcher thread.
-            std::shared_lock<std::shared_mutex> _lock(sensor_status_map_mutex_);
-            prev_hot_severity = sensor_status.prev_hot_severity;
-            prev_cold_severity = sensor_status.prev_cold_severity;
-        }
         status = getSeverityFromThresholds(sensor_info.hot_thresholds, sensor_info.cold_thresholds,
                                            sensor_info.hot_hysteresis, sensor_info.cold_hysteresis,
-                                           prev_hot_severity, prev_cold_severity, out->value);
+                                           sensor_status.prev_hot_severity,
+                                           sensor_status.prev_cold_severity, out->value);
     }
 
     if (throttling_status) {
         *throttling_status = status;
     }
 
-    if (sensor_status.emul_setting != nullptr && sensor_status.emul_setting->emul_severity >= 0) {
-        std::shared_lock<std::shared_mutex> _lock(sensor_status_map_mutex_);
-        out->throttlingStatus =
-                static_cast<ThrottlingSeverity>(sensor_status.emul_setting->emul_severity);
+    if (sensor_status.is_emulated && sensor_status.emul_severity >= 0) {
+        out->throttlingStatus = static_cast<ThrottlingSeverity>(sensor_status.emul_severity);
     } else {
         out->throttlingStatus =
                 static_cast<size_t>(status.first) > static_cast<size_t>(status.second)
@@ -424,8 +555,6 @@ bool ThermalHelper::readTemperature(
         thermal_stats_helper_.updateSensorTempStatsBySeverity(sensor_name, out->throttlingStatus);
         LOG(INFO) << sensor_name.data() << ":" << out->value << " raw data: " << sensor_log.str();
     }
-
-    return true;
 }
 
 bool ThermalHelper::readTemperatureThreshold(std::string_view sensor_name,
@@ -575,13 +704,18 @@ bool ThermalHelper::initializeSensorMap(
             path = ::android::base::StringPrintf("%s/%s", path_map.at(sensor_name.data()).c_str(),
                                                  kSensorTempSuffix.data());
         } else {
-            path = sensor_info_pair.second.temp_path;
+            path = root_dir_ + sensor_info_pair.second.temp_path;
         }
 
         if (!thermal_sensors_.addThermalFile(sensor_name, path)) {
             LOG(ERROR) << "Could not add " << sensor_name << "to sensors map";
             return false;
         }
+
+        // Keep the temp node open, it will be read on every sample
+        if (!thermal_sensors_.openThermalFile(sensor_name)) {
+            LOG(WARNING) << sensor_name << " will be read without a cached fd";
+        }
     }
     return true;
 }
@@ -598,7 +732,7 @@ bool ThermalHelper::initializeCoolingDevices(
         std::string_view path = path_map.at(cooling_device_name);
         std::string read_path;
         if (!cooling_device_info_pair.second.read_path.empty()) {
-            read_path = cooling_device_info_pair.second.read_path.data();
+            read_path = root_dir_ + cooling_device_info_pair.second.read_path;
         } else {
             read_path = ::android::base::StringPrintf("%s/%s", path.data(),
                                                       kCoolingDeviceCurStateSuffix.data());
@@ -659,7 +793,7 @@ bool ThermalHelper::initializeCoolingDevices(
                 ::android::base::StringPrintf("%s_%s", cooling_device_name.c_str(), "w");
         std::string write_path;
         if (!cooling_device_info_pair.second.write_path.empty()) {
-            write_path = cooling_device_info_pair.second.write_path.data();
+            write_path = root_dir_ + cooling_device_info_pair.second.write_path;
         } else {
             write_path = ::android::base::StringPrintf("%s/%s", path.data(),
                                                        kCoolingDeviceCurStateSuffix.data());
@@ -822,281 +956,560 @@ bool ThermalHelper::fillCurrentCoolingDevices(bool filterType, CoolingType type,
     return ret.size() > 0;
 }
 
-bool ThermalHelper::readDataByType(std::string_view sensor_data, float *reading_value,
-                                   const SensorFusionType type, const bool force_no_cache,
-                                   std::map<std::string, float> *sensor_log_map) {
-    switch (type) {
-        case SensorFusionType::SENSOR:
-            if (!readThermalSensor(sensor_data.data(), reading_value, force_no_cache,
-                                   sensor_log_map)) {
-                LOG(ERROR) << "Failed to get " << sensor_data.data() << " data";
-                return false;
+bool ThermalHelper::buildSensorEvalGraph() {
+    // 0: not visited, 1: visiting, 2: sorted
+    std::unordered_map<std::string, int> visit_state;
+    std::function<bool(const std::string &)> visit = [&](const std::string &sensor_name) {
+        auto &state = visit_state[sensor_name];
+        if (state == 2) {
+            return true;
+        }
+        if (state == 1) {
+            LOG(ERROR) << "Sensor " << sensor_name << " has a circular dependency";
+            return false;
+        }
+        state = 1;
+
+        const auto sensor_info_itr = sensor_info_map_.find(sensor_name);
+        const auto &sensor_info = sensor_info_itr->second;
+        if (sensor_info.virtual_sensor_info != nullptr) {
+            for (size_t i = 0; i < sensor_info.virtual_sensor_info->linked_sensors.size(); i++) {
+                if (sensor_info.virtual_sensor_info->linked_sensors_type[i] !=
+                    SensorFusionType::SENSOR) {
+                    continue;
+                }
+                const auto &linked_sensor = sensor_info.virtual_sensor_info->linked_sensors[i];
+                if (!sensor_info_map_.count(linked_sensor)) {
+                    LOG(ERROR) << sensor_name << "'s link sensor " << linked_sensor
+                               << " is invalid";
+                    return false;
+                }
+                if (!visit(linked_sensor)) {
+                    return false;
+                }
             }
-            break;
-        case SensorFusionType::ODPM:
-            *reading_value = GetPowerStatusMap().at(sensor_data.data()).last_updated_avg_power;
-            if (std::isnan(*reading_value)) {
-                LOG(INFO) << "Power data " << sensor_data.data() << " is under collecting";
-                return false;
+        }
+
+        state = 2;
+        sensor_eval_index_map_[sensor_name] = sensor_eval_nodes_.size();
+        sensor_eval_nodes_.push_back({
+                .name = &sensor_info_itr->first,
+                .info = &sensor_info,
+                .status = &sensor_status_map_.at(sensor_name),
+                .linked_nodes = {},
+                .trigger_nodes = {},
+                .triggered_nodes = {},
+                .throttling_index = thermal_throttling_.getThrottlingIndex(sensor_name),
+        });
+        return true;
+    };
+
+    sensor_eval_nodes_.clear();
+    sensor_eval_index_map_.clear();
+    for (const auto &name_info_pair : sensor_info_map_) {
+        if (!visit(name_info_pair.first)) {
+            return false;
+        }
+    }
+
+    for (auto &node : sensor_eval_nodes_) {
+        if (node.info->virtual_sensor_info == nullptr) {
+            continue;
+        }
+        const auto &virtual_sensor_info = *node.info->virtual_sensor_info;
+        for (size_t i = 0; i < virtual_sensor_info.linked_sensors.size(); i++) {
+            node.linked_nodes.push_back(
+                    virtual_sensor_info.linked_sensors_type[i] == SensorFusionType::SENSOR
+                            ? sensor_eval_index_map_.at(virtual_sensor_info.linked_sensors[i])
+                            : kSensorEvalNoNode);
+        }
+        for (const auto &trigger_sensor : virtual_sensor_info.trigger_sensors) {
+            const auto trigger_itr = sensor_eval_index_map_.find(trigger_sensor);
+            if (trigger_itr != sensor_eval_index_map_.end()) {
+                node.trigger_nodes.push_back(trigger_itr->second);
             }
-            (*sensor_log_map)[sensor_data.data()] = *reading_value;
-            break;
-        default:
-            break;
+        }
     }
+    watcher_eval_state_.values.reserve(sensor_eval_nodes_.size());
+    watcher_eval_state_.flags.reserve(sensor_eval_nodes_.size());
     return true;
 }
 
-bool ThermalHelper::readThermalSensor(std::string_view sensor_name, float *temp,
-                                      const bool force_no_cache,
-                                      std::map<std::string, float> *sensor_log_map) {
-    float temp_val = 0.0;
-    std::string file_reading;
+void ThermalHelper::evaluateSensorGraph(const std::vector<std::pair<size_t, bool>> &roots,
+                                        SensorEvalState *state) {
+    const size_t num_nodes = sensor_eval_nodes_.size();
     boot_clock::time_point now = boot_clock::now();
 
-    ATRACE_NAME(StringPrintf("ThermalHelper::readThermalSensor - %s", sensor_name.data()).c_str());
-    if (!(sensor_info_map_.count(sensor_name.data()) &&
-          sensor_status_map_.count(sensor_name.data()))) {
-        return false;
-    }
+    ATRACE_CALL();
+    state->values.assign(num_nodes, NAN);
+    state->flags.assign(num_nodes, 0);
+    state->read_names.clear();
+    state->read_nodes.clear();
 
-    const auto &sensor_info = sensor_info_map_.at(sensor_name.data());
-    auto &sensor_status = sensor_status_map_.at(sensor_name.data());
+    for (const auto &[node_index, force_no_cache] : roots) {
+        state->flags[node_index] |= kSensorEvalNeeded | (force_no_cache ? kSensorEvalNoCache : 0);
+    }
+    // Linked sensors are sorted before their parents, walk backwards to mark them needed
+    for (size_t i = num_nodes; i-- > 0;) {
+        if (!(state->flags[i] & kSensorEvalNeeded)) {
+            continue;
+        }
+        for (const auto linked_node : sensor_eval_nodes_[i].linked_nodes) {
+            if (linked_node != kSensorEvalNoNode) {
+                state->flags[linked_node] |=
+                        kSensorEvalNeeded | (state->flags[i] & kSensorEvalNoCache);
+            }
+        }
+    }
 
+    // Resolve emulated and cached sensors, and collect the physical sensors to read
     {
         std::shared_lock<std::shared_mutex> _lock(sensor_status_map_mutex_);
-        if (sensor_status.emul_setting != nullptr &&
-            !isnan(sensor_status.emul_setting->emul_temp)) {
-            *temp = sensor_status.emul_setting->emul_temp;
-            return true;
+        for (size_t i = 0; i < num_nodes; ++i) {
+            auto &flags = state->flags[i];
+            if (!(flags & kSensorEvalNeeded)) {
+                continue;
+            }
+            const auto &node = sensor_eval_nodes_[i];
+            float emul_temp = NAN;
+            if (node.status->emul_setting != nullptr) {
+                emul_temp = node.status->emul_setting->emul_temp;
+            }
+            const ThermalSample &thermal_cached = node.status->thermal_cached;
+
+            if (!isnan(emul_temp)) {
+                state->values[i] = emul_temp;
+                flags |= kSensorEvalValid;
+                continue;
+            }
+
+            // Check if thermal data need to be read from cache
+            if (!(flags & kSensorEvalNoCache) &&
+                (thermal_cached.timestamp != boot_clock::time_point::min()) &&
+                (std::chrono::duration_cast<std::chrono::milliseconds>(
+                         now - thermal_cached.timestamp) < node.info->time_resolution) &&
+                !isnan(thermal_cached.temp)) {
+                state->values[i] = thermal_cached.temp;
+                flags |= kSensorEvalValid | kSensorEvalLogged;
+                ATRACE_INT((*node.name + "-cached").c_str(), static_cast<int>(state->values[i]));
+                continue;
+            }
+
+            flags |= kSensorEvalUpdate;
+            if (node.info->virtual_sensor_info == nullptr) {
+                state->read_names.emplace_back(*node.name);
+                state->read_nodes.push_back(i);
+            }
         }
     }
 
-    // Check if thermal data need to be read from cache
-    if (!force_no_cache &&
-        (sensor_status.thermal_cached.timestamp != boot_clock::time_point::min()) &&
-        (std::chrono::duration_cast<std::chrono::milliseconds>(
-                 now - sensor_status.thermal_cached.timestamp) < sensor_info.time_resolution) &&
-        !isnan(sensor_status.thermal_cached.temp)) {
-        *temp = sensor_status.thermal_cached.temp;
-        (*sensor_log_map)[sensor_name.data()] = *temp;
-        ATRACE_INT((sensor_name.data() + std::string("-cached")).c_str(), static_cast<int>(*temp));
-        return true;
+    thermal_sensors_.readThermalFileValues(state->read_names, &state->read_values);
+    for (size_t j = 0; j < state->read_nodes.size(); ++j) {
+        const size_t i = state->read_nodes[j];
+        if (std::isnan(state->read_values[j])) {
+            LOG(ERROR) << "failed to read sensor: " << *sensor_eval_nodes_[i].name;
+            state->flags[i] &= ~kSensorEvalUpdate;
+            continue;
+        }
+        state->values[i] = state->read_values[j];
     }
 
-    // Reading thermal sensor according to it's composition
-    if (sensor_info.virtual_sensor_info == nullptr) {
-        if (!thermal_sensors_.readThermalFile(sensor_name.data(), &file_reading)) {
-            return false;
+    // Compute the virtual sensors bottom-up
+    for (size_t i = 0; i < num_nodes; ++i) {
+        auto &flags = state->flags[i];
+        if (!(flags & kSensorEvalUpdate)) {
+            continue;
         }
+        const auto &node = sensor_eval_nodes_[i];
+        if (node.info->virtual_sensor_info != nullptr &&
+            !computeVirtualSensor(node, *state, &state->values[i])) {
+            flags &= ~kSensorEvalUpdate;
+            continue;
+        }
+        flags |= kSensorEvalValid | kSensorEvalLogged;
+        ATRACE_INT(node.name->c_str(), static_cast<int>(state->values[i]));
+    }
 
-        if (file_reading.empty()) {
-            LOG(ERROR) << "failed to read sensor: " << sensor_name;
-            return false;
+    {
+        std::unique_lock<std::shared_mutex> _lock(sensor_status_map_mutex_);
+        for (size_t i = 0; i < num_nodes; ++i) {
+            if (state->flags[i] & kSensorEvalUpdate) {
+                sensor_eval_nodes_[i].status->thermal_cached.temp = state->values[i];
+                sensor_eval_nodes_[i].status->thermal_cached.timestamp = now;
+            }
         }
-        *temp = std::stof(::android::base::Trim(file_reading));
-    } else {
-        for (size_t i = 0; i < sensor_info.virtual_sensor_info->linked_sensors.size(); i++) {
-            float sensor_reading = 0.0;
-            // Get the sensor reading data
-            if (!readDataByType(sensor_info.virtual_sensor_info->linked_sensors[i], &sensor_reading,
-                                sensor_info.virtual_sensor_info->linked_sensors_type[i],
-                                force_no_cache, sensor_log_map)) {
-                LOG(ERROR) << "Failed to read " << sensor_name.data() << "'s linked sensor "
-                           << sensor_info.virtual_sensor_info->linked_sensors[i];
+    }
+
+    for (size_t i = 0; i < num_nodes; ++i) {
+        if (state->flags[i] & kSensorEvalUpdate) {
+            const auto &node = sensor_eval_nodes_[i];
+            thermal_stats_helper_.updateSensorTempStatsByThreshold(
+                    *node.name, state->values[i] * node.info->multiplier);
+        }
+    }
+}
+
+bool ThermalHelper::computeVirtualSensor(const SensorEvalNode &node, const SensorEvalState &state,
+                                         float *temp) const {
+    const auto &virtual_sensor_info = *node.info->virtual_sensor_info;
+    float temp_val = 0.0;
+
+    for (size_t i = 0; i < virtual_sensor_info.linked_sensors.size(); i++) {
+        float sensor_reading = 0.0;
+        const size_t linked_node = node.linked_nodes[i];
+        // Get the sensor reading data
+        if (linked_node != kSensorEvalNoNode) {
+            if (state.flags[linked_node] & kSensorEvalValid) {
+                sensor_reading = state.values[linked_node];
+            } else {
+                LOG(ERROR) << "Failed to read " << *node.name << "'s linked sensor "
+                           << virtual_sensor_info.linked_sensors[i];
             }
-            if (std::isnan(sensor_info.virtual_sensor_info->coefficients[i])) {
-                return false;
+        } else if (virtual_sensor_info.linked_sensors_type[i] == SensorFusionType::ODPM) {
+            sensor_reading = GetPowerStatusMap()
+                                     .at(virtual_sensor_info.linked_sensors[i])
+                                     .last_updated_avg_power;
+            if (std::isnan(sensor_reading)) {
+                LOG(INFO) << "Power data " << virtual_sensor_info.linked_sensors[i]
+                          << " is under collecting";
+                LOG(ERROR) << "Failed to read " << *node.name << "'s linked sensor "
+                           << virtual_sensor_info.linked_sensors[i];
             }
-            float coefficient = sensor_info.virtual_sensor_info->coefficients[i];
-            switch (sensor_info.virtual_sensor_info->formula) {
-                case FormulaOption::COUNT_THRESHOLD:
-                    if ((coefficient < 0 && sensor_reading < -coefficient) ||
-                        (coefficient >= 0 && sensor_reading >= coefficient))
-                        temp_val += 1;
-                    break;
-                case FormulaOption::WEIGHTED_AVG:
-                    temp_val += sensor_reading * coefficient;
-                    break;
-                case FormulaOption::MAXIMUM:
-                    if (i == 0)
-                        temp_val = std::numeric_limits<float>::lowest();
-                    if (sensor_reading * coefficient > temp_val)
-                        temp_val = sensor_reading * coefficient;
-                    break;
-                case FormulaOption::MINIMUM:
-                    if (i == 0)
-                        temp_val = std::numeric_limits<float>::max();
-                    if (sensor_reading * coefficient < temp_val)
-                        temp_val = sensor_reading * coefficient;
-                    break;
-                default:
-                    break;
+        }
+        if (std::isnan(virtual_sensor_info.coefficients[i])) {
+            return false;
+        }
+        float coefficient = virtual_sensor_info.coefficients[i];
+        switch (virtual_sensor_info.formula) {
+            case FormulaOption::COUNT_THRESHOLD:
+                if ((coefficient < 0 && sensor_reading < -coefficient) ||
+                    (coefficient >= 0 && sensor_reading >= coefficient))
+                    temp_val += 1;
+                break;
+            case FormulaOption::WEIGHTED_AVG:
+                temp_val += sensor_reading * coefficient;
+                break;
+            case FormulaOption::MAXIMUM:
+                if (i == 0)
+                    temp_val = std::numeric_limits<float>::lowest();
+                if (sensor_reading * coefficient > temp_val)
+                    temp_val = sensor_reading * coefficient;
+                break;
+            case FormulaOption::MINIMUM:
+                if (i == 0)
+                    temp_val = std::numeric_limits<float>::max();
+                if (sensor_reading * coefficient < temp_val)
+                    temp_val = sensor_reading * coefficient;
+                break;
+            default:
+                break;
+        }
+    }
+    *temp = (temp_val + virtual_sensor_info.offset);
+    return true;
+}
+
+void ThermalHelper::getSensorLogMap(size_t node_index, const SensorEvalState &state,
+                                    std::map<std::string, float> *sensor_log_map) const {
+    const auto &node = sensor_eval_nodes_[node_index];
+    if (state.flags[node_index] & kSensorEvalLogged) {
+        (*sensor_log_map)[*node.name] = state.values[node_index];
+    }
+    // Only a virtual sensor computed in this pass has used its linked sensors
+    if (node.info->virtual_sensor_info == nullptr ||
+        !(state.flags[node_index] & kSensorEvalUpdate)) {
+        return;
+    }
+    const auto &virtual_sensor_info = *node.info->virtual_sensor_info;
+    for (size_t i = 0; i < node.linked_nodes.size(); i++) {
+        if (node.linked_nodes[i] != kSensorEvalNoNode) {
+            getSensorLogMap(node.linked_nodes[i], state, sensor_log_map);
+        } else if (virtual_sensor_info.linked_sensors_type[i] == SensorFusionType::ODPM) {
+            const float power = GetPowerStatusMap()
+                                        .at(virtual_sensor_info.linked_sensors[i])
+                                        .last_updated_avg_power;
+            if (!std::isnan(power)) {
+                (*sensor_log_map)[virtual_sensor_info.linked_sensors[i]] = power;
             }
         }
-        *temp = (temp_val + sensor_info.virtual_sensor_info->offset);
     }
-    (*sensor_log_map)[sensor_name.data()] = *temp;
-    ATRACE_INT(sensor_name.data(), static_cast<int>(*temp));
+}
 
+SensorStatusView ThermalHelper::getSensorStatusView(const SensorEvalNode &node) const {
+    SensorStatusView view = {
+            .name = node.name,
+            .severity = node.status->severity,
+            .prev_hot_severity = node.status->prev_hot_severity,
+            .prev_cold_severity = node.status->prev_cold_severity,
+            .thermal_cached = node.status->thermal_cached,
+            .is_emulated = false,
+            .emul_temp = NAN,
+            .emul_severity = -1,
+    };
+
+    if (node.status->emul_setting != nullptr) {
+        view.is_emulated = true;
+        view.emul_temp = node.status->emul_setting->emul_temp;
+        view.emul_severity = node.status->emul_setting->emul_severity;
+    }
+    return view;
+}
+
+void ThermalHelper::publishSensorStatusSnapshot() {
+    // Always a new snapshot, a published one is never written again
+    auto snapshot = std::make_shared<SensorStatusSnapshot>();
+
+    ATRACE_CALL();
+    snapshot->version = sensor_status_snapshot_version_++;
+    snapshot->sensors.reserve(sensor_eval_nodes_.size());
     {
-        std::unique_lock<std::shared_mutex> _lock(sensor_status_map_mutex_);
-        sensor_status.thermal_cached.temp = *temp;
-        sensor_status.thermal_cached.timestamp = now;
+        std::shared_lock<std::shared_mutex> _lock(sensor_status_map_mutex_);
+        for (const auto &node : sensor_eval_nodes_) {
+            snapshot->sensors.push_back(getSensorStatusView(node));
+        }
     }
-    auto real_temp = (*temp) * sensor_info.multiplier;
-    thermal_stats_helper_.updateSensorTempStatsByThreshold(sensor_name, real_temp);
+
+    std::atomic_store(&sensor_status_snapshot_,
+                      std::shared_ptr<const SensorStatusSnapshot>(std::move(snapshot)));
+}
+
+bool ThermalHelper::readThermalSensor(size_t node_index, float *temp, const bool force_no_cache,
+                                      std::map<std::string, float> *sensor_log_map) {
+    // Scratch space of the Binder thread, its vectors keep their capacity between calls
+    static thread_local SensorEvalState state;
+    static thread_local std::vector<std::pair<size_t, bool>> roots;
+
+    ATRACE_NAME(StringPrintf("ThermalHelper::readThermalSensor - %s",
+                             sensor_eval_nodes_[node_index].name->c_str())
+                        .c_str());
+    roots.assign(1, {node_index, force_no_cache});
+    evaluateSensorGraph(roots, &state);
+    getSensorLogMap(node_index, state, sensor_log_map);
+    if (!(state.flags[node_index] & kSensorEvalValid)) {
+        return false;
+    }
+    *temp = state.values[node_index];
     return true;
 }
 
+void ThermalHelper::initializeSensorSchedule() {
+    sensor_deadlines_.assign(sensor_eval_nodes_.size(), boot_clock::time_point::max());
+    watcher_due_flags_.assign(sensor_eval_nodes_.size(), 0);
+    refresh_requested_.reset(new std::atomic<bool>[sensor_eval_nodes_.size()]);
+    for (size_t node_index = 0; node_index < sensor_eval_nodes_.size(); ++node_index) {
+        auto &node = sensor_eval_nodes_[node_index];
+        // The first tick reads every sensor, so that Binder reads have a snapshot reading
+        refresh_requested_[node_index].store(!node.info->is_watch, std::memory_order_relaxed);
+        if (!node.info->is_watch) {
+            continue;
+        }
+        for (const auto trigger_node : node.trigger_nodes) {
+            sensor_eval_nodes_[trigger_node].triggered_nodes.push_back(node_index);
+        }
+        scheduleSensor(node_index, boot_clock::time_point::min());
+    }
+}
+
+std::chrono::milliseconds ThermalHelper::getSensorSleepMs(const SensorEvalNode &node) const {
+    if (node.status->severity != ThrottlingSeverity::NONE) {
+        return node.info->passive_delay;
+    }
+    for (const auto trigger_node : node.trigger_nodes) {
+        if (sensor_eval_nodes_[trigger_node].status->severity != ThrottlingSeverity::NONE) {
+            return node.info->passive_delay;
+        }
+    }
+    return node.info->polling_delay;
+}
+
+void ThermalHelper::scheduleSensor(size_t node_index, boot_clock::time_point deadline) {
+    sensor_deadlines_[node_index] = deadline;
+    sensor_deadline_queue_.emplace(deadline, node_index);
+}
+
 // This is called in the different thread context and will update sensor_status
 // uevent_sensors is the set of sensors which trigger uevent from thermal core driver.
 std::chrono::milliseconds ThermalHelper::thermalWatcherCallbackFunc(
         const std::set<std::string> &uevent_sensors) {
+    constexpr uint8_t kSensorDue = 1 << 0;
+    constexpr uint8_t kSensorDueNoCache = 1 << 1;
     std::vector<Temperature> temps;
     std::vector<std::string> cooling_devices_to_update;
+    std::vector<size_t> sensors_to_update;
+    std::vector<std::pair<size_t, bool>> eval_roots;
+    std::vector<ThrottlingStep> throttled_sensors;
+    std::deque<Temperature> throttled_temps;
     boot_clock::time_point now = boot_clock::now();
-    auto min_sleep_ms = std::chrono::milliseconds::max();
-    bool power_data_is_updated = false;
 
     ATRACE_CALL();
-    for (auto &name_status_pair : sensor_status_map_) {
-        bool force_update = false;
-        bool force_no_cache = false;
-        Temperature temp;
-        TemperatureThreshold threshold;
-        SensorStatus &sensor_status = name_status_pair.second;
-        const SensorInfo &sensor_info = sensor_info_map_.at(name_status_pair.first);
+    const auto add_due_sensor = [&](size_t node_index, bool force_no_cache) {
+        if (!watcher_due_flags_[node_index]) {
+            sensors_to_update.push_back(node_index);
+        }
+        watcher_due_flags_[node_index] |= kSensorDue | (force_no_cache ? kSensorDueNoCache : 0);
+    };
+
+    // Only touch the sensors whose polling deadline has passed
+    while (!sensor_deadline_queue_.empty() && sensor_deadline_queue_.top().first <= now) {
+        const auto [deadline, node_index] = sensor_deadline_queue_.top();
+        sensor_deadline_queue_.pop();
+        if (deadline == sensor_deadlines_[node_index]) {
+            add_due_sensor(node_index, false);
+        }
+    }
 
-        // Only handle the sensors in allow list
-        if (!sensor_info.is_watch) {
+    // And the sensors notified by the thermal core driver
+    for (const auto &uevent_sensor : uevent_sensors) {
+        const auto node_itr = sensor_eval_index_map_.find(uevent_sensor);
+        if (node_itr == sensor_eval_index_map_.end()) {
             continue;
         }
+        const auto &node = sensor_eval_nodes_[node_itr->second];
+        if (node.info->is_watch && node.info->virtual_sensor_info == nullptr) {
+            add_due_sensor(node_itr->second, true);
+        }
+        for (const auto triggered_node : node.triggered_nodes) {
+            add_due_sensor(triggered_node, false);
+        }
+    }
 
-        ATRACE_NAME(StringPrintf("ThermalHelper::thermalWatcherCallbackFunc - %s",
-                                 name_status_pair.first.data())
-                            .c_str());
+    {
+        std::lock_guard<std::shared_mutex> _lock(sensor_status_map_mutex_);
+        for (const auto node_index : emul_pending_nodes_) {
+            const auto &node = sensor_eval_nodes_[node_index];
+            if (!node.info->is_watch || node.status->emul_setting == nullptr) {
+                continue;
+            }
+            node.status->emul_setting->pending_update = false;
+            LOG(INFO) << "Update " << *node.name << " right away with emul setting";
+            add_due_sensor(node_index, false);
+        }
+        emul_pending_nodes_.clear();
+    }
 
-        std::chrono::milliseconds time_elapsed_ms = std::chrono::milliseconds::zero();
-        auto sleep_ms = (sensor_status.severity != ThrottlingSeverity::NONE)
-                                ? sensor_info.passive_delay
-                                : sensor_info.polling_delay;
-
-        if (sensor_info.virtual_sensor_info != nullptr &&
-            !sensor_info.virtual_sensor_info->trigger_sensors.empty()) {
-            for (size_t i = 0; i < sensor_info.virtual_sensor_info->trigger_sensors.size(); i++) {
-                const auto &trigger_sensor_status =
-                        sensor_status_map_.at(sensor_info.virtual_sensor_info->trigger_sensors[i]);
-                if (trigger_sensor_status.severity != ThrottlingSeverity::NONE) {
-                    sleep_ms = sensor_info.passive_delay;
-                    break;
-                }
+    for (const auto node_index : sensors_to_update) {
+        eval_roots.emplace_back(node_index, watcher_due_flags_[node_index] & kSensorDueNoCache);
+    }
+    // The unpolled sensors that Binder reads found stale ride along, within their
+    // time_resolution the cached reading is kept
+    bool refreshed = false;
+    for (size_t node_index = 0; node_index < sensor_eval_nodes_.size(); ++node_index) {
+        if (refresh_requested_[node_index].load(std::memory_order_relaxed) &&
+            refresh_requested_[node_index].exchange(false, std::memory_order_relaxed)) {
+            if (!watcher_due_flags_[node_index]) {
+                eval_roots.emplace_back(node_index, false);
             }
+            refreshed = true;
         }
-        // Check if the sensor need to be updated
-        if (sensor_status.last_update_time == boot_clock::time_point::min()) {
-            force_update = true;
-        } else {
+    }
+
+    // Read all the due sensors in one pass, so shared linked sensors are only read once
+    if (!eval_roots.empty()) {
+        power_files_.refreshPowerStatus();
+        evaluateSensorGraph(eval_roots, &watcher_eval_state_);
+    }
+
+    for (const auto node_index : sensors_to_update) {
+        const auto &node = sensor_eval_nodes_[node_index];
+        const std::string &sensor_name = *node.name;
+        SensorStatus &sensor_status = *node.status;
+        const SensorInfo &sensor_info = *node.info;
+        const auto prev_severity = sensor_status.severity;
+        std::chrono::milliseconds time_elapsed_ms = std::chrono::milliseconds::zero();
+        Temperature temp;
+        TemperatureThreshold threshold;
+
+        watcher_due_flags_[node_index] = 0;
+        if (sensor_status.last_update_time != boot_clock::time_point::min()) {
             time_elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
                     now - sensor_status.last_update_time);
-            if (uevent_sensors.size()) {
-                if (sensor_info.virtual_sensor_info != nullptr) {
-                    for (size_t i = 0; i < sensor_info.virtual_sensor_info->trigger_sensors.size();
-                         i++) {
-                        if (uevent_sensors.find(
-                                    sensor_info.virtual_sensor_info->trigger_sensors[i]) !=
-                            uevent_sensors.end()) {
-                            force_update = true;
-                            break;
-                        }
-                    }
-                } else if (uevent_sensors.find(name_status_pair.first) != uevent_sensors.end()) {
-                    force_update = true;
-                    force_no_cache = true;
-                }
-            } else if (time_elapsed_ms > sleep_ms) {
-                force_update = true;
-            }
-        }
-        {
-            std::lock_guard<std::shared_mutex> _lock(sensor_status_map_mutex_);
-            if (sensor_status.emul_setting != nullptr &&
-                sensor_status.emul_setting->pending_update) {
-                force_update = true;
-                sensor_status.emul_setting->pending_update = false;
-                LOG(INFO) << "Update " << name_status_pair.first.data()
-                          << " right away with emul setting";
-            }
         }
-        LOG(VERBOSE) << "sensor " << name_status_pair.first
-                     << ": time_elapsed=" << time_elapsed_ms.count()
-                     << ", sleep_ms=" << sleep_ms.count() << ", force_update = " << force_update
-                     << ", force_no_cache = " << force_no_cache;
 
-        if (!force_update) {
-            auto timeout_remaining = sleep_ms - time_elapsed_ms;
-            if (min_sleep_ms > timeout_remaining) {
-                min_sleep_ms = timeout_remaining;
-            }
-            LOG(VERBOSE) << "sensor " << name_status_pair.first
-                         << ": timeout_remaining=" << timeout_remaining.count();
-            continue;
-        }
+        ATRACE_NAME(StringPrintf("ThermalHelper::thermalWatcherCallbackFunc - %s",
+                                 sensor_name.c_str())
+                            .c_str());
 
         std::pair<ThrottlingSeverity, ThrottlingSeverity> throttling_status;
-        if (!readTemperature(name_status_pair.first, &temp, &throttling_status, force_no_cache)) {
-            LOG(ERROR) << __func__
-                       << ": error reading temperature for sensor: " << name_status_pair.first;
+        if (!(watcher_eval_state_.flags[node_index] & kSensorEvalValid)) {
+            LOG(ERROR) << __func__ << ": error reading temperature for sensor: " << sensor_name;
+            // Retry on the next polling interval
+            scheduleSensor(node_index, now + getSensorSleepMs(node));
             continue;
         }
-        if (!readTemperatureThreshold(name_status_pair.first, &threshold)) {
-            LOG(ERROR) << __func__ << ": error reading temperature threshold for sensor: "
-                       << name_status_pair.first;
+        std::map<std::string, float> sensor_log_map;
+        SensorStatusView sensor_status_view;
+        {
+            std::shared_lock<std::shared_mutex> _lock(sensor_status_map_mutex_);
+            sensor_status_view = getSensorStatusView(node);
+        }
+        getSensorLogMap(node_index, watcher_eval_state_, &sensor_log_map);
+        fillTemperature(sensor_name, watcher_eval_state_.values[node_index],
+                        sensor_status_view, sensor_log_map, &temp, &throttling_status);
+        if (!readTemperatureThreshold(sensor_name, &threshold)) {
+            LOG(ERROR) << __func__
+                       << ": error reading temperature threshold for sensor: " << sensor_name;
+            scheduleSensor(node_index, now + getSensorSleepMs(node));
             continue;
         }
 
-        {
-            // writer lock
-            std::unique_lock<std::shared_mutex> _lock(sensor_status_map_mutex_);
-            if (throttling_status.first != sensor_status.prev_hot_severity) {
-                sensor_status.prev_hot_severity = throttling_status.first;
-            }
-            if (throttling_status.second != sensor_status.prev_cold_severity) {
-                sensor_status.prev_cold_severity = throttling_status.second;
-            }
-            if (temp.throttlingStatus != sensor_status.severity) {
-                temps.push_back(temp);
-                sensor_status.severity = temp.throttlingStatus;
-                sleep_ms = (sensor_status.severity != ThrottlingSeverity::NONE)
-                                   ? sensor_info.passive_delay
-                                   : sensor_info.polling_delay;
-            }
+        if (throttling_status.first != sensor_status.prev_hot_severity) {
+            sensor_status.prev_hot_severity = throttling_status.first;
+        }
+        if (throttling_status.second != sensor_status.prev_cold_severity) {
+            sensor_status.prev_cold_severity = throttling_status.second;
         }
+        if (temp.throttlingStatus != sensor_status.severity) {
+            temps.push_back(temp);
+            sensor_status.severity = temp.throttlingStatus;
+        }
+
+        if (node.throttling_index != kThrottlingNoIndex) {
+            throttled_sensors.push_back({
+                    .throttling_index = node.throttling_index,
+                    .temp = &throttled_temps.emplace_back(temp),
+                    .sensor_info = &sensor_info,
+                    .severity = sensor_status.severity,
+                    .time_elapsed_ms = time_elapsed_ms,
+            });
+        }
+        const auto sleep_ms = getSensorSleepMs(node);
+        scheduleSensor(node_index, now + sleep_ms);
+        LOG(VERBOSE) << "Sensor " << sensor_name << ": sleep_ms=" << sleep_ms.count();
+        sensor_status.last_update_time = now;
 
-        if (!power_data_is_updated) {
-            power_files_.refreshPowerStatus();
-            power_data_is_updated = true;
+        // The virtual sensors triggered by this one switch between passive and polling delay
+        if (sensor_status.severity != prev_severity) {
+            for (const auto triggered_node : node.triggered_nodes) {
+                const auto &triggered_status = *sensor_eval_nodes_[triggered_node].status;
+                if (watcher_due_flags_[triggered_node] ||
+                    triggered_status.last_update_time == boot_clock::time_point::min()) {
+                    continue;
+                }
+                scheduleSensor(triggered_node,
+                               triggered_status.last_update_time +
+                                       getSensorSleepMs(sensor_eval_nodes_[triggered_node]));
+            }
         }
+    }
 
-        if (sensor_status.severity == ThrottlingSeverity::NONE) {
-            thermal_throttling_.clearThrottlingData(name_status_pair.first, sensor_info);
+    // Run the PID step of all the throttled sensors in one pass, then update their requests in
+    // order, as a sensor's power allocation depends on the cdev votes of the sensors before it
+    thermal_throttling_.updatePowerBudgets(throttled_sensors);
+    for (const auto &throttled_sensor : throttled_sensors) {
+        if (throttled_sensor.severity == ThrottlingSeverity::NONE) {
+            thermal_throttling_.clearThrottlingData(throttled_sensor.throttling_index);
         } else {
             // update thermal throttling request
-            thermal_throttling_.thermalThrottlingUpdate(
-                    temp, sensor_info, sensor_status.severity, time_elapsed_ms,
-                    power_files_.GetPowerStatusMap(), cooling_device_info_map_);
+            thermal_throttling_.thermalThrottlingUpdate(throttled_sensor);
         }
 
         thermal_throttling_.computeCoolingDevicesRequest(
-                name_status_pair.first, sensor_info, sensor_status.severity,
+                throttled_sensor.throttling_index, throttled_sensor.severity,
                 &cooling_devices_to_update, &thermal_stats_helper_);
-        if (min_sleep_ms > sleep_ms) {
-            min_sleep_ms = sleep_ms;
-        }
+    }
 
-        LOG(VERBOSE) << "Sensor " << name_status_pair.first << ": sleep_ms=" << sleep_ms.count()
-                     << ", min_sleep_ms voting result=" << min_sleep_ms.count();
-        sensor_status.last_update_time = now;
+    if (!sensors_to_update.empty() || refreshed) {
+        publishSensorStatusSnapshot();
     }
 
     if (!cooling_devices_to_update.empty()) {
@@ -1120,7 +1533,18 @@ std::chrono::milliseconds ThermalHelper::thermalWatcherCallbackFunc(
         LOG(ERROR) << "Failed to report " << count_failed_reporting << " thermal stats";
     }
 
-    return min_sleep_ms;
+    // Drop the stale deadlines and sleep until the next sensor is due
+    while (!sensor_deadline_queue_.empty() &&
+           sensor_deadline_queue_.top().first !=
+                   sensor_deadlines_[sensor_deadline_queue_.top().second]) {
+        sensor_deadline_queue_.pop();
+    }
+    if (sensor_deadline_queue_.empty()) {
+        return std::chrono::milliseconds::max();
+    }
+    return std::max(std::chrono::milliseconds::zero(),
+                    std::chrono::ceil<std::chrono::milliseconds>(
+                            sensor_deadline_queue_.top().first - boot_clock::now()));
 }
 
 bool ThermalHelper::connectToPowerHal() {
@@ -19,9 +19,14 @@
 #include <aidl/android/hardware/thermal/IThermal.h>
 
 #include <array>
+#include <atomic>
 #include <chrono>
+#include <functional>
+#include <limits>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <queue>
 #include <shared_mutex>
 #include <string>
 #include <string_view>
@@ -31,6 +36,7 @@
 
 #include "utils/power_files.h"
 #include "utils/powerhal_helper.h"
+#include "utils/thermal_config_cache.h"
 #include "utils/thermal_files.h"
 #include "utils/thermal_info.h"
 #include "utils/thermal_stats_helper.h"
@@ -47,6 +53,8 @@ using ::android::sp;
 
 using NotificationCallback = std::function<void(const Temperature &t)>;
 
+class ThermalReplay;
+
 // Get thermal_zone type
 bool getThermalZoneTypeById(int tz_id, std::string *);
 
@@ -71,9 +79,64 @@ struct SensorStatus {
     std::unique_ptr<EmulSetting> emul_setting;
 };
 
+// The status of a sensor as seen outside of the watcher thread.
+struct SensorStatusView {
+    const std::string *name;
+    ThrottlingSeverity severity;
+    ThrottlingSeverity prev_hot_severity;
+    ThrottlingSeverity prev_cold_severity;
+    ThermalSample thermal_cached;
+    bool is_emulated;
+    float emul_temp;
+    int emul_severity;
+};
+
+// An immutable snapshot of every sensor status, indexed like the sensor graph nodes. The watcher
+// thread publishes a new one once per tick, with the cached readings and emulation settings the
+// tick used, and Binder reads are answered from it alone. Readers load it with std::atomic_load,
+// which only takes a short internal lock of the standard library rather than
+// sensor_status_map_mutex_, and the snapshot stays valid for as long as they hold the pointer.
+struct SensorStatusSnapshot {
+    uint64_t version;
+    std::vector<SensorStatusView> sensors;
+};
+
+// A sensor of the virtual sensor dependency graph. The nodes are kept in topological order so
+// that every linked sensor is evaluated before the virtual sensors depending on it.
+struct SensorEvalNode {
+    const std::string *name;
+    const SensorInfo *info;
+    SensorStatus *status;
+    // Node index of each linked sensor, kSensorEvalNoNode for linked power rails
+    std::vector<size_t> linked_nodes;
+    // Node index of the trigger sensors, and of the watched virtual sensors triggered by this one
+    std::vector<size_t> trigger_nodes;
+    std::vector<size_t> triggered_nodes;
+    // Index in thermal_throttling_, kThrottlingNoIndex if the sensor has no throttling
+    size_t throttling_index;
+};
+
+// The next polling deadline of a watched sensor node
+using SensorDeadline = std::pair<boot_clock::time_point, size_t>;
+
+constexpr size_t kSensorEvalNoNode = std::numeric_limits<size_t>::max();
+
+// Scratch space of one evaluation pass over the sensor graph, indexed by node.
+struct SensorEvalState {
+    std::vector<float> values;
+    std::vector<uint8_t> flags;
+    // The physical sensors to read from sysfs in this pass
+    std::vector<std::string_view> read_names;
+    std::vector<size_t> read_nodes;
+    std::vector<float> read_values;
+};
+
 class ThermalHelper {
   public:
-    explicit ThermalHelper(const NotificationCallback &cb);
+    // root_dir prefixes every sysfs and config path. It is empty on a device; the replay
+    // harness points it at a synthesized tree, in which case the watcher thread is not started
+    // and the power HAL is not connected, and the harness drives the watcher callback itself.
+    explicit ThermalHelper(const NotificationCallback &cb, std::string_view root_dir = "");
     ~ThermalHelper() = default;
 
     bool fillCurrentTemperatures(bool filterType, bool filterCallback, TemperatureType type,
@@ -92,7 +155,8 @@ class ThermalHelper {
 
     bool isInitializedOk() const { return is_initialized_; }
 
-    // Read the temperature of a single sensor.
+    // Read the temperature of a single sensor. Unless force_sysfs is set, the temperature,
+    // severities and emulation setting all come from the last published snapshot.
     bool readTemperature(std::string_view sensor_name, Temperature *out);
     bool readTemperature(
             std::string_view sensor_name, Temperature *out,
@@ -110,14 +174,12 @@ class ThermalHelper {
     const std::unordered_map<std::string, CdevInfo> &GetCdevInfoMap() const {
         return cooling_device_info_map_;
     }
-    // Get SensorStatus Map
-    const std::unordered_map<std::string, SensorStatus> &GetSensorStatusMap() const {
-        std::shared_lock<std::shared_mutex> _lock(sensor_status_map_mutex_);
-        return sensor_status_map_;
+    // Get the latest SensorStatus snapshot published by the watcher thread
+    std::shared_ptr<const SensorStatusSnapshot> GetSensorStatusSnapshot() const {
+        return std::atomic_load(&sensor_status_snapshot_);
     }
     // Get ThermalThrottling Map
-    const std::unordered_map<std::string, ThermalThrottlingStatus> &GetThermalThrottlingStatusMap()
-            const {
+    std::unordered_map<std::string, ThermalThrottlingStatus> GetThermalThrottlingStatusMap() const {
         return thermal_throttling_.GetThermalThrottlingStatusMap();
     }
     // Get PowerRailInfo Map
@@ -146,6 +208,8 @@ class ThermalHelper {
     bool isPowerHalExtConnected() { return power_hal_service_.isPowerHalExtConnected(); }
 
   private:
+    friend class ThermalReplay;
+
     bool initializeSensorMap(const std::unordered_map<std::string, std::string> &path_map);
     bool initializeCoolingDevices(const std::unordered_map<std::string, std::string> &path_map);
     bool isSubSensorValid(std::string_view sensor_data, const SensorFusionType sensor_fusion_type);
@@ -153,6 +217,15 @@ class ThermalHelper {
     void initializeTrip(const std::unordered_map<std::string, std::string> &path_map,
                         std::set<std::string> *monitored_sensors, bool thermal_genl_enabled);
     void clearAllThrottling();
+    // Schedule every watched sensor to be polled on the first watcher callback
+    void initializeSensorSchedule();
+    // The polling interval of a sensor according to its and its trigger sensors' severity
+    std::chrono::milliseconds getSensorSleepMs(const SensorEvalNode &node) const;
+    void scheduleSensor(size_t node_index, boot_clock::time_point deadline);
+    // Have the watcher update target_sensor right away, called with sensor_status_map_mutex_ held
+    void addEmulPendingSensor(std::string_view target_sensor);
+    // Have the watcher refresh the cached reading of a sensor it does not poll on its next tick
+    void requestSensorRefresh(size_t node_index);
     // For thermal_watcher_'s polling thread, return the sleep interval
     std::chrono::milliseconds thermalWatcherCallbackFunc(
             const std::set<std::string> &uevent_sensors);
@@ -162,16 +235,36 @@ class ThermalHelper {
             const ThrottlingArray &hot_hysteresis, const ThrottlingArray &cold_hysteresis,
             ThrottlingSeverity prev_hot_severity, ThrottlingSeverity prev_cold_severity,
             float value) const;
-    // Read sensor data according to the type
-    bool readDataByType(std::string_view sensor_data, float *reading_value,
-                        const SensorFusionType type, const bool force_no_cache,
-                        std::map<std::string, float> *sensor_log_map);
+    // Sort the sensors into sensor_eval_nodes_, return false on unknown or circular links
+    bool buildSensorEvalGraph();
+    // Evaluate the (node index, force_no_cache) roots and all the sensors they link to, reading
+    // every physical sensor at most once and computing virtual sensors bottom-up. The cached
+    // readings are updated with the sensors read.
+    void evaluateSensorGraph(const std::vector<std::pair<size_t, bool>> &roots,
+                             SensorEvalState *state);
+    // Compute a virtual sensor from the already evaluated values of its linked sensors
+    bool computeVirtualSensor(const SensorEvalNode &node, const SensorEvalState &state,
+                              float *temp) const;
+    // Collect the raw data used by the last evaluation of a node for logging
+    void getSensorLogMap(size_t node_index, const SensorEvalState &state,
+                         std::map<std::string, float> *sensor_log_map) const;
     // Read temperature data according to thermal sensor's info
-    bool readThermalSensor(std::string_view sensor_name, float *temp, const bool force_sysfs,
+    bool readThermalSensor(size_t node_index, float *temp, const bool force_sysfs,
                            std::map<std::string, float> *sensor_log_map);
+    // Fill in the temperature and throttling status from an evaluated sensor reading
+    void fillTemperature(std::string_view sensor_name, float temp,
+                         const SensorStatusView &sensor_status,
+                         const std::map<std::string, float> &sensor_log_map, Temperature *out,
+                         std::pair<ThrottlingSeverity, ThrottlingSeverity> *throttling_status);
+    // Get the current status of a sensor, only called in the watcher thread with
+    // sensor_status_map_mutex_ held for the emulation settings
+    SensorStatusView getSensorStatusView(const SensorEvalNode &node) const;
+    // Publish the current sensor status to sensor_status_snapshot_
+    void publishSensorStatusSnapshot();
     bool connectToPowerHal();
     void updateSupportedPowerHints();
     void updateCoolingDevices(const std::vector<std::string> &cooling_devices_to_update);
+    const std::string root_dir_;
     sp<ThermalWatcher> thermal_watcher_;
     PowerFiles power_files_;
     ThermalFiles thermal_sensors_;
@@ -185,8 +278,31 @@ class ThermalHelper {
             supported_powerhint_map_;
     PowerHalService power_hal_service_;
     ThermalStatsHelper thermal_stats_helper_;
+    // Protects the emul_setting and thermal_cached of sensor_status_map_, which Binder reads
+    // share with the watcher thread. The rest of SensorStatus is only accessed by the watcher
+    // thread and published through sensor_status_snapshot_.
     mutable std::shared_mutex sensor_status_map_mutex_;
     std::unordered_map<std::string, SensorStatus> sensor_status_map_;
+    // Accessed with std::atomic_load/std::atomic_store only
+    std::shared_ptr<const SensorStatusSnapshot> sensor_status_snapshot_;
+    // Only used by the watcher thread
+    uint64_t sensor_status_snapshot_version_ = 0;
+    // Topologically sorted sensors and the node index of each sensor name
+    std::vector<SensorEvalNode> sensor_eval_nodes_;
+    std::unordered_map<std::string, size_t> sensor_eval_index_map_;
+    // Only used by the watcher thread
+    SensorEvalState watcher_eval_state_;
+    // Min-heap of the watched sensors' polling deadlines. An entry is stale unless it matches
+    // sensor_deadlines_ of its node, so rescheduling just pushes a new entry.
+    std::priority_queue<SensorDeadline, std::vector<SensorDeadline>, std::greater<SensorDeadline>>
+            sensor_deadline_queue_;
+    std::vector<boot_clock::time_point> sensor_deadlines_;
+    std::vector<uint8_t> watcher_due_flags_;
+    // The sensors with a new emulation setting, guarded by sensor_status_map_mutex_
+    std::vector<size_t> emul_pending_nodes_;
+    // Set by Binder reads for the sensors the watcher does not poll whose snapshot reading is
+    // older than their time_resolution, cleared by the watcher once it refreshed them
+    std::unique_ptr<std::atomic<bool>[]> refresh_requested_;
 };
 
 }  // namespace implementation
@@ -24,8 +24,13 @@
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <utils/Trace.h>
 
+#include <cerrno>
+#include <charconv>
+
 namespace aidl {
 namespace android {
 namespace hardware {
@@ -35,15 +40,53 @@ namespace implementation {
 constexpr std::string_view kDeviceType("iio:device");
 constexpr std::string_view kIioRootDir("/sys/bus/iio/devices");
 constexpr std::string_view kEnergyValueNode("energy_value");
+constexpr size_t kEnergyBufInitSize = 4096;
 
 using ::android::base::ReadFileToString;
 using ::android::base::StringPrintf;
+using ::android::base::unique_fd;
+
+namespace {
+
+uint64_t parseEnergyNumber(std::string_view str) {
+    uint64_t value = 0;
+    while (!str.empty() && (str.front() == ' ' || str.front() == '\t')) {
+        str.remove_prefix(1);
+    }
+    std::from_chars(str.data(), str.data() + str.size(), value);
+    return value;
+}
+
+// Parse one energy_value line in place.
+// Format example: CH3(T=358356)[S2M_VDD_CPUCL2], 761330
+bool parseEnergyLine(std::string_view line, std::string_view *rail_name, PowerSample *sample) {
+    auto start_pos = line.find("T=");
+    auto end_pos = line.find(')');
+    if (start_pos == std::string_view::npos) {
+        return false;
+    }
+    sample->duration = parseEnergyNumber(line.substr(start_pos + 2, end_pos - start_pos - 2));
 
-bool PowerFiles::registerPowerRailsToWatch(const Json::Value &config) {
-    if (!ParsePowerRailInfo(config, &power_rail_info_map_)) {
-        LOG(ERROR) << "Failed to parse power rail info config";
+    start_pos = line.find(")[");
+    end_pos = line.find(']');
+    if (start_pos == std::string_view::npos) {
         return false;
     }
+    *rail_name = line.substr(start_pos + 2, end_pos - start_pos - 2);
+
+    start_pos = line.find("],");
+    if (start_pos == std::string_view::npos) {
+        return false;
+    }
+    sample->energy_counter = parseEnergyNumber(line.substr(start_pos + 2));
+    return true;
+}
+
+}  // namespace
+
+bool PowerFiles::registerPowerRailsToWatch(
+        std::unordered_map<std::string, PowerRailInfo> &&power_rail_info_map) {
+    power_rail_info_map_ = std::move(power_rail_info_map);
 
     if (!power_rail_info_map_.size()) {
         LOG(INFO) << " No power rail info config found";
@@ -55,13 +98,14 @@ bool PowerFiles::registerPowerRailsToWatch(const Json::Value &config) {
         return false;
     }
 
-    if (!energy_info_map_.size() && !updateEnergyValues()) {
+    if (!energy_samples_.size() && !updateEnergyValues()) {
         LOG(ERROR) << "Faield to update energy info";
         return false;
     }
 
     for (const auto &power_rail_info_pair : power_rail_info_map_) {
         std::vector<std::queue<PowerSample>> power_history;
+        std::vector<size_t> energy_slots;
         if (!power_rail_info_pair.second.power_sample_count ||
             power_rail_info_pair.second.power_sample_delay == std::chrono::milliseconds::max()) {
             continue;
@@ -77,20 +121,25 @@ bool PowerFiles::registerPowerRailsToWatch(const Json::Value &config) {
             for (size_t i = 0;
                  i < power_rail_info_pair.second.virtual_power_rail_info->linked_power_rails.size();
                  ++i) {
-                if (!energy_info_map_.count(power_rail_info_pair.second.virtual_power_rail_info
-                                                    ->linked_power_rails[i])) {
+                const auto slot_itr = energy_rail_slot_map_.find(
+                        power_rail_info_pair.second.virtual_power_rail_info
+                                ->linked_power_rails[i]);
+                if (slot_itr == energy_rail_slot_map_.end()) {
                     LOG(ERROR) << " Could not find energy source "
                                << power_rail_info_pair.second.virtual_power_rail_info
                                           ->linked_power_rails[i];
                     return false;
                 }
+                energy_slots.push_back(slot_itr->second);
                 power_history.emplace_back(std::queue<PowerSample>());
                 for (int j = 0; j < power_rail_info_pair.second.power_sample_count; j++) {
                     power_history[i].emplace(power_sample);
                 }
             }
         } else {
-            if (energy_info_map_.count(power_rail_info_pair.first)) {
+            const auto slot_itr = energy_rail_slot_map_.find(power_rail_info_pair.first);
+            if (slot_itr != energy_rail_slot_map_.end()) {
+                energy_slots.push_back(slot_itr->second);
                 power_history.emplace_back(std::queue<PowerSample>());
                 for (int j = 0; j < power_rail_info_pair.second.power_sample_count; j++) {
                     power_history[0].emplace(power_sample);
@@ -103,9 +152,11 @@ bool PowerFiles::registerPowerRailsToWatch(const Json::Value &config) {
 
         if (power_history.size()) {
             power_status_map_[power_rail_info_pair.first] = {
-                    .power_history = power_history,
                     .last_update_time = boot_clock::time_point::min(),
+                    .power_history = power_history,
                     .last_updated_avg_power = NAN,
+                    .energy_slots = std::move(energy_slots),
+                    .rail_info = &power_rail_info_pair.second,
             };
         } else {
             LOG(ERROR) << "power history size is zero";
@@ -119,13 +170,14 @@ bool PowerFiles::registerPowerRailsToWatch(const Json::Value &config) {
 bool PowerFiles::findEnergySourceToWatch(void) {
     std::string devicePath;
 
-    if (energy_path_set_.size()) {
+    if (energy_files_.size()) {
         return true;
     }
 
-    std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(kIioRootDir.data()), closedir);
+    const std::string iio_root_dir = root_dir_ + std::string(kIioRootDir);
+    std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(iio_root_dir.c_str()), closedir);
     if (!dir) {
-        PLOG(ERROR) << "Error opening directory" << kIioRootDir;
+        PLOG(ERROR) << "Error opening directory" << iio_root_dir;
         return false;
     }
 
@@ -133,106 +185,136 @@ bool PowerFiles::findEnergySourceToWatch(void) {
     while (struct dirent *ent = readdir(dir.get())) {
         std::string devTypeDir = ent->d_name;
         if (devTypeDir.find(kDeviceType) != std::string::npos) {
-            devicePath = StringPrintf("%s/%s", kIioRootDir.data(), devTypeDir.data());
+            devicePath = StringPrintf("%s/%s", iio_root_dir.c_str(), devTypeDir.data());
             std::string deviceEnergyContent;
 
             if (!ReadFileToString(StringPrintf("%s/%s", devicePath.data(), kEnergyValueNode.data()),
                                   &deviceEnergyContent)) {
             } else if (deviceEnergyContent.size()) {
-                energy_path_set_.emplace(
-                        StringPrintf("%s/%s", devicePath.data(), kEnergyValueNode.data()));
+                std::string energy_path =
+                        StringPrintf("%s/%s", devicePath.data(), kEnergyValueNode.data());
+                unique_fd fd(TEMP_FAILURE_RETRY(open(energy_path.c_str(), O_RDONLY | O_CLOEXEC)));
+                if (fd == -1) {
+                    PLOG(ERROR) << "Failed to open " << energy_path;
+                    continue;
+                }
+                energy_files_.emplace_back(std::move(energy_path), std::move(fd));
             }
         }
     }
 
-    if (!energy_path_set_.size()) {
+    if (!energy_files_.size()) {
         return false;
     }
 
     return true;
 }
 
-bool PowerFiles::updateEnergyValues(void) {
-    std::string deviceEnergyContent;
-    std::string deviceEnergyContents;
-    std::string line;
+size_t PowerFiles::getEnergySlot(std::string_view rail_name, size_t line_index) {
+    if (line_index < energy_line_slots_.size() &&
+        energy_rail_names_[energy_line_slots_[line_index]] == rail_name) {
+        return energy_line_slots_[line_index];
+    }
 
-    ATRACE_CALL();
-    for (const auto &path : energy_path_set_) {
-        if (!::android::base::ReadFileToString(path, &deviceEnergyContent)) {
-            LOG(ERROR) << "Failed to read energy content from " << path;
-            return false;
-        } else {
-            deviceEnergyContents.append(deviceEnergyContent);
-        }
+    // The rail layout is new or has changed, fall back to the name lookup
+    std::string rail(rail_name);
+    auto slot_itr = energy_rail_slot_map_.find(rail);
+    size_t slot;
+    if (slot_itr != energy_rail_slot_map_.end()) {
+        slot = slot_itr->second;
+    } else {
+        slot = energy_samples_.size();
+        energy_samples_.push_back({});
+        energy_rail_names_.push_back(rail);
+        energy_rail_slot_map_.emplace(std::move(rail), slot);
     }
 
-    std::istringstream energyData(deviceEnergyContents);
+    if (line_index < energy_line_slots_.size()) {
+        energy_line_slots_[line_index] = slot;
+    } else {
+        energy_line_slots_.resize(line_index + 1, slot);
+    }
+    return slot;
+}
+
+void PowerFiles::parseEnergyValues(std::string_view buf, size_t *line_index) {
+    while (!buf.empty()) {
+        auto line_end = buf.find('\n');
+        std::string_view line = buf.substr(0, line_end);
+        buf.remove_prefix(line_end == std::string_view::npos ? buf.size() : line_end + 1);
 
-    while (std::getline(energyData, line)) {
         /* Read rail energy */
-        uint64_t energy_counter = 0;
-        uint64_t duration = 0;
-
-        /* Format example: CH3(T=358356)[S2M_VDD_CPUCL2], 761330 */
-        auto start_pos = line.find("T=");
-        auto end_pos = line.find(')');
-        if (start_pos != std::string::npos) {
-            duration =
-                    strtoul(line.substr(start_pos + 2, end_pos - start_pos - 2).c_str(), NULL, 10);
-        } else {
+        std::string_view rail_name;
+        PowerSample sample = {
+                .energy_counter = 0,
+                .duration = 0,
+        };
+        if (!parseEnergyLine(line, &rail_name, &sample)) {
             continue;
         }
 
-        start_pos = line.find(")[");
-        end_pos = line.find(']');
-        std::string railName;
-        if (start_pos != std::string::npos) {
-            railName = line.substr(start_pos + 2, end_pos - start_pos - 2);
-        } else {
-            continue;
-        }
+        const size_t slot = getEnergySlot(rail_name, *line_index);
+        energy_samples_[slot] = sample;
+        (*line_index)++;
+    }
+}
 
-        start_pos = line.find("],");
-        if (start_pos != std::string::npos) {
-            energy_counter = strtoul(line.substr(start_pos + 2).c_str(), NULL, 10);
-        } else {
-            continue;
+bool PowerFiles::updateEnergyValues(void) {
+    size_t line_index = 0;
+
+    ATRACE_CALL();
+    if (energy_buf_.empty()) {
+        energy_buf_.resize(kEnergyBufInitSize);
+    }
+
+    for (auto &[path, fd] : energy_files_) {
+        ssize_t len;
+        while (true) {
+            len = TEMP_FAILURE_RETRY(pread(fd.get(), energy_buf_.data(), energy_buf_.size(), 0));
+            if (len < 0 && errno == ENODEV) {
+                // The iio device was re-registered, reopen it once
+                fd.reset(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC)));
+                len = TEMP_FAILURE_RETRY(
+                        pread(fd.get(), energy_buf_.data(), energy_buf_.size(), 0));
+            }
+            if (len < 0 || static_cast<size_t>(len) < energy_buf_.size()) {
+                break;
+            }
+            // The content may be truncated, read again with a larger buffer
+            energy_buf_.resize(energy_buf_.size() * 2);
         }
 
-        energy_info_map_[railName] = {
-                .energy_counter = energy_counter,
-                .duration = duration,
-        };
+        if (len < 0) {
+            PLOG(ERROR) << "Failed to read energy content from " << path;
+            return false;
+        }
+        parseEnergyValues(std::string_view(energy_buf_.data(), len), &line_index);
     }
 
     return true;
 }
 
-float PowerFiles::updateAveragePower(std::string_view power_rail,
-                                     std::queue<PowerSample> *power_history) {
+float PowerFiles::updateAveragePower(size_t slot, std::queue<PowerSample> *power_history) {
     float avg_power = NAN;
+    // Slots are never removed, the rail name is only needed for logging
+    const std::string &power_rail = energy_rail_names_[slot];
 
-    if (!energy_info_map_.count(power_rail.data())) {
-        LOG(ERROR) << " Could not find power rail " << power_rail.data();
-        return avg_power;
-    }
     const auto last_sample = power_history->front();
-    const auto curr_sample = energy_info_map_.at(power_rail.data());
+    const auto curr_sample = energy_samples_[slot];
     const auto duration = curr_sample.duration - last_sample.duration;
     const auto deltaEnergy = curr_sample.energy_counter - last_sample.energy_counter;
 
     if (!last_sample.duration) {
-        LOG(VERBOSE) << "Power rail " << power_rail.data()
+        LOG(VERBOSE) << "Power rail " << power_rail
                      << ": all power samples have not been collected yet";
     } else if (duration <= 0 || deltaEnergy < 0) {
-        LOG(ERROR) << "Power rail " << power_rail.data() << " is invalid: duration = " << duration
+        LOG(ERROR) << "Power rail " << power_rail << " is invalid: duration = " << duration
                    << ", deltaEnergy = " << deltaEnergy;
 
         return avg_power;
     } else {
         avg_power = static_cast<float>(deltaEnergy) / static_cast<float>(duration);
-        LOG(VERBOSE) << "Power rail " << power_rail.data() << ", avg power = " << avg_power
+        LOG(VERBOSE) << "Power rail " << power_rail << ", avg power = " << avg_power
                      << ", duration = " << duration << ", deltaEnergy = " << deltaEnergy;
     }
 
@@ -242,19 +324,10 @@ float PowerFiles::updateAveragePower(std::string_view power_rail,
     return avg_power;
 }
 
-float PowerFiles::updatePowerRail(std::string_view power_rail) {
+float PowerFiles::updatePowerRail(PowerStatus *power_status_ptr) {
     float avg_power = NAN;
-
-    if (!power_rail_info_map_.count(power_rail.data())) {
-        return avg_power;
-    }
-
-    if (!power_status_map_.count(power_rail.data())) {
-        return avg_power;
-    }
-
-    const auto &power_rail_info = power_rail_info_map_.at(power_rail.data());
-    auto &power_status = power_status_map_.at(power_rail.data());
+    auto &power_status = *power_status_ptr;
+    const auto &power_rail_info = *power_status.rail_info;
 
     boot_clock::time_point now = boot_clock::now();
     auto time_elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
@@ -265,22 +338,22 @@ float PowerFiles::updatePowerRail(std::string_view power_rail) {
         return power_status.last_updated_avg_power;
     }
 
-    if (!energy_info_map_.size() && !updateEnergyValues()) {
+    if (!energy_samples_.size() && !updateEnergyValues()) {
         LOG(ERROR) << "Failed to update energy values";
         return avg_power;
     }
 
     if (power_rail_info.virtual_power_rail_info == nullptr) {
-        avg_power = updateAveragePower(power_rail, &power_status.power_history[0]);
+        avg_power = updateAveragePower(power_status.energy_slots[0],
+                                       &power_status.power_history[0]);
     } else {
         const auto offset = power_rail_info.virtual_power_rail_info->offset;
         float avg_power_val = 0.0;
         for (size_t i = 0; i < power_rail_info.virtual_power_rail_info->linked_power_rails.size();
              i++) {
             float coefficient = power_rail_info.virtual_power_rail_info->coefficients[i];
-            float avg_power_number = updateAveragePower(
-                    power_rail_info.virtual_power_rail_info->linked_power_rails[i],
-                    &power_status.power_history[i]);
+            float avg_power_number = updateAveragePower(power_status.energy_slots[i],
+                                                        &power_status.power_history[i]);
 
             switch (power_rail_info.virtual_power_rail_info->formula) {
                 case FormulaOption::COUNT_THRESHOLD:
@@ -329,8 +402,8 @@ bool PowerFiles::refreshPowerStatus(void) {
         return false;
     }
 
-    for (const auto &power_status_pair : power_status_map_) {
-        updatePowerRail(power_status_pair.first);
+    for (auto &power_status_pair : power_status_map_) {
+        updatePowerRail(&power_status_pair.second);
     }
     return true;
 }
@@ -17,13 +17,17 @@
 #pragma once
 
 #include <android-base/chrono_utils.h>
+#include <android-base/unique_fd.h>
 
 #include <chrono>
 #include <queue>
 #include <shared_mutex>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "thermal_info.h"
 
@@ -45,17 +49,23 @@ struct PowerStatus {
     // A vector to record the queues of power sample history.
     std::vector<std::queue<PowerSample>> power_history;
     float last_updated_avg_power;
+    // The energy slot of each power_history entry and the config of the rail, both resolved
+    // when the rail is registered.
+    std::vector<size_t> energy_slots;
+    const PowerRailInfo *rail_info;
 };
 
 // A helper class for monitoring power rails.
 class PowerFiles {
   public:
-    PowerFiles() = default;
+    // root_dir prefixes the IIO device root, it is only set by the replay harness.
+    explicit PowerFiles(std::string_view root_dir = "") : root_dir_(root_dir) {}
     ~PowerFiles() = default;
     // Disallow copy and assign.
     PowerFiles(const PowerFiles &) = delete;
     void operator=(const PowerFiles &) = delete;
-    bool registerPowerRailsToWatch(const Json::Value &config);
+    bool registerPowerRailsToWatch(
+            std::unordered_map<std::string, PowerRailInfo> &&power_rail_info_map);
     // Update the power data from ODPM sysfs
     bool refreshPowerStatus(void);
     // Get power status map
@@ -69,23 +79,38 @@ class PowerFiles {
     }
 
   private:
-    // Update energy value to energy_info_map_, return false if the value is failed to update.
+    friend class PowerFilesBenchmark;
+
+    // Update energy value to energy_samples_, return false if the value is failed to update.
     bool updateEnergyValues(void);
-    // Compute the average power for physical power rail.
-    float updateAveragePower(std::string_view power_rail, std::queue<PowerSample> *power_history);
+    // Parse the energy_value lines in buf into energy_samples_, line_index counts the lines
+    // parsed so far in this update.
+    void parseEnergyValues(std::string_view buf, size_t *line_index);
+    // Return the energy slot of rail_name, interning it if this is the first time it is seen.
+    size_t getEnergySlot(std::string_view rail_name, size_t line_index);
+    // Compute the average power for the physical power rail in energy slot.
+    float updateAveragePower(size_t slot, std::queue<PowerSample> *power_history);
     // Update the power data for the target power rail.
-    float updatePowerRail(std::string_view power_rail);
+    float updatePowerRail(PowerStatus *power_status);
     // Find the energy source path, return false if no energy source found.
     bool findEnergySourceToWatch(void);
-    // The map to record the energy counter for each power rail.
-    std::unordered_map<std::string, PowerSample> energy_info_map_;
+    const std::string root_dir_;
+    // The energy counter for each power rail, indexed by the slot of the rail name.
+    std::vector<PowerSample> energy_samples_;
+    std::vector<std::string> energy_rail_names_;
+    std::unordered_map<std::string, size_t> energy_rail_slot_map_;
+    // The slot of each energy_value line seen in the last update. The rail order of the
+    // energy_value nodes does not change, so this avoids looking rail names up by hash.
+    std::vector<size_t> energy_line_slots_;
+    // Read buffer for the energy_value nodes, grown on demand.
+    std::vector<char> energy_buf_;
     // The map to record the power data for each thermal sensor.
     std::unordered_map<std::string, PowerStatus> power_status_map_;
     mutable std::shared_mutex power_status_map_mutex_;
     // The map to record the power rail information from thermal config
     std::unordered_map<std::string, PowerRailInfo> power_rail_info_map_;
-    // The set to store the energy source paths
-    std::unordered_set<std::string> energy_path_set_;
+    // The energy source paths and their opened fds
+    std::vector<std::pair<std::string, ::android::base::unique_fd>> energy_files_;
 };
 
 }  // namespace implementation
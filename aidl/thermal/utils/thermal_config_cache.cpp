@@ -0,0 +1,565 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ATRACE_TAG (ATRACE_TAG_THERMAL | ATRACE_TAG_HAL)
+
+#include "thermal_config_cache.h"
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/mapped_file.h>
+#include <android-base/properties.h>
+#include <android-base/unique_fd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utils/Trace.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <unordered_set>
+#include <variant>
+#include <vector>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace implementation {
+
+constexpr std::string_view kConfigCacheDir("/data/vendor/thermal/");
+constexpr std::string_view kConfigCacheFileName("thermal_info_config.bin");
+constexpr std::string_view kBuildFingerprintProperty("ro.vendor.build.fingerprint");
+constexpr uint32_t kConfigCacheMagic = 0x434d4854;  // "THMC"
+// Bump whenever a struct in thermal_info.h or the encoding below changes.
+constexpr uint32_t kConfigCacheVersion = 1;
+constexpr uint64_t kFnvOffsetBasis = 0xcbf29ce484222325ULL;
+constexpr uint64_t kFnvPrime = 0x100000001b3ULL;
+
+namespace {
+
+struct ConfigCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint64_t payload_size;
+};
+
+uint64_t fnv1a(std::string_view data, uint64_t hash) {
+    for (const unsigned char c : data) {
+        hash ^= c;
+        hash *= kFnvPrime;
+    }
+    return hash;
+}
+
+// Append the config in the field order of thermal_info.h. Containers are written as a
+// uint32_t element count followed by the elements, optional values as a presence flag.
+class ConfigCacheWriter {
+  public:
+    explicit ConfigCacheWriter(std::string *out) : out_(out) {}
+
+    template <typename T>
+    void put(const T &value) {
+        static_assert(std::is_trivially_copyable_v<T>, "no encoding for this type");
+        out_->append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+    void put(const std::string &value) {
+        put(static_cast<uint32_t>(value.size()));
+        out_->append(value);
+    }
+    template <typename T>
+    void put(const std::vector<T> &values) {
+        put(static_cast<uint32_t>(values.size()));
+        for (const auto &value : values) {
+            put(value);
+        }
+    }
+    void put(const std::unordered_set<std::string> &values) {
+        put(static_cast<uint32_t>(values.size()));
+        for (const auto &value : values) {
+            put(value);
+        }
+    }
+    template <typename T>
+    void put(const std::unordered_map<std::string, T> &values) {
+        put(static_cast<uint32_t>(values.size()));
+        for (const auto &[name, value] : values) {
+            put(name);
+            put(value);
+        }
+    }
+    template <typename T>
+    void put(const std::optional<T> &value) {
+        put(value.has_value());
+        if (value.has_value()) {
+            put(*value);
+        }
+    }
+    template <typename T>
+    void put(const std::unique_ptr<T> &value) {
+        put(value != nullptr);
+        if (value != nullptr) {
+            put(*value);
+        }
+    }
+    template <typename T>
+    void put(const std::shared_ptr<T> &value) {
+        put(value != nullptr);
+        if (value != nullptr) {
+            put(*value);
+        }
+    }
+    template <typename T>
+    void put(const ThresholdList<T> &value) {
+        put(value.logging_name);
+        put(value.thresholds);
+    }
+    template <typename T>
+    void put(const StatsInfo<T> &value) {
+        const auto &all_or_name_set = value.record_by_default_threshold_all_or_name_set_;
+        put(static_cast<uint8_t>(all_or_name_set.index()));
+        if (std::holds_alternative<bool>(all_or_name_set)) {
+            put(std::get<bool>(all_or_name_set));
+        } else {
+            put(std::get<std::unordered_set<std::string>>(all_or_name_set));
+        }
+        put(value.record_by_threshold);
+    }
+    void put(const StatsConfig &value) {
+        put(value.sensor_stats_info);
+        put(value.cooling_device_request_info);
+    }
+    void put(const VirtualSensorInfo &value) {
+        put(value.linked_sensors);
+        put(value.linked_sensors_type);
+        put(value.coefficients);
+        put(value.offset);
+        put(value.trigger_sensors);
+        put(value.formula);
+    }
+    void put(const VirtualPowerRailInfo &value) {
+        put(value.linked_power_rails);
+        put(value.coefficients);
+        put(value.offset);
+        put(value.formula);
+    }
+    void put(const BindedCdevInfo &value) {
+        put(value.limit_info);
+        put(value.power_thresholds);
+        put(value.release_logic);
+        put(value.cdev_weight_for_pid);
+        put(value.cdev_ceiling);
+        put(value.max_release_step);
+        put(value.max_throttle_step);
+        put(value.cdev_floor_with_power_link);
+        put(value.power_rail);
+        put(value.high_power_check);
+        put(value.throttling_with_power_link);
+    }
+    void put(const ThrottlingInfo &value) {
+        put(value.k_po);
+        put(value.k_pu);
+        put(value.k_i);
+        put(value.k_d);
+        put(value.i_max);
+        put(value.max_alloc_power);
+        put(value.min_alloc_power);
+        put(value.s_power);
+        put(value.i_cutoff);
+        put(value.i_default);
+        put(value.tran_cycle);
+        put(value.excluded_power_info_map);
+        put(value.binded_cdev_info_map);
+    }
+    void put(const SensorInfo &value) {
+        put(value.type);
+        put(value.hot_thresholds);
+        put(value.cold_thresholds);
+        put(value.hot_hysteresis);
+        put(value.cold_hysteresis);
+        put(value.temp_path);
+        put(value.vr_threshold);
+        put(value.multiplier);
+        put(value.polling_delay);
+        put(value.passive_delay);
+        put(value.time_resolution);
+        put(value.send_cb);
+        put(value.send_powerhint);
+        put(value.is_watch);
+        put(value.is_hidden);
+        put(value.virtual_sensor_info);
+        put(value.throttling_info);
+    }
+    void put(const CdevInfo &value) {
+        put(value.type);
+        put(value.read_path);
+        put(value.write_path);
+        put(value.state2power);
+        put(value.max_state);
+    }
+    void put(const PowerRailInfo &value) {
+        put(value.rail);
+        put(value.power_sample_count);
+        put(value.power_sample_delay);
+        put(value.virtual_power_rail_info);
+    }
+
+  private:
+    std::string *out_;
+};
+
+// Decode what ConfigCacheWriter wrote, bounds-checking every read against the mapping.
+class ConfigCacheReader {
+  public:
+    ConfigCacheReader(const char *data, size_t size) : pos_(data), end_(data + size) {}
+
+    bool done() const { return pos_ == end_; }
+
+    template <typename T>
+    bool get(T *value) {
+        static_assert(std::is_trivially_copyable_v<T>, "no encoding for this type");
+        // Not every byte pattern is a valid bool or enum, read those through their integer
+        if constexpr (std::is_same_v<T, bool>) {
+            uint8_t raw;
+            if (!getBytes(&raw) || raw > 1) {
+                return false;
+            }
+            *value = raw != 0;
+            return true;
+        } else if constexpr (std::is_enum_v<T>) {
+            std::underlying_type_t<T> raw;
+            if (!getBytes(&raw) || !isValidEnum<T>(raw)) {
+                return false;
+            }
+            *value = static_cast<T>(raw);
+            return true;
+        } else {
+            return getBytes(value);
+        }
+    }
+    bool get(std::string *value) {
+        uint32_t size;
+        if (!get(&size) || static_cast<size_t>(end_ - pos_) < size) {
+            return false;
+        }
+        value->assign(pos_, size);
+        pos_ += size;
+        return true;
+    }
+    template <typename T>
+    bool get(std::vector<T> *values) {
+        uint32_t count;
+        if (!getCount(&count)) {
+            return false;
+        }
+        values->resize(count);
+        for (auto &value : *values) {
+            if (!get(&value)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    bool get(std::unordered_set<std::string> *values) {
+        uint32_t count;
+        if (!getCount(&count)) {
+            return false;
+        }
+        values->reserve(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            std::string value;
+            if (!get(&value)) {
+                return false;
+            }
+            values->emplace(std::move(value));
+        }
+        return true;
+    }
+    template <typename T>
+    bool get(std::unordered_map<std::string, T> *values) {
+        uint32_t count;
+        if (!getCount(&count)) {
+            return false;
+        }
+        values->reserve(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            std::string name;
+            T value{};
+            if (!get(&name) || !get(&value)) {
+                return false;
+            }
+            values->emplace(std::move(name), std::move(value));
+        }
+        return true;
+    }
+    template <typename T>
+    bool get(std::optional<T> *value) {
+        bool has_value;
+        if (!get(&has_value)) {
+            return false;
+        }
+        if (!has_value) {
+            value->reset();
+            return true;
+        }
+        return get(&value->emplace());
+    }
+    template <typename T>
+    bool get(std::unique_ptr<T> *value) {
+        bool has_value;
+        if (!get(&has_value)) {
+            return false;
+        }
+        value->reset(has_value ? new T{} : nullptr);
+        return !has_value || get(value->get());
+    }
+    template <typename T>
+    bool get(std::shared_ptr<T> *value) {
+        bool has_value;
+        if (!get(&has_value)) {
+            return false;
+        }
+        value->reset(has_value ? new T{} : nullptr);
+        return !has_value || get(value->get());
+    }
+    template <typename T>
+    bool get(ThresholdList<T> *value) {
+        return get(&value->logging_name) && get(&value->thresholds);
+    }
+    template <typename T>
+    bool get(StatsInfo<T> *value) {
+        uint8_t index;
+        if (!get(&index)) {
+            return false;
+        }
+        auto &all_or_name_set = value->record_by_default_threshold_all_or_name_set_;
+        if (index == 0) {
+            bool record_all;
+            if (!get(&record_all)) {
+                return false;
+            }
+            all_or_name_set = record_all;
+        } else {
+            std::unordered_set<std::string> name_set;
+            if (!get(&name_set)) {
+                return false;
+            }
+            all_or_name_set = std::move(name_set);
+        }
+        return get(&value->record_by_threshold);
+    }
+    bool get(StatsConfig *value) {
+        return get(&value->sensor_stats_info) && get(&value->cooling_device_request_info);
+    }
+    bool get(VirtualSensorInfo *value) {
+        return get(&value->linked_sensors) && get(&value->linked_sensors_type) &&
+               get(&value->coefficients) && get(&value->offset) &&
+               get(&value->trigger_sensors) && get(&value->formula);
+    }
+    bool get(VirtualPowerRailInfo *value) {
+        return get(&value->linked_power_rails) && get(&value->coefficients) &&
+               get(&value->offset) && get(&value->formula);
+    }
+    bool get(BindedCdevInfo *value) {
+        return get(&value->limit_info) && get(&value->power_thresholds) &&
+               get(&value->release_logic) && get(&value->cdev_weight_for_pid) &&
+               get(&value->cdev_ceiling) && get(&value->max_release_step) &&
+               get(&value->max_throttle_step) && get(&value->cdev_floor_with_power_link) &&
+               get(&value->power_rail) && get(&value->high_power_check) &&
+               get(&value->throttling_with_power_link);
+    }
+    bool get(ThrottlingInfo *value) {
+        return get(&value->k_po) && get(&value->k_pu) && get(&value->k_i) && get(&value->k_d) &&
+               get(&value->i_max) && get(&value->max_alloc_power) &&
+               get(&value->min_alloc_power) && get(&value->s_power) && get(&value->i_cutoff) &&
+               get(&value->i_default) && get(&value->tran_cycle) &&
+               get(&value->excluded_power_info_map) && get(&value->binded_cdev_info_map);
+    }
+    bool get(SensorInfo *value) {
+        return get(&value->type) && get(&value->hot_thresholds) &&
+               get(&value->cold_thresholds) && get(&value->hot_hysteresis) &&
+               get(&value->cold_hysteresis) && get(&value->temp_path) &&
+               get(&value->vr_threshold) && get(&value->multiplier) &&
+               get(&value->polling_delay) && get(&value->passive_delay) &&
+               get(&value->time_resolution) && get(&value->send_cb) &&
+               get(&value->send_powerhint) && get(&value->is_watch) &&
+               get(&value->is_hidden) && get(&value->virtual_sensor_info) &&
+               get(&value->throttling_info);
+    }
+    bool get(CdevInfo *value) {
+        return get(&value->type) && get(&value->read_path) && get(&value->write_path) &&
+               get(&value->state2power) && get(&value->max_state);
+    }
+    bool get(PowerRailInfo *value) {
+        return get(&value->rail) && get(&value->power_sample_count) &&
+               get(&value->power_sample_delay) && get(&value->virtual_power_rail_info);
+    }
+
+  private:
+    template <typename T>
+    bool getBytes(T *value) {
+        if (static_cast<size_t>(end_ - pos_) < sizeof(*value)) {
+            return false;
+        }
+        std::memcpy(value, pos_, sizeof(*value));
+        pos_ += sizeof(*value);
+        return true;
+    }
+    template <typename T>
+    static bool isValidEnum(std::underlying_type_t<T> raw) {
+        if constexpr (std::is_same_v<T, FormulaOption>) {
+            return raw <= FormulaOption::MINIMUM;
+        } else if constexpr (std::is_same_v<T, SensorFusionType>) {
+            return raw <= SensorFusionType::ODPM;
+        } else if constexpr (std::is_same_v<T, ReleaseLogic>) {
+            return raw <= ReleaseLogic::NONE;
+        } else {
+            for (const auto type : ::ndk::enum_range<T>()) {
+                if (static_cast<std::underlying_type_t<T>>(type) == raw) {
+                    return true;
+                }
+            }
+            return false;
+        }
+    }
+    // Every element takes at least one byte, so a count beyond the remaining bytes is corrupt
+    // and must not be used to size an allocation.
+    bool getCount(uint32_t *count) {
+        return get(count) && *count <= static_cast<size_t>(end_ - pos_);
+    }
+
+    const char *pos_;
+    const char *end_;
+};
+
+}  // namespace
+
+std::string GetThermalConfigCachePath(std::string_view root_dir) {
+    return std::string(root_dir) + std::string(kConfigCacheDir) +
+           std::string(kConfigCacheFileName);
+}
+
+uint64_t GetThermalConfigKey(std::string_view json_doc) {
+    uint64_t key = fnv1a(json_doc, kFnvOffsetBasis);
+    // Separate the document from the property values so the two cannot alias.
+    key = fnv1a(std::string_view("\0", 1), key);
+    key = fnv1a(::android::base::GetProperty(kPowerLinkDisabledProperty.data(), ""), key);
+    // A vendor update can ship a HAL with a different cache layout next to an unchanged
+    // config, so a cache never survives a change of the vendor build.
+    key = fnv1a(std::string_view("\0", 1), key);
+    key = fnv1a(::android::base::GetProperty(kBuildFingerprintProperty.data(), ""), key);
+    return key;
+}
+
+bool ReadThermalConfigCache(std::string_view cache_path, uint64_t key, ThermalConfig *config) {
+    ATRACE_CALL();
+    ::android::base::unique_fd fd(
+            TEMP_FAILURE_RETRY(open(cache_path.data(), O_RDONLY | O_CLOEXEC)));
+    if (fd == -1) {
+        if (errno != ENOENT) {
+            PLOG(WARNING) << "Failed to open thermal config cache " << cache_path;
+        }
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(ConfigCacheHeader)) {
+        LOG(WARNING) << "Thermal config cache " << cache_path << " is truncated";
+        return false;
+    }
+    auto mapped = ::android::base::MappedFile::FromFd(fd, 0, st.st_size, PROT_READ);
+    if (mapped == nullptr) {
+        PLOG(WARNING) << "Failed to map thermal config cache " << cache_path;
+        return false;
+    }
+
+    ConfigCacheHeader header;
+    std::memcpy(&header, mapped->data(), sizeof(header));
+    if (header.magic != kConfigCacheMagic || header.version != kConfigCacheVersion ||
+        header.key != key || header.payload_size != mapped->size() - sizeof(header)) {
+        LOG(INFO) << "Thermal config cache " << cache_path << " is stale";
+        return false;
+    }
+
+    ConfigCacheReader reader(mapped->data() + sizeof(header), header.payload_size);
+    if (!reader.get(&config->sensor_info_map) ||
+        !reader.get(&config->cooling_device_info_map) ||
+        !reader.get(&config->power_rail_info_map) || !reader.get(&config->stats_config) ||
+        !reader.done()) {
+        LOG(WARNING) << "Thermal config cache " << cache_path << " is corrupt";
+        *config = ThermalConfig();
+        return false;
+    }
+    return true;
+}
+
+bool WriteThermalConfigCache(std::string_view cache_path, uint64_t key,
+                             const ThermalConfig &config) {
+    ATRACE_CALL();
+    std::string cache(sizeof(ConfigCacheHeader), '\0');
+    ConfigCacheWriter writer(&cache);
+    writer.put(config.sensor_info_map);
+    writer.put(config.cooling_device_info_map);
+    writer.put(config.power_rail_info_map);
+    writer.put(config.stats_config);
+
+    const ConfigCacheHeader header = {
+            .magic = kConfigCacheMagic,
+            .version = kConfigCacheVersion,
+            .key = key,
+            .payload_size = cache.size() - sizeof(ConfigCacheHeader),
+    };
+    std::memcpy(cache.data(), &header, sizeof(header));
+
+    // Write a temporary file and rename it over the cache, so a reader never sees a partial one.
+    const std::string tmp_path = std::string(cache_path) + ".tmp";
+    ::android::base::unique_fd fd(TEMP_FAILURE_RETRY(
+            open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640)));
+    if (fd == -1) {
+        if (errno == ENOENT) {
+            LOG(INFO) << "No thermal config cache directory for " << tmp_path
+                      << ", the JSON config is parsed on every start";
+        } else {
+            PLOG(WARNING) << "Failed to create thermal config cache " << tmp_path;
+        }
+        return false;
+    }
+    if (!::android::base::WriteFully(fd, cache.data(), cache.size()) || fsync(fd) != 0) {
+        PLOG(WARNING) << "Failed to write thermal config cache " << tmp_path;
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    fd.reset();
+    if (rename(tmp_path.c_str(), cache_path.data()) != 0) {
+        PLOG(WARNING) << "Failed to install thermal config cache " << cache_path;
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    LOG(INFO) << "Wrote thermal config cache " << cache_path << " (" << cache.size()
+              << " bytes)";
+    return true;
+}
+
+}  // namespace implementation
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "thermal_info.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace implementation {
+
+// The parsed form of thermal_info_config.json, i.e. everything the Parse* functions produce.
+struct ThermalConfig {
+    std::unordered_map<std::string, SensorInfo> sensor_info_map;
+    std::unordered_map<std::string, CdevInfo> cooling_device_info_map;
+    std::unordered_map<std::string, PowerRailInfo> power_rail_info_map;
+    StatsConfig stats_config;
+};
+
+// Path of the binary config cache under root_dir, which lives on /data since /vendor is
+// read-only. The HAL's init script creates /data/vendor/thermal, the device sepolicy has to
+// label it writable for the thermal HAL. Without that, the cache is never written and the
+// JSON config is parsed on every start.
+std::string GetThermalConfigCachePath(std::string_view root_dir);
+// Key a cache by the JSON document, the vendor build fingerprint and every property the config
+// parsers consult, so that any change to them makes the cache stale.
+uint64_t GetThermalConfigKey(std::string_view json_doc);
+// Map the cache at cache_path and decode it into config. Return false and leave config empty
+// if the cache is missing, truncated, from another format version or keyed differently.
+bool ReadThermalConfigCache(std::string_view cache_path, uint64_t key, ThermalConfig *config);
+// Encode config and atomically replace the cache at cache_path.
+bool WriteThermalConfigCache(std::string_view cache_path, uint64_t key,
+                             const ThermalConfig &config);
+
+}  // namespace implementation
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -22,9 +22,15 @@
 #include <android-base/logging.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <utils/Trace.h>
 
 #include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <string_view>
 
 namespace aidl {
@@ -34,9 +40,51 @@ namespace thermal {
 namespace implementation {
 
 using ::android::base::StringPrintf;
+using ::android::base::unique_fd;
+
+namespace {
+
+// Large enough for any numeric sysfs node read by the HAL.
+constexpr size_t kThermalFileBufSize = 32;
+
+// Parse the content of a numeric sysfs node. Integers, which is what thermal zones expose, are
+// parsed directly; anything else goes through strtof(). Both work on the caller's buffer.
+bool parseThermalFileValue(char *buf, size_t len, float *value) {
+    while (len > 0 && (buf[len - 1] == '\n' || buf[len - 1] == ' ' || buf[len - 1] == '\t')) {
+        --len;
+    }
+    buf[len] = '\0';
+
+    size_t pos = 0;
+    while (pos < len && (buf[pos] == ' ' || buf[pos] == '\t')) {
+        ++pos;
+    }
+    const size_t start = pos;
+    const bool negative = pos < len && buf[pos] == '-';
+    if (negative || (pos < len && buf[pos] == '+')) {
+        ++pos;
+    }
+
+    int64_t integer = 0;
+    const size_t digits_start = pos;
+    while (pos < len && buf[pos] >= '0' && buf[pos] <= '9' && pos - digits_start < 18) {
+        integer = integer * 10 + (buf[pos] - '0');
+        ++pos;
+    }
+    if (pos == len && pos > digits_start) {
+        *value = static_cast<float>(negative ? -integer : integer);
+        return true;
+    }
+
+    char *end = nullptr;
+    *value = std::strtof(buf + start, &end);
+    return end != buf + start && *end == '\0';
+}
+
+}  // namespace
 
 std::string ThermalFiles::getThermalFilePath(std::string_view thermal_name) const {
-    auto sensor_itr = thermal_name_to_path_map_.find(thermal_name.data());
+    auto sensor_itr = thermal_name_to_path_map_.find(thermal_name);
     if (sensor_itr == thermal_name_to_path_map_.end()) {
         return "";
     }
@@ -68,6 +116,104 @@ bool ThermalFiles::readThermalFile(std::string_view thermal_name, std::string *d
     return true;
 }
 
+bool ThermalFiles::openThermalFile(std::string_view thermal_name) {
+    std::string file_path = getThermalFilePath(thermal_name);
+    if (file_path.empty()) {
+        LOG(ERROR) << "Failed to find " << thermal_name << "'s path";
+        return false;
+    }
+
+    unique_fd fd(TEMP_FAILURE_RETRY(open(file_path.c_str(), O_RDONLY | O_CLOEXEC)));
+    if (fd == -1) {
+        PLOG(ERROR) << "Failed to open " << file_path;
+        return false;
+    }
+
+    std::unique_lock<std::shared_mutex> _lock(thermal_fd_map_mutex_);
+    thermal_name_to_fd_map_[std::string(thermal_name)] = std::move(fd);
+    return true;
+}
+
+ssize_t ThermalFiles::preadThermalFile(std::string_view thermal_name, char *buf,
+                                       size_t len) const {
+    int err;
+    {
+        std::shared_lock<std::shared_mutex> _lock(thermal_fd_map_mutex_);
+        auto fd_itr = thermal_name_to_fd_map_.find(thermal_name);
+        if (fd_itr == thermal_name_to_fd_map_.end()) {
+            return -1;
+        }
+        ssize_t ret = TEMP_FAILURE_RETRY(pread(fd_itr->second.get(), buf, len, 0));
+        if (ret >= 0) {
+            return ret;
+        }
+        err = errno;
+    }
+
+    // The node can go away and come back (e.g. a sensor driver reprobing), which leaves the
+    // cached fd stale. Reopen it once before giving up on this sample.
+    if (err != ENODEV && err != ENOENT && err != EBADF) {
+        errno = err;
+        return -1;
+    }
+    LOG(WARNING) << "Reopen " << thermal_name << ": " << strerror(err);
+
+    std::unique_lock<std::shared_mutex> _lock(thermal_fd_map_mutex_);
+    auto fd_itr = thermal_name_to_fd_map_.find(thermal_name);
+    if (fd_itr == thermal_name_to_fd_map_.end()) {
+        return -1;
+    }
+    auto &fd = fd_itr->second;
+    fd.reset(TEMP_FAILURE_RETRY(open(getThermalFilePath(thermal_name).c_str(),
+                                     O_RDONLY | O_CLOEXEC)));
+    if (fd == -1) {
+        return -1;
+    }
+    return TEMP_FAILURE_RETRY(pread(fd.get(), buf, len, 0));
+}
+
+bool ThermalFiles::readThermalFileValue(std::string_view thermal_name, float *value) const {
+    char buf[kThermalFileBufSize];
+
+    ATRACE_CALL();
+    ssize_t len = preadThermalFile(thermal_name, buf, sizeof(buf) - 1);
+    if (len < 0) {
+        // Not kept open, fall back to a one-shot read.
+        std::string file_path = getThermalFilePath(thermal_name);
+        if (file_path.empty()) {
+            LOG(WARNING) << "Failed to find " << thermal_name << "'s path";
+            return false;
+        }
+        unique_fd fd(TEMP_FAILURE_RETRY(open(file_path.c_str(), O_RDONLY | O_CLOEXEC)));
+        if (fd == -1 || (len = TEMP_FAILURE_RETRY(read(fd.get(), buf, sizeof(buf) - 1))) < 0) {
+            PLOG(WARNING) << "Failed to read sensor: " << thermal_name;
+            return false;
+        }
+    }
+
+    if (!parseThermalFileValue(buf, static_cast<size_t>(len), value)) {
+        LOG(ERROR) << "Failed to parse sensor: " << thermal_name << " reading: " << buf;
+        return false;
+    }
+    return true;
+}
+
+size_t ThermalFiles::readThermalFileValues(const std::vector<std::string_view> &thermal_names,
+                                           std::vector<float> *values) const {
+    size_t count = 0;
+
+    ATRACE_CALL();
+    values->resize(thermal_names.size());
+    for (size_t i = 0; i < thermal_names.size(); ++i) {
+        if (readThermalFileValue(thermal_names[i], &(*values)[i])) {
+            ++count;
+        } else {
+            (*values)[i] = NAN;
+        }
+    }
+    return count;
+}
+
 bool ThermalFiles::writeCdevFile(std::string_view cdev_name, std::string_view data) {
     std::string file_path =
             getThermalFilePath(::android::base::StringPrintf("%s_%s", cdev_name.data(), "w"));
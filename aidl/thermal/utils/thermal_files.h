@@ -16,8 +16,15 @@
 
 #pragma once
 
+#include <android-base/unique_fd.h>
+
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
 
 namespace aidl {
 namespace android {
@@ -25,6 +32,15 @@ namespace hardware {
 namespace thermal {
 namespace implementation {
 
+// Lets the maps below be searched with a std::string_view, without building a std::string key.
+struct ThermalNameHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view name) const { return std::hash<std::string_view>{}(name); }
+};
+
+template <typename T>
+using ThermalNameMap = std::unordered_map<std::string, T, ThermalNameHash, std::equal_to<>>;
+
 class ThermalFiles {
   public:
     ThermalFiles() = default;
@@ -39,11 +55,28 @@ class ThermalFiles {
     // data to empty and return false. If the thermal_name is found and its content
     // is read, this function will fill in data accordingly then return true.
     bool readThermalFile(std::string_view thermal_name, std::string *data) const;
+    // Keep the file of thermal_name open so readThermalFileValue() can pread() it instead of
+    // opening it on every read. Returns false if thermal_name is unknown or cannot be opened.
+    bool openThermalFile(std::string_view thermal_name);
+    // Read and parse the numeric content of thermal_name without any heap allocation when the
+    // file is kept open. Returns false if the file cannot be read or does not hold a number.
+    bool readThermalFileValue(std::string_view thermal_name, float *value) const;
+    // Read every file in thermal_names in one pass. values is resized to thermal_names.size()
+    // and failed reads are set to NAN. Returns the number of successful reads.
+    size_t readThermalFileValues(const std::vector<std::string_view> &thermal_names,
+                                 std::vector<float> *values) const;
     bool writeCdevFile(std::string_view thermal_name, std::string_view data);
     size_t getNumThermalFiles() const { return thermal_name_to_path_map_.size(); }
 
   private:
-    std::unordered_map<std::string, std::string> thermal_name_to_path_map_;
+    // pread() the opened file of thermal_name into buf, reopening it once if the device node
+    // went away. Returns the number of bytes read, or -1 on failure.
+    ssize_t preadThermalFile(std::string_view thermal_name, char *buf, size_t len) const;
+
+    ThermalNameMap<std::string> thermal_name_to_path_map_;
+    // The files kept open by openThermalFile(), reopened on ENODEV.
+    mutable ThermalNameMap<::android::base::unique_fd> thermal_name_to_fd_map_;
+    mutable std::shared_mutex thermal_fd_map_mutex_;
 };
 
 }  // namespace implementation
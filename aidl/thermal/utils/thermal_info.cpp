@@ -15,7 +15,6 @@
  */
 #include "thermal_info.h"
 
-#include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/properties.h>
 #include <android-base/strings.h>
@@ -30,7 +29,6 @@ namespace hardware {
 namespace thermal {
 namespace implementation {
 
-constexpr std::string_view kPowerLinkDisabledProperty("vendor.disable.thermal.powerlink");
 
 namespace {
 
@@ -131,12 +129,7 @@ bool getFloatFromJsonValues(const Json::Value &values, ThrottlingArray *out, boo
 }
 }  // namespace
 
-bool ParseThermalConfig(std::string_view config_path, Json::Value *config) {
-    std::string json_doc;
-    if (!::android::base::ReadFileToString(config_path.data(), &json_doc)) {
-        LOG(ERROR) << "Failed to read JSON config from " << config_path;
-        return false;
-    }
+bool ParseThermalConfig(const std::string &json_doc, Json::Value *config) {
     Json::CharReaderBuilder builder;
     std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
     std::string errorMessage;
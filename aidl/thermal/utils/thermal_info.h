@@ -23,6 +23,7 @@
 
 #include <chrono>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
 #include <variant>
@@ -44,6 +45,7 @@ constexpr std::chrono::milliseconds kUeventPollTimeoutMs = std::chrono::millisec
 // VendorSensorCoolingDeviceStats, VendorTempResidencyStats
 constexpr int kMaxStatsResidencyCount = 20;
 constexpr int kMaxStatsThresholdCount = kMaxStatsResidencyCount - 1;
+constexpr std::string_view kPowerLinkDisabledProperty("vendor.disable.thermal.powerlink");
 
 enum FormulaOption : uint32_t {
     COUNT_THRESHOLD = 0,
@@ -187,7 +189,7 @@ struct PowerRailInfo {
     std::unique_ptr<VirtualPowerRailInfo> virtual_power_rail_info;
 };
 
-bool ParseThermalConfig(std::string_view config_path, Json::Value *config);
+bool ParseThermalConfig(const std::string &json_doc, Json::Value *config);
 bool ParseSensorInfo(const Json::Value &config,
                      std::unordered_map<std::string, SensorInfo> *sensors_parsed);
 bool ParseCoolingDevice(const Json::Value &config,
@@ -78,14 +78,9 @@ int calculateThresholdBucket(const std::vector<T> &thresholds, T value) {
 }  // namespace
 
 bool ThermalStatsHelper::initializeStats(
-        const Json::Value &config,
+        const StatsConfig &stats_config,
         const std::unordered_map<std::string, SensorInfo> &sensor_info_map_,
         const std::unordered_map<std::string, CdevInfo> &cooling_device_info_map_) {
-    StatsConfig stats_config;
-    if (!ParseStatsConfig(config, sensor_info_map_, cooling_device_info_map_, &stats_config)) {
-        LOG(ERROR) << "Failed to parse stats config";
-        return false;
-    }
     bool is_initialized_ =
             initializeSensorTempStats(stats_config.sensor_stats_info, sensor_info_map_) &&
             initializeSensorCdevRequestStats(stats_config.cooling_device_request_info,
@@ -106,7 +106,7 @@ class ThermalStatsHelper {
     ThermalStatsHelper(const ThermalStatsHelper &) = delete;
     void operator=(const ThermalStatsHelper &) = delete;
 
-    bool initializeStats(const Json::Value &config,
+    bool initializeStats(const StatsConfig &stats_config,
                          const std::unordered_map<std::string, SensorInfo> &sensor_info_map_,
                          const std::unordered_map<std::string, CdevInfo> &cooling_device_info_map_);
     void updateSensorCdevRequestStats(std::string_view trigger_sensor, std::string_view cdev,
@@ -40,6 +40,13 @@ namespace thermal {
 namespace implementation {
 using ::android::base::StringPrintf;
 
+namespace {
+// The throttling algos registered for a binded cooling device, or for any of a sensor's
+constexpr uint8_t kThrottlingPid = 1 << 0;
+constexpr uint8_t kThrottlingHardLimit = 1 << 1;
+constexpr uint8_t kThrottlingRelease = 1 << 2;
+}  // namespace
+
 // To find the next PID target state according to the current thermal severity
 size_t getTargetStateOfPID(const SensorInfo &sensor_info, const ThrottlingSeverity curr_severity) {
     size_t target_state = 0;
@@ -58,48 +65,53 @@ size_t getTargetStateOfPID(const SensorInfo &sensor_info, const ThrottlingSeveri
     return target_state;
 }
 
-void ThermalThrottling::clearThrottlingData(std::string_view sensor_name,
-                                            const SensorInfo &sensor_info) {
-    if (!thermal_throttling_status_map_.count(sensor_name.data())) {
-        return;
-    }
-    std::unique_lock<std::shared_mutex> _lock(thermal_throttling_status_map_mutex_);
-
-    for (auto &pid_power_budget_pair :
-         thermal_throttling_status_map_.at(sensor_name.data()).pid_power_budget_map) {
-        pid_power_budget_pair.second = std::numeric_limits<int>::max();
-    }
 
-    for (auto &pid_cdev_request_pair :
-         thermal_throttling_status_map_.at(sensor_name.data()).pid_cdev_request_map) {
-        pid_cdev_request_pair.second = 0;
-    }
+void ThermalThrottling::PidStepArrays::resize(size_t count) {
+    step_index.resize(count);
+    target_state.resize(count);
+    target_changed.resize(count);
+    err.resize(count);
+    k_p.resize(count);
+    k_i.resize(count);
+    k_d.resize(count);
+    i_cutoff.resize(count);
+    i_max.resize(count);
+    s_power.resize(count);
+    min_alloc_power.resize(count);
+    max_alloc_power.resize(count);
+    prev_err.resize(count);
+    time_elapsed_ms.resize(count);
+    p.resize(count);
+    i_budget.resize(count);
+    d.resize(count);
+    power_budget.resize(count);
+}
 
-    for (auto &hardlimit_cdev_request_pair :
-         thermal_throttling_status_map_.at(sensor_name.data()).hardlimit_cdev_request_map) {
-        hardlimit_cdev_request_pair.second = 0;
-    }
+void ThermalThrottling::clearThrottlingData(size_t throttling_index) {
+    std::unique_lock<std::shared_mutex> _lock(thermal_throttling_status_mutex_);
 
-    for (auto &throttling_release_pair :
-         thermal_throttling_status_map_.at(sensor_name.data()).throttling_release_map) {
-        throttling_release_pair.second = 0;
+    for (size_t i = sensors_.binding_begin[throttling_index];
+         i < sensors_.binding_end[throttling_index]; ++i) {
+        bindings_.pid_power_budget[i] = std::numeric_limits<int>::max();
+        bindings_.pid_cdev_request[i] = 0;
+        bindings_.hardlimit_cdev_request[i] = 0;
+        bindings_.throttling_release[i] = 0;
     }
 
-    thermal_throttling_status_map_[sensor_name.data()].prev_err = NAN;
-    thermal_throttling_status_map_[sensor_name.data()].i_budget =
-            sensor_info.throttling_info->i_default;
-    thermal_throttling_status_map_[sensor_name.data()].prev_target =
-            static_cast<size_t>(ThrottlingSeverity::NONE);
-    thermal_throttling_status_map_[sensor_name.data()].prev_power_budget = NAN;
-    thermal_throttling_status_map_[sensor_name.data()].tran_cycle = 0;
+    sensors_.prev_err[throttling_index] = NAN;
+    sensors_.i_budget[throttling_index] = sensors_.throttling_info[throttling_index]->i_default;
+    sensors_.prev_target[throttling_index] = static_cast<size_t>(ThrottlingSeverity::NONE);
+    sensors_.prev_power_budget[throttling_index] = NAN;
+    sensors_.tran_cycle[throttling_index] = 0;
 
     return;
 }
 
 bool ThermalThrottling::registerThermalThrottling(
         std::string_view sensor_name, const std::shared_ptr<ThrottlingInfo> &throttling_info,
-        const std::unordered_map<std::string, CdevInfo> &cooling_device_info_map) {
-    if (thermal_throttling_status_map_.count(sensor_name.data())) {
+        const std::unordered_map<std::string, CdevInfo> &cooling_device_info_map,
+        const std::unordered_map<std::string, PowerStatus> &power_status_map) {
+    if (throttling_index_map_.count(sensor_name.data())) {
         LOG(ERROR) << "Sensor " << sensor_name.data() << " throttling map has been registered";
         return false;
     }
@@ -109,174 +121,293 @@ bool ThermalThrottling::registerThermalThrottling(
         return false;
     }
 
-    thermal_throttling_status_map_[sensor_name.data()].prev_err = NAN;
-    thermal_throttling_status_map_[sensor_name.data()].i_budget = throttling_info->i_default;
-    thermal_throttling_status_map_[sensor_name.data()].prev_target =
-            static_cast<size_t>(ThrottlingSeverity::NONE);
-    thermal_throttling_status_map_[sensor_name.data()].prev_power_budget = NAN;
-    thermal_throttling_status_map_[sensor_name.data()].tran_cycle = 0;
-
-    for (auto &binded_cdev_pair : throttling_info->binded_cdev_info_map) {
+    for (const auto &binded_cdev_pair : throttling_info->binded_cdev_info_map) {
         if (!cooling_device_info_map.count(binded_cdev_pair.first)) {
             LOG(ERROR) << "Could not find " << sensor_name.data() << "'s binded CDEV "
                        << binded_cdev_pair.first;
             return false;
         }
-        // Register PID throttling map
-        for (const auto &cdev_weight : binded_cdev_pair.second.cdev_weight_for_pid) {
+    }
+
+    std::unique_lock<std::shared_mutex> _lock(thermal_throttling_status_mutex_);
+    uint8_t sensor_flags = 0;
+    sensors_.binding_begin.push_back(bindings_.cdev_name.size());
+    for (const auto &binded_cdev_pair : throttling_info->binded_cdev_info_map) {
+        const auto &binded_cdev_info = binded_cdev_pair.second;
+        uint8_t flags = 0;
+        // Register PID throttling
+        for (const auto &cdev_weight : binded_cdev_info.cdev_weight_for_pid) {
             if (!std::isnan(cdev_weight)) {
-                thermal_throttling_status_map_[sensor_name.data()]
-                        .pid_power_budget_map[binded_cdev_pair.first] =
-                        std::numeric_limits<int>::max();
-                thermal_throttling_status_map_[sensor_name.data()]
-                        .pid_cdev_request_map[binded_cdev_pair.first] = 0;
-                thermal_throttling_status_map_[sensor_name.data()]
-                        .cdev_status_map[binded_cdev_pair.first] = 0;
-                cdev_all_request_map_[binded_cdev_pair.first].insert(0);
+                flags |= kThrottlingPid;
                 break;
             }
         }
-        // Register hard limit throttling map
-        for (const auto &limit_info : binded_cdev_pair.second.limit_info) {
+        // Register hard limit throttling
+        for (const auto &limit_info : binded_cdev_info.limit_info) {
             if (limit_info > 0) {
-                thermal_throttling_status_map_[sensor_name.data()]
-                        .hardlimit_cdev_request_map[binded_cdev_pair.first] = 0;
-                thermal_throttling_status_map_[sensor_name.data()]
-                        .cdev_status_map[binded_cdev_pair.first] = 0;
-                cdev_all_request_map_[binded_cdev_pair.first].insert(0);
+                flags |= kThrottlingHardLimit;
                 break;
             }
         }
-        // Register throttling release map if power threshold exists
-        if (!binded_cdev_pair.second.power_rail.empty()) {
-            for (const auto &power_threshold : binded_cdev_pair.second.power_thresholds) {
+        // Register throttling release if power threshold exists
+        if (!binded_cdev_info.power_rail.empty()) {
+            for (const auto &power_threshold : binded_cdev_info.power_thresholds) {
                 if (!std::isnan(power_threshold)) {
-                    thermal_throttling_status_map_[sensor_name.data()]
-                            .throttling_release_map[binded_cdev_pair.first] = 0;
+                    flags |= kThrottlingRelease;
                     break;
                 }
             }
         }
-    }
-    return true;
-}
 
-// return power budget based on PID algo
-float ThermalThrottling::updatePowerBudget(const Temperature &temp, const SensorInfo &sensor_info,
-                                           std::chrono::milliseconds time_elapsed_ms,
-                                           ThrottlingSeverity curr_severity) {
-    float p = 0, d = 0;
-    float power_budget = std::numeric_limits<float>::max();
-    bool target_changed = false;
-    float budget_transient = 0.0;
-    auto &throttling_status = thermal_throttling_status_map_.at(temp.name);
-    std::string sensor_name = temp.name;
-
-    if (curr_severity == ThrottlingSeverity::NONE) {
-        return power_budget;
-    }
+        size_t cdev_index = kThrottlingNoIndex;
+        if (flags & (kThrottlingPid | kThrottlingHardLimit)) {
+            std::unique_lock<std::shared_mutex> _cdev_lock(cdev_all_request_map_mutex_);
+            const auto [cdev_index_itr, inserted] =
+                    cdev_index_map_.try_emplace(binded_cdev_pair.first, cdev_all_request_.size());
+            if (inserted) {
+                cdev_all_request_.emplace_back();
+            }
+            cdev_index = cdev_index_itr->second;
+            cdev_all_request_[cdev_index].insert(0);
+        }
 
-    const auto target_state = getTargetStateOfPID(sensor_info, curr_severity);
-    if (throttling_status.prev_target != static_cast<size_t>(ThrottlingSeverity::NONE) &&
-        target_state != throttling_status.prev_target &&
-        sensor_info.throttling_info->tran_cycle > 0) {
-        throttling_status.tran_cycle = sensor_info.throttling_info->tran_cycle - 1;
-        target_changed = true;
+        const auto power_status_itr = power_status_map.find(binded_cdev_info.power_rail);
+        bindings_.cdev_name.push_back(&binded_cdev_pair.first);
+        bindings_.binded_cdev_info.push_back(&binded_cdev_info);
+        bindings_.cdev_info.push_back(&cooling_device_info_map.at(binded_cdev_pair.first));
+        bindings_.power_status.push_back(
+                power_status_itr == power_status_map.end() ? nullptr : &power_status_itr->second);
+        bindings_.cdev_index.push_back(cdev_index);
+        bindings_.flags.push_back(flags);
+        for (size_t i = 0; i < kThrottlingSeverityCount; ++i) {
+            bindings_.cdev_weight[i].push_back(binded_cdev_info.cdev_weight_for_pid[i]);
+        }
+        bindings_.pid_power_budget.push_back(std::numeric_limits<int>::max());
+        bindings_.pid_cdev_request.push_back(0);
+        bindings_.hardlimit_cdev_request.push_back(0);
+        bindings_.throttling_release.push_back(0);
+        bindings_.cdev_status.push_back(0);
+        bindings_.allocated.push_back(0);
+        sensor_flags |= flags;
+    }
+    sensors_.binding_end.push_back(bindings_.cdev_name.size());
+
+    sensors_.excluded_begin.push_back(excluded_power_.power_rail.size());
+    for (const auto &excluded_power_info_pair : throttling_info->excluded_power_info_map) {
+        const auto power_status_itr = power_status_map.find(excluded_power_info_pair.first);
+        excluded_power_.power_rail.push_back(&excluded_power_info_pair.first);
+        excluded_power_.power_status.push_back(
+                power_status_itr == power_status_map.end() ? nullptr : &power_status_itr->second);
+        for (size_t i = 0; i < kThrottlingSeverityCount; ++i) {
+            excluded_power_.weight[i].push_back(excluded_power_info_pair.second[i]);
+        }
     }
-    throttling_status.prev_target = target_state;
-
-    // Compute PID
-    float err = sensor_info.hot_thresholds[target_state] - temp.value;
-    p = err * (err < 0 ? sensor_info.throttling_info->k_po[target_state]
-                       : sensor_info.throttling_info->k_pu[target_state]);
+    sensors_.excluded_end.push_back(excluded_power_.power_rail.size());
+
+    throttling_index_map_[sensor_name.data()] = sensors_.name.size();
+    sensors_.name.emplace_back(sensor_name);
+    sensors_.throttling_info.push_back(throttling_info);
+    sensors_.flags.push_back(sensor_flags);
+    sensors_.prev_err.push_back(NAN);
+    sensors_.i_budget.push_back(throttling_info->i_default);
+    sensors_.prev_target.push_back(static_cast<size_t>(ThrottlingSeverity::NONE));
+    sensors_.prev_power_budget.push_back(NAN);
+    sensors_.budget_transient.push_back(0);
+    sensors_.tran_cycle.push_back(0);
+    sensors_.power_budget.push_back(std::numeric_limits<float>::max());
+    return true;
+}
 
-    if (err < sensor_info.throttling_info->i_cutoff[target_state]) {
-        throttling_status.i_budget += err * sensor_info.throttling_info->k_i[target_state];
-    }
+size_t ThermalThrottling::getThrottlingIndex(std::string_view sensor_name) const {
+    const auto throttling_index_itr = throttling_index_map_.find(sensor_name.data());
+    return throttling_index_itr == throttling_index_map_.end() ? kThrottlingNoIndex
+                                                               : throttling_index_itr->second;
+}
 
-    if (fabsf(throttling_status.i_budget) > sensor_info.throttling_info->i_max[target_state]) {
-        throttling_status.i_budget = sensor_info.throttling_info->i_max[target_state] *
-                                     (throttling_status.i_budget > 0 ? 1 : -1);
-    }
+std::unordered_map<std::string, ThermalThrottlingStatus>
+ThermalThrottling::GetThermalThrottlingStatusMap() const {
+    std::unordered_map<std::string, ThermalThrottlingStatus> thermal_throttling_status_map;
+    std::shared_lock<std::shared_mutex> _lock(thermal_throttling_status_mutex_);
+
+    for (size_t sensor = 0; sensor < sensors_.name.size(); ++sensor) {
+        auto &throttling_status = thermal_throttling_status_map[sensors_.name[sensor]];
+        for (size_t i = sensors_.binding_begin[sensor]; i < sensors_.binding_end[sensor]; ++i) {
+            const auto &cdev_name = *bindings_.cdev_name[i];
+            const auto flags = bindings_.flags[i];
+            if (flags & kThrottlingPid) {
+                throttling_status.pid_power_budget_map[cdev_name] = bindings_.pid_power_budget[i];
+                throttling_status.pid_cdev_request_map[cdev_name] = bindings_.pid_cdev_request[i];
+            }
+            if (flags & kThrottlingHardLimit) {
+                throttling_status.hardlimit_cdev_request_map[cdev_name] =
+                        bindings_.hardlimit_cdev_request[i];
+            }
+            if (flags & kThrottlingRelease) {
+                throttling_status.throttling_release_map[cdev_name] =
+                        bindings_.throttling_release[i];
+            }
+            if (flags & (kThrottlingPid | kThrottlingHardLimit)) {
+                throttling_status.cdev_status_map[cdev_name] = bindings_.cdev_status[i];
+            }
+        }
+        throttling_status.prev_err = sensors_.prev_err[sensor];
+        throttling_status.i_budget = sensors_.i_budget[sensor];
+        throttling_status.prev_target = sensors_.prev_target[sensor];
+        throttling_status.prev_power_budget = sensors_.prev_power_budget[sensor];
+        throttling_status.budget_transient = sensors_.budget_transient[sensor];
+        throttling_status.tran_cycle = sensors_.tran_cycle[sensor];
+    }
+    return thermal_throttling_status_map;
+}
 
-    if (!std::isnan(throttling_status.prev_err) &&
-        time_elapsed_ms != std::chrono::milliseconds::zero()) {
-        d = sensor_info.throttling_info->k_d[target_state] * (err - throttling_status.prev_err) /
-            time_elapsed_ms.count();
-    }
+// Compute the power budget of each PID throttled sensor based on PID algo
+void ThermalThrottling::updatePowerBudgets(const std::vector<ThrottlingStep> &steps) {
+    ATRACE_CALL();
+    std::unique_lock<std::shared_mutex> _lock(thermal_throttling_status_mutex_);
+    auto &pid = pid_steps_;
+    size_t count = 0;
+
+    pid.resize(steps.size());
+    // Gather the state and the gains of each sensor's control target
+    for (size_t step_index = 0; step_index < steps.size(); ++step_index) {
+        const auto &step = steps[step_index];
+        const size_t sensor = step.throttling_index;
+        if (!(sensors_.flags[sensor] & kThrottlingPid)) {
+            continue;
+        }
+        if (step.severity == ThrottlingSeverity::NONE) {
+            sensors_.power_budget[sensor] = std::numeric_limits<float>::max();
+            continue;
+        }
 
-    throttling_status.prev_err = err;
-    // Calculate power budget
-    power_budget =
-            sensor_info.throttling_info->s_power[target_state] + p + throttling_status.i_budget + d;
-    if (power_budget < sensor_info.throttling_info->min_alloc_power[target_state]) {
-        power_budget = sensor_info.throttling_info->min_alloc_power[target_state];
-    }
-    if (power_budget > sensor_info.throttling_info->max_alloc_power[target_state]) {
-        power_budget = sensor_info.throttling_info->max_alloc_power[target_state];
-    }
+        const auto &throttling_info = *sensors_.throttling_info[sensor];
+        const auto target_state = getTargetStateOfPID(*step.sensor_info, step.severity);
+        bool target_changed = false;
+        if (sensors_.prev_target[sensor] != static_cast<size_t>(ThrottlingSeverity::NONE) &&
+            target_state != sensors_.prev_target[sensor] && throttling_info.tran_cycle > 0) {
+            sensors_.tran_cycle[sensor] = throttling_info.tran_cycle - 1;
+            target_changed = true;
+        }
+        sensors_.prev_target[sensor] = target_state;
+
+        const float err = step.sensor_info->hot_thresholds[target_state] - step.temp->value;
+        pid.step_index[count] = step_index;
+        pid.target_state[count] = target_state;
+        pid.target_changed[count] = target_changed;
+        pid.err[count] = err;
+        pid.k_p[count] = err < 0 ? throttling_info.k_po[target_state]
+                                 : throttling_info.k_pu[target_state];
+        pid.k_i[count] = throttling_info.k_i[target_state];
+        pid.k_d[count] = throttling_info.k_d[target_state];
+        pid.i_cutoff[count] = throttling_info.i_cutoff[target_state];
+        pid.i_max[count] = throttling_info.i_max[target_state];
+        pid.s_power[count] = throttling_info.s_power[target_state];
+        pid.min_alloc_power[count] = throttling_info.min_alloc_power[target_state];
+        pid.max_alloc_power[count] = throttling_info.max_alloc_power[target_state];
+        pid.prev_err[count] = sensors_.prev_err[sensor];
+        pid.i_budget[count] = sensors_.i_budget[sensor];
+        pid.time_elapsed_ms[count] = static_cast<float>(step.time_elapsed_ms.count());
+        ++count;
+    }
+
+    // Compute PID for all the sensors at once, kept branch free so it can be vectorized
+    for (size_t i = 0; i < count; ++i) {
+        const float err = pid.err[i];
+        const float p = err * pid.k_p[i];
+        float i_budget = pid.i_budget[i] + (err < pid.i_cutoff[i] ? err * pid.k_i[i] : 0.0f);
+        i_budget = fabsf(i_budget) > pid.i_max[i] ? pid.i_max[i] * (i_budget > 0 ? 1 : -1)
+                                                  : i_budget;
+        const float d = (!std::isnan(pid.prev_err[i]) && pid.time_elapsed_ms[i] != 0)
+                                ? pid.k_d[i] * (err - pid.prev_err[i]) / pid.time_elapsed_ms[i]
+                                : 0.0f;
+        // Calculate power budget
+        float power_budget = pid.s_power[i] + p + i_budget + d;
+        power_budget = power_budget < pid.min_alloc_power[i] ? pid.min_alloc_power[i]
+                                                             : power_budget;
+        power_budget = power_budget > pid.max_alloc_power[i] ? pid.max_alloc_power[i]
+                                                             : power_budget;
+        pid.p[i] = p;
+        pid.i_budget[i] = i_budget;
+        pid.d[i] = d;
+        pid.power_budget[i] = power_budget;
+    }
+
+    // Apply the transient of a control target change and store the state back
+    for (size_t i = 0; i < count; ++i) {
+        const auto &step = steps[pid.step_index[i]];
+        const size_t sensor = step.throttling_index;
+        const auto &throttling_info = *sensors_.throttling_info[sensor];
+        const auto &sensor_info = *step.sensor_info;
+        const std::string &sensor_name = step.temp->name;
+        const auto target_state = pid.target_state[i];
+        const auto time_elapsed_ms = step.time_elapsed_ms;
+        float power_budget = pid.power_budget[i];
+        float budget_transient = 0.0;
+
+        sensors_.prev_err[sensor] = pid.err[i];
+        sensors_.i_budget[sensor] = pid.i_budget[i];
+        if (pid.target_changed[i]) {
+            sensors_.budget_transient[sensor] = sensors_.prev_power_budget[sensor] - power_budget;
+        }
 
-    if (target_changed) {
-        throttling_status.budget_transient = throttling_status.prev_power_budget - power_budget;
-    }
+        if (sensors_.tran_cycle[sensor]) {
+            budget_transient = sensors_.budget_transient[sensor] *
+                               ((static_cast<float>(sensors_.tran_cycle[sensor]) /
+                                 static_cast<float>(throttling_info.tran_cycle)));
+            power_budget += budget_transient;
+            sensors_.tran_cycle[sensor]--;
+        }
 
-    if (throttling_status.tran_cycle) {
-        budget_transient = throttling_status.budget_transient *
-                           ((static_cast<float>(throttling_status.tran_cycle) /
-                             static_cast<float>(sensor_info.throttling_info->tran_cycle)));
-        power_budget += budget_transient;
-        throttling_status.tran_cycle--;
+        LOG(INFO) << sensor_name << " power_budget=" << power_budget << " err=" << pid.err[i]
+                  << " s_power=" << pid.s_power[i]
+                  << " time_elapsed_ms=" << time_elapsed_ms.count() << " p=" << pid.p[i]
+                  << " i=" << pid.i_budget[i] << " d=" << pid.d[i]
+                  << " budget transient=" << budget_transient << " control target=" << target_state;
+
+        ATRACE_INT((sensor_name + std::string("-power_budget")).c_str(),
+                   static_cast<int>(power_budget));
+        ATRACE_INT((sensor_name + std::string("-s_power")).c_str(),
+                   static_cast<int>(pid.s_power[i]));
+        ATRACE_INT((sensor_name + std::string("-time_elapsed_ms")).c_str(),
+                   static_cast<int>(time_elapsed_ms.count()));
+        ATRACE_INT((sensor_name + std::string("-budget_transient")).c_str(),
+                   static_cast<int>(budget_transient));
+        ATRACE_INT((sensor_name + std::string("-i")).c_str(), static_cast<int>(pid.i_budget[i]));
+        ATRACE_INT((sensor_name + std::string("-target_state")).c_str(),
+                   static_cast<int>(target_state));
+
+        ATRACE_INT((sensor_name + std::string("-err")).c_str(),
+                   static_cast<int>(pid.err[i] / sensor_info.multiplier));
+        ATRACE_INT((sensor_name + std::string("-p")).c_str(), static_cast<int>(pid.p[i]));
+        ATRACE_INT((sensor_name + std::string("-d")).c_str(), static_cast<int>(pid.d[i]));
+        ATRACE_INT((sensor_name + std::string("-temp")).c_str(),
+                   static_cast<int>(step.temp->value / sensor_info.multiplier));
+
+        sensors_.prev_power_budget[sensor] = power_budget;
+        sensors_.power_budget[sensor] = power_budget;
     }
-
-    LOG(INFO) << temp.name << " power_budget=" << power_budget << " err=" << err
-              << " s_power=" << sensor_info.throttling_info->s_power[target_state]
-              << " time_elapsed_ms=" << time_elapsed_ms.count() << " p=" << p
-              << " i=" << throttling_status.i_budget << " d=" << d
-              << " budget transient=" << budget_transient << " control target=" << target_state;
-
-    ATRACE_INT((sensor_name + std::string("-power_budget")).c_str(),
-               static_cast<int>(power_budget));
-    ATRACE_INT((sensor_name + std::string("-s_power")).c_str(),
-               static_cast<int>(sensor_info.throttling_info->s_power[target_state]));
-    ATRACE_INT((sensor_name + std::string("-time_elapsed_ms")).c_str(),
-               static_cast<int>(time_elapsed_ms.count()));
-    ATRACE_INT((sensor_name + std::string("-budget_transient")).c_str(),
-               static_cast<int>(budget_transient));
-    ATRACE_INT((sensor_name + std::string("-i")).c_str(),
-               static_cast<int>(throttling_status.i_budget));
-    ATRACE_INT((sensor_name + std::string("-target_state")).c_str(),
-               static_cast<int>(target_state));
-
-    ATRACE_INT((sensor_name + std::string("-err")).c_str(), static_cast<int>(err / sensor_info.multiplier));
-    ATRACE_INT((sensor_name + std::string("-p")).c_str(), static_cast<int>(p));
-    ATRACE_INT((sensor_name + std::string("-d")).c_str(), static_cast<int>(d));
-    ATRACE_INT((sensor_name + std::string("-temp")).c_str(), static_cast<int>(temp.value / sensor_info.multiplier));
-
-    throttling_status.prev_power_budget = power_budget;
-
-    return power_budget;
 }
 
-float ThermalThrottling::computeExcludedPower(
-        const SensorInfo &sensor_info, const ThrottlingSeverity curr_severity,
-        const std::unordered_map<std::string, PowerStatus> &power_status_map, std::string *log_buf,
-        std::string_view sensor_name) {
+float ThermalThrottling::computeExcludedPower(size_t throttling_index,
+                                              const ThrottlingSeverity curr_severity,
+                                              std::string *log_buf, std::string_view sensor_name) {
+    const auto &excluded_weight = excluded_power_.weight[static_cast<size_t>(curr_severity)];
     float excluded_power = 0.0;
 
-    for (const auto &excluded_power_info_pair :
-         sensor_info.throttling_info->excluded_power_info_map) {
-        const auto last_updated_avg_power =
-                power_status_map.at(excluded_power_info_pair.first).last_updated_avg_power;
+    for (size_t i = sensors_.excluded_begin[throttling_index];
+         i < sensors_.excluded_end[throttling_index]; ++i) {
+        if (excluded_power_.power_status[i] == nullptr) {
+            continue;
+        }
+        const auto last_updated_avg_power = excluded_power_.power_status[i]->last_updated_avg_power;
         if (!std::isnan(last_updated_avg_power)) {
-            excluded_power += last_updated_avg_power *
-                              excluded_power_info_pair.second[static_cast<size_t>(curr_severity)];
-            log_buf->append(StringPrintf(
-                    "(%s: %0.2f mW, cdev_weight: %f)", excluded_power_info_pair.first.c_str(),
-                    last_updated_avg_power,
-                    excluded_power_info_pair.second[static_cast<size_t>(curr_severity)]));
+            excluded_power += last_updated_avg_power * excluded_weight[i];
+            log_buf->append(StringPrintf("(%s: %0.2f mW, cdev_weight: %f)",
+                                         excluded_power_.power_rail[i]->c_str(),
+                                         last_updated_avg_power, excluded_weight[i]));
 
             ATRACE_INT((std::string(sensor_name) + std::string("-") +
-                        excluded_power_info_pair.first + std::string("-avg_power"))
+                        *excluded_power_.power_rail[i] + std::string("-avg_power"))
                                .c_str(),
                        static_cast<int>(last_updated_avg_power));
         }
@@ -288,11 +419,12 @@ float ThermalThrottling::computeExcludedPower(
 }
 
 // Allocate power budget to binded cooling devices base on the real ODPM power data
-bool ThermalThrottling::allocatePowerToCdev(
-        const Temperature &temp, const SensorInfo &sensor_info,
-        const ThrottlingSeverity curr_severity, const std::chrono::milliseconds time_elapsed_ms,
-        const std::unordered_map<std::string, PowerStatus> &power_status_map,
-        const std::unordered_map<std::string, CdevInfo> &cooling_device_info_map) {
+bool ThermalThrottling::allocatePowerToCdev(const ThrottlingStep &step) {
+    const size_t sensor = step.throttling_index;
+    const std::string &sensor_name = step.temp->name;
+    const auto &cdev_weights = bindings_.cdev_weight[static_cast<size_t>(step.severity)];
+    const size_t binding_begin = sensors_.binding_begin[sensor];
+    const size_t binding_end = sensors_.binding_end[sensor];
     float total_weight = 0;
     float last_updated_avg_power = NAN;
     float allocated_power = 0;
@@ -300,70 +432,61 @@ bool ThermalThrottling::allocatePowerToCdev(
     bool low_power_device_check = true;
     bool is_budget_allocated = false;
     bool power_data_invalid = false;
-    std::set<std::string> allocated_cdev;
     std::string log_buf;
 
-    std::unique_lock<std::shared_mutex> _lock(thermal_throttling_status_map_mutex_);
-    auto total_power_budget = updatePowerBudget(temp, sensor_info, time_elapsed_ms, curr_severity);
+    std::unique_lock<std::shared_mutex> _lock(thermal_throttling_status_mutex_);
+    auto total_power_budget = sensors_.power_budget[sensor];
 
-    if (sensor_info.throttling_info->excluded_power_info_map.size()) {
-        total_power_budget -= computeExcludedPower(sensor_info, curr_severity, power_status_map,
-                                                   &log_buf, temp.name);
+    if (sensors_.excluded_begin[sensor] != sensors_.excluded_end[sensor]) {
+        total_power_budget -= computeExcludedPower(sensor, step.severity, &log_buf, sensor_name);
         total_power_budget = std::max(total_power_budget, 0.0f);
         if (!log_buf.empty()) {
-            LOG(INFO) << temp.name << " power budget=" << total_power_budget << " after " << log_buf
-                      << " is excluded";
+            LOG(INFO) << sensor_name << " power budget=" << total_power_budget << " after "
+                      << log_buf << " is excluded";
         }
     }
 
     // Compute total cdev weight
-    for (const auto &binded_cdev_info_pair : sensor_info.throttling_info->binded_cdev_info_map) {
-        const auto cdev_weight = binded_cdev_info_pair.second
-                                         .cdev_weight_for_pid[static_cast<size_t>(curr_severity)];
-        if (std::isnan(cdev_weight) || cdev_weight == 0) {
-            allocated_cdev.insert(binded_cdev_info_pair.first);
-            continue;
+    for (size_t i = binding_begin; i < binding_end; ++i) {
+        const auto cdev_weight = cdev_weights[i];
+        bindings_.allocated[i] = std::isnan(cdev_weight) || cdev_weight == 0;
+        if (!bindings_.allocated[i]) {
+            total_weight += cdev_weight;
         }
-        total_weight += cdev_weight;
     }
 
     while (!is_budget_allocated) {
-        for (const auto &binded_cdev_info_pair :
-             sensor_info.throttling_info->binded_cdev_info_map) {
+        for (size_t i = binding_begin; i < binding_end; ++i) {
+            const auto &cdev_name = *bindings_.cdev_name[i];
+            const auto &binded_cdev_info = *bindings_.binded_cdev_info[i];
             float cdev_power_adjustment = 0;
-            const auto cdev_weight =
-                    binded_cdev_info_pair.second
-                            .cdev_weight_for_pid[static_cast<size_t>(curr_severity)];
+            const auto cdev_weight = cdev_weights[i];
 
-            if (allocated_cdev.count(binded_cdev_info_pair.first)) {
-                continue;
-            }
-            if (std::isnan(cdev_weight) || !cdev_weight) {
-                allocated_cdev.insert(binded_cdev_info_pair.first);
+            if (bindings_.allocated[i]) {
                 continue;
             }
 
             // Get the power data
             if (!power_data_invalid) {
-                if (!binded_cdev_info_pair.second.power_rail.empty()) {
+                if (!binded_cdev_info.power_rail.empty()) {
+                    const auto *power_status = bindings_.power_status[i];
                     last_updated_avg_power =
-                            power_status_map.at(binded_cdev_info_pair.second.power_rail)
-                                    .last_updated_avg_power;
+                            power_status != nullptr ? power_status->last_updated_avg_power : NAN;
                     if (std::isnan(last_updated_avg_power)) {
                         LOG(VERBOSE) << "power data is under collecting";
                         power_data_invalid = true;
                         break;
                     }
 
-                    ATRACE_INT((temp.name + std::string("-") +
-                                binded_cdev_info_pair.second.power_rail + std::string("-avg_power"))
+                    ATRACE_INT((sensor_name + std::string("-") + binded_cdev_info.power_rail +
+                                std::string("-avg_power"))
                                        .c_str(),
                                static_cast<int>(last_updated_avg_power));
                 } else {
                     power_data_invalid = true;
                     break;
                 }
-                if (binded_cdev_info_pair.second.throttling_with_power_link) {
+                if (binded_cdev_info.throttling_with_power_link) {
                     return false;
                 }
             }
@@ -373,40 +496,35 @@ bool ThermalThrottling::allocatePowerToCdev(
 
             if (low_power_device_check) {
                 // Share the budget for the CDEV which power is lower than target
-                if (cdev_power_adjustment > 0 &&
-                    thermal_throttling_status_map_[temp.name].pid_cdev_request_map.at(
-                            binded_cdev_info_pair.first) == 0) {
+                if (cdev_power_adjustment > 0 && bindings_.pid_cdev_request[i] == 0) {
                     allocated_power += last_updated_avg_power;
                     allocated_weight += cdev_weight;
-                    allocated_cdev.insert(binded_cdev_info_pair.first);
-                    if (!binded_cdev_info_pair.second.power_rail.empty()) {
+                    bindings_.allocated[i] = true;
+                    if (!binded_cdev_info.power_rail.empty()) {
                         log_buf.append(StringPrintf("(%s: %0.2f mW)",
-                                                    binded_cdev_info_pair.second.power_rail.c_str(),
+                                                    binded_cdev_info.power_rail.c_str(),
                                                     last_updated_avg_power));
                     }
-                    LOG(VERBOSE) << temp.name << " binded " << binded_cdev_info_pair.first
+                    LOG(VERBOSE) << sensor_name << " binded " << cdev_name
                                  << " has been already at min state 0";
                 }
             } else {
-                const CdevInfo &cdev_info = cooling_device_info_map.at(binded_cdev_info_pair.first);
-                if (!binded_cdev_info_pair.second.power_rail.empty()) {
+                const CdevInfo &cdev_info = *bindings_.cdev_info[i];
+                if (!binded_cdev_info.power_rail.empty()) {
                     log_buf.append(StringPrintf("(%s: %0.2f mW)",
-                                                binded_cdev_info_pair.second.power_rail.c_str(),
+                                                binded_cdev_info.power_rail.c_str(),
                                                 last_updated_avg_power));
                 }
                 // Ignore the power distribution if the CDEV has no space to reduce power
                 if ((cdev_power_adjustment < 0 &&
-                     thermal_throttling_status_map_[temp.name].pid_cdev_request_map.at(
-                             binded_cdev_info_pair.first) == cdev_info.max_state)) {
-                    LOG(VERBOSE) << temp.name << " binded " << binded_cdev_info_pair.first
+                     bindings_.pid_cdev_request[i] == cdev_info.max_state)) {
+                    LOG(VERBOSE) << sensor_name << " binded " << cdev_name
                                  << " has been already at max state " << cdev_info.max_state;
                     continue;
                 }
 
-                if (!power_data_invalid && binded_cdev_info_pair.second.power_rail != "") {
-                    auto cdev_curr_power_budget =
-                            thermal_throttling_status_map_[temp.name].pid_power_budget_map.at(
-                                    binded_cdev_info_pair.first);
+                if (!power_data_invalid && binded_cdev_info.power_rail != "") {
+                    auto cdev_curr_power_budget = bindings_.pid_power_budget[i];
 
                     if (last_updated_avg_power > cdev_curr_power_budget) {
                         cdev_power_budget = cdev_curr_power_budget +=
@@ -427,47 +545,40 @@ bool ThermalThrottling::allocatePowerToCdev(
                 }
 
                 int max_cdev_vote;
-                if (!getCdevMaxRequest(binded_cdev_info_pair.first, &max_cdev_vote)) {
-                    return false;
+                {
+                    std::shared_lock<std::shared_mutex> _cdev_lock(cdev_all_request_map_mutex_);
+                    max_cdev_vote = *cdev_all_request_[bindings_.cdev_index[i]].begin();
                 }
 
-                const auto curr_cdev_vote =
-                        thermal_throttling_status_map_[temp.name].pid_cdev_request_map.at(
-                                binded_cdev_info_pair.first);
+                const auto curr_cdev_vote = bindings_.pid_cdev_request[i];
 
-                if (binded_cdev_info_pair.second.max_release_step !=
-                            std::numeric_limits<int>::max() &&
+                if (binded_cdev_info.max_release_step != std::numeric_limits<int>::max() &&
                     (power_data_invalid || cdev_power_adjustment > 0)) {
                     if (!power_data_invalid && curr_cdev_vote < max_cdev_vote) {
                         cdev_power_budget = cdev_info.state2power[curr_cdev_vote];
-                        LOG(VERBOSE) << temp.name << "'s " << binded_cdev_info_pair.first
+                        LOG(VERBOSE) << sensor_name << "'s " << cdev_name
                                      << " vote: " << curr_cdev_vote
                                      << " is lower than max cdev vote: " << max_cdev_vote;
                     } else {
-                        const auto target_state = std::max(
-                                curr_cdev_vote - binded_cdev_info_pair.second.max_release_step, 0);
+                        const auto target_state =
+                                std::max(curr_cdev_vote - binded_cdev_info.max_release_step, 0);
                         cdev_power_budget =
                                 std::min(cdev_power_budget, cdev_info.state2power[target_state]);
                     }
                 }
 
-                if (binded_cdev_info_pair.second.max_throttle_step !=
-                            std::numeric_limits<int>::max() &&
+                if (binded_cdev_info.max_throttle_step != std::numeric_limits<int>::max() &&
                     (power_data_invalid || cdev_power_adjustment < 0)) {
-                    const auto target_state = std::min(
-                            curr_cdev_vote + binded_cdev_info_pair.second.max_throttle_step,
-                            cdev_info.max_state);
+                    const auto target_state =
+                            std::min(curr_cdev_vote + binded_cdev_info.max_throttle_step,
+                                     cdev_info.max_state);
                     cdev_power_budget =
                             std::max(cdev_power_budget, cdev_info.state2power[target_state]);
                 }
 
-                thermal_throttling_status_map_[temp.name].pid_power_budget_map.at(
-                        binded_cdev_info_pair.first) = cdev_power_budget;
-                LOG(VERBOSE) << temp.name << " allocate "
-                             << thermal_throttling_status_map_[temp.name].pid_power_budget_map.at(
-                                        binded_cdev_info_pair.first)
-                             << "mW to " << binded_cdev_info_pair.first
-                             << "(cdev_weight=" << cdev_weight << ")";
+                bindings_.pid_power_budget[i] = cdev_power_budget;
+                LOG(VERBOSE) << sensor_name << " allocate " << bindings_.pid_power_budget[i]
+                             << "mW to " << cdev_name << "(cdev_weight=" << cdev_weight << ")";
             }
         }
 
@@ -485,105 +596,94 @@ bool ThermalThrottling::allocatePowerToCdev(
         }
     }
     if (log_buf.size()) {
-        LOG(INFO) << temp.name << " binded power rails: " << log_buf;
+        LOG(INFO) << sensor_name << " binded power rails: " << log_buf;
     }
     return true;
 }
 
-void ThermalThrottling::updateCdevRequestByPower(
-        std::string sensor_name,
-        const std::unordered_map<std::string, CdevInfo> &cooling_device_info_map) {
-    size_t i;
+void ThermalThrottling::updateCdevRequestByPower(size_t throttling_index) {
+    size_t state;
 
-    std::unique_lock<std::shared_mutex> _lock(thermal_throttling_status_map_mutex_);
-    for (auto &pid_power_budget_pair :
-         thermal_throttling_status_map_[sensor_name.data()].pid_power_budget_map) {
-        const CdevInfo &cdev_info = cooling_device_info_map.at(pid_power_budget_pair.first);
+    std::unique_lock<std::shared_mutex> _lock(thermal_throttling_status_mutex_);
+    for (size_t i = sensors_.binding_begin[throttling_index];
+         i < sensors_.binding_end[throttling_index]; ++i) {
+        if (!(bindings_.flags[i] & kThrottlingPid)) {
+            continue;
+        }
+        const auto &state2power = bindings_.cdev_info[i]->state2power;
 
-        for (i = 0; i < cdev_info.state2power.size() - 1; ++i) {
-            if (pid_power_budget_pair.second >= cdev_info.state2power[i]) {
+        for (state = 0; state < state2power.size() - 1; ++state) {
+            if (bindings_.pid_power_budget[i] >= state2power[state]) {
                 break;
             }
         }
-        thermal_throttling_status_map_[sensor_name.data()].pid_cdev_request_map.at(
-                pid_power_budget_pair.first) = static_cast<int>(i);
+        bindings_.pid_cdev_request[i] = static_cast<int>(state);
     }
 
     return;
 }
 
-void ThermalThrottling::updateCdevRequestBySeverity(std::string_view sensor_name,
-                                                    const SensorInfo &sensor_info,
+void ThermalThrottling::updateCdevRequestBySeverity(size_t throttling_index,
                                                     ThrottlingSeverity curr_severity) {
-    std::unique_lock<std::shared_mutex> _lock(thermal_throttling_status_map_mutex_);
-    for (auto const &binded_cdev_info_pair : sensor_info.throttling_info->binded_cdev_info_map) {
-        thermal_throttling_status_map_[sensor_name.data()].hardlimit_cdev_request_map.at(
-                binded_cdev_info_pair.first) =
-                binded_cdev_info_pair.second.limit_info[static_cast<size_t>(curr_severity)];
-        LOG(VERBOSE) << "Hard Limit: Sensor " << sensor_name.data() << " update cdev "
-                     << binded_cdev_info_pair.first << " to "
-                     << thermal_throttling_status_map_[sensor_name.data()]
-                                .hardlimit_cdev_request_map.at(binded_cdev_info_pair.first);
+    std::unique_lock<std::shared_mutex> _lock(thermal_throttling_status_mutex_);
+    for (size_t i = sensors_.binding_begin[throttling_index];
+         i < sensors_.binding_end[throttling_index]; ++i) {
+        if (!(bindings_.flags[i] & kThrottlingHardLimit)) {
+            continue;
+        }
+        bindings_.hardlimit_cdev_request[i] =
+                bindings_.binded_cdev_info[i]->limit_info[static_cast<size_t>(curr_severity)];
+        LOG(VERBOSE) << "Hard Limit: Sensor " << sensors_.name[throttling_index]
+                     << " update cdev " << *bindings_.cdev_name[i] << " to "
+                     << bindings_.hardlimit_cdev_request[i];
     }
 }
 
-bool ThermalThrottling::throttlingReleaseUpdate(
-        std::string_view sensor_name,
-        const std::unordered_map<std::string, CdevInfo> &cooling_device_info_map,
-        const std::unordered_map<std::string, PowerStatus> &power_status_map,
-        const ThrottlingSeverity severity, const SensorInfo &sensor_info) {
+bool ThermalThrottling::throttlingReleaseUpdate(size_t throttling_index,
+                                                const ThrottlingSeverity severity) {
     ATRACE_CALL();
-    std::unique_lock<std::shared_mutex> _lock(thermal_throttling_status_map_mutex_);
-    if (!thermal_throttling_status_map_.count(sensor_name.data())) {
-        return false;
-    }
-    auto &thermal_throttling_status = thermal_throttling_status_map_.at(sensor_name.data());
-    for (const auto &binded_cdev_info_pair : sensor_info.throttling_info->binded_cdev_info_map) {
+    std::unique_lock<std::shared_mutex> _lock(thermal_throttling_status_mutex_);
+    const std::string &sensor_name = sensors_.name[throttling_index];
+    for (size_t i = sensors_.binding_begin[throttling_index];
+         i < sensors_.binding_end[throttling_index]; ++i) {
+        const auto &binded_cdev_info = *bindings_.binded_cdev_info[i];
         float avg_power = -1;
 
-        if (!thermal_throttling_status.throttling_release_map.count(binded_cdev_info_pair.first) ||
-            !power_status_map.count(binded_cdev_info_pair.second.power_rail)) {
+        if (!(bindings_.flags[i] & kThrottlingRelease) || bindings_.power_status[i] == nullptr) {
             return false;
         }
 
-        const auto max_state = cooling_device_info_map.at(binded_cdev_info_pair.first).max_state;
+        const auto max_state = bindings_.cdev_info[i]->max_state;
 
-        auto &release_step =
-                thermal_throttling_status.throttling_release_map.at(binded_cdev_info_pair.first);
-        avg_power =
-                power_status_map.at(binded_cdev_info_pair.second.power_rail).last_updated_avg_power;
+        auto &release_step = bindings_.throttling_release[i];
+        avg_power = bindings_.power_status[i]->last_updated_avg_power;
 
         if (std::isnan(avg_power) || avg_power < 0) {
-            release_step = binded_cdev_info_pair.second.throttling_with_power_link ? max_state : 0;
+            release_step = binded_cdev_info.throttling_with_power_link ? max_state : 0;
             continue;
         }
 
         bool is_over_budget = true;
-        if (!binded_cdev_info_pair.second.high_power_check) {
-            if (avg_power <
-                binded_cdev_info_pair.second.power_thresholds[static_cast<int>(severity)]) {
+        if (!binded_cdev_info.high_power_check) {
+            if (avg_power < binded_cdev_info.power_thresholds[static_cast<int>(severity)]) {
                 is_over_budget = false;
             }
         } else {
-            if (avg_power >
-                binded_cdev_info_pair.second.power_thresholds[static_cast<int>(severity)]) {
+            if (avg_power > binded_cdev_info.power_thresholds[static_cast<int>(severity)]) {
                 is_over_budget = false;
             }
         }
-        LOG(INFO) << sensor_name.data() << "'s " << binded_cdev_info_pair.first
-                  << " binded power rail " << binded_cdev_info_pair.second.power_rail
-                  << ": power threshold = "
-                  << binded_cdev_info_pair.second.power_thresholds[static_cast<int>(severity)]
+        LOG(INFO) << sensor_name << "'s " << *bindings_.cdev_name[i] << " binded power rail "
+                  << binded_cdev_info.power_rail << ": power threshold = "
+                  << binded_cdev_info.power_thresholds[static_cast<int>(severity)]
                   << ", avg power = " << avg_power;
         std::string atrace_prefix = ::android::base::StringPrintf(
-                "%s-%s", sensor_name.data(), binded_cdev_info_pair.second.power_rail.data());
-        ATRACE_INT(
-                (atrace_prefix + std::string("-power_threshold")).c_str(),
-                static_cast<int>(
-                        binded_cdev_info_pair.second.power_thresholds[static_cast<int>(severity)]));
+                "%s-%s", sensor_name.data(), binded_cdev_info.power_rail.data());
+        ATRACE_INT((atrace_prefix + std::string("-power_threshold")).c_str(),
+                   static_cast<int>(binded_cdev_info.power_thresholds[static_cast<int>(severity)]));
         ATRACE_INT((atrace_prefix + std::string("-avg_power")).c_str(), avg_power);
 
-        switch (binded_cdev_info_pair.second.release_logic) {
+        switch (binded_cdev_info.release_logic) {
             case ReleaseLogic::INCREASE:
                 if (!is_over_budget) {
                     if (std::abs(release_step) < static_cast<int>(max_state)) {
@@ -624,77 +724,67 @@ bool ThermalThrottling::throttlingReleaseUpdate(
     return true;
 }
 
-void ThermalThrottling::thermalThrottlingUpdate(
-        const Temperature &temp, const SensorInfo &sensor_info,
-        const ThrottlingSeverity curr_severity, const std::chrono::milliseconds time_elapsed_ms,
-        const std::unordered_map<std::string, PowerStatus> &power_status_map,
-        const std::unordered_map<std::string, CdevInfo> &cooling_device_info_map) {
-    if (!thermal_throttling_status_map_.count(temp.name)) {
-        return;
-    }
+void ThermalThrottling::thermalThrottlingUpdate(const ThrottlingStep &step) {
+    const size_t sensor = step.throttling_index;
+    const auto flags = sensors_.flags[sensor];
 
-    if (thermal_throttling_status_map_[temp.name].pid_power_budget_map.size()) {
-        if (!allocatePowerToCdev(temp, sensor_info, curr_severity, time_elapsed_ms,
-                                 power_status_map, cooling_device_info_map)) {
-            LOG(ERROR) << "Sensor " << temp.name << " PID request cdev failed";
+    if (flags & kThrottlingPid) {
+        if (!allocatePowerToCdev(step)) {
+            LOG(ERROR) << "Sensor " << step.temp->name << " PID request cdev failed";
             // Clear the CDEV request if the power budget is failed to be allocated
-            for (auto &pid_cdev_request_pair :
-                 thermal_throttling_status_map_[temp.name].pid_cdev_request_map) {
-                pid_cdev_request_pair.second = 0;
+            for (size_t i = sensors_.binding_begin[sensor]; i < sensors_.binding_end[sensor];
+                 ++i) {
+                bindings_.pid_cdev_request[i] = 0;
             }
         }
-        updateCdevRequestByPower(temp.name, cooling_device_info_map);
+        updateCdevRequestByPower(sensor);
     }
 
-    if (thermal_throttling_status_map_[temp.name].hardlimit_cdev_request_map.size()) {
-        updateCdevRequestBySeverity(temp.name.c_str(), sensor_info, curr_severity);
+    if (flags & kThrottlingHardLimit) {
+        updateCdevRequestBySeverity(sensor, step.severity);
     }
 
-    if (thermal_throttling_status_map_[temp.name].throttling_release_map.size()) {
-        throttlingReleaseUpdate(temp.name.c_str(), cooling_device_info_map, power_status_map,
-                                curr_severity, sensor_info);
+    if (flags & kThrottlingRelease) {
+        throttlingReleaseUpdate(sensor, step.severity);
     }
 }
 
 void ThermalThrottling::computeCoolingDevicesRequest(
-        std::string_view sensor_name, const SensorInfo &sensor_info,
-        const ThrottlingSeverity curr_severity, std::vector<std::string> *cooling_devices_to_update,
+        size_t throttling_index, const ThrottlingSeverity curr_severity,
+        std::vector<std::string> *cooling_devices_to_update,
         ThermalStatsHelper *thermal_stats_helper) {
     int release_step = 0;
-    std::unique_lock<std::shared_mutex> _lock(thermal_throttling_status_map_mutex_);
-
-    if (!thermal_throttling_status_map_.count(sensor_name.data())) {
-        return;
-    }
+    std::unique_lock<std::shared_mutex> _lock(thermal_throttling_status_mutex_);
+    const std::string &sensor_name = sensors_.name[throttling_index];
 
-    auto &thermal_throttling_status = thermal_throttling_status_map_.at(sensor_name.data());
-    const auto &cdev_release_map = thermal_throttling_status.throttling_release_map;
-
-    for (auto &cdev_request_pair : thermal_throttling_status.cdev_status_map) {
+    for (size_t i = sensors_.binding_begin[throttling_index];
+         i < sensors_.binding_end[throttling_index]; ++i) {
+        const auto flags = bindings_.flags[i];
+        if (!(flags & (kThrottlingPid | kThrottlingHardLimit))) {
+            continue;
+        }
         int pid_cdev_request = 0;
         int hardlimit_cdev_request = 0;
-        const auto &cdev_name = cdev_request_pair.first;
-        const auto &binded_cdev_info =
-                sensor_info.throttling_info->binded_cdev_info_map.at(cdev_name);
+        const auto &cdev_name = *bindings_.cdev_name[i];
+        const auto &binded_cdev_info = *bindings_.binded_cdev_info[i];
         const auto cdev_ceiling = binded_cdev_info.cdev_ceiling[static_cast<size_t>(curr_severity)];
         const auto cdev_floor =
                 binded_cdev_info.cdev_floor_with_power_link[static_cast<size_t>(curr_severity)];
         release_step = 0;
 
-        if (thermal_throttling_status.pid_cdev_request_map.count(cdev_name)) {
-            pid_cdev_request = thermal_throttling_status.pid_cdev_request_map.at(cdev_name);
+        if (flags & kThrottlingPid) {
+            pid_cdev_request = bindings_.pid_cdev_request[i];
         }
 
-        if (thermal_throttling_status.hardlimit_cdev_request_map.count(cdev_name)) {
-            hardlimit_cdev_request =
-                    thermal_throttling_status.hardlimit_cdev_request_map.at(cdev_name);
+        if (flags & kThrottlingHardLimit) {
+            hardlimit_cdev_request = bindings_.hardlimit_cdev_request[i];
         }
 
-        if (cdev_release_map.count(cdev_name)) {
-            release_step = cdev_release_map.at(cdev_name);
+        if (flags & kThrottlingRelease) {
+            release_step = bindings_.throttling_release[i];
         }
 
-        LOG(VERBOSE) << sensor_name.data() << " binded cooling device " << cdev_name
+        LOG(VERBOSE) << sensor_name << " binded cooling device " << cdev_name
                      << "'s pid_request=" << pid_cdev_request
                      << " hardlimit_cdev_request=" << hardlimit_cdev_request
                      << " release_step=" << release_step
@@ -720,30 +810,30 @@ void ThermalThrottling::computeCoolingDevicesRequest(
             request_state = std::max(request_state, cdev_floor);
         }
         request_state = std::min(request_state, cdev_ceiling);
-        if (cdev_request_pair.second != request_state) {
-            if (updateCdevMaxRequestAndNotifyIfChange(cdev_name, cdev_request_pair.second,
-                                                      request_state)) {
+        auto &cdev_status = bindings_.cdev_status[i];
+        if (cdev_status != request_state) {
+            if (updateCdevMaxRequestAndNotifyIfChange(i, cdev_status, request_state)) {
                 cooling_devices_to_update->emplace_back(cdev_name);
             }
-            cdev_request_pair.second = request_state;
+            cdev_status = request_state;
             // Update sensor cdev request time in state
             thermal_stats_helper->updateSensorCdevRequestStats(sensor_name, cdev_name,
-                                                               cdev_request_pair.second);
+                                                               cdev_status);
         }
     }
 }
 
-bool ThermalThrottling::updateCdevMaxRequestAndNotifyIfChange(std::string_view cdev_name,
+bool ThermalThrottling::updateCdevMaxRequestAndNotifyIfChange(size_t binding_index,
                                                               int cur_request, int new_request) {
     std::unique_lock<std::shared_mutex> _lock(cdev_all_request_map_mutex_);
-    auto &request_set = cdev_all_request_map_.at(cdev_name.data());
+    auto &request_set = cdev_all_request_[bindings_.cdev_index[binding_index]];
     int cur_max_request = (*request_set.begin());
     // Remove old cdev request and add the new one.
     request_set.erase(request_set.find(cur_request));
     request_set.insert(new_request);
     // Check if there is any change in aggregated max cdev request.
     int new_max_request = (*request_set.begin());
-    LOG(VERBOSE) << "For cooling device [" << cdev_name.data()
+    LOG(VERBOSE) << "For cooling device [" << *bindings_.cdev_name[binding_index]
                  << "] cur_max_request is: " << cur_max_request
                  << " new_max_request is: " << new_max_request;
     return new_max_request != cur_max_request;
@@ -751,12 +841,13 @@ bool ThermalThrottling::updateCdevMaxRequestAndNotifyIfChange(std::string_view c
 
 bool ThermalThrottling::getCdevMaxRequest(std::string_view cdev_name, int *max_state) {
     std::shared_lock<std::shared_mutex> _lock(cdev_all_request_map_mutex_);
-    if (!cdev_all_request_map_.count(cdev_name.data())) {
+    const auto cdev_index_itr = cdev_index_map_.find(cdev_name.data());
+    if (cdev_index_itr == cdev_index_map_.end()) {
         LOG(ERROR) << "Cooling device [" << cdev_name.data()
                    << "] not present in cooling device request map";
         return false;
     }
-    *max_state = *cdev_all_request_map_.at(cdev_name.data()).begin();
+    *max_state = *cdev_all_request_[cdev_index_itr->second].begin();
     return true;
 }
 
@@ -18,12 +18,18 @@
 
 #include <aidl/android/hardware/thermal/Temperature.h>
 
+#include <array>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <queue>
 #include <set>
 #include <shared_mutex>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include "power_files.h"
 #include "thermal_info.h"
@@ -35,6 +41,9 @@ namespace hardware {
 namespace thermal {
 namespace implementation {
 
+constexpr size_t kThrottlingNoIndex = std::numeric_limits<size_t>::max();
+
+// The throttling status of a sensor by cooling device name, for dumpsys
 struct ThermalThrottlingStatus {
     std::unordered_map<std::string, int> pid_power_budget_map;
     std::unordered_map<std::string, int> pid_cdev_request_map;
@@ -49,6 +58,16 @@ struct ThermalThrottlingStatus {
     int tran_cycle;
 };
 
+// A throttled sensor to update in this polling cycle
+struct ThrottlingStep {
+    // Index handed out by registerThermalThrottling()
+    size_t throttling_index;
+    const Temperature *temp;
+    const SensorInfo *sensor_info;
+    ThrottlingSeverity severity;
+    std::chrono::milliseconds time_elapsed_ms;
+};
+
 // Return the control temp target of PID algorithm
 size_t getTargetStateOfPID(const SensorInfo &sensor_info, const ThrottlingSeverity curr_severity);
 
@@ -62,29 +81,24 @@ class ThermalThrottling {
     void operator=(const ThermalThrottling &) = delete;
 
     // Clear throttling data
-    void clearThrottlingData(std::string_view sensor_name, const SensorInfo &sensor_info);
+    void clearThrottlingData(size_t throttling_index);
     // Register map for throttling algo
     bool registerThermalThrottling(
             std::string_view sensor_name, const std::shared_ptr<ThrottlingInfo> &throttling_info,
-            const std::unordered_map<std::string, CdevInfo> &cooling_device_info_map);
-    // Register map for throttling release algo
-    bool registerThrottlingReleaseToWatch(std::string_view sensor_name, std::string_view cdev_name,
-                                          const BindedCdevInfo &binded_cdev_info);
+            const std::unordered_map<std::string, CdevInfo> &cooling_device_info_map,
+            const std::unordered_map<std::string, PowerStatus> &power_status_map);
+    // Return the dense index of a registered sensor, or kThrottlingNoIndex
+    size_t getThrottlingIndex(std::string_view sensor_name) const;
     // Get throttling status map
-    const std::unordered_map<std::string, ThermalThrottlingStatus> &GetThermalThrottlingStatusMap()
-            const {
-        std::shared_lock<std::shared_mutex> _lock(thermal_throttling_status_map_mutex_);
-        return thermal_throttling_status_map_;
-    }
+    std::unordered_map<std::string, ThermalThrottlingStatus> GetThermalThrottlingStatusMap() const;
+    // PID algo - compute the total power budget of every throttled sensor in one pass, which
+    // thermalThrottlingUpdate() then allocates to the cooling devices
+    void updatePowerBudgets(const std::vector<ThrottlingStep> &steps);
     // Update thermal throttling request for the specific sensor
-    void thermalThrottlingUpdate(
-            const Temperature &temp, const SensorInfo &sensor_info,
-            const ThrottlingSeverity curr_severity, const std::chrono::milliseconds time_elapsed_ms,
-            const std::unordered_map<std::string, PowerStatus> &power_status_map,
-            const std::unordered_map<std::string, CdevInfo> &cooling_device_info_map);
+    void thermalThrottlingUpdate(const ThrottlingStep &step);
 
     // Compute the throttling target from all the sensors' request
-    void computeCoolingDevicesRequest(std::string_view sensor_name, const SensorInfo &sensor_info,
+    void computeCoolingDevicesRequest(size_t throttling_index,
                                       const ThrottlingSeverity curr_severity,
                                       std::vector<std::string> *cooling_devices_to_update,
                                       ThermalStatsHelper *thermal_stats_helper);
@@ -92,47 +106,104 @@ class ThermalThrottling {
     bool getCdevMaxRequest(std::string_view cdev_name, int *max_state);
 
   private:
-    // PID algo - get the total power budget
-    float updatePowerBudget(const Temperature &temp, const SensorInfo &sensor_info,
-                            std::chrono::milliseconds time_elapsed_ms,
-                            ThrottlingSeverity curr_severity);
+    // Per sensor state, indexed by throttling index. The PID state is kept as plain arrays so
+    // updatePowerBudgets() can update all sensors without any map lookup.
+    struct ThrottlingSensorArrays {
+        std::vector<std::string> name;
+        std::vector<std::shared_ptr<ThrottlingInfo>> throttling_info;
+        std::vector<uint8_t> flags;
+        // Range of the sensor's binded cooling devices in ThrottlingBindingArrays
+        std::vector<size_t> binding_begin;
+        std::vector<size_t> binding_end;
+        // Range of the sensor's excluded power rails in ExcludedPowerArrays
+        std::vector<size_t> excluded_begin;
+        std::vector<size_t> excluded_end;
+        std::vector<float> prev_err;
+        std::vector<float> i_budget;
+        std::vector<size_t> prev_target;
+        std::vector<float> prev_power_budget;
+        std::vector<float> budget_transient;
+        std::vector<int> tran_cycle;
+        // The output of the last updatePowerBudgets()
+        std::vector<float> power_budget;
+    };
+    // Per (sensor, binded cooling device) state, grouped by sensor
+    struct ThrottlingBindingArrays {
+        std::vector<const std::string *> cdev_name;
+        std::vector<const BindedCdevInfo *> binded_cdev_info;
+        std::vector<const CdevInfo *> cdev_info;
+        // nullptr when the binded power rail is not monitored
+        std::vector<const PowerStatus *> power_status;
+        // Index into cdev_all_request_, kThrottlingNoIndex if the binding never requests
+        std::vector<size_t> cdev_index;
+        std::vector<uint8_t> flags;
+        // cdev_weight_for_pid, transposed so the weights of a severity are contiguous
+        std::array<std::vector<float>, kThrottlingSeverityCount> cdev_weight;
+        std::vector<int> pid_power_budget;
+        std::vector<int> pid_cdev_request;
+        std::vector<int> hardlimit_cdev_request;
+        std::vector<int> throttling_release;
+        std::vector<int> cdev_status;
+        // Scratch flags of allocatePowerToCdev()
+        std::vector<uint8_t> allocated;
+    };
+    // Per (sensor, excluded power rail), grouped by sensor
+    struct ExcludedPowerArrays {
+        std::vector<const std::string *> power_rail;
+        std::vector<const PowerStatus *> power_status;
+        std::array<std::vector<float>, kThrottlingSeverityCount> weight;
+    };
+    // Inputs and outputs of the PID loop in updatePowerBudgets(), indexed by PID step
+    struct PidStepArrays {
+        std::vector<size_t> step_index;
+        std::vector<size_t> target_state;
+        std::vector<uint8_t> target_changed;
+        std::vector<float> err;
+        std::vector<float> k_p;
+        std::vector<float> k_i;
+        std::vector<float> k_d;
+        std::vector<float> i_cutoff;
+        std::vector<float> i_max;
+        std::vector<float> s_power;
+        std::vector<float> min_alloc_power;
+        std::vector<float> max_alloc_power;
+        std::vector<float> prev_err;
+        std::vector<float> time_elapsed_ms;
+        std::vector<float> p;
+        std::vector<float> i_budget;
+        std::vector<float> d;
+        std::vector<float> power_budget;
+        void resize(size_t count);
+    };
 
     // PID algo - return the power number from excluded power rail list
-    float computeExcludedPower(const SensorInfo &sensor_info,
-                               const ThrottlingSeverity curr_severity,
-                               const std::unordered_map<std::string, PowerStatus> &power_status_map,
+    float computeExcludedPower(size_t throttling_index, const ThrottlingSeverity curr_severity,
                                std::string *log_buf, std::string_view sensor_name);
 
     // PID algo - allocate the power to target CDEV according to the ODPM
-    bool allocatePowerToCdev(
-            const Temperature &temp, const SensorInfo &sensor_info,
-            const ThrottlingSeverity curr_severity, const std::chrono::milliseconds time_elapsed_ms,
-            const std::unordered_map<std::string, PowerStatus> &power_status_map,
-            const std::unordered_map<std::string, CdevInfo> &cooling_device_info_map);
+    bool allocatePowerToCdev(const ThrottlingStep &step);
     // PID algo - map the target throttling state according to the power budget
-    void updateCdevRequestByPower(
-            std::string sensor_name,
-            const std::unordered_map<std::string, CdevInfo> &cooling_device_info_map);
+    void updateCdevRequestByPower(size_t throttling_index);
     // Hard limit algo - assign the throttling state according to the severity
-    void updateCdevRequestBySeverity(std::string_view sensor_name, const SensorInfo &sensor_info,
-                                     ThrottlingSeverity curr_severity);
+    void updateCdevRequestBySeverity(size_t throttling_index, ThrottlingSeverity curr_severity);
     // Throttling release algo - decide release step according to the predefined power threshold,
     // return false if the throttling release is not registered in thermal config
-    bool throttlingReleaseUpdate(
-            std::string_view sensor_name,
-            const std::unordered_map<std::string, CdevInfo> &cooling_device_info_map,
-            const std::unordered_map<std::string, PowerStatus> &power_status_map,
-            const ThrottlingSeverity severity, const SensorInfo &sensor_info);
+    bool throttlingReleaseUpdate(size_t throttling_index, const ThrottlingSeverity severity);
     // Update the cooling device request set for new request and notify the caller if there is
     // change in max_request for the cooling device.
-    bool updateCdevMaxRequestAndNotifyIfChange(std::string_view cdev_name, int cur_request,
+    bool updateCdevMaxRequestAndNotifyIfChange(size_t binding_index, int cur_request,
                                                int new_request);
-    mutable std::shared_mutex thermal_throttling_status_map_mutex_;
+    mutable std::shared_mutex thermal_throttling_status_mutex_;
     // Thermal throttling status from each sensor
-    std::unordered_map<std::string, ThermalThrottlingStatus> thermal_throttling_status_map_;
+    std::unordered_map<std::string, size_t> throttling_index_map_;
+    ThrottlingSensorArrays sensors_;
+    ThrottlingBindingArrays bindings_;
+    ExcludedPowerArrays excluded_power_;
+    PidStepArrays pid_steps_;
     std::shared_mutex cdev_all_request_map_mutex_;
     // Set of all request for a cooling device from each sensor
-    std::unordered_map<std::string, std::multiset<int, std::greater<int>>> cdev_all_request_map_;
+    std::unordered_map<std::string, size_t> cdev_index_map_;
+    std::vector<std::multiset<int, std::greater<int>>> cdev_all_request_;
 };
 
 }  // namespace implementation
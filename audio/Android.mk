@@ -23,7 +23,12 @@ LOCAL_ARM_MODE := arm
 LOCAL_SRC_FILES := \
 	audience.c \
 	audio_hw.c \
+	audio_stats.c \
 	compress_offload.c \
+	deep_buffer.c \
+	pcm_fanout.c \
+	pcm_kernels.c \
+	polyphase_resampler.c \
 	ril_interface.c \
 	voice.c
 
@@ -54,6 +59,11 @@ LOCAL_C_INCLUDES += \
 LOCAL_CFLAGS := -Werror -Wall
 LOCAL_CFLAGS += -DPREPROCESSING_ENABLED
 
+# Delay in us for the DSPs to power off, see DSP_POWEROFF_DELAY in samsung_audio.h
+ifneq ($(TARGET_AUDIOHAL_DSP_POWEROFF_DELAY),)
+LOCAL_CFLAGS += -DDSP_POWEROFF_DELAY=$(TARGET_AUDIOHAL_DSP_POWEROFF_DELAY)
+endif
+
 LOCAL_MODULE := audio.primary.$(TARGET_BOOTLOADER_BOARD_NAME)
 
 LOCAL_MODULE_RELATIVE_PATH := hw
@@ -64,4 +74,40 @@ LOCAL_VENDOR_MODULE := true
 
 include $(BUILD_SHARED_LIBRARY)
 
+# Checks the vector kernels of pcm_kernels.c against the plain loops
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	pcm_kernels.c \
+	tests/pcm_kernels_test.cpp
+
+LOCAL_C_INCLUDES += $(LOCAL_PATH)
+
+LOCAL_CFLAGS := -Werror -Wall
+
+LOCAL_MODULE := audio.primary.samsung_pcm_kernels_test
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_NATIVE_TEST)
+
+# Throughput of the same kernels, run with --benchmark_filter to pick some
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	pcm_kernels.c \
+	tests/pcm_kernels_benchmark.cpp
+
+LOCAL_C_INCLUDES += $(LOCAL_PATH)
+
+LOCAL_CFLAGS := -Werror -Wall
+
+LOCAL_STATIC_LIBRARIES := libgoogle-benchmark
+
+LOCAL_MODULE := audio.primary.samsung_pcm_kernels_benchmark
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
 endif
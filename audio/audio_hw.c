@@ -30,6 +30,8 @@
 #include <errno.h>
 #include <pthread.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <sys/prctl.h>
 #include <sys/time.h>
 #include <stdlib.h>
 #include <math.h>
@@ -48,13 +50,22 @@
 #include <audio_effects/effect_aec.h>
 #include <audio_effects/effect_ns.h>
 #include "audio_hw.h"
+#include "audio_stats.h"
 #include "compress_offload.h"
+#include "deep_buffer.h"
+#include "pcm_fanout.h"
+#include "pcm_kernels.h"
+#include "polyphase_resampler.h"
 #include "voice.h"
 
 #include "sound/compress_params.h"
 
 
 /* TODO: the following PCM device profiles could be read from a config file */
+#ifdef CAPTURE_SUPPORTED_SAMPLING_RATES
+static const unsigned int capture_rates[] = { CAPTURE_SUPPORTED_SAMPLING_RATES, 0 };
+#endif
+
 static struct pcm_device_profile pcm_device_playback = {
     .config = {
         .channels = PLAYBACK_DEFAULT_CHANNEL_COUNT,
@@ -109,6 +120,9 @@ static struct pcm_device_profile pcm_device_capture = {
     .id = SOUND_CAPTURE_DEVICE,
     .type = PCM_CAPTURE,
     .devices = AUDIO_DEVICE_IN_BUILTIN_MIC|AUDIO_DEVICE_IN_WIRED_HEADSET|AUDIO_DEVICE_IN_BACK_MIC|AUDIO_DEVICE_IN_BLUETOOTH_SCO_HEADSET,
+#ifdef CAPTURE_SUPPORTED_SAMPLING_RATES
+    .rates = capture_rates,
+#endif
 };
 
 static struct pcm_device_profile pcm_device_capture_low_latency = {
@@ -127,12 +141,64 @@ static struct pcm_device_profile pcm_device_capture_low_latency = {
     .id = SOUND_CAPTURE_DEVICE,
     .type = PCM_CAPTURE_LOW_LATENCY,
     .devices = AUDIO_DEVICE_IN_BUILTIN_MIC|AUDIO_DEVICE_IN_WIRED_HEADSET|AUDIO_DEVICE_IN_BACK_MIC|AUDIO_DEVICE_IN_BLUETOOTH_SCO_HEADSET,
+#ifdef CAPTURE_SUPPORTED_SAMPLING_RATES
+    .rates = capture_rates,
+#endif
+};
+
+#ifdef SOUND_MMAP_PLAYBACK_DEVICE
+static struct pcm_device_profile pcm_device_playback_mmap = {
+    .config = {
+        .channels = PLAYBACK_DEFAULT_CHANNEL_COUNT,
+        .rate = PLAYBACK_DEFAULT_SAMPLING_RATE,
+        .period_size = MMAP_PERIOD_SIZE,
+        .period_count = MMAP_PERIOD_COUNT_DEFAULT,
+        .format = PCM_FORMAT_S16_LE,
+        .start_threshold = MMAP_PERIOD_SIZE * 8,
+        .stop_threshold = INT32_MAX,
+        .silence_threshold = 0,
+        .silence_size = 0,
+        .avail_min = MMAP_PERIOD_SIZE,
+    },
+    .card = SOUND_CARD,
+    .id = SOUND_MMAP_PLAYBACK_DEVICE,
+    .type = PCM_PLAYBACK_MMAP,
+    .devices = AUDIO_DEVICE_OUT_WIRED_HEADSET|AUDIO_DEVICE_OUT_WIRED_HEADPHONE|
+               AUDIO_DEVICE_OUT_SPEAKER|AUDIO_DEVICE_OUT_EARPIECE,
+};
+#endif
+
+#ifdef SOUND_MMAP_CAPTURE_DEVICE
+static struct pcm_device_profile pcm_device_capture_mmap = {
+    .config = {
+        .channels = CAPTURE_DEFAULT_CHANNEL_COUNT,
+        .rate = CAPTURE_DEFAULT_SAMPLING_RATE,
+        .period_size = MMAP_PERIOD_SIZE,
+        .period_count = MMAP_PERIOD_COUNT_DEFAULT,
+        .format = PCM_FORMAT_S16_LE,
+        .start_threshold = 0,
+        .stop_threshold = INT32_MAX,
+        .silence_threshold = 0,
+        .silence_size = 0,
+        .avail_min = MMAP_PERIOD_SIZE,
+    },
+    .card = SOUND_CARD,
+    .id = SOUND_MMAP_CAPTURE_DEVICE,
+    .type = PCM_CAPTURE_MMAP,
+    .devices = AUDIO_DEVICE_IN_BUILTIN_MIC|AUDIO_DEVICE_IN_WIRED_HEADSET|AUDIO_DEVICE_IN_BACK_MIC,
 };
+#endif
 
 static struct pcm_device_profile * const pcm_devices[] = {
     &pcm_device_playback,
     &pcm_device_capture,
     &pcm_device_capture_low_latency,
+#ifdef SOUND_MMAP_PLAYBACK_DEVICE
+    &pcm_device_playback_mmap,
+#endif
+#ifdef SOUND_MMAP_CAPTURE_DEVICE
+    &pcm_device_capture_mmap,
+#endif
     NULL,
 };
 
@@ -141,7 +207,9 @@ static const char * const use_case_table[AUDIO_USECASE_MAX] = {
     [USECASE_AUDIO_PLAYBACK_MULTI_CH] = "playback multi-channel",
     [USECASE_AUDIO_PLAYBACK_OFFLOAD] = "compress-offload-playback",
     [USECASE_AUDIO_PLAYBACK_DEEP_BUFFER] = "playback deep-buffer",
+    [USECASE_AUDIO_PLAYBACK_MMAP] = "mmap-playback",
     [USECASE_AUDIO_CAPTURE] = "capture",
+    [USECASE_AUDIO_CAPTURE_MMAP] = "mmap-capture",
     [USECASE_VOICE_CALL] = "voice-call",
 };
 
@@ -215,6 +283,19 @@ static int amplifier_set_output_devices(uint32_t devices)
     return 0;
 }
 
+static bool amplifier_has_enable_devices(uint32_t devices)
+{
+    amplifier_device_t *amp = get_amplifier_device();
+    bool is_output = devices > SND_DEVICE_OUT_BEGIN &&
+        devices < SND_DEVICE_OUT_END;
+
+    if (amp == NULL)
+        return false;
+
+    return is_output ? amp->enable_output_devices != NULL :
+                       amp->enable_input_devices != NULL;
+}
+
 static int amplifier_enable_devices(uint32_t devices, bool enable)
 {
     amplifier_device_t *amp = get_amplifier_device();
@@ -316,32 +397,6 @@ struct timespec time_spec_diff(struct timespec time1, struct timespec time0) {
     return ret;
 }
 
-static bool is_supported_format(audio_format_t format)
-{
-    if (format == AUDIO_FORMAT_MP3 ||
-            ((format & AUDIO_FORMAT_MAIN_MASK) == AUDIO_FORMAT_AAC))
-        return true;
-
-    return false;
-}
-
-static int get_snd_codec_id(audio_format_t format)
-{
-    int id = 0;
-
-    switch (format & AUDIO_FORMAT_MAIN_MASK) {
-    case AUDIO_FORMAT_MP3:
-        id = SND_AUDIOCODEC_MP3;
-        break;
-    case AUDIO_FORMAT_AAC:
-        id = SND_AUDIOCODEC_AAC;
-        break;
-    default:
-        ALOGE("%s: Unsupported audio format", __func__);
-    }
-
-    return id;
-}
 
 /* Array to store sound devices */
 static const char * const device_table[SND_DEVICE_MAX] = {
@@ -534,6 +589,20 @@ static struct pcm_device_profile *get_pcm_device(usecase_type_t uc_type, audio_d
     return pcm_devices[i];
 }
 
+static bool pcm_device_supports_rate(const struct pcm_device_profile *pcm_profile,
+                                     unsigned int rate)
+{
+    const unsigned int *r;
+
+    if (rate == pcm_profile->config.rate)
+        return true;
+    for (r = pcm_profile->rates; r != NULL && *r != 0; r++) {
+        if (*r == rate)
+            return true;
+    }
+    return false;
+}
+
 static struct audio_usecase *get_usecase_from_id(struct audio_device *adev,
                                                    audio_usecase_t uc_id)
 {
@@ -834,17 +903,305 @@ static int64_t render_latency(audio_usecase_t usecase)
     return 0;
 }
 
-static int enable_snd_device(struct audio_device *adev,
-                             struct audio_usecase *uc_info,
-                             snd_device_t snd_device)
+/*
+ * Between begin_route_batch() and end_route_batch() mixer paths are only
+ * applied to and reset in the audio_route state. end_route_batch() then
+ * writes the controls whose value really changed, once per card, so a device
+ * switch does not toggle the controls shared by the old and new paths.
+ * Must be called with adev->lock held.
+ */
+static void begin_route_batch(struct audio_device *adev)
+{
+    adev->route_batch++;
+}
+
+/*
+ * Writes what the batch changed so far without ending it, for the steps that
+ * need a path to really be on or off before they run: the rx cycle, the
+ * amplifier, the voice session and the DSP power-off timestamp.
+ */
+static void flush_route_batch(struct audio_device *adev)
 {
     struct mixer_card *mixer_card;
     struct listnode *node;
-    const char *snd_device_name = get_snd_device_name(snd_device);
+
+    list_for_each(node, &adev->mixer_list) {
+        mixer_card = node_to_item(node, struct mixer_card, adev_list_node);
+        if (mixer_card->route_pending) {
+            audio_route_update_mixer(mixer_card->audio_route);
+            mixer_card->route_pending = false;
+        }
+    }
+}
+
+static void end_route_batch(struct audio_device *adev)
+{
+    if (--adev->route_batch > 0)
+        return;
+
+    flush_route_batch(adev);
+}
+
+static void route_apply_path(struct audio_device *adev,
+                             struct mixer_card *mixer_card,
+                             const char *name)
+{
+    if (adev->route_batch > 0) {
+        audio_route_apply_path(mixer_card->audio_route, name);
+        mixer_card->route_pending = true;
+    } else {
+        audio_route_apply_and_update_path(mixer_card->audio_route, name);
+    }
+}
+
+static void route_reset_path(struct audio_device *adev,
+                             struct mixer_card *mixer_card,
+                             const char *name)
+{
+    if (adev->route_batch > 0) {
+        audio_route_reset_path(mixer_card->audio_route, name);
+        mixer_card->route_pending = true;
+    } else {
+        audio_route_reset_and_update_path(mixer_card->audio_route, name);
+    }
+}
+
+/* takes adev->lock, recording how long it was waited for when contended */
+void lock_adev(struct audio_device *adev)
+{
+    int64_t start_ns;
+
+    if (pthread_mutex_trylock(&adev->lock) == 0)
+        return;
+
+    start_ns = audio_stats_now_ns();
+    pthread_mutex_lock(&adev->lock);
+    latency_hist_add(&adev->lock_wait, audio_stats_now_ns() - start_ns);
+}
+
 #ifdef DSP_POWEROFF_DELAY
+/*
+ * Instead of sleeping with adev->lock held until the DSPs of a card are
+ * powered off, enable_snd_device() queues the path and returns. The routing
+ * worker applies it when it is due; only the streams of the usecase wait for
+ * it, in wait_for_deferred_routes(), and without holding adev->lock.
+ */
+static bool timespec_before(const struct timespec *a, const struct timespec *b)
+{
+    return a->tv_sec < b->tv_sec ||
+           (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+static void *route_thread_loop(void *context)
+{
+    struct audio_device *adev = (struct audio_device *) context;
+    struct deferred_route *route;
+    struct timespec now;
+
+    prctl(PR_SET_NAME, (unsigned long)"Audio Routing", 0, 0, 0);
+
+    lock_adev(adev);
+    while (!adev->route_thread_exit) {
+        if (list_empty(&adev->deferred_routes)) {
+            pthread_cond_wait(&adev->route_cond, &adev->lock);
+            continue;
+        }
+
+        route = node_to_item(list_head(&adev->deferred_routes),
+                             struct deferred_route, node);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (timespec_before(&now, &route->due_time)) {
+            pthread_cond_timedwait(&adev->route_cond, &adev->lock, &route->due_time);
+            continue;
+        }
+
+        ALOGV("%s: snd_device(%d: %s)", __func__,
+              route->snd_device, get_snd_device_name(route->snd_device));
+        list_remove(&route->node);
+        amplifier_enable_devices(route->snd_device, true);
+        route_apply_path(adev, route->mixer_card, get_snd_device_name(route->snd_device));
+        free(route);
+        pthread_cond_broadcast(&adev->route_done_cond);
+    }
+    pthread_mutex_unlock(&adev->lock);
+
+    return NULL;
+}
+
+static void create_route_thread(struct audio_device *adev)
+{
+    pthread_condattr_t attr;
+
+    list_init(&adev->deferred_routes);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&adev->route_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_cond_init(&adev->route_done_cond, (const pthread_condattr_t *) NULL);
+
+    adev->route_thread_exit = false;
+    adev->route_thread_running = pthread_create(&adev->route_thread,
+            (const pthread_attr_t *) NULL, route_thread_loop, adev) == 0;
+    if (!adev->route_thread_running)
+        ALOGE("%s: failed to create the routing thread", __func__);
+}
+
+static void destroy_route_thread(struct audio_device *adev)
+{
+    struct deferred_route *route;
+    struct listnode *node;
+    struct listnode *next;
+
+    if (adev->route_thread_running) {
+        lock_adev(adev);
+        adev->route_thread_exit = true;
+        pthread_cond_signal(&adev->route_cond);
+        pthread_mutex_unlock(&adev->lock);
+        pthread_join(adev->route_thread, (void **) NULL);
+        adev->route_thread_running = false;
+    }
+
+    list_for_each_safe(node, next, &adev->deferred_routes) {
+        route = node_to_item(node, struct deferred_route, node);
+        list_remove(node);
+        free(route);
+    }
+    pthread_cond_destroy(&adev->route_done_cond);
+    pthread_cond_destroy(&adev->route_cond);
+}
+
+/* returns true if enabling the path was left to the routing worker */
+static bool defer_route_l(struct audio_device *adev,
+                          struct mixer_card *mixer_card,
+                          snd_device_t snd_device)
+{
+    struct deferred_route *route;
+    struct deferred_route *item;
+    struct listnode *node;
     struct timespec activation_time;
     struct timespec elapsed_time;
+    long elapsed_usec;
+
+    clock_gettime(CLOCK_MONOTONIC, &activation_time);
+
+    elapsed_time = time_spec_diff(activation_time,
+                                  mixer_card->dsp_poweroff_time);
+    if (elapsed_time.tv_sec != 0)
+        return false;
+
+    elapsed_usec = elapsed_time.tv_nsec / 1000;
+    if (elapsed_usec >= DSP_POWEROFF_DELAY)
+        return false;
+
+    route = adev->route_thread_running ?
+            (struct deferred_route *)calloc(1, sizeof(struct deferred_route)) : NULL;
+    if (route == NULL) {
+        usleep(DSP_POWEROFF_DELAY - elapsed_usec);
+        return false;
+    }
+
+    route->mixer_card = mixer_card;
+    route->snd_device = snd_device;
+    route->due_time = mixer_card->dsp_poweroff_time;
+    route->due_time.tv_nsec += DSP_POWEROFF_DELAY * 1000L;
+    while (route->due_time.tv_nsec >= 1000000000L) {
+        route->due_time.tv_nsec -= 1000000000L;
+        route->due_time.tv_sec++;
+    }
+
+    list_for_each(node, &adev->deferred_routes) {
+        item = node_to_item(node, struct deferred_route, node);
+        if (timespec_before(&route->due_time, &item->due_time))
+            break;
+    }
+    /* insert before node, which is the list head when appending */
+    list_add_tail(node, &route->node);
+    pthread_cond_signal(&adev->route_cond);
+
+    ALOGV("%s: snd_device(%d) in %ld us", __func__, snd_device,
+          DSP_POWEROFF_DELAY - elapsed_usec);
+    return true;
+}
+
+/* returns true if a deferred, so never applied, path was dropped */
+static bool cancel_deferred_route_l(struct audio_device *adev,
+                                    struct mixer_card *mixer_card,
+                                    snd_device_t snd_device)
+{
+    struct deferred_route *route;
+    struct listnode *node;
+    struct listnode *next;
+
+    list_for_each_safe(node, next, &adev->deferred_routes) {
+        route = node_to_item(node, struct deferred_route, node);
+        if (route->mixer_card == mixer_card && route->snd_device == snd_device) {
+            list_remove(node);
+            free(route);
+            pthread_cond_broadcast(&adev->route_done_cond);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* returns true if the path of snd_device still waits on a card, any card if mixer_card is NULL */
+static bool is_route_deferred_l(struct audio_device *adev,
+                                struct mixer_card *mixer_card,
+                                snd_device_t snd_device)
+{
+    struct deferred_route *route;
+    struct listnode *node;
+
+    if (snd_device == SND_DEVICE_OUT_SPEAKER_AND_HEADPHONES)
+        return is_route_deferred_l(adev, mixer_card, SND_DEVICE_OUT_SPEAKER) ||
+               is_route_deferred_l(adev, mixer_card, SND_DEVICE_OUT_HEADPHONES);
+
+    list_for_each(node, &adev->deferred_routes) {
+        route = node_to_item(node, struct deferred_route, node);
+        if (route->snd_device == snd_device &&
+                (mixer_card == NULL || route->mixer_card == mixer_card))
+            return true;
+    }
+
+    return false;
+}
+#endif /* DSP_POWEROFF_DELAY */
+
+/*
+ * blocks until the paths of the sound devices of the usecase are applied,
+ * adev->lock must not be held. This goes by sound device and not by usecase:
+ * a usecase joining a device that is already referenced never queues a route
+ * of its own, but must still wait for the one queued by the first user.
+ */
+static void wait_for_deferred_routes(struct audio_device *adev, audio_usecase_t usecase)
+{
+#ifdef DSP_POWEROFF_DELAY
+    struct audio_usecase *uc_info;
+
+    lock_adev(adev);
+    for (;;) {
+        uc_info = get_usecase_from_id(adev, usecase);
+        if (uc_info == NULL ||
+                (!is_route_deferred_l(adev, NULL, uc_info->out_snd_device) &&
+                 !is_route_deferred_l(adev, NULL, uc_info->in_snd_device)))
+            break;
+        pthread_cond_wait(&adev->route_done_cond, &adev->lock);
+    }
+    pthread_mutex_unlock(&adev->lock);
+#else
+    (void)adev;
+    (void)usecase;
 #endif /* DSP_POWEROFF_DELAY */
+}
+
+static int enable_snd_device(struct audio_device *adev,
+                             struct audio_usecase *uc_info,
+                             snd_device_t snd_device)
+{
+    struct mixer_card *mixer_card;
+    struct listnode *node;
+    const char *snd_device_name = get_snd_device_name(snd_device);
 
     if (snd_device_name == NULL)
         return -EINVAL;
@@ -869,22 +1226,13 @@ static int enable_snd_device(struct audio_device *adev,
         mixer_card = node_to_item(node, struct mixer_card, uc_list_node[uc_info->id]);
 
 #ifdef DSP_POWEROFF_DELAY
-        clock_gettime(CLOCK_MONOTONIC, &activation_time);
-
-        elapsed_time = time_spec_diff(activation_time,
-                                      mixer_card->dsp_poweroff_time);
-        if (elapsed_time.tv_sec == 0) {
-            long elapsed_usec = elapsed_time.tv_nsec / 1000;
-
-            if (elapsed_usec < DSP_POWEROFF_DELAY) {
-                usleep(DSP_POWEROFF_DELAY - elapsed_usec);
-            }
-        }
+        if (defer_route_l(adev, mixer_card, snd_device))
+            continue;
 #endif /* DSP_POWEROFF_DELAY */
 
         amplifier_enable_devices(snd_device, true);
 
-        audio_route_apply_and_update_path(mixer_card->audio_route, snd_device_name);
+        route_apply_path(adev, mixer_card, snd_device_name);
     }
 
     return 0;
@@ -920,19 +1268,37 @@ int disable_snd_device(struct audio_device *adev,
               snd_device, snd_device_name);
         list_for_each(node, &uc_info->mixer_list) {
             mixer_card = node_to_item(node, struct mixer_card, uc_list_node[uc_info->id]);
-            audio_route_reset_and_update_path(mixer_card->audio_route, snd_device_name);
+#ifdef DSP_POWEROFF_DELAY
+            if (cancel_deferred_route_l(adev, mixer_card, snd_device))
+                continue;
+#endif /* DSP_POWEROFF_DELAY */
+            route_reset_path(adev, mixer_card, snd_device_name);
             if (snd_device > SND_DEVICE_IN_BEGIN && out_uc_info != NULL) {
                 /*
                  * Cycle the rx device to eliminate routing conflicts.
                  * This prevents issues when an input route shares mixer controls with an output
                  * route.
                  */
+                flush_route_batch(adev);
                 out_snd_device_name = get_snd_device_name(out_uc_info->out_snd_device);
-                audio_route_apply_and_update_path(mixer_card->audio_route, out_snd_device_name);
+#ifdef DSP_POWEROFF_DELAY
+                /* a deferred output path is applied by the routing worker when it is due */
+                if (is_route_deferred_l(adev, mixer_card, out_uc_info->out_snd_device))
+                    out_snd_device_name = NULL;
+#endif /* DSP_POWEROFF_DELAY */
+                if (out_snd_device_name != NULL)
+                    route_apply_path(adev, mixer_card, out_snd_device_name);
+                flush_route_batch(adev);
             }
 
-            amplifier_enable_devices(snd_device, false);
+            if (amplifier_has_enable_devices(snd_device)) {
+                /* the amplifier is turned off after the path, as without a batch */
+                flush_route_batch(adev);
+                amplifier_enable_devices(snd_device, false);
+            }
 #ifdef DSP_POWEROFF_DELAY
+            /* the DSPs only start powering off once the path is written */
+            flush_route_batch(adev);
             clock_gettime(CLOCK_MONOTONIC, &(mixer_card->dsp_poweroff_time));
 #endif /* DSP_POWEROFF_DELAY */
         }
@@ -1010,6 +1376,8 @@ static int select_devices(struct audio_device *adev,
     struct audio_usecase *vc_usecase = NULL;
     struct stream_in *active_input = NULL;
     struct stream_out *active_out;
+    int64_t start_ns;
+    int64_t route_ns;
 
     ALOGV("%s: usecase(%d)", __func__, uc_id);
 
@@ -1080,6 +1448,9 @@ static int select_devices(struct audio_device *adev,
           out_snd_device, get_snd_device_display_name(out_snd_device),
           in_snd_device,  get_snd_device_display_name(in_snd_device));
 
+    start_ns = audio_stats_now_ns();
+
+    begin_route_batch(adev);
 
     /* Disable current sound devices */
     if (usecase->out_snd_device != SND_DEVICE_NONE) {
@@ -1094,6 +1465,8 @@ static int select_devices(struct audio_device *adev,
     if (out_snd_device != SND_DEVICE_NONE) {
         /* We need to update the audio path if we switch the out devices */
         if (adev->voice.in_call) {
+            /* the voice session expects the old devices to be off already */
+            flush_route_batch(adev);
             set_voice_session_audio_path(adev->voice.session);
         }
 
@@ -1109,10 +1482,18 @@ static int select_devices(struct audio_device *adev,
     usecase->in_snd_device = in_snd_device;
     usecase->out_snd_device = out_snd_device;
 
+    end_route_batch(adev);
+
     /* Rely on amplifier_set_devices to distinguish between in/out devices */
     amplifier_set_input_devices(in_snd_device);
     amplifier_set_output_devices(out_snd_device);
 
+    route_ns = audio_stats_now_ns() - start_ns;
+    if (out_snd_device != SND_DEVICE_NONE)
+        latency_hist_add(&adev->route_latency[out_snd_device], route_ns);
+    if (in_snd_device != SND_DEVICE_NONE)
+        latency_hist_add(&adev->route_latency[in_snd_device], route_ns);
+
     return 0;
 }
 
@@ -1158,6 +1539,10 @@ static void get_capture_delay(struct stream_in *in,
     rsmp_delay = 0;
     if (in->resampler) {
         rsmp_delay = in->resampler->delay_ns(in->resampler);
+    } else if (in->poly_resampler) {
+        rsmp_delay = polyphase_resampler_delay_ns(in->poly_resampler) +
+                (long)(((int64_t)(in->rsmp_buf_frames - in->rsmp_buf_pos) * 1000000000) /
+                       in->requested_rate);
     }
 
     kernel_delay = (long)(((int64_t)kernel_frames * 1000000000) / in->config.rate);
@@ -1690,11 +2075,11 @@ static ssize_t read_and_process_frames(struct stream_in *in, void* buffer, ssize
     ssize_t frames_wr = 0;
     size_t src_channels = in->config.channels;
     size_t dst_channels = audio_channel_count_from_in_mask(in->main_channels);
-    int i;
     void *proc_buf_out;
     struct pcm_device *pcm_device;
     bool has_additional_channels = (dst_channels != src_channels) ? true : false;
 #ifdef PREPROCESSING_ENABLED
+    int i;
     audio_buffer_t in_buf;
     audio_buffer_t out_buf;
     bool has_processing = (in->num_preprocessors != 0) ? true : false;
@@ -1822,28 +2207,12 @@ static ssize_t read_and_process_frames(struct stream_in *in, void* buffer, ssize
      * - aux_channels
      * - extra channels from HW due to HW limitations
      * Assumption is made that the channels are interleaved and that the main
-     * channels are first. */
+     * channels are first.
+     * Nothing to copy when muted, in_read() zeroes the client buffer anyway. */
 
-    if (has_additional_channels)
-    {
-        int16_t* src_buffer = (int16_t *)proc_buf_out;
-        int16_t* dst_buffer = (int16_t *)buffer;
-
-        if (dst_channels == 1) {
-            for (i = frames_wr; i > 0; i--)
-            {
-                *dst_buffer++ = *src_buffer;
-                src_buffer += src_channels;
-            }
-        } else {
-            for (i = frames_wr; i > 0; i--)
-            {
-                memcpy(dst_buffer, src_buffer, dst_channels*sizeof(int16_t));
-                dst_buffer += dst_channels;
-                src_buffer += src_channels;
-            }
-        }
-    }
+    if (has_additional_channels && frames_wr > 0 && !in->dev->mic_mute)
+        extract_channels_i16((int16_t *)buffer, (int16_t *)proc_buf_out, frames_wr,
+                             src_channels, dst_channels);
 
     return frames_wr;
 }
@@ -1912,6 +2281,33 @@ static void release_buffer(struct resampler_buffer_provider *buffer_provider,
     in->read_buf_frames -= buffer->frame_count;
 }
 
+/* hands out the frames resampled by the polyphase resampler, a period at a time */
+static size_t resample_polyphase(struct stream_in *in, int16_t *buffer, size_t frames)
+{
+    if (in->rsmp_buf_pos == in->rsmp_buf_frames) {
+        struct resampler_buffer buf = {
+                .raw = NULL,
+                .frame_count = in->config.period_size,
+        };
+
+        get_next_buffer(&in->buf_provider, &buf);
+        if (buf.raw == NULL)
+            return 0;
+        in->rsmp_buf_frames = polyphase_resampler_process(in->poly_resampler, buf.i16,
+                                                          buf.frame_count, in->rsmp_buf);
+        in->rsmp_buf_pos = 0;
+        release_buffer(&in->buf_provider, &buf);
+    }
+
+    if (frames > in->rsmp_buf_frames - in->rsmp_buf_pos)
+        frames = in->rsmp_buf_frames - in->rsmp_buf_pos;
+    memcpy(buffer, in->rsmp_buf + in->rsmp_buf_pos * in->config.channels,
+           frames * in->config.channels * sizeof(int16_t));
+    in->rsmp_buf_pos += frames;
+
+    return frames;
+}
+
 /* read_frames() reads frames from kernel driver, down samples to capture rate
  * if necessary and output the number of frames requested to the buffer specified */
 static ssize_t read_frames(struct stream_in *in, void *buffer, ssize_t frames)
@@ -1932,7 +2328,12 @@ static ssize_t read_frames(struct stream_in *in, void *buffer, ssize_t frames)
         size_t frames_rd = frames - frames_wr;
         ALOGVV("%s: frames_rd: %zd, frames_wr: %zd, in->config.channels: %d",
                __func__,frames_rd,frames_wr,in->config.channels);
-        if (in->resampler != NULL) {
+        if (in->poly_resampler != NULL) {
+            frames_rd = resample_polyphase(in,
+                    (int16_t *)((char *)buffer +
+                            pcm_frames_to_bytes(pcm_device->pcm, frames_wr)),
+                    frames_rd);
+        } else if (in->resampler != NULL) {
             in->resampler->resample_from_provider(in->resampler,
                     (int16_t *)((char *)buffer +
                             pcm_frames_to_bytes(pcm_device->pcm, frames_wr)),
@@ -1953,7 +2354,7 @@ static ssize_t read_frames(struct stream_in *in, void *buffer, ssize_t frames)
             release_buffer(&in->buf_provider, &buf);
         }
         /* in->read_status is updated by getNextBuffer() also called by
-         * in->resampler->resample_from_provider() */
+         * in->resampler->resample_from_provider() and resample_polyphase() */
         if (in->read_status != 0)
             return in->read_status;
 
@@ -1977,6 +2378,50 @@ static int in_release_pcm_devices(struct stream_in *in)
     return 0;
 }
 
+static void release_capture_resampler(struct stream_in *in)
+{
+    if (in->resampler) {
+        release_resampler(in->resampler);
+        in->resampler = NULL;
+    }
+    if (in->poly_resampler) {
+        polyphase_resampler_release(in->poly_resampler);
+        in->poly_resampler = NULL;
+    }
+    free(in->rsmp_buf);
+    in->rsmp_buf = NULL;
+    in->rsmp_buf_frames = 0;
+    in->rsmp_buf_pos = 0;
+}
+
+static int create_capture_resampler(struct stream_in *in)
+{
+    struct audio_device *adev = in->dev;
+    int ret;
+
+    if (adev->polyphase_resampler &&
+            polyphase_resampler_create(in->config.rate, in->requested_rate,
+                                       in->config.channels, in->config.period_size,
+                                       &in->poly_resampler) == 0) {
+        in->rsmp_buf = (int16_t *)malloc(polyphase_resampler_max_out_frames(in->poly_resampler) *
+                                         in->config.channels * sizeof(int16_t));
+        if (in->rsmp_buf != NULL)
+            return 0;
+        polyphase_resampler_release(in->poly_resampler);
+        in->poly_resampler = NULL;
+    }
+
+    in->buf_provider.get_next_buffer = get_next_buffer;
+    in->buf_provider.release_buffer = release_buffer;
+    ret = create_resampler(in->config.rate,
+                           in->requested_rate,
+                           in->config.channels,
+                           RESAMPLER_QUALITY_DEFAULT,
+                           &in->buf_provider,
+                           &in->resampler);
+    return ret;
+}
+
 static int stop_input_stream(struct stream_in *in)
 {
     struct audio_usecase *uc_info;
@@ -2019,6 +2464,8 @@ static int start_input_stream(struct stream_in *in)
     struct audio_device *adev = in->dev;
     struct pcm_device_profile *pcm_profile;
     struct pcm_device *pcm_device;
+    struct pcm_config config;
+    unsigned int pcm_open_flags;
 
     ALOGV("%s: enter: usecase(%d)", __func__, in->usecase);
     adev->active_input = in;
@@ -2065,11 +2512,18 @@ static int start_input_stream(struct stream_in *in)
     /* Config should be updated as profile can be changed between different calls
      * to this function:
      * - Trigger resampler creation
-     * - Config needs to be updated */
-    if (in->config.rate != pcm_profile->config.rate) {
+     * - Config needs to be updated
+     * Capture at the requested rate if the pcm can, with periods of the same duration. */
+    config = pcm_profile->config;
+    if (in->requested_rate != config.rate &&
+            pcm_device_supports_rate(pcm_profile, in->requested_rate)) {
+        config.period_size = config.period_size * in->requested_rate / config.rate;
+        config.rate = in->requested_rate;
+    }
+    if (in->config.rate != config.rate) {
         recreate_resampler = true;
     }
-    in->config = pcm_profile->config;
+    in->config = config;
 
 #ifdef PREPROCESSING_ENABLED
     if (in->aux_channels_changed) {
@@ -2083,18 +2537,9 @@ static int start_input_stream(struct stream_in *in)
     }
 
     if (recreate_resampler) {
-        if (in->resampler) {
-            release_resampler(in->resampler);
-            in->resampler = NULL;
-        }
-        in->buf_provider.get_next_buffer = get_next_buffer;
-        in->buf_provider.release_buffer = release_buffer;
-        ret = create_resampler(in->config.rate,
-                               in->requested_rate,
-                               in->config.channels,
-                               RESAMPLER_QUALITY_DEFAULT,
-                               &in->buf_provider,
-                               &in->resampler);
+        release_capture_resampler(in);
+        if (in->requested_rate != in->config.rate)
+            ret = create_capture_resampler(in);
     }
 
 #ifdef PREPROCESSING_ENABLED
@@ -2114,11 +2559,14 @@ static int start_input_stream(struct stream_in *in)
      */
     ALOGV("%s: Opening PCM device card_id(%d) device_id(%d), channels %d, smp rate %d format %d, \
           period_size %d", __func__, pcm_device->pcm_profile->card, pcm_device->pcm_profile->id,
-          pcm_device->pcm_profile->config.channels,pcm_device->pcm_profile->config.rate,
-          pcm_device->pcm_profile->config.format, pcm_device->pcm_profile->config.period_size);
+          config.channels, config.rate, config.format, config.period_size);
+
+    pcm_open_flags = PCM_IN | PCM_MONOTONIC;
+    if (in->usecase == USECASE_AUDIO_CAPTURE_MMAP)
+        pcm_open_flags |= PCM_MMAP | PCM_NOIRQ;
 
     pcm_device->pcm = pcm_open(pcm_device->pcm_profile->card, pcm_device->pcm_profile->id,
-                                   PCM_IN | PCM_MONOTONIC, &pcm_device->pcm_profile->config);
+                                   pcm_open_flags, &config);
 
     if (pcm_device->pcm && !pcm_is_ready(pcm_device->pcm)) {
         ALOGE("%s: %s", __func__, pcm_get_error(pcm_device->pcm));
@@ -2139,15 +2587,17 @@ static int start_input_stream(struct stream_in *in)
     if (in->resampler) {
         in->resampler->reset(in->resampler);
     }
+    if (in->poly_resampler) {
+        polyphase_resampler_reset(in->poly_resampler);
+        in->rsmp_buf_frames = 0;
+        in->rsmp_buf_pos = 0;
+    }
 
     ALOGV("%s: exit", __func__);
     return ret;
 
 error_open:
-    if (in->resampler) {
-        release_resampler(in->resampler);
-        in->resampler = NULL;
-    }
+    release_capture_resampler(in);
     stop_input_stream(in);
 
 error_config:
@@ -2170,6 +2620,19 @@ void lock_output_stream(struct stream_out *out)
     pthread_mutex_unlock(&out->pre_lock);
 }
 
+/* Keep the drain thread away from the pcm devices, must be called with out->lock locked */
+static void lock_output_drain(struct stream_out *out)
+{
+    if (out->use_ring)
+        pthread_mutex_lock(&out->drain_lock);
+}
+
+static void unlock_output_drain(struct stream_out *out)
+{
+    if (out->use_ring)
+        pthread_mutex_unlock(&out->drain_lock);
+}
+
 static int uc_release_pcm_devices(struct audio_usecase *usecase)
 {
     struct stream_out *out = (struct stream_out *)usecase->stream;
@@ -2195,11 +2658,16 @@ static int uc_select_pcm_devices(struct audio_usecase *usecase)
     struct pcm_device_profile *pcm_profile;
     struct mixer_card *mixer_card;
     audio_devices_t devices = usecase->devices;
+    usecase_type_t pcm_type = usecase->type;
 
     list_init(&usecase->mixer_list);
     list_init(&out->pcm_dev_list);
 
-    while ((pcm_profile = get_pcm_device(usecase->type, devices)) != NULL) {
+    /* Routed like any other playback, but on the no-IRQ PCM */
+    if (usecase->id == USECASE_AUDIO_PLAYBACK_MMAP)
+        pcm_type = PCM_PLAYBACK_MMAP;
+
+    while ((pcm_profile = get_pcm_device(pcm_type, devices)) != NULL) {
         pcm_device = calloc(1, sizeof(struct pcm_device));
         if (pcm_device == NULL) {
             return -ENOMEM;
@@ -2222,6 +2690,8 @@ static int out_close_pcm_devices(struct stream_out *out)
     struct pcm_device *pcm_device;
     struct listnode *node;
 
+    pcm_fanout_stop(out);
+
     list_for_each(node, &out->pcm_dev_list) {
         pcm_device = node_to_item(node, struct pcm_device, stream_list_node);
         if (pcm_device->pcm) {
@@ -2240,6 +2710,13 @@ static int out_open_pcm_devices(struct stream_out *out)
     int ret = 0;
     int pcm_device_card;
     int pcm_device_id;
+    unsigned int pcm_open_flags = PCM_OUT | PCM_MONOTONIC;
+
+    /* pcm_write() reports underruns instead of recovering, see pcm_device_write() */
+    if (out->usecase == USECASE_AUDIO_PLAYBACK_MMAP)
+        pcm_open_flags |= PCM_MMAP | PCM_NOIRQ;
+    else
+        pcm_open_flags |= PCM_NORESTART;
 
     list_for_each(node, &out->pcm_dev_list) {
         pcm_device = node_to_item(node, struct pcm_device, stream_list_node);
@@ -2253,7 +2730,7 @@ static int out_open_pcm_devices(struct stream_out *out)
               __func__, pcm_device_card, pcm_device_id);
 
         pcm_device->pcm = pcm_open(pcm_device_card, pcm_device_id,
-                               PCM_OUT | PCM_MONOTONIC, &out->config);
+                               pcm_open_flags, &out->config);
 
         if (pcm_device->pcm && !pcm_is_ready(pcm_device->pcm)) {
             ALOGE("%s: %s", __func__, pcm_get_error(pcm_device->pcm));
@@ -2262,6 +2739,9 @@ static int out_open_pcm_devices(struct stream_out *out)
             goto error_open;
         }
     }
+
+    if (out->usecase != USECASE_AUDIO_PLAYBACK_MMAP)
+        pcm_fanout_start(out);
     return ret;
 
 error_open:
@@ -2393,8 +2873,10 @@ int stop_voice_call(struct audio_device *adev)
         return -EINVAL;
     }
 
+    begin_route_batch(adev);
     disable_snd_device(adev, uc_info, uc_info->out_snd_device);
     disable_snd_device(adev, uc_info, uc_info->in_snd_device);
+    end_route_batch(adev);
 
     list_remove(&uc_info->adev_list_node);
     free(uc_info);
@@ -2554,8 +3036,11 @@ static int do_out_standby_l(struct stream_out *out)
     int status = 0;
 
     out->standby = true;
+    stream_stats_standby(&out->stats);
     if (out->usecase != USECASE_AUDIO_PLAYBACK_OFFLOAD) {
         out_close_pcm_devices(out);
+        if (out->use_ring)
+            flush_deep_buffer_l(out);
 #ifdef PREPROCESSING_ENABLED
         /* stop writing to echo reference */
         if (out->echo_reference != NULL) {
@@ -2591,10 +3076,12 @@ static int out_standby(struct audio_stream *stream)
           out->usecase, use_case_table[out->usecase]);
     lock_output_stream(out);
     if (!out->standby) {
-        pthread_mutex_lock(&adev->lock);
+        lock_output_drain(out);
+        lock_adev(adev);
         amplifier_output_stream_standby((struct audio_stream_out *) stream);
         do_out_standby_l(out);
         pthread_mutex_unlock(&adev->lock);
+        unlock_output_drain(out);
     }
     pthread_mutex_unlock(&out->lock);
     ALOGV("%s: exit", __func__);
@@ -2606,8 +3093,32 @@ static int out_standby(struct audio_stream *stream)
 
 static int out_dump(const struct audio_stream *stream, int fd)
 {
-    (void)stream;
-    (void)fd;
+    struct stream_out *out = (struct stream_out *)stream;
+    struct pcm_device *pcm_device;
+    struct listnode *node;
+
+    /*
+     * A dump must not block behind a stuck write, try to get the lock for
+     * consistency only. The pcm devices come and go with the lock held, they
+     * are left out without it; the counters are fine to read racily.
+     */
+    const bool locked = (pthread_mutex_trylock(&out->lock) == 0);
+    dprintf(fd, "      Usecase: %s\n", use_case_table[out->usecase]);
+    dprintf(fd, "      Standby: %s\n", out->standby ? "yes" : "no");
+    if (locked) {
+        list_for_each(node, &out->pcm_dev_list) {
+            pcm_device = node_to_item(node, struct pcm_device, stream_list_node);
+            dprintf(fd, "      PCM card %d device %d: %s, underruns %u, last status %d\n",
+                    pcm_device->pcm_profile->card, pcm_device->pcm_profile->id,
+                    pcm_device->has_fanout_thread ? "writer thread" : "caller thread",
+                    pcm_device->underruns, pcm_device->status);
+        }
+    } else {
+        dprintf(fd, "      PCM devices: stream busy\n");
+    }
+    stream_stats_dump(fd, &out->stats);
+    if (locked)
+        pthread_mutex_unlock(&out->lock);
 
     return 0;
 }
@@ -2643,7 +3154,8 @@ static int out_set_parameters(struct audio_stream *stream, const char *kvpairs)
 
         pthread_mutex_lock(&adev->lock_inputs);
         lock_output_stream(out);
-        pthread_mutex_lock(&adev->lock);
+        lock_output_drain(out);
+        lock_adev(adev);
 #ifdef PREPROCESSING_ENABLED
         if (((int)out->devices != val) && (val != 0) && (!out->standby) &&
             (out->usecase == USECASE_AUDIO_PLAYBACK)) {
@@ -2711,12 +3223,13 @@ static int out_set_parameters(struct audio_stream *stream, const char *kvpairs)
         }
 
         pthread_mutex_unlock(&adev->lock);
+        unlock_output_drain(out);
         pthread_mutex_unlock(&out->lock);
 #ifdef PREPROCESSING_ENABLED
         if (in) {
             /* The lock on adev->lock_inputs prevents input stream from being closed */
             lock_input_stream(in);
-            pthread_mutex_lock(&adev->lock);
+            lock_adev(adev);
             LOG_ALWAYS_FATAL_IF(in != adev->active_input);
             do_in_standby_l(in);
             pthread_mutex_unlock(&adev->lock);
@@ -2786,6 +3299,10 @@ static uint32_t out_get_latency(const struct audio_stream_out *stream)
     if (out->usecase == USECASE_AUDIO_PLAYBACK_OFFLOAD)
         return COMPRESS_OFFLOAD_PLAYBACK_LATENCY;
 
+    if (out->use_ring)
+        return ((out->config.period_count * out->config.period_size + out->ring.frames) * 1000) /
+               (out->config.rate);
+
     return (out->config.period_count * out->config.period_size * 1000) /
            (out->config.rate);
 }
@@ -2831,6 +3348,60 @@ static int fast_set_affinity(pid_t tid) {
 }
 #endif
 
+/* must be called with out->lock locked, or out->drain_lock when writing from the drain thread */
+int out_write_pcm_devices_l(struct stream_out *out, void *buffer, size_t bytes)
+{
+    int ret = 0;
+#ifdef PREPROCESSING_ENABLED
+    struct pcm_device *pcm_device;
+    struct listnode *node;
+    struct audio_device *adev = out->dev;
+    size_t frame_size = audio_stream_out_frame_size(&out->stream);
+    size_t in_frames = bytes / frame_size;
+    size_t out_frames = in_frames;
+
+    if (android_atomic_acquire_load(&adev->echo_reference_generation)
+            != out->echo_reference_generation) {
+        lock_adev(adev);
+        if (out->echo_reference != NULL) {
+            ALOGV("%s: release_echo_reference %p", __func__, out->echo_reference);
+            release_echo_reference(out->echo_reference);
+        }
+        // note that adev->echo_reference_generation here can be different from the one
+        // tested above but it doesn't matter as we now have the adev mutex and it is consistent
+        // with what has been set by get_echo_reference() or put_echo_reference()
+        out->echo_reference_generation = adev->echo_reference_generation;
+        out->echo_reference = adev->echo_reference;
+        ALOGV("%s: update echo reference generation %d", __func__,
+              out->echo_reference_generation);
+        pthread_mutex_unlock(&adev->lock);
+    }
+#endif
+
+    if (out->muted)
+        memset(buffer, 0, bytes);
+#ifdef PREPROCESSING_ENABLED
+    list_for_each(node, &out->pcm_dev_list) {
+        pcm_device = node_to_item(node, struct pcm_device, stream_list_node);
+        if (pcm_device->pcm) {
+            if (out->echo_reference != NULL && pcm_device->pcm_profile->devices != SND_DEVICE_OUT_SPEAKER) {
+                struct echo_reference_buffer b;
+                b.raw = buffer;
+                b.frame_count = in_frames;
+
+                get_playback_delay(out, out_frames, &b);
+                out->echo_reference->write(out->echo_reference, &b);
+             }
+        }
+    }
+#endif
+    ret = pcm_fanout_write(out, buffer, bytes);
+    if (ret == 0)
+        out->written += bytes / (out->config.channels * sizeof(short));
+
+    return ret;
+}
+
 static ssize_t out_write(struct audio_stream_out *stream, const void *buffer,
                          size_t bytes)
 {
@@ -2839,13 +3410,17 @@ static ssize_t out_write(struct audio_stream_out *stream, const void *buffer,
     ssize_t ret = 0;
     struct pcm_device *pcm_device;
     struct listnode *node;
+    int64_t start_ns;
 #ifdef PREPROCESSING_ENABLED
-    size_t frame_size = audio_stream_out_frame_size(stream);
-    size_t in_frames = bytes / frame_size;
-    size_t out_frames = in_frames;
     struct stream_in *in = NULL;
 #endif
 
+    /* MMAP clients write straight into the DMA buffer */
+    if (out->usecase == USECASE_AUDIO_PLAYBACK_MMAP)
+        return -ENOSYS;
+
+    start_ns = audio_stats_now_ns();
+
     lock_output_stream(out);
 
 #if SUPPORTS_IRQ_AFFINITY
@@ -2872,8 +3447,11 @@ static ssize_t out_write(struct audio_stream_out *stream, const void *buffer,
             goto false_alarm;
         }
 #endif
-        pthread_mutex_lock(&adev->lock);
+        lock_output_drain(out);
+        lock_adev(adev);
+        const int64_t start_stream_ns = audio_stats_now_ns();
         ret = start_output_stream(out);
+        latency_hist_add(&adev->start_latency, audio_stats_now_ns() - start_stream_ns);
         if (ret == 0) {
             amplifier_output_stream_start(stream, out->usecase == USECASE_AUDIO_PLAYBACK_OFFLOAD);
         }
@@ -2881,12 +3459,14 @@ static ssize_t out_write(struct audio_stream_out *stream, const void *buffer,
         /* ToDo: If use case is compress offload should return 0 */
         if (ret != 0) {
             pthread_mutex_unlock(&adev->lock);
+            unlock_output_drain(out);
 #ifdef PREPROCESSING_ENABLED
             pthread_mutex_unlock(&adev->lock_inputs);
 #endif
             goto exit;
         }
         out->standby = false;
+        unlock_output_drain(out);
 
 #ifdef PREPROCESSING_ENABLED
         /* A change in output device may change the microphone selection */
@@ -2904,6 +3484,7 @@ static ssize_t out_write(struct audio_stream_out *stream, const void *buffer,
             pthread_mutex_unlock(&adev->lock_inputs);
         }
 #endif
+        wait_for_deferred_routes(adev, out->usecase);
     }
 #ifdef PREPROCESSING_ENABLED
 false_alarm:
@@ -2911,56 +3492,22 @@ false_alarm:
 
     if (out->usecase == USECASE_AUDIO_PLAYBACK_OFFLOAD) {
         ret = out_write_offload(stream, buffer, bytes);
+        stream_stats_io(&out->stats, start_ns);
         return ret;
+    } else if (out->use_ring) {
+        /* the drain thread writes to the pcm devices, don't hold up routing or standby */
+        pthread_mutex_unlock(&out->lock);
+        out_write_deep_buffer(out, buffer, bytes);
+        goto done;
     } else {
-#ifdef PREPROCESSING_ENABLED
-        if (android_atomic_acquire_load(&adev->echo_reference_generation)
-                != out->echo_reference_generation) {
-            pthread_mutex_lock(&adev->lock);
-            if (out->echo_reference != NULL) {
-                ALOGV("%s: release_echo_reference %p", __func__, out->echo_reference);
-                release_echo_reference(out->echo_reference);
-            }
-            // note that adev->echo_reference_generation here can be different from the one
-            // tested above but it doesn't matter as we now have the adev mutex and it is consistent
-            // with what has been set by get_echo_reference() or put_echo_reference()
-            out->echo_reference_generation = adev->echo_reference_generation;
-            out->echo_reference = adev->echo_reference;
-            ALOGV("%s: update echo reference generation %d", __func__,
-                  out->echo_reference_generation);
-            pthread_mutex_unlock(&adev->lock);
-        }
-#endif
-
-        if (out->muted)
-            memset((void *)buffer, 0, bytes);
-        list_for_each(node, &out->pcm_dev_list) {
-            pcm_device = node_to_item(node, struct pcm_device, stream_list_node);
-            if (pcm_device->pcm) {
-#ifdef PREPROCESSING_ENABLED
-                if (out->echo_reference != NULL && pcm_device->pcm_profile->devices != SND_DEVICE_OUT_SPEAKER) {
-                    struct echo_reference_buffer b;
-                    b.raw = (void *)buffer;
-                    b.frame_count = in_frames;
-
-                    get_playback_delay(out, out_frames, &b);
-                    out->echo_reference->write(out->echo_reference, &b);
-                 }
-#endif
-                ALOGVV("%s: writing buffer (%d bytes) to pcm device", __func__, bytes);
-                pcm_device->status = pcm_write(pcm_device->pcm, (void *)buffer, bytes);
-                if (pcm_device->status != 0)
-                    ret = pcm_device->status;
-            }
-        }
-        if (ret == 0)
-            out->written += bytes / (out->config.channels * sizeof(short));
+        ret = out_write_pcm_devices_l(out, (void *)buffer, bytes);
     }
 
 exit:
     pthread_mutex_unlock(&out->lock);
 
     if (ret != 0) {
+        out->stats.errors++;
         list_for_each(node, &out->pcm_dev_list) {
             pcm_device = node_to_item(node, struct pcm_device, stream_list_node);
             if (pcm_device->pcm && pcm_device->status != 0)
@@ -2991,11 +3538,12 @@ exit:
         // This is a crude approximation; we don't handle underruns precisely.
     }
 
+done:
 #ifdef PREPROCESSING_ENABLED
     if (in) {
         /* The lock on adev->lock_inputs prevents input stream from being closed */
         lock_input_stream(in);
-        pthread_mutex_lock(&adev->lock);
+        lock_adev(adev);
         LOG_ALWAYS_FATAL_IF(in != adev->active_input);
         do_in_standby_l(in);
         pthread_mutex_unlock(&adev->lock);
@@ -3005,6 +3553,7 @@ exit:
     }
 #endif
 
+    stream_stats_io(&out->stats, start_ns);
     return bytes;
 }
 
@@ -3048,6 +3597,7 @@ static int out_get_presentation_position(const struct audio_stream_out *stream,
     int ret = -EINVAL;
 
     lock_output_stream(out);
+    lock_output_drain(out);
 
     if (out->usecase == USECASE_AUDIO_PLAYBACK_OFFLOAD) {
         ret = out_get_presentation_offload_position(out, frames, timestamp);
@@ -3085,6 +3635,9 @@ static int out_get_presentation_position(const struct audio_stream_out *stream,
     }
 
 done:
+    if (ret == 0)
+        stream_stats_position(&out->stats, *frames, timestamp, out->sample_rate);
+    unlock_output_drain(out);
     pthread_mutex_unlock(&out->lock);
 
     return ret;
@@ -3143,6 +3696,172 @@ static int out_flush(struct audio_stream_out* stream)
     return -ENOSYS;
 }
 
+static struct pcm *get_first_pcm(struct listnode *pcm_dev_list)
+{
+    struct pcm_device *pcm_device;
+
+    if (list_empty(pcm_dev_list))
+        return NULL;
+
+    pcm_device = node_to_item(list_head(pcm_dev_list), struct pcm_device, stream_list_node);
+    return pcm_device->pcm;
+}
+
+/* Map the DMA buffer of a no-IRQ pcm and describe it to the client */
+static int pcm_get_mmap_buffer_info(struct pcm *pcm, int32_t min_size_frames,
+                                    struct audio_mmap_buffer_info *info)
+{
+    unsigned int offset1;
+    unsigned int frames1;
+    int ret;
+
+    ret = pcm_mmap_begin(pcm, &info->shared_memory_address, &offset1, &frames1);
+    if (ret < 0) {
+        ALOGE("%s: pcm_mmap_begin failed: %s", __func__, pcm_get_error(pcm));
+        return ret;
+    }
+
+    info->buffer_size_frames = pcm_get_buffer_size(pcm);
+    info->burst_size_frames = MMAP_PERIOD_SIZE;
+    info->shared_memory_fd = pcm_get_poll_fd(pcm);
+    if (info->buffer_size_frames < min_size_frames) {
+        ALOGE("%s: buffer of %d frames is smaller than the requested %d frames",
+              __func__, info->buffer_size_frames, min_size_frames);
+        return -EINVAL;
+    }
+
+    /* Prime the pcm with one period of silence, the client moves appl_ptr itself from now on */
+    memset(info->shared_memory_address, 0,
+           pcm_frames_to_bytes(pcm, info->buffer_size_frames));
+    ret = pcm_mmap_commit(pcm, 0, MMAP_PERIOD_SIZE);
+    if (ret < 0) {
+        ALOGE("%s: pcm_mmap_commit failed: %s", __func__, pcm_get_error(pcm));
+        return ret;
+    }
+
+    return 0;
+}
+
+static int pcm_get_mmap_position(struct pcm *pcm, struct audio_mmap_position *position)
+{
+    struct timespec ts = { 0, 0 };
+    unsigned int hw_ptr;
+    int ret;
+
+    ret = pcm_mmap_get_hw_ptr(pcm, &hw_ptr, &ts);
+    if (ret < 0) {
+        ALOGE("%s: pcm_mmap_get_hw_ptr failed: %s", __func__, pcm_get_error(pcm));
+        return ret;
+    }
+
+    position->position_frames = (int32_t)hw_ptr;
+    position->time_nanoseconds = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+
+    return 0;
+}
+
+static int out_start(const struct audio_stream_out* stream)
+{
+    struct stream_out *out = (struct stream_out *)stream;
+    struct pcm *pcm;
+    int ret = -ENOSYS;
+
+    ALOGV("%s", __func__);
+    lock_output_stream(out);
+    pcm = get_first_pcm(&out->pcm_dev_list);
+    if (out->usecase == USECASE_AUDIO_PLAYBACK_MMAP && !out->standby && pcm != NULL) {
+        ret = pcm_start(pcm);
+        if (ret < 0)
+            ALOGE("%s: pcm_start failed: %s", __func__, pcm_get_error(pcm));
+    }
+    pthread_mutex_unlock(&out->lock);
+
+    return ret;
+}
+
+static int out_stop(const struct audio_stream_out* stream)
+{
+    struct stream_out *out = (struct stream_out *)stream;
+    struct pcm *pcm;
+    int ret = -ENOSYS;
+
+    ALOGV("%s", __func__);
+    lock_output_stream(out);
+    pcm = get_first_pcm(&out->pcm_dev_list);
+    if (out->usecase == USECASE_AUDIO_PLAYBACK_MMAP && !out->standby && pcm != NULL) {
+        ret = pcm_stop(pcm);
+    }
+    pthread_mutex_unlock(&out->lock);
+
+    return ret;
+}
+
+static int out_create_mmap_buffer(const struct audio_stream_out *stream,
+                                  int32_t min_size_frames,
+                                  struct audio_mmap_buffer_info *info)
+{
+    struct stream_out *out = (struct stream_out *)stream;
+    struct audio_device *adev = out->dev;
+    unsigned int period_count;
+    int ret = 0;
+
+    ALOGV("%s: min_size_frames(%d)", __func__, min_size_frames);
+    if (info == NULL || min_size_frames <= 0)
+        return -EINVAL;
+
+    lock_output_stream(out);
+    lock_adev(adev);
+
+    if (out->usecase != USECASE_AUDIO_PLAYBACK_MMAP || !out->standby) {
+        ret = -ENOSYS;
+        goto exit;
+    }
+
+    period_count = (min_size_frames + MMAP_PERIOD_SIZE - 1) / MMAP_PERIOD_SIZE;
+    if (period_count < MMAP_PERIOD_COUNT_MIN)
+        period_count = MMAP_PERIOD_COUNT_MIN;
+    else if (period_count > MMAP_PERIOD_COUNT_MAX)
+        period_count = MMAP_PERIOD_COUNT_MAX;
+    out->config.period_count = period_count;
+
+    ret = start_output_stream(out);
+    if (ret != 0)
+        goto exit;
+    out->standby = false;
+    amplifier_output_stream_start((struct audio_stream_out *)stream, false);
+
+    ret = pcm_get_mmap_buffer_info(get_first_pcm(&out->pcm_dev_list), min_size_frames, info);
+    if (ret != 0) {
+        amplifier_output_stream_standby((struct audio_stream_out *)stream);
+        do_out_standby_l(out);
+    }
+
+exit:
+    pthread_mutex_unlock(&adev->lock);
+    pthread_mutex_unlock(&out->lock);
+
+    return ret;
+}
+
+static int out_get_mmap_position(const struct audio_stream_out *stream,
+                                 struct audio_mmap_position *position)
+{
+    struct stream_out *out = (struct stream_out *)stream;
+    struct pcm *pcm;
+    int ret = -ENOSYS;
+
+    if (position == NULL)
+        return -EINVAL;
+
+    lock_output_stream(out);
+    pcm = get_first_pcm(&out->pcm_dev_list);
+    if (out->usecase == USECASE_AUDIO_PLAYBACK_MMAP && !out->standby && pcm != NULL)
+        ret = pcm_get_mmap_position(pcm, position);
+    pthread_mutex_unlock(&out->lock);
+
+    return ret;
+}
+
 /** audio_stream_in implementation **/
 static uint32_t in_get_sample_rate(const struct audio_stream *stream)
 {
@@ -3250,7 +3969,7 @@ static int in_standby_l(struct stream_in *in)
     int status = 0;
     lock_input_stream(in);
     if (!in->standby) {
-        pthread_mutex_lock(&adev->lock);
+        lock_adev(adev);
         amplifier_input_stream_standby((struct audio_stream_in *) in);
         status = do_in_standby_l(in);
         pthread_mutex_unlock(&adev->lock);
@@ -3274,8 +3993,15 @@ static int in_standby(struct audio_stream *stream)
 
 static int in_dump(const struct audio_stream *stream, int fd)
 {
-    (void)stream;
-    (void)fd;
+    struct stream_in *in = (struct stream_in *)stream;
+
+    /* a dump must not block behind a stuck read, see out_dump() */
+    const bool locked = (pthread_mutex_trylock(&in->lock) == 0);
+    dprintf(fd, "      Usecase: %s\n", use_case_table[in->usecase]);
+    dprintf(fd, "      Standby: %s\n", in->standby ? "yes" : "no");
+    stream_stats_dump(fd, &in->stats);
+    if (locked)
+        pthread_mutex_unlock(&in->lock);
 
     return 0;
 }
@@ -3298,7 +4024,7 @@ static int in_set_parameters(struct audio_stream *stream, const char *kvpairs)
 
     pthread_mutex_lock(&adev->lock_inputs);
     lock_input_stream(in);
-    pthread_mutex_lock(&adev->lock);
+    lock_adev(adev);
     if (ret >= 0) {
         val = atoi(value);
         /* no audio source uses val == 0 */
@@ -3373,9 +4099,16 @@ static ssize_t in_read(struct audio_stream_in *stream, void *buffer,
     ssize_t frames = -1;
     int ret = -1;
     int read_and_process_successful = false;
+    int64_t start_ns;
 
     size_t frames_rq = bytes / audio_stream_in_frame_size(stream);
 
+    /* MMAP clients read straight from the DMA buffer */
+    if (in->usecase == USECASE_AUDIO_CAPTURE_MMAP)
+        return -ENOSYS;
+
+    start_ns = audio_stats_now_ns();
+
     /* no need to acquire adev->lock_inputs because API contract prevents a close */
     lock_input_stream(in);
 
@@ -3400,8 +4133,10 @@ static ssize_t in_read(struct audio_stream_in *stream, void *buffer,
             pthread_mutex_unlock(&adev->lock_inputs);
             goto false_alarm;
         }
-        pthread_mutex_lock(&adev->lock);
+        lock_adev(adev);
+        const int64_t start_stream_ns = audio_stats_now_ns();
         ret = start_input_stream(in);
+        latency_hist_add(&adev->start_latency, audio_stats_now_ns() - start_stream_ns);
         if (ret == 0) {
             amplifier_input_stream_start(stream);
         }
@@ -3412,6 +4147,7 @@ static ssize_t in_read(struct audio_stream_in *stream, void *buffer,
             goto exit;
         }
         in->standby = 0;
+        wait_for_deferred_routes(adev, in->usecase);
     }
 false_alarm:
 
@@ -3438,6 +4174,7 @@ exit:
     pthread_mutex_unlock(&in->lock);
 
     if (read_and_process_successful == false) {
+        in->stats.errors++;
         in_standby(&in->stream.common);
         ALOGV("%s: read failed - sleeping for buffer duration", __func__);
         struct timespec t = { .tv_sec = 0, .tv_nsec = 0 };
@@ -3469,6 +4206,7 @@ exit:
         in->frames_read += bytes / audio_stream_in_frame_size(stream);
     }
 
+    stream_stats_io(&in->stats, start_ns);
     return bytes;
 }
 
@@ -3513,6 +4251,102 @@ static int in_get_capture_position(const struct audio_stream_in *stream,
     return ret;
 }
 
+static int in_start(const struct audio_stream_in* stream)
+{
+    struct stream_in *in = (struct stream_in *)stream;
+    struct pcm *pcm;
+    int ret = -ENOSYS;
+
+    ALOGV("%s", __func__);
+    lock_input_stream(in);
+    pcm = get_first_pcm(&in->pcm_dev_list);
+    if (in->usecase == USECASE_AUDIO_CAPTURE_MMAP && !in->standby && pcm != NULL) {
+        ret = pcm_start(pcm);
+        if (ret < 0)
+            ALOGE("%s: pcm_start failed: %s", __func__, pcm_get_error(pcm));
+    }
+    pthread_mutex_unlock(&in->lock);
+
+    return ret;
+}
+
+static int in_stop(const struct audio_stream_in* stream)
+{
+    struct stream_in *in = (struct stream_in *)stream;
+    struct pcm *pcm;
+    int ret = -ENOSYS;
+
+    ALOGV("%s", __func__);
+    lock_input_stream(in);
+    pcm = get_first_pcm(&in->pcm_dev_list);
+    if (in->usecase == USECASE_AUDIO_CAPTURE_MMAP && !in->standby && pcm != NULL) {
+        ret = pcm_stop(pcm);
+    }
+    pthread_mutex_unlock(&in->lock);
+
+    return ret;
+}
+
+static int in_create_mmap_buffer(const struct audio_stream_in *stream,
+                                 int32_t min_size_frames,
+                                 struct audio_mmap_buffer_info *info)
+{
+    struct stream_in *in = (struct stream_in *)stream;
+    struct audio_device *adev = in->dev;
+    int ret = 0;
+
+    ALOGV("%s: min_size_frames(%d)", __func__, min_size_frames);
+    if (info == NULL || min_size_frames <= 0)
+        return -EINVAL;
+
+    pthread_mutex_lock(&adev->lock_inputs);
+    lock_input_stream(in);
+    lock_adev(adev);
+
+    if (in->usecase != USECASE_AUDIO_CAPTURE_MMAP || !in->standby) {
+        ret = -ENOSYS;
+        goto exit;
+    }
+
+    ret = start_input_stream(in);
+    if (ret != 0)
+        goto exit;
+    in->standby = 0;
+    amplifier_input_stream_start((struct audio_stream_in *)stream);
+
+    ret = pcm_get_mmap_buffer_info(get_first_pcm(&in->pcm_dev_list), min_size_frames, info);
+    if (ret != 0) {
+        amplifier_input_stream_standby((struct audio_stream_in *)stream);
+        do_in_standby_l(in);
+    }
+
+exit:
+    pthread_mutex_unlock(&adev->lock);
+    pthread_mutex_unlock(&in->lock);
+    pthread_mutex_unlock(&adev->lock_inputs);
+
+    return ret;
+}
+
+static int in_get_mmap_position(const struct audio_stream_in *stream,
+                                struct audio_mmap_position *position)
+{
+    struct stream_in *in = (struct stream_in *)stream;
+    struct pcm *pcm;
+    int ret = -ENOSYS;
+
+    if (position == NULL)
+        return -EINVAL;
+
+    lock_input_stream(in);
+    pcm = get_first_pcm(&in->pcm_dev_list);
+    if (in->usecase == USECASE_AUDIO_CAPTURE_MMAP && !in->standby && pcm != NULL)
+        ret = pcm_get_mmap_position(pcm, position);
+    pthread_mutex_unlock(&in->lock);
+
+    return ret;
+}
+
 static int add_remove_audio_effect(const struct audio_stream *stream,
                                    effect_handle_t effect,
                                    bool enable)
@@ -3532,7 +4366,7 @@ static int add_remove_audio_effect(const struct audio_stream *stream,
 
     pthread_mutex_lock(&adev->lock_inputs);
     lock_input_stream(in);
-    pthread_mutex_lock(&in->dev->lock);
+    lock_adev(in->dev);
 #ifndef PREPROCESSING_ENABLED
     if ((in->source == AUDIO_SOURCE_VOICE_COMMUNICATION) &&
             in->enable_aec != enable &&
@@ -3671,18 +4505,17 @@ static int adev_open_output_stream(struct audio_hw_device *dev,
             ret = -EINVAL;
             goto error_open;
         }
-        if (!is_supported_format(config->offload_info.format)) {
-            ALOGE("%s: Unsupported audio format", __func__);
-            ret = -EINVAL;
-            goto error_open;
-        }
-
         out->compr_config.codec = (struct snd_codec *)
                                     calloc(1, sizeof(struct snd_codec));
         if (out->compr_config.codec == NULL) {
             ret = -ENOMEM;
             goto error_open;
         }
+        ret = out_set_offload_codec(out, &config->offload_info);
+        if (ret != 0) {
+            free(out->compr_config.codec);
+            goto error_open;
+        }
 
         out->usecase = USECASE_AUDIO_PLAYBACK_OFFLOAD;
         if (config->offload_info.channel_mask)
@@ -3698,13 +4531,8 @@ static int adev_open_output_stream(struct audio_hw_device *dev,
         out->stream.drain = out_drain;
         out->stream.flush = out_flush;
 
-        out->compr_config.codec->id =
-                get_snd_codec_id(config->offload_info.format);
         out->compr_config.fragment_size = COMPRESS_OFFLOAD_FRAGMENT_SIZE;
         out->compr_config.fragments = COMPRESS_OFFLOAD_NUM_FRAGMENTS;
-        out->compr_config.codec->sample_rate = config->offload_info.sample_rate;
-        out->compr_config.codec->bit_rate =
-                    config->offload_info.bit_rate;
         out->compr_config.codec->ch_in =
                 audio_channel_count_from_out_mask(config->channel_mask);
         out->compr_config.codec->ch_out = out->compr_config.codec->ch_in;
@@ -3713,16 +4541,38 @@ static int adev_open_output_stream(struct audio_hw_device *dev,
             out->non_blocking = 1;
 
         out->send_new_metadata = 1;
-        create_offload_callback_thread(out);
+        ret = create_offload_callback_thread(out);
+        if (ret != 0) {
+            free(out->compr_config.codec);
+            goto error_open;
+        }
         out->offload_state = OFFLOAD_STATE_IDLE;
 
         ALOGV("%s: offloaded output offload_info version %04x bit rate %d",
                 __func__, config->offload_info.version,
                 config->offload_info.bit_rate);
+    } else if (out->flags & AUDIO_OUTPUT_FLAG_MMAP_NOIRQ) {
+        pcm_profile = get_pcm_device(PCM_PLAYBACK_MMAP, devices);
+        if (pcm_profile == NULL) {
+            ALOGE("%s: No MMAP pcm device for devices(%#x)", __func__, devices);
+            ret = -EINVAL;
+            goto error_open;
+        }
+        out->usecase = USECASE_AUDIO_PLAYBACK_MMAP;
+        out->config = pcm_profile->config;
+        out->format = AUDIO_FORMAT_PCM_16_BIT;
+        out->sample_rate = out->config.rate;
+
+        out->stream.start = out_start;
+        out->stream.stop = out_stop;
+        out->stream.create_mmap_buffer = out_create_mmap_buffer;
+        out->stream.get_mmap_position = out_get_mmap_position;
+        ALOGV("%s: use AUDIO_PLAYBACK_MMAP",__func__);
     } else if (out->flags & (AUDIO_OUTPUT_FLAG_DEEP_BUFFER)) {
         out->usecase = USECASE_AUDIO_PLAYBACK_DEEP_BUFFER;
         out->config = pcm_device_deep_buffer.config;
         out->sample_rate = out->config.rate;
+        out->use_ring = adev->deep_buffer_ring;
         ALOGV("%s: use AUDIO_PLAYBACK_DEEP_BUFFER",__func__);
     } else {
         out->usecase = USECASE_AUDIO_PLAYBACK;
@@ -3740,7 +4590,7 @@ static int adev_open_output_stream(struct audio_hw_device *dev,
     }
 
     /* Check if this usecase is already existing */
-    pthread_mutex_lock(&adev->lock);
+    lock_adev(adev);
     if (get_usecase_from_id(adev, out->usecase) != NULL) {
         ALOGE("%s: Usecase (%d) is already present", __func__, out->usecase);
         pthread_mutex_unlock(&adev->lock);
@@ -3769,12 +4619,17 @@ static int adev_open_output_stream(struct audio_hw_device *dev,
     out->stream.get_presentation_position = out_get_presentation_position;
 
     out->standby = 1;
+    list_init(&out->pcm_dev_list);
+    stream_stats_init(&out->stats, use_case_table[out->usecase]);
     /* out->muted = false; by calloc() */
     /* out->written = 0; by calloc() */
 
     pthread_mutex_init(&out->lock, (const pthread_mutexattr_t *) NULL);
     pthread_mutex_init(&out->pre_lock, (const pthread_mutexattr_t *) NULL);
     pthread_cond_init(&out->cond, (const pthread_condattr_t *) NULL);
+    pthread_mutex_init(&out->fanout_lock, (const pthread_mutexattr_t *) NULL);
+    pthread_cond_init(&out->fanout_cond, (const pthread_condattr_t *) NULL);
+    pthread_cond_init(&out->fanout_done_cond, (const pthread_condattr_t *) NULL);
 
     config->format = out->stream.common.get_format(&out->stream.common);
     config->channel_mask = out->stream.common.get_channels(&out->stream.common);
@@ -3782,6 +4637,11 @@ static int adev_open_output_stream(struct audio_hw_device *dev,
 
     out->is_fastmixer_affinity_set = false;
 
+    if (out->use_ring && create_deep_buffer_thread(out) != 0) {
+        ALOGW("%s: writing to the pcm devices from out_write instead", __func__);
+        out->use_ring = false;
+    }
+
     *stream_out = &out->stream;
     ALOGV("%s: exit", __func__);
     return 0;
@@ -3808,6 +4668,11 @@ static void adev_close_output_stream(struct audio_hw_device *dev,
         if (out->compr_config.codec != NULL)
             free(out->compr_config.codec);
     }
+    if (out->use_ring)
+        destroy_deep_buffer_thread(out);
+    pthread_cond_destroy(&out->fanout_done_cond);
+    pthread_cond_destroy(&out->fanout_cond);
+    pthread_mutex_destroy(&out->fanout_lock);
     pthread_cond_destroy(&out->cond);
     pthread_mutex_destroy(&out->lock);
     free(stream);
@@ -3880,7 +4745,7 @@ static int adev_set_parameters(struct audio_hw_device *dev, const char *kvpairs)
         default:
             ALOGE("%s: unexpected rotation of %d", __func__, val);
         }
-        pthread_mutex_lock(&adev->lock);
+        lock_adev(adev);
         if (adev->speaker_lr_swap != reverse_speakers) {
             adev->speaker_lr_swap = reverse_speakers;
             /* only update the selected device if there is active pcm playback */
@@ -3927,7 +4792,7 @@ static int adev_set_voice_volume(struct audio_hw_device *dev, float volume)
 {
     int ret = 0;
     struct audio_device *adev = (struct audio_device *)dev;
-    pthread_mutex_lock(&adev->lock);
+    lock_adev(adev);
     /* cache volume */
     adev->voice.volume = volume;
     ret = set_voice_volume_l(adev, adev->voice.volume);
@@ -3972,7 +4837,7 @@ static int adev_set_mode(struct audio_hw_device *dev, audio_mode_t mode)
 {
     struct audio_device *adev = (struct audio_device *)dev;
 
-    pthread_mutex_lock(&adev->lock);
+    lock_adev(adev);
     if (adev->mode != mode) {
         ALOGI("%s mode = %d", __func__, mode);
         if (amplifier_set_mode(mode) != 0) {
@@ -3993,7 +4858,7 @@ static int adev_set_mic_mute(struct audio_hw_device *dev, bool state)
     struct audio_device *adev = (struct audio_device *)dev;
     int err = 0;
 
-    pthread_mutex_lock(&adev->lock);
+    lock_adev(adev);
     adev->mic_mute = state;
 
     if (adev->mode == AUDIO_MODE_IN_CALL) {
@@ -4050,6 +4915,19 @@ static int adev_open_input_stream(struct audio_hw_device *dev,
 
     usecase_type_t usecase_type = flags & AUDIO_INPUT_FLAG_FAST ?
                         PCM_CAPTURE_LOW_LATENCY : PCM_CAPTURE;
+    if (flags & AUDIO_INPUT_FLAG_MMAP_NOIRQ) {
+        pcm_profile = get_pcm_device(PCM_CAPTURE_MMAP, devices);
+        // MMAP clients get the raw hardware buffer, there is no resampler or
+        // channel remix in between. fall back to regular capture otherwise.
+        if (pcm_profile != NULL &&
+                config->sample_rate == pcm_profile->config.rate &&
+                audio_channel_count_from_in_mask(config->channel_mask) ==
+                        pcm_profile->config.channels) {
+            usecase_type = PCM_CAPTURE_MMAP;
+        } else {
+            flags &= ~AUDIO_INPUT_FLAG_MMAP_NOIRQ;
+        }
+    }
     pcm_profile = get_pcm_device(usecase_type, devices);
     if (pcm_profile == NULL && usecase_type == PCM_CAPTURE_LOW_LATENCY) {
         // a low latency profile may not exist for that device, fall back
@@ -4101,9 +4979,17 @@ static int adev_open_input_stream(struct audio_hw_device *dev,
     /* Update config params with the requested sample rate and channels */
     in->usecase = USECASE_AUDIO_CAPTURE;
     in->usecase_type = usecase_type;
+    if (usecase_type == PCM_CAPTURE_MMAP) {
+        in->usecase = USECASE_AUDIO_CAPTURE_MMAP;
+        in->stream.start = in_start;
+        in->stream.stop = in_stop;
+        in->stream.create_mmap_buffer = in_create_mmap_buffer;
+        in->stream.get_mmap_position = in_get_mmap_position;
+    }
 
     pthread_mutex_init(&in->lock, (const pthread_mutexattr_t *) NULL);
     pthread_mutex_init(&in->pre_lock, (const pthread_mutexattr_t *) NULL);
+    stream_stats_init(&in->stats, use_case_table[in->usecase]);
 
     in->is_fastcapture_affinity_set = false;
 
@@ -4127,10 +5013,7 @@ static void adev_close_input_stream(struct audio_hw_device *dev,
         in->read_buf = NULL;
     }
 
-    if (in->resampler) {
-        release_resampler(in->resampler);
-        in->resampler = NULL;
-    }
+    release_capture_resampler(in);
 
 #ifdef PREPROCESSING_ENABLED
     int i;
@@ -4166,8 +5049,19 @@ static void adev_close_input_stream(struct audio_hw_device *dev,
 
 static int adev_dump(const audio_hw_device_t *device, int fd)
 {
-    (void)device;
-    (void)fd;
+    struct audio_device *adev = (struct audio_device *)device;
+    int i;
+
+    /* a dump must not block behind a stuck routing change, see out_dump() */
+    const bool locked = (pthread_mutex_trylock(&adev->lock) == 0);
+    latency_hist_dump(fd, "adev lock waits", &adev->lock_wait);
+    latency_hist_dump(fd, "Stream starts", &adev->start_latency);
+    for (i = 0; i < SND_DEVICE_MAX; i++) {
+        if (device_table[i] != NULL)
+            latency_hist_dump(fd, device_table[i], &adev->route_latency[i]);
+    }
+    if (locked)
+        pthread_mutex_unlock(&adev->lock);
 
     return 0;
 }
@@ -4175,6 +5069,9 @@ static int adev_dump(const audio_hw_device_t *device, int fd)
 static int adev_close(hw_device_t *device)
 {
     struct audio_device *adev = (struct audio_device *)device;
+#ifdef DSP_POWEROFF_DELAY
+    destroy_route_thread(adev);
+#endif /* DSP_POWEROFF_DELAY */
     voice_session_deinit(adev->voice.session);
     audio_device_ref_count--;
     if (audio_device_ref_count == 0) {
@@ -4306,6 +5203,10 @@ static int adev_open(const hw_module_t *module, const char *name,
         ALOGE("Amplifier initialization failed");
     }
 
+#ifdef DSP_POWEROFF_DELAY
+    create_route_thread(adev);
+#endif /* DSP_POWEROFF_DELAY */
+
     *device = &adev->device.common;
 
     audio_device_ref_count++;
@@ -4325,6 +5226,9 @@ static int adev_open(const hw_module_t *module, const char *name,
         }
     }
 
+    adev->deep_buffer_ring = property_get_bool("audio_hal.deep_buffer_ring", false);
+    adev->polyphase_resampler = property_get_bool("audio_hal.polyphase_resampler", false);
+
     ALOGV("%s: exit", __func__);
     return 0;
 }
@@ -19,6 +19,8 @@
 #ifndef SAMSUNG_AUDIO_HW_H
 #define SAMSUNG_AUDIO_HW_H
 
+#include <stdatomic.h>
+
 #include <cutils/list.h>
 #include <hardware/audio.h>
 #include <hardware/audio_amplifier.h>
@@ -165,6 +167,14 @@ enum {
 #define DEEP_BUFFER_OUTPUT_SAMPLING_RATE 48000
 #define DEEP_BUFFER_OUTPUT_PERIOD_SIZE 480
 #define DEEP_BUFFER_OUTPUT_PERIOD_COUNT 8
+/* Periods buffered between out_write and the drain thread, see deep_buffer.c */
+#define DEEP_BUFFER_RING_PERIOD_COUNT 4
+
+/* MMAP/no-IRQ streams: the client reads and writes the DMA buffer directly */
+#define MMAP_PERIOD_SIZE (PLAYBACK_DEFAULT_SAMPLING_RATE / 1000)
+#define MMAP_PERIOD_COUNT_MIN 32
+#define MMAP_PERIOD_COUNT_MAX 512
+#define MMAP_PERIOD_COUNT_DEFAULT (MMAP_PERIOD_COUNT_MAX)
 
 #define MAX_SUPPORTED_CHANNEL_MASKS 2
 
@@ -181,9 +191,11 @@ typedef enum {
     USECASE_AUDIO_PLAYBACK_MULTI_CH,
     USECASE_AUDIO_PLAYBACK_OFFLOAD,
     USECASE_AUDIO_PLAYBACK_DEEP_BUFFER,
+    USECASE_AUDIO_PLAYBACK_MMAP,
 
     /* Capture usecases */
     USECASE_AUDIO_CAPTURE,
+    USECASE_AUDIO_CAPTURE_MMAP,
 
     USECASE_VOICE_CALL,
     AUDIO_USECASE_MAX
@@ -201,7 +213,7 @@ typedef enum {
  */
 
 enum {
-    OFFLOAD_CMD_EXIT,               /* exit compress offload thread loop*/
+    OFFLOAD_CMD_EXIT,               /* exit compress offload thread loop, never queued */
     OFFLOAD_CMD_DRAIN,              /* send a full drain request to DSP */
     OFFLOAD_CMD_PARTIAL_DRAIN,      /* send a partial drain request to DSP */
     OFFLOAD_CMD_WAIT_FOR_BUFFER,    /* wait for buffer released by DSP */
@@ -219,12 +231,43 @@ typedef enum {
     PCM_CAPTURE = 0x2,
     VOICE_CALL = 0x4,
     PCM_CAPTURE_LOW_LATENCY = 0x10,
+    PCM_PLAYBACK_MMAP = 0x20,
+    PCM_CAPTURE_MMAP = 0x40,
 } usecase_type_t;
 
-struct offload_cmd {
-    struct listnode node;
-    int             cmd;
-    int             data[];
+#define OFFLOAD_CMD_RING_SIZE 16 /* a power of two */
+
+/* Commands to the offload callback thread, only queued with out->lock held */
+struct offload_cmd_ring {
+    int                 cmds[OFFLOAD_CMD_RING_SIZE];
+    _Atomic uint32_t    rear;     /* only moved by send_offload_cmd_l() */
+    _Atomic uint32_t    front;    /* only moved by the offload thread */
+    atomic_bool         exit;     /* set by destroy_offload_callback_thread() */
+    int                 event_fd; /* eventfd, rear moved or exit set */
+};
+
+#define LATENCY_HIST_BUCKETS 16
+
+/* Durations of a call, bucket i counts those below 64us << i, the last one the rest */
+struct latency_hist {
+    uint32_t            buckets[LATENCY_HIST_BUCKETS];
+    uint32_t            count;
+    uint64_t            total_ns;
+    uint64_t            max_ns;
+};
+
+/* Always on telemetry of a stream, see audio_stats.c */
+struct stream_stats {
+    struct latency_hist io;               /* out_write()/in_read(), only touched by the caller */
+    uint32_t            errors;           /* failed writes/reads */
+    _Atomic uint32_t    xruns;            /* from every pcm device the stream has had */
+    int64_t             drift_frames;     /* presentation position against the clock */
+    int64_t             max_drift_frames;
+    uint64_t            last_frames;
+    int64_t             last_position_ns; /* 0 when no position was reported since standby */
+    char                trace_io[40];     /* atrace counter names */
+    char                trace_xruns[40];
+    char                trace_drift[40];
 };
 
 struct pcm_device_profile {
@@ -233,6 +276,7 @@ struct pcm_device_profile {
     int               id;
     usecase_type_t    type;
     audio_devices_t   devices;
+    const unsigned int* rates; /* other rates the pcm can run at, 0 terminated, may be NULL */
 };
 
 struct pcm_device {
@@ -240,6 +284,24 @@ struct pcm_device {
     struct pcm_device_profile* pcm_profile;
     struct pcm*                pcm;
     int                        status;
+    /* xruns found before a pcm_write(), reported by out_dump() */
+    uint32_t                   underruns;
+    /* writer thread of a stream with several pcm devices, see pcm_fanout.c */
+    struct stream_out*         fanout_out;
+    pthread_t                  fanout_thread;
+    bool                       has_fanout_thread;
+    uint32_t                   fanout_generation;
+};
+
+/* Single producer (out_write), single consumer (drain thread) ring of frames */
+struct out_ring {
+    uint8_t*                   data;
+    uint32_t                   frames;      /* capacity, a power of two */
+    size_t                     frame_size;
+    _Atomic uint32_t           rear;        /* frames written, only moved by the producer */
+    _Atomic uint32_t           front;       /* frames drained, only moved by the consumer */
+    int                        data_fd;     /* eventfd, producer -> consumer */
+    int                        space_fd;    /* eventfd, consumer -> producer */
 };
 
 struct stream_out {
@@ -267,9 +329,8 @@ struct stream_out {
 
     int                         non_blocking;
     int                         offload_state;
-    pthread_cond_t              offload_cond;
     pthread_t                   offload_thread;
-    struct listnode             offload_cmd_list;
+    struct offload_cmd_ring     offload_cmds;
     bool                        offload_thread_blocked;
 
     stream_callback_t           offload_callback;
@@ -277,6 +338,22 @@ struct stream_out {
     struct compr_gapless_mdata  gapless_mdata;
     int                         send_new_metadata;
 
+    bool                        use_ring;
+    struct out_ring             ring;
+    pthread_t                   drain_thread;
+    pthread_mutex_t             drain_lock; /* held by the drain thread while writing to the pcms */
+    atomic_bool                 drain_thread_exit;
+
+    pthread_mutex_t             fanout_lock;
+    pthread_cond_t              fanout_cond;      /* a buffer was posted to the writers */
+    pthread_cond_t              fanout_done_cond; /* all writers are done with the buffer */
+    const void*                 fanout_buffer;
+    size_t                      fanout_bytes;
+    uint32_t                    fanout_generation;
+    int                         fanout_pending;
+    int                         fanout_writers;
+    bool                        fanout_exit;
+
     struct audio_device*        dev;
 
 #ifdef PREPROCESSING_ENABLED
@@ -291,6 +368,8 @@ struct stream_out {
     bool                         is_fastmixer_affinity_set;
 
     int64_t                      last_write_time_us;
+
+    struct stream_stats          stats;
 };
 
 struct stream_in {
@@ -313,6 +392,11 @@ struct stream_in {
     unsigned int                        requested_rate;
     struct resampler_itfe*              resampler;
     struct resampler_buffer_provider    buf_provider;
+    /* used instead of resampler if adev->polyphase_resampler and it handles the rates */
+    struct polyphase_resampler*         poly_resampler;
+    int16_t*                            rsmp_buf; /* a resampled period */
+    size_t                              rsmp_buf_frames;
+    size_t                              rsmp_buf_pos;
     int                                 read_status;
     int16_t*                            read_buf;
     size_t                              read_buf_size;
@@ -341,6 +425,8 @@ struct stream_in {
     int64_t                             last_read_time_us;
     int64_t                             frames_read; /* total frames read, not cleared when
                                                         entering standby */
+
+    struct stream_stats                 stats;
 };
 
 struct mixer_card {
@@ -350,6 +436,15 @@ struct mixer_card {
     struct mixer*       mixer;
     struct audio_route* audio_route;
     struct timespec     dsp_poweroff_time;
+    bool                route_pending; /* paths changed, mixer not updated yet */
+};
+
+/* A path enable postponed until the DSPs of its card had time to power off */
+struct deferred_route {
+    struct listnode     node;
+    struct mixer_card*  mixer_card;
+    snd_device_t        snd_device;
+    struct timespec     due_time;
 };
 
 struct audio_usecase {
@@ -375,6 +470,7 @@ struct audio_device {
     struct audio_hw_device  device;
     pthread_mutex_t         lock; /* see note below on mutex acquisition order */
     struct listnode         mixer_list;
+    int                     route_batch; /* nesting of begin_route_batch() */
     audio_mode_t            mode;
     struct stream_in*       active_input;
     struct stream_out*      primary_output;
@@ -409,11 +505,27 @@ struct audio_device {
 
     pthread_mutex_t         lock_inputs; /* see note below on mutex acquisition order */
     amplifier_device_t      *amp;
+
+    bool                    deep_buffer_ring;
+    bool                    polyphase_resampler;
+
+    /* routing worker applying the deferred routes, only with DSP_POWEROFF_DELAY */
+    pthread_t               route_thread;
+    bool                    route_thread_running;
+    bool                    route_thread_exit;
+    pthread_cond_t          route_cond;      /* route queued or exit requested */
+    pthread_cond_t          route_done_cond; /* deferred route applied */
+    struct listnode         deferred_routes; /* sorted by due_time */
+
+    /* telemetry, only updated with adev->lock held, see audio_stats.c */
+    struct latency_hist     lock_wait;       /* contended acquisitions of adev->lock */
+    struct latency_hist     start_latency;   /* start_output_stream()/start_input_stream() */
+    struct latency_hist     route_latency[SND_DEVICE_MAX]; /* enable_snd_device() */
 };
 
 /*
  * NOTE: when multiple mutexes have to be acquired, always take the
- * lock_inputs, stream_in, stream_out, then audio_device mutex.
+ * lock_inputs, stream_in, stream_out, stream_out drain_lock, then audio_device mutex.
  * stream_in mutex must always be before stream_out mutex
  * lock_inputs must be held in order to either close the input stream, or prevent closure.
  */
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Always on latency and xrun telemetry.
+ *
+ * Everything here is a clock read and a few increments, cheap enough to
+ * stay on in every build. The histograms are reported by out_dump(),
+ * in_dump() and adev_dump(), the per stream counters are also published
+ * as atrace counters so they line up with the rest of a systrace.
+ */
+
+#define LOG_TAG "audio_hw_primary"
+/*#define LOG_NDEBUG 0*/
+#define ATRACE_TAG (ATRACE_TAG_AUDIO | ATRACE_TAG_HAL)
+
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <cutils/log.h>
+#include <cutils/trace.h>
+
+#include "audio_hw.h"
+#include "audio_stats.h"
+
+#define LATENCY_HIST_FIRST_US 64
+
+int64_t audio_stats_now_ns(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+void latency_hist_add(struct latency_hist *hist, int64_t ns)
+{
+    uint64_t limit = LATENCY_HIST_FIRST_US * 1000ULL;
+    int i;
+
+    if (ns < 0)
+        ns = 0;
+
+    for (i = 0; i < LATENCY_HIST_BUCKETS - 1 && (uint64_t)ns >= limit; i++)
+        limit <<= 1;
+    hist->buckets[i]++;
+    hist->count++;
+    hist->total_ns += ns;
+    if ((uint64_t)ns > hist->max_ns)
+        hist->max_ns = ns;
+}
+
+void latency_hist_dump(int fd, const char *name, const struct latency_hist *hist)
+{
+    uint64_t limit = LATENCY_HIST_FIRST_US;
+    int i;
+
+    if (hist->count == 0)
+        return;
+
+    dprintf(fd, "      %s: %u calls, mean %" PRIu64 " us, max %" PRIu64 " us\n",
+            name, hist->count, hist->total_ns / hist->count / 1000, hist->max_ns / 1000);
+    dprintf(fd, "       ");
+    for (i = 0; i < LATENCY_HIST_BUCKETS; i++, limit <<= 1) {
+        if (hist->buckets[i] == 0)
+            continue;
+        if (i == LATENCY_HIST_BUCKETS - 1)
+            dprintf(fd, " >=%" PRIu64 "us:%u", limit >> 1, hist->buckets[i]);
+        else
+            dprintf(fd, " <%" PRIu64 "us:%u", limit, hist->buckets[i]);
+    }
+    dprintf(fd, "\n");
+}
+
+void stream_stats_init(struct stream_stats *stats, const char *name)
+{
+    snprintf(stats->trace_io, sizeof(stats->trace_io), "%s io us", name);
+    snprintf(stats->trace_xruns, sizeof(stats->trace_xruns), "%s xruns", name);
+    snprintf(stats->trace_drift, sizeof(stats->trace_drift), "%s drift frames", name);
+    atomic_init(&stats->xruns, 0);
+}
+
+/* must be called by the thread writing to or reading from the stream */
+void stream_stats_io(struct stream_stats *stats, int64_t start_ns)
+{
+    int64_t ns = audio_stats_now_ns() - start_ns;
+
+    latency_hist_add(&stats->io, ns);
+    ATRACE_INT(stats->trace_io, (int32_t)(ns / 1000));
+}
+
+/* may be called from any thread writing to a pcm device of the stream */
+void stream_stats_xrun(struct stream_stats *stats)
+{
+    uint32_t xruns = atomic_fetch_add_explicit(&stats->xruns, 1, memory_order_relaxed) + 1;
+
+    ATRACE_INT(stats->trace_xruns, (int32_t)xruns);
+}
+
+/*
+ * Compares the frames presented since the last position with what the
+ * clock says should have been presented. Must be called with the stream
+ * locked.
+ */
+void stream_stats_position(struct stream_stats *stats, uint64_t frames,
+                           const struct timespec *timestamp, uint32_t sample_rate)
+{
+    int64_t now_ns = timestamp->tv_sec * 1000000000LL + timestamp->tv_nsec;
+    int64_t expected;
+
+    if (stats->last_position_ns != 0 && now_ns > stats->last_position_ns) {
+        expected = (now_ns - stats->last_position_ns) * sample_rate / 1000000000LL;
+        stats->drift_frames = (int64_t)(frames - stats->last_frames) - expected;
+        if (llabs(stats->drift_frames) > llabs(stats->max_drift_frames))
+            stats->max_drift_frames = stats->drift_frames;
+        ATRACE_INT(stats->trace_drift, (int32_t)stats->drift_frames);
+    }
+    stats->last_frames = frames;
+    stats->last_position_ns = now_ns;
+}
+
+/* the position stops while in standby, don't count that as drift */
+void stream_stats_standby(struct stream_stats *stats)
+{
+    stats->last_position_ns = 0;
+}
+
+void stream_stats_dump(int fd, const struct stream_stats *stats)
+{
+    latency_hist_dump(fd, "I/O", &stats->io);
+    dprintf(fd, "      Errors: %u, xruns: %u\n", stats->errors,
+            atomic_load_explicit(&stats->xruns, memory_order_relaxed));
+    dprintf(fd, "      Position drift: last %" PRId64 " frames, max %" PRId64 " frames\n",
+            stats->drift_frames, stats->max_drift_frames);
+}
@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AUDIO_STATS_H
+#define AUDIO_STATS_H
+
+int64_t audio_stats_now_ns(void);
+
+void latency_hist_add(struct latency_hist *hist, int64_t ns);
+
+void latency_hist_dump(int fd, const char *name, const struct latency_hist *hist);
+
+void stream_stats_init(struct stream_stats *stats, const char *name);
+
+void stream_stats_io(struct stream_stats *stats, int64_t start_ns);
+
+void stream_stats_xrun(struct stream_stats *stats);
+
+void stream_stats_position(struct stream_stats *stats, uint64_t frames,
+                           const struct timespec *timestamp, uint32_t sample_rate);
+
+void stream_stats_standby(struct stream_stats *stats);
+
+void stream_stats_dump(int fd, const struct stream_stats *stats);
+
+#endif // AUDIO_STATS_H
@@ -29,6 +29,9 @@
 #include <pthread.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 #include <sys/resource.h>
 #include <sys/prctl.h>
 
@@ -41,14 +44,21 @@
 #include <samsung_audio.h>
 
 #include "audio_hw.h"
+#include "sound/asound.h"
 #include "sound/compress_params.h"
 
 #define MIXER_CTL_COMPRESS_PLAYBACK_VOLUME "Compress Playback Volume"
 
+#define AUDIO_OFFLOAD_CODEC_FLAC_MIN_BLK_SIZE "music_offload_flac_min_blk_size"
+#define AUDIO_OFFLOAD_CODEC_FLAC_MAX_BLK_SIZE "music_offload_flac_max_blk_size"
+#define AUDIO_OFFLOAD_CODEC_FLAC_MIN_FRAME_SIZE "music_offload_flac_min_frame_size"
+#define AUDIO_OFFLOAD_CODEC_FLAC_MAX_FRAME_SIZE "music_offload_flac_max_frame_size"
+
 
 /* Prototypes */
 void lock_input_stream(struct stream_in *in);
 void lock_output_stream(struct stream_out *out);
+void lock_adev(struct audio_device *adev);
 int disable_snd_device(struct audio_device *adev,
                               struct audio_usecase *uc_info,
                               snd_device_t snd_device,
@@ -56,19 +66,60 @@ int disable_snd_device(struct audio_device *adev,
 int enable_output_path_l(struct stream_out *out);
 int disable_output_path_l(struct stream_out *out);
 
-/* must be called with out->lock locked */
+static void wake_offload_thread(struct offload_cmd_ring *ring)
+{
+    uint64_t one = 1;
+
+    while (write(ring->event_fd, &one, sizeof(one)) < 0 && errno == EINTR);
+}
+
+/*
+ * must be called with out->lock locked. Commands are never dropped: a full
+ * ring waits on out->cond, which the offload thread signals after every
+ * command, with out->lock released so the thread can get there.
+ */
 static int send_offload_cmd_l(struct stream_out* out, int command)
 {
-    struct offload_cmd *cmd = (struct offload_cmd *)calloc(1, sizeof(struct offload_cmd));
+    struct offload_cmd_ring *ring = &out->offload_cmds;
+    uint32_t rear = atomic_load_explicit(&ring->rear, memory_order_relaxed);
 
     ALOGVV("%s %d", __func__, command);
 
-    cmd->cmd = command;
-    list_add_tail(&out->offload_cmd_list, &cmd->node);
-    pthread_cond_signal(&out->offload_cond);
+    while (rear - atomic_load_explicit(&ring->front, memory_order_acquire) ==
+            OFFLOAD_CMD_RING_SIZE) {
+        ALOGW("%s: command ring full, waiting to queue command %d", __func__, command);
+        pthread_cond_wait(&out->cond, &out->lock);
+    }
+
+    ring->cmds[rear & (OFFLOAD_CMD_RING_SIZE - 1)] = command;
+    atomic_store_explicit(&ring->rear, rear + 1, memory_order_release);
+    wake_offload_thread(ring);
     return 0;
 }
 
+/* blocks until a command is queued or exit is requested, without holding out->lock */
+static int receive_offload_cmd(struct stream_out *out)
+{
+    struct offload_cmd_ring *ring = &out->offload_cmds;
+    uint32_t front = atomic_load_explicit(&ring->front, memory_order_relaxed);
+    uint64_t count;
+    int cmd;
+
+    for (;;) {
+        if (atomic_load_explicit(&ring->exit, memory_order_acquire))
+            return OFFLOAD_CMD_EXIT;
+        if (front != atomic_load_explicit(&ring->rear, memory_order_acquire))
+            break;
+        ALOGV("%s SLEEPING", __func__);
+        while (read(ring->event_fd, &count, sizeof(count)) < 0 && errno == EINTR);
+        ALOGV("%s RUNNING", __func__);
+    }
+
+    cmd = ring->cmds[front & (OFFLOAD_CMD_RING_SIZE - 1)];
+    atomic_store_explicit(&ring->front, front + 1, memory_order_release);
+    return cmd;
+}
+
 /* must be called iwth out->lock locked */
 void stop_compressed_output_l(struct stream_out *out)
 {
@@ -84,50 +135,33 @@ void stop_compressed_output_l(struct stream_out *out)
 static void *offload_thread_loop(void *context)
 {
     struct stream_out *out = (struct stream_out *) context;
-    struct listnode *item;
 
     setpriority(PRIO_PROCESS, 0, ANDROID_PRIORITY_AUDIO);
     set_sched_policy(0, SP_FOREGROUND);
     prctl(PR_SET_NAME, (unsigned long)"Offload Callback", 0, 0, 0);
 
     ALOGV("%s", __func__);
-    lock_output_stream(out);
     for (;;) {
-        struct offload_cmd *cmd = NULL;
+        int cmd = receive_offload_cmd(out);
         stream_callback_event_t event;
         bool send_callback = false;
 
-        ALOGVV("%s offload_cmd_list %d out->offload_state %d",
-              __func__, list_empty(&out->offload_cmd_list),
-              out->offload_state);
-        if (list_empty(&out->offload_cmd_list)) {
-            ALOGV("%s SLEEPING", __func__);
-            pthread_cond_wait(&out->offload_cond, &out->lock);
-            ALOGV("%s RUNNING", __func__);
-            continue;
-        }
-
-        item = list_head(&out->offload_cmd_list);
-        cmd = node_to_item(item, struct offload_cmd, node);
-        list_remove(item);
+        if (cmd == OFFLOAD_CMD_EXIT)
+            break;
 
+        lock_output_stream(out);
         ALOGVV("%s STATE %d CMD %d out->compr %p",
-               __func__, out->offload_state, cmd->cmd, out->compr);
-
-        if (cmd->cmd == OFFLOAD_CMD_EXIT) {
-            free(cmd);
-            break;
-        }
+               __func__, out->offload_state, cmd, out->compr);
 
         if (out->compr == NULL) {
             ALOGE("%s: Compress handle is NULL", __func__);
-            pthread_cond_signal(&out->cond);
+            pthread_cond_broadcast(&out->cond);
+            pthread_mutex_unlock(&out->lock);
             continue;
         }
         out->offload_thread_blocked = true;
         pthread_mutex_unlock(&out->lock);
-        send_callback = false;
-        switch(cmd->cmd) {
+        switch(cmd) {
         case OFFLOAD_CMD_WAIT_FOR_BUFFER:
             compress_wait(out->compr, -1);
             send_callback = true;
@@ -145,24 +179,21 @@ static void *offload_thread_loop(void *context)
             event = STREAM_CBK_EVENT_DRAIN_READY;
             break;
         default:
-            ALOGE("%s unknown command received: %d", __func__, cmd->cmd);
+            ALOGE("%s unknown command received: %d", __func__, cmd);
             break;
         }
         lock_output_stream(out);
         out->offload_thread_blocked = false;
-        pthread_cond_signal(&out->cond);
+        /* wakes stop_compressed_output_l() and senders waiting for ring space */
+        pthread_cond_broadcast(&out->cond);
         if (send_callback) {
             out->offload_callback(event, NULL, out->offload_cookie);
         }
-        free(cmd);
+        pthread_mutex_unlock(&out->lock);
     }
 
-    pthread_cond_signal(&out->cond);
-    while (!list_empty(&out->offload_cmd_list)) {
-        item = list_head(&out->offload_cmd_list);
-        list_remove(item);
-        free(node_to_item(item, struct offload_cmd, node));
-    }
+    lock_output_stream(out);
+    pthread_cond_broadcast(&out->cond);
     pthread_mutex_unlock(&out->lock);
 
     return NULL;
@@ -170,54 +201,187 @@ static void *offload_thread_loop(void *context)
 
 int create_offload_callback_thread(struct stream_out *out)
 {
-    pthread_cond_init(&out->offload_cond, (const pthread_condattr_t *) NULL);
-    list_init(&out->offload_cmd_list);
-    pthread_create(&out->offload_thread, (const pthread_attr_t *) NULL,
-                    offload_thread_loop, out);
+    int ret;
+
+    out->offload_cmds.event_fd = eventfd(0, EFD_CLOEXEC);
+    if (out->offload_cmds.event_fd < 0) {
+        ALOGE("%s: eventfd failed: %s", __func__, strerror(errno));
+        return -errno;
+    }
+    atomic_init(&out->offload_cmds.rear, 0);
+    atomic_init(&out->offload_cmds.front, 0);
+    atomic_init(&out->offload_cmds.exit, false);
+
+    ret = pthread_create(&out->offload_thread, (const pthread_attr_t *) NULL,
+                         offload_thread_loop, out);
+    if (ret != 0) {
+        ALOGE("%s: failed to create offload thread: %d", __func__, ret);
+        close(out->offload_cmds.event_fd);
+        return -ret;
+    }
     return 0;
 }
 
 int destroy_offload_callback_thread(struct stream_out *out)
 {
-    lock_output_stream(out);
-    send_offload_cmd_l(out, OFFLOAD_CMD_EXIT);
+    /* not queued, so a full ring can't keep the thread from seeing it */
+    atomic_store_explicit(&out->offload_cmds.exit, true, memory_order_release);
+    wake_offload_thread(&out->offload_cmds);
 
-    pthread_mutex_unlock(&out->lock);
     pthread_join(out->offload_thread, (void **) NULL);
-    pthread_cond_destroy(&out->offload_cond);
+    close(out->offload_cmds.event_fd);
 
     return 0;
 }
 
-int parse_compress_metadata(struct stream_out *out, struct str_parms *parms)
+#ifdef OFFLOAD_FLAC_SUPPORTED
+static void set_flac_options(struct snd_codec *codec, const audio_offload_info_t *info)
+{
+    codec->options.flac_d.sample_size = info->bit_width ? info->bit_width : 16;
+    /* the block and frame sizes are set by parse_compress_metadata() */
+}
+#endif
+
+#ifdef OFFLOAD_PCM_SUPPORTED
+static void set_pcm_options(struct snd_codec *codec, const audio_offload_info_t *info)
+{
+    switch (info->format) {
+    case AUDIO_FORMAT_PCM_8_24_BIT:
+        codec->format = SNDRV_PCM_FORMAT_S24_LE;
+        break;
+    case AUDIO_FORMAT_PCM_24_BIT_PACKED:
+        codec->format = SNDRV_PCM_FORMAT_S24_3LE;
+        break;
+    default:
+        codec->format = SNDRV_PCM_FORMAT_S16_LE;
+        break;
+    }
+}
+#endif
+
+struct offload_codec {
+    audio_format_t format;  /* main format, the full format for linear PCM */
+    uint32_t       id;
+    void           (*set_options)(struct snd_codec *codec, const audio_offload_info_t *info);
+};
+
+static const struct offload_codec offload_codecs[] = {
+    { AUDIO_FORMAT_MP3, SND_AUDIOCODEC_MP3, NULL },
+    { AUDIO_FORMAT_AAC, SND_AUDIOCODEC_AAC, NULL },
+#ifdef OFFLOAD_FLAC_SUPPORTED
+    { AUDIO_FORMAT_FLAC, SND_AUDIOCODEC_FLAC, set_flac_options },
+#endif
+#ifdef OFFLOAD_VORBIS_SUPPORTED
+    { AUDIO_FORMAT_VORBIS, SND_AUDIOCODEC_VORBIS, NULL },
+#endif
+#if defined(OFFLOAD_OPUS_SUPPORTED) && defined(SND_AUDIOCODEC_OPUS)
+    { AUDIO_FORMAT_OPUS, SND_AUDIOCODEC_OPUS, NULL },
+#endif
+#ifdef OFFLOAD_PCM_SUPPORTED
+    { AUDIO_FORMAT_PCM_16_BIT, SND_AUDIOCODEC_PCM, set_pcm_options },
+    { AUDIO_FORMAT_PCM_8_24_BIT, SND_AUDIOCODEC_PCM, set_pcm_options },
+    { AUDIO_FORMAT_PCM_24_BIT_PACKED, SND_AUDIOCODEC_PCM, set_pcm_options },
+#endif
+};
+
+static const struct offload_codec *get_offload_codec(audio_format_t format)
+{
+    size_t i;
+
+    if (!audio_is_linear_pcm(format))
+        format &= AUDIO_FORMAT_MAIN_MASK;
+
+    for (i = 0; i < ARRAY_SIZE(offload_codecs); i++) {
+        if (offload_codecs[i].format == format)
+            return &offload_codecs[i];
+    }
+
+    return NULL;
+}
+
+/* fills the codec parameters of out->compr_config.codec from the offload info */
+int out_set_offload_codec(struct stream_out *out, const audio_offload_info_t *info)
+{
+    const struct offload_codec *offload_codec = get_offload_codec(info->format);
+    struct snd_codec *codec = out->compr_config.codec;
+
+    if (offload_codec == NULL) {
+        ALOGE("%s: Unsupported audio format %#x", __func__, info->format);
+        return -EINVAL;
+    }
+
+    codec->id = offload_codec->id;
+    codec->sample_rate = info->sample_rate;
+    codec->bit_rate = info->bit_rate;
+    if (offload_codec->set_options != NULL)
+        offload_codec->set_options(codec, info);
+
+    return 0;
+}
+
+static bool parse_metadata_u32(struct str_parms *parms, const char *key, uint32_t *val)
 {
-    int ret = 0;
     char value[32];
+
+    if (str_parms_get_str(parms, key, value, sizeof(value)) < 0)
+        return false;
+
+    *val = (uint32_t)atoi(value);
+    return true;
+}
+
+int parse_compress_metadata(struct stream_out *out, struct str_parms *parms)
+{
     struct compr_gapless_mdata tmp_mdata;
+    bool has_delay;
+    bool has_padding;
+#ifdef OFFLOAD_FLAC_SUPPORTED
+    struct snd_codec *codec = out ? out->compr_config.codec : NULL;
+    uint32_t val;
+#endif
 
     if (!out || !parms) {
         return -EINVAL;
     }
 
-    ret = str_parms_get_str(parms, AUDIO_OFFLOAD_CODEC_DELAY_SAMPLES, value, sizeof(value));
-    if (ret >= 0) {
-        tmp_mdata.encoder_delay = atoi(value); /* what is a good limit check? */
-    } else {
-        return -EINVAL;
+    lock_output_stream(out);
+
+#ifdef OFFLOAD_FLAC_SUPPORTED
+    /*
+     * The block and frame sizes are only handed to the DSP by compress_open(),
+     * there is no ioctl to change them for a gapless next track. They apply to
+     * the first track after the stream leaves standby; the tracks that follow
+     * gaplessly are decoded with those, which is fine as long as their sizes
+     * stay within the same bounds.
+     */
+    if (codec != NULL && codec->id == SND_AUDIOCODEC_FLAC) {
+        if (parse_metadata_u32(parms, AUDIO_OFFLOAD_CODEC_FLAC_MIN_BLK_SIZE, &val))
+            codec->options.flac_d.min_blk_size = val;
+        if (parse_metadata_u32(parms, AUDIO_OFFLOAD_CODEC_FLAC_MAX_BLK_SIZE, &val))
+            codec->options.flac_d.max_blk_size = val;
+        if (parse_metadata_u32(parms, AUDIO_OFFLOAD_CODEC_FLAC_MIN_FRAME_SIZE, &val))
+            codec->options.flac_d.min_frame_size = val;
+        if (parse_metadata_u32(parms, AUDIO_OFFLOAD_CODEC_FLAC_MAX_FRAME_SIZE, &val))
+            codec->options.flac_d.max_frame_size = val;
     }
+#endif
 
-    ret = str_parms_get_str(parms, AUDIO_OFFLOAD_CODEC_PADDING_SAMPLES, value, sizeof(value));
-    if (ret >= 0) {
-        tmp_mdata.encoder_padding = atoi(value);
-    } else {
+    has_delay = parse_metadata_u32(parms, AUDIO_OFFLOAD_CODEC_DELAY_SAMPLES,
+                                   &tmp_mdata.encoder_delay); /* what is a good limit check? */
+    has_padding = parse_metadata_u32(parms, AUDIO_OFFLOAD_CODEC_PADDING_SAMPLES,
+                                     &tmp_mdata.encoder_padding);
+    if (!has_delay || !has_padding) {
+        pthread_mutex_unlock(&out->lock);
         return -EINVAL;
     }
 
+    /* every gapless track needs its own metadata ioctl, even with unchanged values */
     out->gapless_mdata = tmp_mdata;
     out->send_new_metadata = 1;
     ALOGV("%s new encoder delay %u and padding %u", __func__,
           out->gapless_mdata.encoder_delay, out->gapless_mdata.encoder_padding);
 
+    pthread_mutex_unlock(&out->lock);
     return 0;
 }
 
@@ -267,7 +431,7 @@ ssize_t out_write_offload(struct audio_stream_out *stream, const void *buffer,
 
     if (out->offload_state == OFFLOAD_STATE_PAUSED_FLUSHED) {
         ALOGV("start offload write from pause state");
-        pthread_mutex_lock(&adev->lock);
+        lock_adev(adev);
         ret = enable_output_path_l(out);
         pthread_mutex_unlock(&adev->lock);
         if (ret != 0) {
@@ -341,7 +505,7 @@ int out_pause_offload(struct stream_out *out)
     if (out->compr != NULL && out->offload_state == OFFLOAD_STATE_PLAYING) {
         status = compress_pause(out->compr);
         out->offload_state = OFFLOAD_STATE_PAUSED;
-        pthread_mutex_lock(&out->dev->lock);
+        lock_adev(out->dev);
         status = disable_output_path_l(out);
         pthread_mutex_unlock(&out->dev->lock);
     }
@@ -357,7 +521,7 @@ int out_resume_offload(struct stream_out *out)
     status = 0;
     lock_output_stream(out);
     if (out->compr != NULL && out->offload_state == OFFLOAD_STATE_PAUSED) {
-        pthread_mutex_lock(&out->dev->lock);
+        lock_adev(out->dev);
         enable_output_path_l(out);
         pthread_mutex_unlock(&out->dev->lock);
         status = compress_resume(out->compr);
@@ -24,6 +24,8 @@ int create_offload_callback_thread(struct stream_out *out);
 
 int destroy_offload_callback_thread(struct stream_out *out);
 
+int out_set_offload_codec(struct stream_out *out, const audio_offload_info_t *info);
+
 int parse_compress_metadata(struct stream_out *out, struct str_parms *parms);
 
 int stop_output_offload_stream(struct stream_out *out, bool *disable);
@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Deep buffer output through a ring buffer.
+ *
+ * out_write() only copies into a lock-free single producer/single consumer
+ * ring and returns; a SCHED_FIFO drain thread per stream moves the frames to
+ * the pcm devices. The drain thread holds out->drain_lock while it touches
+ * the pcm devices, so routing and standby wait for at most one pcm_write()
+ * of the drain thread instead of a blocking out_write() holding out->lock.
+ */
+
+#define LOG_TAG "audio_hw_primary"
+/*#define LOG_NDEBUG 0*/
+/*#define VERY_VERY_VERBOSE_LOGGING*/
+#ifdef VERY_VERY_VERBOSE_LOGGING
+#define ALOGVV ALOGV
+#else
+#define ALOGVV(a...) do { } while(0)
+#endif
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+
+#include <cutils/log.h>
+
+#include <system/thread_defs.h>
+
+#include "audio_hw.h"
+#include "deep_buffer.h"
+
+#define DEEP_BUFFER_DRAIN_PRIORITY 2
+
+/* Prototypes */
+int out_write_pcm_devices_l(struct stream_out *out, void *buffer, size_t bytes);
+
+static uint32_t roundup_pow2(uint32_t v)
+{
+    v--;
+    v |= v >> 1;
+    v |= v >> 2;
+    v |= v >> 4;
+    v |= v >> 8;
+    v |= v >> 16;
+    return v + 1;
+}
+
+static void ring_signal(int fd)
+{
+    uint64_t one = 1;
+
+    while (write(fd, &one, sizeof(one)) < 0 && errno == EINTR);
+}
+
+static void ring_wait(int fd)
+{
+    uint64_t count;
+
+    while (read(fd, &count, sizeof(count)) < 0 && errno == EINTR);
+}
+
+static void *drain_thread_loop(void *context)
+{
+    struct stream_out *out = (struct stream_out *) context;
+    struct out_ring *ring = &out->ring;
+    uint32_t mask = ring->frames - 1;
+    uint32_t front = atomic_load_explicit(&ring->front, memory_order_relaxed);
+
+    prctl(PR_SET_NAME, (unsigned long)"Deep Buffer Drain", 0, 0, 0);
+
+    ALOGV("%s", __func__);
+    while (!atomic_load_explicit(&out->drain_thread_exit, memory_order_acquire)) {
+        uint32_t rear = atomic_load_explicit(&ring->rear, memory_order_acquire);
+        uint32_t frames = rear - front;
+        int ret;
+
+        if (frames == 0) {
+            ring_wait(ring->data_fd);
+            continue;
+        }
+
+        /* at most a period, and don't wrap around the end of the ring */
+        if (frames > out->config.period_size)
+            frames = out->config.period_size;
+        if (frames > ring->frames - (front & mask))
+            frames = ring->frames - (front & mask);
+
+        pthread_mutex_lock(&out->drain_lock);
+        if (front != atomic_load_explicit(&ring->front, memory_order_relaxed)) {
+            /* flushed by standby while we waited for the lock, start over */
+            front = atomic_load_explicit(&ring->front, memory_order_relaxed);
+            pthread_mutex_unlock(&out->drain_lock);
+            continue;
+        }
+        if (out->standby) {
+            /* nothing is open to play to, drop the frames like pcm_close() would */
+            ret = 0;
+        } else {
+            ret = out_write_pcm_devices_l(out, ring->data + (front & mask) * ring->frame_size,
+                                          frames * ring->frame_size);
+        }
+        /* publish the read index before a flush waiting on drain_lock can reset it */
+        front += frames;
+        atomic_store_explicit(&ring->front, front, memory_order_release);
+        pthread_mutex_unlock(&out->drain_lock);
+
+        ring_signal(ring->space_fd);
+
+        if (ret != 0) {
+            ALOGE("%s: error %d writing to the pcm devices", __func__, ret);
+            out->stream.common.standby(&out->stream.common);
+            /* don't spin on a broken device */
+            usleep(frames * 1000000LL / out->config.rate);
+        }
+    }
+    ALOGV("%s: exit", __func__);
+
+    return NULL;
+}
+
+int create_deep_buffer_thread(struct stream_out *out)
+{
+    struct out_ring *ring = &out->ring;
+    struct sched_param param = { .sched_priority = DEEP_BUFFER_DRAIN_PRIORITY };
+    pthread_attr_t attr;
+    int ret;
+
+    ring->frame_size = audio_stream_out_frame_size(&out->stream);
+    ring->frames = roundup_pow2(out->config.period_size * DEEP_BUFFER_RING_PERIOD_COUNT);
+    atomic_init(&ring->rear, 0);
+    atomic_init(&ring->front, 0);
+    ring->data = (uint8_t *)calloc(ring->frames, ring->frame_size);
+    if (ring->data == NULL)
+        return -ENOMEM;
+
+    ring->data_fd = eventfd(0, EFD_CLOEXEC);
+    ring->space_fd = eventfd(0, EFD_CLOEXEC);
+    if (ring->data_fd < 0 || ring->space_fd < 0) {
+        ret = -errno;
+        goto error;
+    }
+
+    atomic_init(&out->drain_thread_exit, false);
+    pthread_mutex_init(&out->drain_lock, (const pthread_mutexattr_t *) NULL);
+
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    pthread_attr_setschedparam(&attr, &param);
+    ret = -pthread_create(&out->drain_thread, &attr, drain_thread_loop, out);
+    pthread_attr_destroy(&attr);
+    if (ret == -EPERM) {
+        /* no RT budget for this process, run at audio priority instead */
+        ALOGW("%s: SCHED_FIFO not permitted, falling back to SCHED_OTHER", __func__);
+        ret = -pthread_create(&out->drain_thread, (const pthread_attr_t *) NULL,
+                              drain_thread_loop, out);
+        if (ret == 0)
+            setpriority(PRIO_PROCESS, pthread_gettid_np(out->drain_thread),
+                        ANDROID_PRIORITY_URGENT_AUDIO);
+    }
+    if (ret != 0) {
+        pthread_mutex_destroy(&out->drain_lock);
+        goto error;
+    }
+
+    ALOGV("%s: ring of %u frames", __func__, ring->frames);
+    return 0;
+
+error:
+    ALOGE("%s: failed to set up the drain thread (%d)", __func__, ret);
+    if (ring->data_fd >= 0)
+        close(ring->data_fd);
+    if (ring->space_fd >= 0)
+        close(ring->space_fd);
+    free(ring->data);
+    ring->data = NULL;
+    return ret;
+}
+
+int destroy_deep_buffer_thread(struct stream_out *out)
+{
+    struct out_ring *ring = &out->ring;
+
+    atomic_store_explicit(&out->drain_thread_exit, true, memory_order_release);
+    ring_signal(ring->data_fd);
+    pthread_join(out->drain_thread, (void **) NULL);
+
+    pthread_mutex_destroy(&out->drain_lock);
+    close(ring->data_fd);
+    close(ring->space_fd);
+    free(ring->data);
+    ring->data = NULL;
+
+    return 0;
+}
+
+/*
+ * Drop whatever is still queued, called on standby with out->lock and
+ * out->drain_lock held. The drain thread owns the read index and notices the
+ * jump once it gets drain_lock back; the write index is only ever moved by
+ * out_write(), so catching the read index up to it is what resets the ring
+ * without racing a concurrent writer.
+ */
+void flush_deep_buffer_l(struct stream_out *out)
+{
+    struct out_ring *ring = &out->ring;
+
+    atomic_store_explicit(&ring->front,
+                          atomic_load_explicit(&ring->rear, memory_order_acquire),
+                          memory_order_release);
+    ring_signal(ring->space_fd);
+}
+
+/* called without out->lock held, see out_write() */
+ssize_t out_write_deep_buffer(struct stream_out *out, const void *buffer,
+                              size_t bytes)
+{
+    struct out_ring *ring = &out->ring;
+    const uint8_t *src = (const uint8_t *)buffer;
+    uint32_t mask = ring->frames - 1;
+    uint32_t rear = atomic_load_explicit(&ring->rear, memory_order_relaxed);
+    size_t remaining = bytes / ring->frame_size;
+
+    while (remaining > 0) {
+        uint32_t front = atomic_load_explicit(&ring->front, memory_order_acquire);
+        uint32_t frames = ring->frames - (rear - front);
+
+        if (frames == 0) {
+            /* full, this is where AudioFlinger gets its back pressure */
+            ring_wait(ring->space_fd);
+            continue;
+        }
+
+        if (frames > remaining)
+            frames = remaining;
+        if (frames > ring->frames - (rear & mask))
+            frames = ring->frames - (rear & mask);
+
+        memcpy(ring->data + (rear & mask) * ring->frame_size, src, frames * ring->frame_size);
+        src += frames * ring->frame_size;
+        remaining -= frames;
+
+        rear += frames;
+        atomic_store_explicit(&ring->rear, rear, memory_order_release);
+        ring_signal(ring->data_fd);
+    }
+
+    return bytes;
+}
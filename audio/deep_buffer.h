@@ -0,0 +1,29 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DEEP_BUFFER_H
+#define DEEP_BUFFER_H
+
+int create_deep_buffer_thread(struct stream_out *out);
+
+int destroy_deep_buffer_thread(struct stream_out *out);
+
+void flush_deep_buffer_l(struct stream_out *out);
+
+ssize_t out_write_deep_buffer(struct stream_out *out, const void *buffer,
+                              size_t bytes);
+
+#endif // DEEP_BUFFER_H
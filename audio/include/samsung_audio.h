@@ -59,6 +59,32 @@
 #define SOUND_CAPTURE_HOTWORD_DEVICE 0
 */
 
+/*
+ * MMAP/no-IRQ devices for AAudio. Define them if the kernel driver exposes
+ * PCMs which can be mmapped and run without period interrupts.
+ *
+#define SOUND_MMAP_PLAYBACK_DEVICE 5
+#define SOUND_MMAP_CAPTURE_DEVICE 5
+ */
+
+/*
+ * Capture rates the PCM can be opened at besides 48 kHz. Streams asking for
+ * one of them are captured at that rate and skip the resampler.
+ *
+#define CAPTURE_SUPPORTED_SAMPLING_RATES 8000, 16000
+ */
+
+/*
+ * Compress offload formats the DSP firmware decodes on top of MP3 and AAC.
+ * FLAC needs the snd_dec_flac options (flac_d) in the kernel's
+ * sound/compress_params.h, Opus a kernel defining SND_AUDIOCODEC_OPUS.
+ *
+#define OFFLOAD_FLAC_SUPPORTED
+#define OFFLOAD_VORBIS_SUPPORTED
+#define OFFLOAD_OPUS_SUPPORTED
+#define OFFLOAD_PCM_SUPPORTED
+ */
+
 /*
  * If the device has stereo speakers and the speakers are arranged on
  * different sides of the device you can activate this feature by
@@ -80,6 +106,8 @@
  * A good value to start with is 10ms:
  *
  * #define DSP_POWEROFF_DELAY 10 * 1000
+ *
+ * or TARGET_AUDIOHAL_DSP_POWEROFF_DELAY := 10000 in BoardConfig.mk.
  */
 /* #define DSP_POWEROFF_DELAY 0 */
 
@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Parallel writes to the pcm devices of a stream.
+ *
+ * When a stream plays on several pcm devices at once (e.g. speaker and
+ * HDMI), every device but the first gets a writer thread. A write posts the
+ * buffer to the writers, writes the first device on the calling thread and
+ * waits until every writer is done, so a write takes as long as the slowest
+ * device instead of the sum of all of them. fanout_lock is only ever taken
+ * on its own.
+ */
+
+#define LOG_TAG "audio_hw_primary"
+/*#define LOG_NDEBUG 0*/
+/*#define VERY_VERY_VERBOSE_LOGGING*/
+#ifdef VERY_VERY_VERBOSE_LOGGING
+#define ALOGVV ALOGV
+#else
+#define ALOGVV(a...) do { } while(0)
+#endif
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+
+#include <cutils/log.h>
+
+#include <system/thread_defs.h>
+
+#include "audio_hw.h"
+#include "audio_stats.h"
+#include "pcm_fanout.h"
+
+static int pcm_device_write(struct stream_out *out, struct pcm_device *pcm_device,
+                            const void *buffer, size_t bytes)
+{
+    int ret;
+
+    /*
+     * The pcm is opened with PCM_NORESTART, so an underrun comes back as
+     * -EPIPE instead of being recovered silently inside tinyalsa. Count it,
+     * prepare the pcm again and retry the write once.
+     */
+    ret = pcm_write(pcm_device->pcm, buffer, bytes);
+    if (ret == -EPIPE) {
+        pcm_device->underruns++;
+        stream_stats_xrun(&out->stats);
+        ret = pcm_prepare(pcm_device->pcm);
+        if (ret == 0)
+            ret = pcm_write(pcm_device->pcm, buffer, bytes);
+    }
+
+    pcm_device->status = ret;
+    return ret;
+}
+
+static void *fanout_thread_loop(void *context)
+{
+    struct pcm_device *pcm_device = (struct pcm_device *) context;
+    struct stream_out *out = pcm_device->fanout_out;
+    const void *buffer;
+    size_t bytes;
+
+    setpriority(PRIO_PROCESS, 0, ANDROID_PRIORITY_URGENT_AUDIO);
+    prctl(PR_SET_NAME, (unsigned long)"PCM Fanout", 0, 0, 0);
+
+    pthread_mutex_lock(&out->fanout_lock);
+    for (;;) {
+        if (out->fanout_exit)
+            break;
+
+        if (pcm_device->fanout_generation == out->fanout_generation) {
+            pthread_cond_wait(&out->fanout_cond, &out->fanout_lock);
+            continue;
+        }
+
+        pcm_device->fanout_generation = out->fanout_generation;
+        buffer = out->fanout_buffer;
+        bytes = out->fanout_bytes;
+        pthread_mutex_unlock(&out->fanout_lock);
+
+        pcm_device_write(out, pcm_device, buffer, bytes);
+
+        pthread_mutex_lock(&out->fanout_lock);
+        if (--out->fanout_pending == 0)
+            pthread_cond_signal(&out->fanout_done_cond);
+    }
+    pthread_mutex_unlock(&out->fanout_lock);
+
+    return NULL;
+}
+
+/*
+ * must be called with out->lock locked, after the pcm devices were opened.
+ * Devices left without a writer thread are written by the caller.
+ */
+void pcm_fanout_start(struct stream_out *out)
+{
+    struct pcm_device *pcm_device;
+    struct listnode *node;
+    bool first = true;
+    int ret;
+
+    out->fanout_writers = 0;
+    out->fanout_exit = false;
+
+    list_for_each(node, &out->pcm_dev_list) {
+        pcm_device = node_to_item(node, struct pcm_device, stream_list_node);
+        if (pcm_device->pcm == NULL)
+            continue;
+        /* the first device is always written by the caller */
+        if (first) {
+            first = false;
+            continue;
+        }
+
+        pcm_device->fanout_out = out;
+        pcm_device->fanout_generation = out->fanout_generation;
+        ret = pthread_create(&pcm_device->fanout_thread, (const pthread_attr_t *) NULL,
+                             fanout_thread_loop, pcm_device);
+        if (ret != 0) {
+            ALOGE("%s: failed to create writer thread: %d", __func__, ret);
+            break;
+        }
+        pcm_device->has_fanout_thread = true;
+        out->fanout_writers++;
+    }
+
+    ALOGV("%s: %d writer thread(s)", __func__, out->fanout_writers);
+}
+
+/* must be called with out->lock locked, before the pcm devices are closed */
+void pcm_fanout_stop(struct stream_out *out)
+{
+    struct pcm_device *pcm_device;
+    struct listnode *node;
+
+    pthread_mutex_lock(&out->fanout_lock);
+    out->fanout_exit = true;
+    pthread_cond_broadcast(&out->fanout_cond);
+    pthread_mutex_unlock(&out->fanout_lock);
+
+    list_for_each(node, &out->pcm_dev_list) {
+        pcm_device = node_to_item(node, struct pcm_device, stream_list_node);
+        if (pcm_device->has_fanout_thread) {
+            pthread_join(pcm_device->fanout_thread, (void **) NULL);
+            pcm_device->has_fanout_thread = false;
+        }
+    }
+
+    out->fanout_writers = 0;
+    out->fanout_exit = false;
+}
+
+/* writes the same buffer to every opened pcm device of the stream */
+int pcm_fanout_write(struct stream_out *out, const void *buffer, size_t bytes)
+{
+    struct pcm_device *pcm_device;
+    struct listnode *node;
+    int ret = 0;
+
+    if (out->fanout_writers > 0) {
+        pthread_mutex_lock(&out->fanout_lock);
+        out->fanout_buffer = buffer;
+        out->fanout_bytes = bytes;
+        out->fanout_pending = out->fanout_writers;
+        out->fanout_generation++;
+        pthread_cond_broadcast(&out->fanout_cond);
+        pthread_mutex_unlock(&out->fanout_lock);
+    }
+
+    list_for_each(node, &out->pcm_dev_list) {
+        pcm_device = node_to_item(node, struct pcm_device, stream_list_node);
+        if (pcm_device->pcm != NULL && !pcm_device->has_fanout_thread) {
+            ALOGVV("%s: writing buffer (%zu bytes) to pcm device", __func__, bytes);
+            pcm_device_write(out, pcm_device, buffer, bytes);
+        }
+    }
+
+    if (out->fanout_writers > 0) {
+        pthread_mutex_lock(&out->fanout_lock);
+        while (out->fanout_pending > 0)
+            pthread_cond_wait(&out->fanout_done_cond, &out->fanout_lock);
+        pthread_mutex_unlock(&out->fanout_lock);
+    }
+
+    list_for_each(node, &out->pcm_dev_list) {
+        pcm_device = node_to_item(node, struct pcm_device, stream_list_node);
+        if (pcm_device->pcm != NULL && pcm_device->status != 0)
+            ret = pcm_device->status;
+    }
+
+    return ret;
+}
@@ -0,0 +1,26 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PCM_FANOUT_H
+#define PCM_FANOUT_H
+
+void pcm_fanout_start(struct stream_out *out);
+
+void pcm_fanout_stop(struct stream_out *out);
+
+int pcm_fanout_write(struct stream_out *out, const void *buffer, size_t bytes);
+
+#endif // PCM_FANOUT_H
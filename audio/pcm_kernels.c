@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Vectorized sample loops of the capture path.
+ *
+ * The variant is picked at build time: NEON is always there on the arm
+ * targets this HAL is built for, SSE2 always on x86. Layouts without a
+ * vector loop and the tail of every buffer go through the scalar loop.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PCM_KERNELS_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define PCM_KERNELS_SSE2
+#endif
+
+#include "pcm_kernels.h"
+
+static void extract_channels_i16_c(int16_t *dst, const int16_t *src, size_t frames,
+                                   size_t src_channels, size_t dst_channels)
+{
+    size_t i;
+
+    if (dst_channels == 1) {
+        for (i = 0; i < frames; i++) {
+            *dst++ = *src;
+            src += src_channels;
+        }
+    } else {
+        for (i = 0; i < frames; i++) {
+            memcpy(dst, src, dst_channels * sizeof(int16_t));
+            dst += dst_channels;
+            src += src_channels;
+        }
+    }
+}
+
+#if defined(PCM_KERNELS_NEON)
+/* returns the number of frames done, a vector at a time */
+static size_t extract_channels_i16_simd(int16_t *dst, const int16_t *src, size_t frames,
+                                        size_t src_channels, size_t dst_channels)
+{
+    size_t done = 0;
+
+    if (src_channels == 2 && dst_channels == 1) {
+        for (; frames - done >= 8; done += 8, src += 16, dst += 8) {
+            int16x8x2_t v = vld2q_s16(src);
+            vst1q_s16(dst, v.val[0]);
+        }
+    } else if (src_channels == 3 && dst_channels == 1) {
+        for (; frames - done >= 8; done += 8, src += 24, dst += 8) {
+            int16x8x3_t v = vld3q_s16(src);
+            vst1q_s16(dst, v.val[0]);
+        }
+    } else if (src_channels == 3 && dst_channels == 2) {
+        for (; frames - done >= 8; done += 8, src += 24, dst += 16) {
+            int16x8x3_t v = vld3q_s16(src);
+            int16x8x2_t o = { { v.val[0], v.val[1] } };
+            vst2q_s16(dst, o);
+        }
+    } else if (src_channels == 4 && dst_channels == 1) {
+        for (; frames - done >= 8; done += 8, src += 32, dst += 8) {
+            int16x8x4_t v = vld4q_s16(src);
+            vst1q_s16(dst, v.val[0]);
+        }
+    } else if (src_channels == 4 && dst_channels == 2) {
+        /* a stereo frame is one 32 bit lane */
+        for (; frames - done >= 8; done += 8, src += 32, dst += 16) {
+            int32x4x2_t v = vld2q_s32((const int32_t *)src);
+            int32x4x2_t w = vld2q_s32((const int32_t *)(src + 16));
+            vst1q_s32((int32_t *)dst, v.val[0]);
+            vst1q_s32((int32_t *)(dst + 8), w.val[0]);
+        }
+    }
+
+    return done;
+}
+#elif defined(PCM_KERNELS_SSE2)
+/* returns the number of frames done, a vector at a time */
+static size_t extract_channels_i16_simd(int16_t *dst, const int16_t *src, size_t frames,
+                                        size_t src_channels, size_t dst_channels)
+{
+    size_t done = 0;
+
+    if (src_channels == 2 && dst_channels == 1) {
+        for (; frames - done >= 8; done += 8, src += 16, dst += 8) {
+            __m128i a = _mm_loadu_si128((const __m128i *)src);
+            __m128i b = _mm_loadu_si128((const __m128i *)(src + 8));
+            /* sign extend the first channel of each frame, the pack is then exact */
+            a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+            b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+            _mm_storeu_si128((__m128i *)dst, _mm_packs_epi32(a, b));
+        }
+    } else if (src_channels == 4 && dst_channels == 2) {
+        /* a stereo frame is one 32 bit lane, keep the even lanes */
+        for (; frames - done >= 4; done += 4, src += 16, dst += 8) {
+            __m128i a = _mm_loadu_si128((const __m128i *)src);
+            __m128i b = _mm_loadu_si128((const __m128i *)(src + 8));
+            a = _mm_shuffle_epi32(a, _MM_SHUFFLE(3, 1, 2, 0));
+            b = _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 1, 2, 0));
+            _mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi64(a, b));
+        }
+    }
+
+    return done;
+}
+#else
+static size_t extract_channels_i16_simd(int16_t *dst, const int16_t *src, size_t frames,
+                                        size_t src_channels, size_t dst_channels)
+{
+    (void)dst;
+    (void)src;
+    (void)frames;
+    (void)src_channels;
+    (void)dst_channels;
+
+    return 0;
+}
+#endif
+
+void extract_channels_i16(int16_t *dst, const int16_t *src, size_t frames,
+                          size_t src_channels, size_t dst_channels)
+{
+    size_t done = extract_channels_i16_simd(dst, src, frames, src_channels, dst_channels);
+
+    extract_channels_i16_c(dst + done * dst_channels, src + done * src_channels,
+                           frames - done, src_channels, dst_channels);
+}
+
+#if defined(PCM_KERNELS_NEON)
+static size_t dot_product_i16_simd(const int16_t *a, const int16_t *b, size_t n,
+                                   int32_t *sum)
+{
+    int32x4_t acc = vdupq_n_s32(0);
+    size_t done = 0;
+
+    for (; n - done >= 8; done += 8) {
+        int16x8_t va = vld1q_s16(a + done);
+        int16x8_t vb = vld1q_s16(b + done);
+        acc = vmlal_s16(acc, vget_low_s16(va), vget_low_s16(vb));
+        acc = vmlal_s16(acc, vget_high_s16(va), vget_high_s16(vb));
+    }
+    *sum = vgetq_lane_s32(acc, 0) + vgetq_lane_s32(acc, 1) +
+           vgetq_lane_s32(acc, 2) + vgetq_lane_s32(acc, 3);
+
+    return done;
+}
+#elif defined(PCM_KERNELS_SSE2)
+static size_t dot_product_i16_simd(const int16_t *a, const int16_t *b, size_t n,
+                                   int32_t *sum)
+{
+    __m128i acc = _mm_setzero_si128();
+    size_t done = 0;
+
+    for (; n - done >= 8; done += 8) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + done));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + done));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(va, vb));
+    }
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+    *sum = _mm_cvtsi128_si32(acc);
+
+    return done;
+}
+#else
+static size_t dot_product_i16_simd(const int16_t *a, const int16_t *b, size_t n,
+                                   int32_t *sum)
+{
+    (void)a;
+    (void)b;
+    (void)n;
+
+    *sum = 0;
+    return 0;
+}
+#endif
+
+int32_t dot_product_i16(const int16_t *a, const int16_t *b, size_t n)
+{
+    int32_t sum;
+    size_t i = dot_product_i16_simd(a, b, n, &sum);
+
+    for (; i < n; i++)
+        sum += a[i] * b[i];
+
+    return sum;
+}
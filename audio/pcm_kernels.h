@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PCM_KERNELS_H
+#define PCM_KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Copies the first dst_channels of every interleaved src frame to dst.
+ * dst and src must not overlap.
+ */
+void extract_channels_i16(int16_t *dst, const int16_t *src, size_t frames,
+                          size_t src_channels, size_t dst_channels);
+
+/* Returns the sum of a[i] * b[i], the caller makes sure it does not overflow */
+int32_t dot_product_i16(const int16_t *a, const int16_t *b, size_t n);
+
+#endif // PCM_KERNELS_H
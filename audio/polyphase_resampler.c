@@ -0,0 +1,253 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Block based polyphase resampler for the capture path.
+ *
+ * Resamples by up/down, the rates divided by their gcd, with a Kaiser
+ * windowed sinc split in up phases of taps coefficients each. Every output
+ * sample is a single dot product of one phase with the last taps input
+ * samples of a channel, done by dot_product_i16() with 16 bit samples and
+ * Q14 coefficients. A whole period is processed per call, there is no
+ * buffer provider to call back into.
+ *
+ * Only the ratios with a filter of a sensible size are handled (e.g. 48 kHz
+ * to 8 kHz, 16 kHz or 44.1 kHz and back), the others get -EINVAL and are
+ * left to the generic resampler.
+ */
+
+#define LOG_TAG "audio_hw_primary"
+/*#define LOG_NDEBUG 0*/
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cutils/log.h>
+
+#include "pcm_kernels.h"
+#include "polyphase_resampler.h"
+
+#define MAX_PHASES          160 /* 44.1 kHz <-> 48 kHz */
+#define MAX_DECIMATION      12
+#define TAPS_PER_ZERO_CROSS 16  /* input samples seen per output, for up >= down */
+#define CUTOFF              0.92
+#define KAISER_BETA         7.0
+#define COEF_SHIFT          14  /* the absolute values of a phase sum to well below 4 */
+
+struct polyphase_resampler {
+    uint32_t    in_rate;
+    uint32_t    up;
+    uint32_t    down;
+    uint32_t    channels;
+    uint32_t    taps;          /* per phase, a multiple of 8 */
+    size_t      max_in_frames;
+    int16_t*    coefs;         /* up phases of taps, in input order */
+    int16_t*    hist;          /* per channel, the taps - 1 last samples and the new ones */
+    size_t      hist_stride;
+    size_t      hist_frames;
+    uint64_t    pos;           /* of the next output, in 1/up of a hist sample */
+};
+
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+    while (b != 0) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/* zeroth order modified Bessel function of the first kind */
+static double bessel_i0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    int k;
+
+    for (k = 1; k < 32; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+static int design_filter(struct polyphase_resampler *r)
+{
+    size_t n = (size_t)r->up * r->taps;
+    double center = (n - 1) / 2.0;
+    double fc = CUTOFF * 0.5 / (r->up > r->down ? r->up : r->down);
+    double *h;
+    uint32_t p, k;
+    size_t j;
+
+    h = (double *)malloc(n * sizeof(double));
+    if (h == NULL)
+        return -ENOMEM;
+
+    for (j = 0; j < n; j++) {
+        double t = j - center;
+        double w = (j - center) / (center + 1);
+        double sinc = t == 0 ? 1.0 : sin(2 * M_PI * fc * t) / (2 * M_PI * fc * t);
+
+        h[j] = 2 * fc * sinc * bessel_i0(KAISER_BETA * sqrt(1 - w * w)) /
+                bessel_i0(KAISER_BETA);
+    }
+
+    /* each phase gets a DC gain of exactly 1 */
+    for (p = 0; p < r->up; p++) {
+        double sum = 0;
+
+        for (k = 0; k < r->taps; k++)
+            sum += h[p + (size_t)k * r->up];
+        for (k = 0; k < r->taps; k++) {
+            double c = h[p + (size_t)k * r->up] / sum;
+            /* the newest input sample meets the first coefficient of the phase */
+            r->coefs[(size_t)p * r->taps + r->taps - 1 - k] =
+                    (int16_t)lrint(c * (1 << COEF_SHIFT));
+        }
+    }
+
+    free(h);
+    return 0;
+}
+
+int polyphase_resampler_create(uint32_t in_rate, uint32_t out_rate, uint32_t channels,
+                               size_t max_in_frames, struct polyphase_resampler **resampler)
+{
+    struct polyphase_resampler *r;
+    uint32_t div, up, down, taps;
+
+    *resampler = NULL;
+    if (in_rate == 0 || out_rate == 0 || channels == 0 || max_in_frames == 0)
+        return -EINVAL;
+
+    div = gcd(in_rate, out_rate);
+    up = out_rate / div;
+    down = in_rate / div;
+    if (up > MAX_PHASES || down > up * MAX_DECIMATION)
+        return -EINVAL;
+
+    /* a decimating filter is narrower, it needs down/up times the input samples */
+    taps = (TAPS_PER_ZERO_CROSS * down + up - 1) / up;
+    if (taps < TAPS_PER_ZERO_CROSS)
+        taps = TAPS_PER_ZERO_CROSS;
+    taps = (taps + 7) & ~7u;
+
+    r = (struct polyphase_resampler *)calloc(1, sizeof(struct polyphase_resampler));
+    if (r == NULL)
+        return -ENOMEM;
+
+    r->in_rate = in_rate;
+    r->up = up;
+    r->down = down;
+    r->channels = channels;
+    r->taps = taps;
+    r->max_in_frames = max_in_frames;
+    r->hist_stride = taps - 1 + max_in_frames;
+    r->coefs = (int16_t *)calloc((size_t)up * taps, sizeof(int16_t));
+    r->hist = (int16_t *)calloc(r->hist_stride * channels, sizeof(int16_t));
+    if (r->coefs == NULL || r->hist == NULL || design_filter(r) != 0) {
+        polyphase_resampler_release(r);
+        return -ENOMEM;
+    }
+    polyphase_resampler_reset(r);
+
+    ALOGV("%s: %u -> %u Hz, %u phases of %u taps", __func__, in_rate, out_rate, up, taps);
+    *resampler = r;
+    return 0;
+}
+
+void polyphase_resampler_release(struct polyphase_resampler *resampler)
+{
+    if (resampler == NULL)
+        return;
+
+    free(resampler->coefs);
+    free(resampler->hist);
+    free(resampler);
+}
+
+void polyphase_resampler_reset(struct polyphase_resampler *resampler)
+{
+    memset(resampler->hist, 0, resampler->hist_stride * resampler->channels * sizeof(int16_t));
+    resampler->hist_frames = resampler->taps - 1;
+    resampler->pos = 0;
+}
+
+size_t polyphase_resampler_max_out_frames(const struct polyphase_resampler *resampler)
+{
+    return resampler->max_in_frames * resampler->up / resampler->down + 2;
+}
+
+size_t polyphase_resampler_process(struct polyphase_resampler *resampler, const int16_t *in,
+                                   size_t in_frames, int16_t *out)
+{
+    struct polyphase_resampler *r = resampler;
+    size_t out_frames = 0;
+    size_t idx;
+    uint32_t ch;
+    size_t i;
+
+    if (in_frames > r->max_in_frames)
+        in_frames = r->max_in_frames;
+
+    for (ch = 0; ch < r->channels; ch++) {
+        int16_t *dst = r->hist + ch * r->hist_stride + r->hist_frames;
+        for (i = 0; i < in_frames; i++)
+            dst[i] = in[i * r->channels + ch];
+    }
+    r->hist_frames += in_frames;
+
+    while ((idx = r->pos / r->up) + r->taps <= r->hist_frames) {
+        const int16_t *coefs = r->coefs + (r->pos % r->up) * r->taps;
+
+        for (ch = 0; ch < r->channels; ch++) {
+            int32_t acc = dot_product_i16(coefs, r->hist + ch * r->hist_stride + idx, r->taps);
+            acc = (acc + (1 << (COEF_SHIFT - 1))) >> COEF_SHIFT;
+            if (acc > INT16_MAX)
+                acc = INT16_MAX;
+            else if (acc < INT16_MIN)
+                acc = INT16_MIN;
+            *out++ = (int16_t)acc;
+        }
+        out_frames++;
+        r->pos += r->down;
+    }
+
+    /* keep what the next outputs still need, fewer than taps samples */
+    idx = r->pos / r->up;
+    if (idx > r->hist_frames)
+        idx = r->hist_frames;
+    for (ch = 0; ch < r->channels; ch++) {
+        int16_t *h = r->hist + ch * r->hist_stride;
+        memmove(h, h + idx, (r->hist_frames - idx) * sizeof(int16_t));
+    }
+    r->hist_frames -= idx;
+    r->pos -= (uint64_t)idx * r->up;
+
+    return out_frames;
+}
+
+/* group delay of the filter, in ns of the input */
+int32_t polyphase_resampler_delay_ns(const struct polyphase_resampler *resampler)
+{
+    uint64_t n = (uint64_t)resampler->up * resampler->taps;
+
+    return (int32_t)((n - 1) * 1000000000ULL / (2ULL * resampler->up * resampler->in_rate));
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef POLYPHASE_RESAMPLER_H
+#define POLYPHASE_RESAMPLER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct polyphase_resampler;
+
+/* Returns -EINVAL for the rate pairs it does not handle, see polyphase_resampler.c */
+int polyphase_resampler_create(uint32_t in_rate, uint32_t out_rate, uint32_t channels,
+                               size_t max_in_frames, struct polyphase_resampler **resampler);
+
+void polyphase_resampler_release(struct polyphase_resampler *resampler);
+
+void polyphase_resampler_reset(struct polyphase_resampler *resampler);
+
+/* The most frames one call for max_in_frames of input can produce */
+size_t polyphase_resampler_max_out_frames(const struct polyphase_resampler *resampler);
+
+/* Consumes all in_frames (at most max_in_frames), returns the number of frames written to out */
+size_t polyphase_resampler_process(struct polyphase_resampler *resampler, const int16_t *in,
+                                   size_t in_frames, int16_t *out);
+
+int32_t polyphase_resampler_delay_ns(const struct polyphase_resampler *resampler);
+
+#endif // POLYPHASE_RESAMPLER_H
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Throughput of the pcm_kernels.c kernels next to the plain loops they
+ * replace. Args are the source and destination channel counts, or the
+ * number of samples for the dot product; bytes/s counts the source samples.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+extern "C" {
+#include "pcm_kernels.h"
+}
+#include "pcm_kernels_reference.h"
+
+namespace {
+
+// A 20 ms capture period at 48 kHz
+constexpr size_t kFrames = 960;
+
+template <bool kReference>
+void BM_ExtractChannels(benchmark::State &state) {
+    const size_t src_channels = state.range(0);
+    const size_t dst_channels = state.range(1);
+    std::vector<int16_t> src(kFrames * src_channels);
+    std::vector<int16_t> dst(kFrames * dst_channels);
+
+    for (size_t i = 0; i < src.size(); i++)
+        src[i] = static_cast<int16_t>(i * 7919);
+
+    for (auto _ : state) {
+        if (kReference)
+            extract_channels_i16_reference(dst.data(), src.data(), kFrames, src_channels,
+                                           dst_channels);
+        else
+            extract_channels_i16(dst.data(), src.data(), kFrames, src_channels, dst_channels);
+        benchmark::DoNotOptimize(dst.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * src.size() * sizeof(int16_t));
+}
+
+void ExtractChannelsArgs(benchmark::internal::Benchmark *b) {
+    b->Args({2, 1})->Args({3, 1})->Args({3, 2})->Args({4, 1})->Args({4, 2})->Args({6, 2});
+}
+
+BENCHMARK_TEMPLATE(BM_ExtractChannels, false)->Apply(ExtractChannelsArgs);
+BENCHMARK_TEMPLATE(BM_ExtractChannels, true)->Apply(ExtractChannelsArgs);
+
+template <bool kReference>
+void BM_DotProduct(benchmark::State &state) {
+    const size_t n = state.range(0);
+    std::vector<int16_t> a(n);
+    std::vector<int16_t> b(n);
+    int32_t sum;
+
+    for (size_t i = 0; i < n; i++) {
+        a[i] = static_cast<int16_t>((i * 7919) & 0x3ff);
+        b[i] = static_cast<int16_t>((i * 104729) & 0x3ff);
+    }
+
+    for (auto _ : state) {
+        if (kReference)
+            sum = dot_product_i16_reference(a.data(), b.data(), n);
+        else
+            sum = dot_product_i16(a.data(), b.data(), n);
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetBytesProcessed(state.iterations() * 2 * n * sizeof(int16_t));
+}
+
+BENCHMARK_TEMPLATE(BM_DotProduct, false)->Arg(64)->Arg(256)->Arg(kFrames);
+BENCHMARK_TEMPLATE(BM_DotProduct, true)->Arg(64)->Arg(256)->Arg(kFrames);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PCM_KERNELS_REFERENCE_H
+#define PCM_KERNELS_REFERENCE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* The plain loops the vector kernels of pcm_kernels.c must match */
+
+static inline void extract_channels_i16_reference(int16_t *dst, const int16_t *src,
+                                                  size_t frames, size_t src_channels,
+                                                  size_t dst_channels)
+{
+    for (size_t i = 0; i < frames; i++) {
+        for (size_t c = 0; c < dst_channels; c++)
+            dst[i * dst_channels + c] = src[i * src_channels + c];
+    }
+}
+
+static inline int32_t dot_product_i16_reference(const int16_t *a, const int16_t *b, size_t n)
+{
+    int32_t sum = 0;
+
+    for (size_t i = 0; i < n; i++)
+        sum += a[i] * b[i];
+
+    return sum;
+}
+
+#endif // PCM_KERNELS_REFERENCE_H
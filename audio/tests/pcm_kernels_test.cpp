@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <tuple>
+#include <vector>
+
+extern "C" {
+#include "pcm_kernels.h"
+}
+#include "pcm_kernels_reference.h"
+
+namespace {
+
+// Every layout the capture path uses, the vectorized ones and a few that fall back
+const std::pair<size_t, size_t> kLayouts[] = {
+        {1, 1}, {2, 1}, {2, 2}, {3, 1}, {3, 2}, {4, 1}, {4, 2}, {6, 2},
+};
+
+// Empty, shorter than a vector, exact vectors and vectors plus a tail
+const size_t kFrameCounts[] = {0, 1, 3, 4, 7, 8, 9, 15, 16, 17, 63, 64, 65, 480, 961};
+
+std::vector<int16_t> RandomSamples(size_t n, int16_t min, int16_t max, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> dist(min, max);
+    std::vector<int16_t> samples(n);
+    for (auto &sample : samples)
+        sample = static_cast<int16_t>(dist(rng));
+    return samples;
+}
+
+class ExtractChannelsTest : public ::testing::TestWithParam<std::pair<size_t, size_t>> {};
+
+TEST_P(ExtractChannelsTest, MatchesReference) {
+    const auto [src_channels, dst_channels] = GetParam();
+
+    for (size_t frames : kFrameCounts) {
+        // One extra leading sample so the kernels also see unaligned buffers
+        for (size_t offset : {0, 1}) {
+            SCOPED_TRACE(::testing::Message() << frames << " frames, offset " << offset);
+            // Full scale samples catch a saturating or sign-dropping narrowing
+            std::vector<int16_t> src = RandomSamples(frames * src_channels + offset, INT16_MIN,
+                                                     INT16_MAX, frames);
+            std::vector<int16_t> expected(frames * dst_channels + offset, 0x5a5a);
+            std::vector<int16_t> actual(expected);
+
+            extract_channels_i16_reference(expected.data() + offset, src.data() + offset,
+                                           frames, src_channels, dst_channels);
+            extract_channels_i16(actual.data() + offset, src.data() + offset, frames,
+                                 src_channels, dst_channels);
+            EXPECT_EQ(actual, expected);
+        }
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(PcmKernels, ExtractChannelsTest, ::testing::ValuesIn(kLayouts),
+                         [](const ::testing::TestParamInfo<std::pair<size_t, size_t>> &info) {
+                             return std::to_string(info.param.first) + "to" +
+                                    std::to_string(info.param.second);
+                         });
+
+TEST(DotProductTest, MatchesReference) {
+    for (size_t n : kFrameCounts) {
+        for (size_t offset : {0, 1}) {
+            SCOPED_TRACE(::testing::Message() << n << " samples, offset " << offset);
+            // Small enough that no partial sum overflows, as the callers guarantee
+            std::vector<int16_t> a = RandomSamples(n + offset, -1024, 1023, n);
+            std::vector<int16_t> b = RandomSamples(n + offset, -1024, 1023, n + 1);
+
+            EXPECT_EQ(dot_product_i16(a.data() + offset, b.data() + offset, n),
+                      dot_product_i16_reference(a.data() + offset, b.data() + offset, n));
+        }
+    }
+}
+
+TEST(DotProductTest, FullScaleProducts) {
+    // A single full scale product in every lane
+    for (size_t n = 1; n <= 16; n++) {
+        std::vector<int16_t> a(n, 0);
+        std::vector<int16_t> b(n, 0);
+        a[n - 1] = INT16_MIN;
+        b[n - 1] = INT16_MIN;
+
+        EXPECT_EQ(dot_product_i16(a.data(), b.data(), n), 1 << 30) << n << " samples";
+    }
+}
+
+}  // namespace
@@ -71,6 +71,7 @@ struct pcm_config pcm_config_voice_sco_wb = {
 };
 
 /* Prototypes */
+void lock_adev(struct audio_device *adev);
 int start_voice_call(struct audio_device *adev);
 int stop_voice_call(struct audio_device *adev);
 
@@ -383,7 +384,7 @@ static void voice_session_wb_amr_callback(void *data, int wb_amr_type)
     struct voice_session *session =
         (struct voice_session *)adev->voice.session;
 
-    pthread_mutex_lock(&adev->lock);
+    lock_adev(adev);
 
     if (session->wb_amr_type != wb_amr_type) {
         session->wb_amr_type = wb_amr_type;
@@ -68,6 +68,86 @@ LOCAL_EXPORT_C_INCLUDE_DIRS := $(LOCAL_PATH)/../include
 LOCAL_MODULE:= libril
 LOCAL_SANITIZE := integer
 
+libril_cflags := $(LOCAL_CFLAGS)
+libril_c_includes := $(LOCAL_C_INCLUDES)
+
 include $(BUILD_SHARED_LIBRARY)
 
+# The mock vendor RIL and trace replay below must see the SIM_COUNT libril was built with,
+# so they share its flags. Like libril, they only build for the device: it links the vendor
+# HIDL radio interfaces and libhardware_legacy, which have no host variant.
+
+# Replays a request and URC trace through libril and prints its request, indication and wake
+# lock counters for every slot
+include $(CLEAR_VARS)
+
+LOCAL_VENDOR_MODULE := true
+
+LOCAL_SRC_FILES := \
+    tests/mock_vendor_ril.cpp \
+    tests/ril_replay.cpp \
+    tests/ril_replay_main.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+    libril \
+    liblog \
+    libutils
+
+LOCAL_CFLAGS := $(libril_cflags)
+LOCAL_C_INCLUDES := $(LOCAL_PATH) $(libril_c_includes)
+
+LOCAL_MODULE := ril_replay
+
+include $(BUILD_EXECUTABLE)
+
+# Request path counters under inline, delayed and overflowing responses, indication and wake
+# lock counters under coalesced and waking URCs, and a trace replay, on every slot
+include $(CLEAR_VARS)
+
+LOCAL_VENDOR_MODULE := true
+
+LOCAL_SRC_FILES := \
+    tests/mock_vendor_ril.cpp \
+    tests/ril_replay.cpp \
+    tests/ril_request_test.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+    libril \
+    libbase \
+    liblog \
+    libutils
+
+LOCAL_CFLAGS := $(libril_cflags)
+LOCAL_C_INCLUDES := $(LOCAL_PATH) $(libril_c_includes)
+
+LOCAL_TEST_DATA := $(call find-test-data-in-subdirs,$(LOCAL_PATH),"*.txt",tests/data)
+
+LOCAL_MODULE := libril_test
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_NATIVE_TEST)
+
+# Cost of a request round trip, of request bursts and of URC dispatch, with the counters of
+# each run, on every slot
+include $(CLEAR_VARS)
+
+LOCAL_VENDOR_MODULE := true
+
+LOCAL_SRC_FILES := \
+    tests/mock_vendor_ril.cpp \
+    tests/ril_request_benchmark.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+    libril \
+    liblog \
+    libutils
+
+LOCAL_CFLAGS := $(libril_cflags)
+LOCAL_C_INCLUDES := $(LOCAL_PATH) $(libril_c_includes)
+
+LOCAL_MODULE := libril_benchmark
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_NATIVE_BENCHMARK)
+
 endif # BOARD_PROVIDES_LIBRIL
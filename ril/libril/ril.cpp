@@ -29,6 +29,7 @@
 #include <sys/types.h>
 #include <sys/limits.h>
 #include <sys/system_properties.h>
+#include <sys/timerfd.h>
 #include <pwd.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -129,33 +130,95 @@ int s_wakelock_count = 0;
 
 static struct ril_event s_wakeupfd_event;
 
-static pthread_mutex_t s_pendingRequestsMutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t s_wakeLockCountMutex = PTHREAD_MUTEX_INITIALIZER;
-static RequestInfo *s_pendingRequests = NULL;
 
-#if (SIM_COUNT >= 2)
-static pthread_mutex_t s_pendingRequestsMutex_socket2  = PTHREAD_MUTEX_INITIALIZER;
-static RequestInfo *s_pendingRequests_socket2          = NULL;
-#endif
-
-#if (SIM_COUNT >= 3)
-static pthread_mutex_t s_pendingRequestsMutex_socket3  = PTHREAD_MUTEX_INITIALIZER;
-static RequestInfo *s_pendingRequests_socket3          = NULL;
-#endif
+/*
+ * The kernel wake lock is held while s_wakelock_count is non-zero. Every
+ * grab pushes out the deadline of a single timerfd watched by the event
+ * loop, so a burst of wake-type responses costs one acquire_wake_lock(),
+ * one release_wake_lock() and no timer allocations. Everything below is
+ * protected by s_wakeLockCountMutex.
+ */
+static int s_wakeLockTimerFd = -1;
+static struct ril_event s_wakeLockTimerEvent;
+static bool s_wakeLockHeld = false;
+static int64_t s_wakeLockAcquiredMs;   // elapsedRealtime() of the kernel acquire
+static WakeLockStats s_wakeLockStats;
 
-#if (SIM_COUNT >= 4)
-static pthread_mutex_t s_pendingRequestsMutex_socket4  = PTHREAD_MUTEX_INITIALIZER;
-static RequestInfo *s_pendingRequests_socket4          = NULL;
-#endif
+/*
+ * Requests pending a response, one table per socket. RequestInfos come from a
+ * preallocated pool and are indexed by their RIL_Token in an open-addressed
+ * hash table, so add, ack and complete don't walk a list or hit the heap.
+ * The pool only falls back to calloc() once it is exhausted, and those
+ * entries join the pool when released.
+ *
+ * The RIL_Token is the RequestInfo address, so a late or duplicate
+ * RIL_onRequestComplete() for a released entry would match the request
+ * reusing it. The free list is FIFO to reuse an entry as late as possible.
+ */
+#define REQUEST_TABLE_INIT_SIZE (2 * REQUEST_POOL_SIZE)
+
+typedef struct PendingRequests {
+    pthread_mutex_t mutex;
+    RequestInfo pool[REQUEST_POOL_SIZE];
+    RequestInfo *freeHead;      // unused entries, linked through p_next,
+    RequestInfo *freeTail;      // oldest released first
+    RequestStats stats;
+    RequestInfo **table;        // linear probing, size is a power of two
+    size_t tableSize;
+    size_t count;
+} PendingRequests;
+
+static PendingRequests s_pendingRequests[SIM_COUNT];
+static pthread_once_t s_pendingRequestsOnce = PTHREAD_ONCE_INIT;
 
 static const struct timeval TIMEVAL_WAKE_TIMEOUT = {ANDROID_WAKE_LOCK_SECS,ANDROID_WAKE_LOCK_USECS};
 
+/*
+ * Latest-value-wins indications come in bursts. The first one of a burst
+ * is delivered right away; the ones following it within the window only
+ * replace a held back copy, delivered (with its wake lock) when the window
+ * ends. Screen on and radio or call state changes deliver the held back
+ * copies at once. URC_WINDOW_PROPERTY overrides every window, 0 turns
+ * coalescing off.
+ */
+#define URC_WINDOW_PROPERTY "persist.vendor.radio.urc_window_ms"
+
+typedef struct {
+    int unsolResponse;
+    int64_t windowMs;
+} CoalescedUnsolInfo;
+
+static const CoalescedUnsolInfo s_coalescedUnsols[] = {
+    {RIL_UNSOL_SIGNAL_STRENGTH, 2000},
+    {RIL_UNSOL_CELL_INFO_LIST, 2000},
+    {RIL_UNSOL_RESPONSE_VOICE_NETWORK_STATE_CHANGED, 500},
+};
+
+typedef struct {
+    int64_t lastDeliveryMs;     // elapsedRealtime() of the last delivery
+    void *pending;              // held back payload, flat structs only
+    size_t pendingLen;
+    size_t pendingSize;         // allocated size of pending
+    bool hasPending;
+    bool timerArmed;
+} CoalescedUnsolState;
+
+typedef struct {
+    CoalescedUnsolState state[NUM_ELEMS(s_coalescedUnsols)];
+    unsigned int received;
+    unsigned int delivered;
+    unsigned int suppressed;
+} CoalescedUnsols;
+
+static CoalescedUnsols s_coalescedUnsolState[SIM_COUNT];
+static int64_t s_coalescedUnsolWindowMs[NUM_ELEMS(s_coalescedUnsols)];
+static pthread_mutex_t s_coalesceMutex = PTHREAD_MUTEX_INITIALIZER;
+
 
 static pthread_mutex_t s_startupMutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t s_startupCond = PTHREAD_COND_INITIALIZER;
 
-static UserCallbackInfo *s_last_wake_timeout_info = NULL;
-
 static void *s_lastNITZTimeData = NULL;
 static size_t s_lastNITZTimeDataSize;
 
@@ -166,7 +229,7 @@ static size_t s_lastNITZTimeDataSize;
 /*******************************************************************/
 static void grabPartialWakeLock();
 void releaseWakeLock();
-static void wakeTimeoutCallback(void *);
+static void wakeTimeoutCallback(int fd, short flags, void *param);
 
 #ifdef RIL_SHLIB
 #if defined(ANDROID_MULTI_SIM)
@@ -205,69 +268,275 @@ static UnsolResponseInfo s_unsolResponses_v[] = {
 #include <telephony/ril_unsol_commands_vendor.h>
 };
 
+/*
+ * The AOSP tables are indexed by number - base. The vendor numbers are not
+ * always at their computed index (e.g. RIL_UNSOL_SNDMGR_WB_AMR_REPORT is
+ * 20017 but sits at index 33), so RIL_register() puts them in open-addressed
+ * maps from number to index, built once and only read afterwards.
+ */
+#define VENDOR_MAP_SIZE 256 // power of two, keeps the load factor at or below 1/2
+
+typedef struct {
+    int number;     // 0 for an empty slot
+    int index;
+} VendorIndexEntry;
+
+static VendorIndexEntry s_commandsVendorMap[VENDOR_MAP_SIZE];
+static VendorIndexEntry s_unsolResponsesVendorMap[VENDOR_MAP_SIZE];
+
+static_assert(NUM_ELEMS(s_commands_v) * 2 <= VENDOR_MAP_SIZE, "VENDOR_MAP_SIZE too small");
+static_assert(NUM_ELEMS(s_unsolResponses_v) * 2 <= VENDOR_MAP_SIZE, "VENDOR_MAP_SIZE too small");
+
 char * RIL_getServiceName() {
     return ril_service_name;
 }
 
-RequestInfo *
-addRequestToList(int serial, int slotId, int request) {
-    RequestInfo *pRI;
-    int ret;
-    RIL_SOCKET_ID socket_id = (RIL_SOCKET_ID) slotId;
-    /* Hook for current context */
-    /* pendingRequestsMutextHook refer to &s_pendingRequestsMutex */
-    pthread_mutex_t* pendingRequestsMutexHook = &s_pendingRequestsMutex;
-    /* pendingRequestsHook refer to &s_pendingRequests */
-    RequestInfo**    pendingRequestsHook = &s_pendingRequests;
+static void
+addVendorIndex(VendorIndexEntry *map, int number, int index) {
+    size_t slot = (size_t) number & (VENDOR_MAP_SIZE - 1);
 
-#if (SIM_COUNT >= 2)
-    if (socket_id == RIL_SOCKET_2) {
-        pendingRequestsMutexHook = &s_pendingRequestsMutex_socket2;
-        pendingRequestsHook = &s_pendingRequests_socket2;
+    while (map[slot].number != 0) {
+        if (map[slot].number == number) {
+            RLOGE("Duplicate vendor request/response number %d", number);
+            return;
+        }
+        slot = (slot + 1) & (VENDOR_MAP_SIZE - 1);
     }
-#if (SIM_COUNT >= 3)
-    else if (socket_id == RIL_SOCKET_3) {
-        pendingRequestsMutexHook = &s_pendingRequestsMutex_socket3;
-        pendingRequestsHook = &s_pendingRequests_socket3;
+    map[slot].number = number;
+    map[slot].index = index;
+}
+
+// Returns the index of number in the vendor table of map, or -1
+static int
+findVendorIndex(const VendorIndexEntry *map, int number) {
+    size_t slot = (size_t) number & (VENDOR_MAP_SIZE - 1);
+
+    if (number <= 0) {
+        return -1;
     }
-#endif
-#if (SIM_COUNT >= 4)
-    else if (socket_id == RIL_SOCKET_4) {
-        pendingRequestsMutexHook = &s_pendingRequestsMutex_socket4;
-        pendingRequestsHook = &s_pendingRequests_socket4;
+    while (map[slot].number != 0) {
+        if (map[slot].number == number) {
+            return map[slot].index;
+        }
+        slot = (slot + 1) & (VENDOR_MAP_SIZE - 1);
     }
+    return -1;
+}
+
+static void
+initVendorIndexMaps() {
+    for (int i = 0; i < (int)NUM_ELEMS(s_commands_v); i++) {
+        addVendorIndex(s_commandsVendorMap, s_commands_v[i].requestNumber, i);
+    }
+    for (int i = 0; i < (int)NUM_ELEMS(s_unsolResponses_v); i++) {
+        addVendorIndex(s_unsolResponsesVendorMap, s_unsolResponses_v[i].requestNumber, i);
+    }
+}
+
+static CommandInfo *
+findCommandInfo(int request) {
+    int index;
+
+    if (request >= 0 && request < (int32_t)NUM_ELEMS(s_commands)) {
+        return &s_commands[request];
+    }
+    index = findVendorIndex(s_commandsVendorMap, request);
+#if VDBG
+    RLOGD("findCommandInfo: samsung request=%d, index=%d", request, index);
 #endif
+    return index >= 0 ? &s_commands_v[index] : NULL;
+}
+
+static UnsolResponseInfo *
+findUnsolResponseInfo(int unsolResponse) {
+    int index = unsolResponse - RIL_UNSOL_RESPONSE_BASE;
+
+    if (index >= 0 && index < (int32_t)NUM_ELEMS(s_unsolResponses)) {
+        return &s_unsolResponses[index];
+    }
+    index = findVendorIndex(s_unsolResponsesVendorMap, unsolResponse);
+#if VDBG
+    RLOGD("SAMSUNG: unsolResponse=%d, unsolResponseIndex=%d", unsolResponse, index);
 #endif
+    return index >= 0 ? &s_unsolResponses_v[index] : NULL;
+}
+
+static void initPendingRequests() {
+    for (int i = 0; i < SIM_COUNT; i++) {
+        PendingRequests *pending = &s_pendingRequests[i];
+
+        pthread_mutex_init(&pending->mutex, NULL);
+        for (int j = 0; j < REQUEST_POOL_SIZE - 1; j++) {
+            pending->pool[j].p_next = &pending->pool[j + 1];
+        }
+        pending->pool[REQUEST_POOL_SIZE - 1].p_next = NULL;
+        pending->freeHead = &pending->pool[0];
+        pending->freeTail = &pending->pool[REQUEST_POOL_SIZE - 1];
+        pending->tableSize = REQUEST_TABLE_INIT_SIZE;
+        pending->table = (RequestInfo **)calloc(pending->tableSize, sizeof(RequestInfo *));
+        assert(pending->table != NULL);
+        pending->count = 0;
+    }
+}
+
+static PendingRequests *
+getPendingRequests(RIL_SOCKET_ID socket_id) {
+    pthread_once(&s_pendingRequestsOnce, initPendingRequests);
+
+    if ((int) socket_id < 0 || (int) socket_id >= SIM_COUNT) {
+        return &s_pendingRequests[0];
+    }
+    return &s_pendingRequests[socket_id];
+}
+
+// libril is built with the integer sanitizer, which traps on unsigned wrap-around: the hash
+// and the probe distances below are written so that they never wrap
+static inline size_t
+pendingRequestSlot(const PendingRequests *pending, const RequestInfo *pRI) {
+    // The low bits of the pointer are always zero, fold the higher ones onto them
+    uintptr_t key = (uintptr_t) pRI >> 4;
+    return (size_t)(key ^ (key >> 7) ^ (key >> 17)) & (pending->tableSize - 1);
+}
+
+// Returns the slot holding pRI, or the empty slot ending its probe sequence
+static size_t
+findPendingRequest(const PendingRequests *pending, const RequestInfo *pRI) {
+    size_t mask = pending->tableSize - 1;
+    size_t slot = pendingRequestSlot(pending, pRI);
+
+    while (pending->table[slot] != NULL && pending->table[slot] != pRI) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static int
+growPendingRequests(PendingRequests *pending) {
+    RequestInfo **oldTable = pending->table;
+    size_t oldSize = pending->tableSize;
+    RequestInfo **newTable = (RequestInfo **)calloc(oldSize * 2, sizeof(RequestInfo *));
+
+    if (newTable == NULL) {
+        return -1;
+    }
+    pending->table = newTable;
+    pending->tableSize = oldSize * 2;
+    for (size_t i = 0; i < oldSize; i++) {
+        if (oldTable[i] != NULL) {
+            pending->table[findPendingRequest(pending, oldTable[i])] = oldTable[i];
+        }
+    }
+    free(oldTable);
+    return 0;
+}
+
+static void
+removePendingRequest(PendingRequests *pending, size_t slot) {
+    size_t size = pending->tableSize;
+    size_t mask = size - 1;
+    size_t next = (slot + 1) & mask;
+
+    // Backward shift deletion keeps probe sequences intact without tombstones
+    pending->table[slot] = NULL;
+    while (pending->table[next] != NULL) {
+        size_t home = pendingRequestSlot(pending, pending->table[next]);
+        // Probe distances, adding size first so crossing slot 0 does not wrap
+        if (((next + size - home) & mask) >= ((next + size - slot) & mask)) {
+            pending->table[slot] = pending->table[next];
+            pending->table[next] = NULL;
+            slot = next;
+        }
+        next = (next + 1) & mask;
+    }
+    pending->count--;
+}
+
+// Account the time a request took from the framework to its response
+static void
+recordRequestLatency(RequestInfo *pRI) {
+    PendingRequests *pending = getPendingRequests(pRI->socket_id);
+    int64_t latencyUs = (android::elapsedRealtimeNano() - pRI->startNs) / 1000;
+
+    pthread_mutex_lock(&pending->mutex);
+    pending->stats.completed++;
+    pending->stats.totalLatencyUs += latencyUs;
+    if (latencyUs > pending->stats.maxLatencyUs) {
+        pending->stats.maxLatencyUs = latencyUs;
+    }
+    pthread_mutex_unlock(&pending->mutex);
+}
+
+void
+getRequestStats(int slotId, RequestStats *stats) {
+    PendingRequests *pending = getPendingRequests((RIL_SOCKET_ID) slotId);
+
+    pthread_mutex_lock(&pending->mutex);
+    *stats = pending->stats;
+    pthread_mutex_unlock(&pending->mutex);
+}
 
-    CommandInfo *pCI = NULL;
-    if (request > RIL_OEM_REQUEST_BASE) {
-        int index = request - RIL_OEM_REQUEST_BASE;
-        RLOGD("processCommandBuffer: samsung request=%d, index=%d",
-                request, index);
-        if (index < (int32_t)NUM_ELEMS(s_commands_v))
-            pCI = &(s_commands_v[index]);
+// Return a RequestInfo which is no longer pending to the tail of the free list
+static void
+releaseRequestInfo(RequestInfo *pRI) {
+    PendingRequests *pending = getPendingRequests(pRI->socket_id);
+
+    pthread_mutex_lock(&pending->mutex);
+    pRI->p_next = NULL;
+    if (pending->freeTail != NULL) {
+        pending->freeTail->p_next = pRI;
     } else {
-        if (request < (int32_t)NUM_ELEMS(s_commands))
-            pCI = &(s_commands[request]);
+        pending->freeHead = pRI;
     }
+    pending->freeTail = pRI;
+    pthread_mutex_unlock(&pending->mutex);
+}
 
-    pRI = (RequestInfo *)calloc(1, sizeof(RequestInfo));
-    if (pRI == NULL) {
+RequestInfo *
+addRequestToList(int serial, int slotId, int request) {
+    RequestInfo *pRI;
+    int ret;
+    RIL_SOCKET_ID socket_id = (RIL_SOCKET_ID) slotId;
+    PendingRequests *pending = getPendingRequests(socket_id);
+
+    CommandInfo *pCI = findCommandInfo(request);
+
+    ret = pthread_mutex_lock(&pending->mutex);
+    assert (ret == 0);
+
+    // Keep the load factor at or below 1/2
+    if ((pending->count + 1) * 2 > pending->tableSize
+            && growPendingRequests(pending) < 0) {
+        pthread_mutex_unlock(&pending->mutex);
         RLOGE("Memory allocation failed for request %s", requestToString(request));
         return NULL;
     }
 
+    pRI = pending->freeHead;
+    if (pRI != NULL) {
+        pending->freeHead = pRI->p_next;
+        if (pending->freeHead == NULL) {
+            pending->freeTail = NULL;
+        }
+        memset(pRI, 0, sizeof(RequestInfo));
+    } else {
+        pRI = (RequestInfo *)calloc(1, sizeof(RequestInfo));
+        if (pRI == NULL) {
+            pthread_mutex_unlock(&pending->mutex);
+            RLOGE("Memory allocation failed for request %s", requestToString(request));
+            return NULL;
+        }
+        pending->stats.heapAllocs++;
+    }
+
     pRI->token = serial;
+    pRI->startNs = android::elapsedRealtimeNano();
     pRI->pCI = pCI;
     pRI->socket_id = socket_id;
 
-    ret = pthread_mutex_lock(pendingRequestsMutexHook);
-    assert (ret == 0);
+    pending->table[findPendingRequest(pending, pRI)] = pRI;
+    pending->count++;
 
-    pRI->p_next = *pendingRequestsHook;
-    *pendingRequestsHook = pRI;
-
-    ret = pthread_mutex_unlock(pendingRequestsMutexHook);
+    ret = pthread_mutex_unlock(&pending->mutex);
     assert (ret == 0);
 
     return pRI;
@@ -367,12 +636,6 @@ static void userTimerCallback (int fd, short flags, void *param) {
 
     p_info->p_callback(p_info->userParam);
 
-
-    // FIXME generalize this...there should be a cancel mechanism
-    if (s_last_wake_timeout_info != NULL && s_last_wake_timeout_info == p_info) {
-        s_last_wake_timeout_info = NULL;
-    }
-
     free(p_info);
 }
 
@@ -384,6 +647,15 @@ eventLoop(void *param) {
 
     ril_event_init();
 
+    // Created before s_started is published: RIL_startEventLoop() returning under
+    // s_startupMutex is what makes the fd visible to the threads that go on to grab
+    // wake locks. Its event is only added once the loop has a wakeup pipe below,
+    // the timerfd stays readable until then.
+    s_wakeLockTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (s_wakeLockTimerFd < 0) {
+        RLOGE("Error in timerfd_create() errno:%d", errno);
+    }
+
     pthread_mutex_lock(&s_startupMutex);
 
     s_started = 1;
@@ -408,6 +680,12 @@ eventLoop(void *param) {
 
     rilEventAddWakeup (&s_wakeupfd_event);
 
+    if (s_wakeLockTimerFd >= 0) {
+        ril_event_set (&s_wakeLockTimerEvent, s_wakeLockTimerFd, true,
+                wakeTimeoutCallback, NULL);
+        rilEventAddWakeup (&s_wakeLockTimerEvent);
+    }
+
     // Only returns on error
     ril_event_loop();
     RLOGE ("error in event_loop_base errno:%d", errno);
@@ -446,18 +724,19 @@ extern "C" void RIL_setcallbacks (const RIL_RadioFunctions *callbacks) {
     memcpy(&s_callbacks, callbacks, sizeof (RIL_RadioFunctions));
 }
 
-extern "C" void
-RIL_register (const RIL_RadioFunctions *callbacks) {
+// Returns false if the callbacks were not taken
+static bool
+registerCallbacks(const RIL_RadioFunctions *callbacks) {
     RLOGI("SIM_COUNT: %d", SIM_COUNT);
 
     if (callbacks == NULL) {
         RLOGE("RIL_register: RIL_RadioFunctions * null");
-        return;
+        return false;
     }
     if (callbacks->version < RIL_VERSION_MIN) {
         RLOGE("RIL_register: version %d is to old, min version is %d",
              callbacks->version, RIL_VERSION_MIN);
-        return;
+        return false;
     }
 
     RLOGE("RIL_register: RIL version %d", callbacks->version);
@@ -465,32 +744,35 @@ RIL_register (const RIL_RadioFunctions *callbacks) {
     if (s_registerCalled > 0) {
         RLOGE("RIL_register has been called more than once. "
                 "Subsequent call ignored");
-        return;
+        return false;
     }
 
     memcpy(&s_callbacks, callbacks, sizeof (RIL_RadioFunctions));
 
-    s_registerCalled = 1;
-
-    RLOGI("s_registerCalled flag set, %d", s_started);
     // Little self-check
 
     for (int i = 0; i < (int)NUM_ELEMS(s_commands); i++) {
         assert(i == s_commands[i].requestNumber);
     }
 
-    for (int i = 0; i < (int)NUM_ELEMS(s_commands_v); i++) {
-        assert(i + RIL_OEM_REQUEST_BASE == s_commands[i].requestNumber);
-    }
-
     for (int i = 0; i < (int)NUM_ELEMS(s_unsolResponses); i++) {
         assert(i + RIL_UNSOL_RESPONSE_BASE
                 == s_unsolResponses[i].requestNumber);
     }
 
-    for (int i = 0; i < (int)NUM_ELEMS(s_unsolResponses_v); i++) {
-        assert(i + SAMSUNG_UNSOL_RESPONSE_BASE
-                == s_unsolResponses[i].requestNumber);
+    initVendorIndexMaps();
+    initCoalescedUnsols();
+
+    s_registerCalled = 1;
+
+    RLOGI("s_registerCalled flag set, %d", s_started);
+    return true;
+}
+
+extern "C" void
+RIL_register (const RIL_RadioFunctions *callbacks) {
+    if (!registerCallbacks(callbacks)) {
+        return;
     }
 
     radio::registerService(&s_callbacks, s_commands);
@@ -498,6 +780,17 @@ RIL_register (const RIL_RadioFunctions *callbacks) {
 
 }
 
+// Used for testing purpose only: like RIL_register(), but no HIDL service is published, so it
+// can run next to the real rild. Responses are dropped as if no framework was connected.
+extern "C" void
+RIL_registerForTest (const RIL_RadioFunctions *callbacks) {
+    if (!registerCallbacks(callbacks)) {
+        return;
+    }
+
+    radio::createServicesForTest(&s_callbacks, s_commands);
+}
+
 extern "C" void
 RIL_register_socket (const RIL_RadioFunctions *(*Init)(const struct RIL_Env *, int, char **),
         RIL_SOCKET_TYPE socketType, int argc, char **argv) {
@@ -535,41 +828,19 @@ RIL_register_socket (const RIL_RadioFunctions *(*Init)(const struct RIL_Env *, i
 static int
 checkAndDequeueRequestInfoIfAck(struct RequestInfo *pRI, bool isAck) {
     int ret = 0;
-    /* Hook for current context
-       pendingRequestsMutextHook refer to &s_pendingRequestsMutex */
-    pthread_mutex_t* pendingRequestsMutexHook = &s_pendingRequestsMutex;
-    /* pendingRequestsHook refer to &s_pendingRequests */
-    RequestInfo ** pendingRequestsHook = &s_pendingRequests;
 
     if (pRI == NULL) {
         return 0;
     }
 
-#if (SIM_COUNT >= 2)
-    if (pRI->socket_id == RIL_SOCKET_2) {
-        pendingRequestsMutexHook = &s_pendingRequestsMutex_socket2;
-        pendingRequestsHook = &s_pendingRequests_socket2;
-    }
-#if (SIM_COUNT >= 3)
-        if (pRI->socket_id == RIL_SOCKET_3) {
-            pendingRequestsMutexHook = &s_pendingRequestsMutex_socket3;
-            pendingRequestsHook = &s_pendingRequests_socket3;
-        }
-#endif
-#if (SIM_COUNT >= 4)
-    if (pRI->socket_id == RIL_SOCKET_4) {
-        pendingRequestsMutexHook = &s_pendingRequestsMutex_socket4;
-        pendingRequestsHook = &s_pendingRequests_socket4;
-    }
-#endif
-#endif
-    pthread_mutex_lock(pendingRequestsMutexHook);
+    // pRI isn't dereferenced until it's found in one of the tables
+    for (int i = 0; i < SIM_COUNT && ret == 0; i++) {
+        PendingRequests *pending = getPendingRequests((RIL_SOCKET_ID) i);
 
-    for(RequestInfo **ppCur = pendingRequestsHook
-        ; *ppCur != NULL
-        ; ppCur = &((*ppCur)->p_next)
-    ) {
-        if (pRI == *ppCur) {
+        pthread_mutex_lock(&pending->mutex);
+
+        size_t slot = findPendingRequest(pending, pRI);
+        if (pending->table[slot] == pRI) {
             ret = 1;
             if (isAck) { // Async ack
                 if (pRI->wasAckSent == 1) {
@@ -578,13 +849,12 @@ checkAndDequeueRequestInfoIfAck(struct RequestInfo *pRI, bool isAck) {
                     pRI->wasAckSent = 1;
                 }
             } else {
-                *ppCur = (*ppCur)->p_next;
+                removePendingRequest(pending, slot);
             }
-            break;
         }
-    }
 
-    pthread_mutex_unlock(pendingRequestsMutexHook);
+        pthread_mutex_unlock(&pending->mutex);
+    }
 
     return ret;
 }
@@ -645,7 +915,7 @@ RIL_onRequestComplete(RIL_Token t, RIL_Errno e, void *response, size_t responsel
         // response does not go back up the command socket
         RLOGD("C[locl]< %s", requestToString(pRI->pCI->requestNumber));
 
-        free(pRI);
+        releaseRequestInfo(pRI);
         return;
     }
 
@@ -677,148 +947,132 @@ RIL_onRequestComplete(RIL_Token t, RIL_Errno e, void *response, size_t responsel
 
         rwlockRet = pthread_rwlock_unlock(radioServiceRwlockPtr);
         assert(rwlockRet == 0);
+
+        recordRequestLatency(pRI);
+    }
+    releaseRequestInfo(pRI);
+}
+
+// must be called with s_wakeLockCountMutex locked, NULL disarms the timer
+static int
+armWakeLockTimer(const struct timeval *timeout) {
+    struct itimerspec its;
+
+    memset(&its, 0, sizeof(its));
+    if (timeout != NULL) {
+        its.it_value.tv_sec = timeout->tv_sec;
+        its.it_value.tv_nsec = timeout->tv_usec * 1000;
+    }
+    if (s_wakeLockTimerFd < 0) {
+        return -1;
+    }
+    if (timerfd_settime(s_wakeLockTimerFd, 0, &its, NULL) < 0) {
+        RLOGE("Error in timerfd_settime() errno:%d", errno);
+        return -1;
+    }
+    return 0;
+}
+
+// must be called with s_wakeLockCountMutex locked
+static void
+releaseKernelWakeLock() {
+    s_wakelock_count = 0;
+    armWakeLockTimer(NULL);
+    if (s_wakeLockHeld) {
+        release_wake_lock(ANDROID_WAKE_LOCK_NAME);
+        s_wakeLockHeld = false;
+        s_wakeLockStats.heldMs += android::elapsedRealtime() - s_wakeLockAcquiredMs;
     }
-    free(pRI);
 }
 
 static void
 grabPartialWakeLock() {
-    if (s_callbacks.version >= 13) {
-        int ret;
-        ret = pthread_mutex_lock(&s_wakeLockCountMutex);
-        assert(ret == 0);
-        acquire_wake_lock(PARTIAL_WAKE_LOCK, ANDROID_WAKE_LOCK_NAME);
+    int ret;
+    ret = pthread_mutex_lock(&s_wakeLockCountMutex);
+    assert(ret == 0);
 
-        UserCallbackInfo *p_info =
-                internalRequestTimedCallback(wakeTimeoutCallback, NULL, &TIMEVAL_WAKE_TIMEOUT);
-        if (p_info == NULL) {
-            release_wake_lock(ANDROID_WAKE_LOCK_NAME);
-        } else {
-            s_wakelock_count++;
-            if (s_last_wake_timeout_info != NULL) {
-                s_last_wake_timeout_info->userParam = (void *)1;
-            }
-            s_last_wake_timeout_info = p_info;
-        }
-        ret = pthread_mutex_unlock(&s_wakeLockCountMutex);
-        assert(ret == 0);
-    } else {
+    if (!s_wakeLockHeld) {
         acquire_wake_lock(PARTIAL_WAKE_LOCK, ANDROID_WAKE_LOCK_NAME);
+        s_wakeLockHeld = true;
+        s_wakeLockAcquiredMs = android::elapsedRealtime();
+        s_wakeLockStats.acquires++;
+    }
+    s_wakeLockStats.grabs++;
+    s_wakelock_count++;
+    if (armWakeLockTimer(&TIMEVAL_WAKE_TIMEOUT) < 0) {
+        // Without a timeout nothing guarantees the release, don't hold it
+        releaseKernelWakeLock();
     }
+
+    ret = pthread_mutex_unlock(&s_wakeLockCountMutex);
+    assert(ret == 0);
 }
 
 void
 releaseWakeLock() {
-    if (s_callbacks.version >= 13) {
-        int ret;
-        ret = pthread_mutex_lock(&s_wakeLockCountMutex);
-        assert(ret == 0);
-
-        if (s_wakelock_count > 1) {
-            s_wakelock_count--;
-        } else {
-            s_wakelock_count = 0;
-            release_wake_lock(ANDROID_WAKE_LOCK_NAME);
-            if (s_last_wake_timeout_info != NULL) {
-                s_last_wake_timeout_info->userParam = (void *)1;
-            }
-        }
+    int ret;
+    ret = pthread_mutex_lock(&s_wakeLockCountMutex);
+    assert(ret == 0);
 
-        ret = pthread_mutex_unlock(&s_wakeLockCountMutex);
-        assert(ret == 0);
+    if (s_wakelock_count > 1) {
+        s_wakelock_count--;
     } else {
-        release_wake_lock(ANDROID_WAKE_LOCK_NAME);
+        releaseKernelWakeLock();
     }
+
+    ret = pthread_mutex_unlock(&s_wakeLockCountMutex);
+    assert(ret == 0);
 }
 
 /**
  * Timer callback to put us back to sleep before the default timeout
  */
 static void
-wakeTimeoutCallback (void *param) {
-    // We're using "param != NULL" as a cancellation mechanism
-    if (s_callbacks.version >= 13) {
-        if (param == NULL) {
-            int ret;
-            ret = pthread_mutex_lock(&s_wakeLockCountMutex);
-            assert(ret == 0);
-            s_wakelock_count = 0;
-            release_wake_lock(ANDROID_WAKE_LOCK_NAME);
-            ret = pthread_mutex_unlock(&s_wakeLockCountMutex);
-            assert(ret == 0);
-        }
-    } else {
-        if (param == NULL) {
-            releaseWakeLock();
-        }
-    }
-}
-
-#if defined(ANDROID_MULTI_SIM)
-extern "C"
-void RIL_onUnsolicitedResponse(int unsolResponse, const void *data,
-                                size_t datalen, RIL_SOCKET_ID socket_id)
-#else
-extern "C"
-void RIL_onUnsolicitedResponse(int unsolResponse, const void *data,
-                                size_t datalen)
-#endif
-{
-    int unsolResponseIndex;
+wakeTimeoutCallback(int fd, short flags, void *param) {
+    uint64_t expirations;
+    struct itimerspec its;
     int ret;
-    bool shouldScheduleTimeout = false;
-    RIL_SOCKET_ID soc_id = RIL_SOCKET_1;
-    UnsolResponseInfo *pRI = NULL;
-    int32_t pRI_elements;
-#if defined(ANDROID_MULTI_SIM)
-    soc_id = socket_id;
-#endif
 
+    // Nothing to read if a grab pushed the deadline out in the meantime
+    if (read(fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+        RLOGE("Error reading wake lock timer errno:%d", errno);
+    }
 
-    if (s_registerCalled == 0) {
-        // Ignore RIL_onUnsolicitedResponse before RIL_register
-        RLOGW("RIL_onUnsolicitedResponse called before RIL_register");
+    ret = pthread_mutex_lock(&s_wakeLockCountMutex);
+    assert(ret == 0);
+    // A grab may have re-armed the timer after it fired, keep the lock then
+    if (timerfd_gettime(fd, &its) == 0
+            && (its.it_value.tv_sec != 0 || its.it_value.tv_nsec != 0)) {
+        ret = pthread_mutex_unlock(&s_wakeLockCountMutex);
+        assert(ret == 0);
         return;
     }
-
-    unsolResponseIndex = unsolResponse - RIL_UNSOL_RESPONSE_BASE;
-    pRI = s_unsolResponses;
-    pRI_elements = (int32_t)NUM_ELEMS(s_unsolResponses);
-
-    /* Hack to include Samsung responses */
-    if (unsolResponse > SAMSUNG_UNSOL_RESPONSE_BASE) {
-        pRI = s_unsolResponses_v;
-        pRI_elements = (int32_t)NUM_ELEMS(s_unsolResponses_v);
-
-        /*
-         * Some of the vendor response codes cannot be found by calculating their index anymore,
-         * because they have an even higher offset and are not ordered in the array.
-         * Example: RIL_UNSOL_SNDMGR_WB_AMR_REPORT = 20017, but it's at index 33 in the vendor
-         * response array.
-         * Thus, look through all the vendor URIs (Unsol Response Info) and pick the correct index.
-         * This has a cost of O(N).
-         */
-        int pRI_index;
-        for (pRI_index = 0; pRI_index < pRI_elements; pRI_index++) {
-            if (pRI[pRI_index].requestNumber == unsolResponse) {
-                unsolResponseIndex = pRI_index;
-            }
-        }
-
-        RLOGD("SAMSUNG: unsolResponse=%d, unsolResponseIndex=%d", unsolResponse, unsolResponseIndex);
+    if (s_wakeLockHeld) {
+        s_wakeLockStats.timeouts++;
     }
+    releaseKernelWakeLock();
+    ret = pthread_mutex_unlock(&s_wakeLockCountMutex);
+    assert(ret == 0);
+}
 
-    if (unsolResponseIndex >= 0 && unsolResponseIndex < pRI_elements) {
-        pRI = &pRI[unsolResponseIndex];
-    } else {
-        RLOGE("could not map unsolResponse=%d to %s response array (index=%d)", unsolResponse,
-                pRI == s_unsolResponses ? "AOSP" : "Samsung", unsolResponseIndex);
+void
+getWakeLockStats(WakeLockStats *stats) {
+    int ret;
+    ret = pthread_mutex_lock(&s_wakeLockCountMutex);
+    assert(ret == 0);
+    *stats = s_wakeLockStats;
+    if (s_wakeLockHeld) {
+        stats->heldMs += android::elapsedRealtime() - s_wakeLockAcquiredMs;
     }
+    ret = pthread_mutex_unlock(&s_wakeLockCountMutex);
+    assert(ret == 0);
+}
 
-    if (pRI == NULL || pRI->responseFunction == NULL) {
-        RLOGE("unsupported unsolicited response code %d", unsolResponse);
-        return;
-    }
+static void
+deliverUnsolicitedResponse(UnsolResponseInfo *pRI, int unsolResponse, const void *data,
+                                size_t datalen, RIL_SOCKET_ID soc_id) {
+    int ret;
+    bool shouldScheduleTimeout = false;
 
     // Grab a wake lock if needed for this reponse,
     // as we exit we'll either release it immediately
@@ -866,23 +1120,6 @@ void RIL_onUnsolicitedResponse(int unsolResponse, const void *data,
     rwlockRet = pthread_rwlock_unlock(radioServiceRwlockPtr);
     assert(rwlockRet == 0);
 
-    if (s_callbacks.version < 13) {
-        if (shouldScheduleTimeout) {
-            UserCallbackInfo *p_info = internalRequestTimedCallback(wakeTimeoutCallback, NULL,
-                    &TIMEVAL_WAKE_TIMEOUT);
-
-            if (p_info == NULL) {
-                goto error_exit;
-            } else {
-                // Cancel the previous request
-                if (s_last_wake_timeout_info != NULL) {
-                    s_last_wake_timeout_info->userParam = (void *)1;
-                }
-                s_last_wake_timeout_info = p_info;
-            }
-        }
-    }
-
 #if VDBG
     RLOGI("%s UNSOLICITED: %s length:%d", rilSocketIdToString(soc_id),
             requestToString(unsolResponse), datalen);
@@ -901,7 +1138,7 @@ void RIL_onUnsolicitedResponse(int unsolResponse, const void *data,
 
         s_lastNITZTimeData = calloc(datalen, 1);
         if (s_lastNITZTimeData == NULL) {
-            RLOGE("Memory allocation failed in RIL_onUnsolicitedResponse");
+            RLOGE("Memory allocation failed in deliverUnsolicitedResponse");
             goto error_exit;
         }
         s_lastNITZTimeDataSize = datalen;
@@ -917,6 +1154,240 @@ error_exit:
     }
 }
 
+static int
+findCoalescedUnsol(int unsolResponse) {
+    for (int i = 0; i < (int)NUM_ELEMS(s_coalescedUnsols); i++) {
+        if (s_coalescedUnsols[i].unsolResponse == unsolResponse) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Delivers the payload held back for URC i of the slot, if there is one
+static void
+flushCoalescedUnsol(RIL_SOCKET_ID soc_id, int i) {
+    CoalescedUnsols *slot = &s_coalescedUnsolState[soc_id];
+    CoalescedUnsolState *state = &slot->state[i];
+    int unsolResponse = s_coalescedUnsols[i].unsolResponse;
+    void *data;
+    size_t datalen;
+
+    pthread_mutex_lock(&s_coalesceMutex);
+    if (!state->hasPending) {
+        pthread_mutex_unlock(&s_coalesceMutex);
+        return;
+    }
+    // Take the buffer, a URC arriving meanwhile gets a new one
+    data = state->pending;
+    datalen = state->pendingLen;
+    state->pending = NULL;
+    state->pendingSize = 0;
+    state->hasPending = false;
+    state->lastDeliveryMs = elapsedRealtime();
+    slot->delivered++;
+    pthread_mutex_unlock(&s_coalesceMutex);
+
+    deliverUnsolicitedResponse(findUnsolResponseInfo(unsolResponse), unsolResponse,
+            datalen > 0 ? data : NULL, datalen, soc_id);
+    free(data);
+}
+
+static void
+coalescedUnsolTimeout(void *param) {
+    int n = (int)(intptr_t) param;
+    RIL_SOCKET_ID soc_id = (RIL_SOCKET_ID)(n / (int)NUM_ELEMS(s_coalescedUnsols));
+    int i = n % (int)NUM_ELEMS(s_coalescedUnsols);
+
+    pthread_mutex_lock(&s_coalesceMutex);
+    s_coalescedUnsolState[soc_id].state[i].timerArmed = false;
+    pthread_mutex_unlock(&s_coalesceMutex);
+
+    flushCoalescedUnsol(soc_id, i);
+}
+
+// Returns true if the URC was held back, to be delivered by the window timer.
+// Every URC of the slot goes through here, so it is also where they are counted.
+static bool
+coalesceUnsolicitedResponse(int unsolResponse, const void *data, size_t datalen,
+                                RIL_SOCKET_ID soc_id) {
+    int i = findCoalescedUnsol(unsolResponse);
+    CoalescedUnsols *slot;
+    CoalescedUnsolState *state;
+    int64_t window;
+    int64_t now;
+    bool held = false;
+
+    if ((int) soc_id < 0 || (int) soc_id >= SIM_COUNT) {
+        return false;
+    }
+    slot = &s_coalescedUnsolState[soc_id];
+    window = i >= 0 ? s_coalescedUnsolWindowMs[i] : 0;
+    if (window <= 0) {
+        pthread_mutex_lock(&s_coalesceMutex);
+        slot->received++;
+        slot->delivered++;
+        pthread_mutex_unlock(&s_coalesceMutex);
+        return false;
+    }
+    state = &slot->state[i];
+    now = elapsedRealtime();
+
+    pthread_mutex_lock(&s_coalesceMutex);
+    slot->received++;
+    if (!state->hasPending && now - state->lastDeliveryMs >= window) {
+        state->lastDeliveryMs = now;
+        slot->delivered++;
+        pthread_mutex_unlock(&s_coalesceMutex);
+        return false;
+    }
+
+    if (datalen > state->pendingSize) {
+        void *pending = realloc(state->pending, datalen);
+        if (pending == NULL) {
+            RLOGE("Memory allocation failed in coalesceUnsolicitedResponse");
+            slot->delivered++;
+            pthread_mutex_unlock(&s_coalesceMutex);
+            return false;
+        }
+        state->pending = pending;
+        state->pendingSize = datalen;
+    }
+    if (state->hasPending) {
+        slot->suppressed++;
+    }
+    if (datalen > 0) {
+        memcpy(state->pending, data, datalen);
+    }
+    state->pendingLen = datalen;
+    state->hasPending = true;
+    held = true;
+
+    if (!state->timerArmed) {
+        int64_t remaining = state->lastDeliveryMs + window - now;
+        struct timeval relativeTime;
+
+        if (remaining < 0) {
+            remaining = 0;
+        }
+        relativeTime.tv_sec = remaining / 1000;
+        relativeTime.tv_usec = (remaining % 1000) * 1000;
+        if (internalRequestTimedCallback(coalescedUnsolTimeout,
+                (void *)(intptr_t)(soc_id * (int)NUM_ELEMS(s_coalescedUnsols) + i),
+                &relativeTime) != NULL) {
+            state->timerArmed = true;
+        } else {
+            // Without a timer nothing would deliver it, let this one through
+            state->hasPending = false;
+            state->lastDeliveryMs = now;
+            slot->delivered++;
+            held = false;
+        }
+    }
+    pthread_mutex_unlock(&s_coalesceMutex);
+
+    return held;
+}
+
+static void
+initCoalescedUnsols() {
+    int32_t window = property_get_int32(URC_WINDOW_PROPERTY, -1);
+
+    for (int i = 0; i < (int)NUM_ELEMS(s_coalescedUnsols); i++) {
+        s_coalescedUnsolWindowMs[i] = window >= 0 ? window : s_coalescedUnsols[i].windowMs;
+    }
+}
+
+void
+flushCoalescedUnsolResponses(int slotId) {
+    if (slotId < 0 || slotId >= SIM_COUNT) {
+        return;
+    }
+    for (int i = 0; i < (int)NUM_ELEMS(s_coalescedUnsols); i++) {
+        flushCoalescedUnsol((RIL_SOCKET_ID) slotId, i);
+    }
+}
+
+void
+getUnsolStats(int slotId, UnsolStats *stats) {
+    CoalescedUnsols *slot = &s_coalescedUnsolState[slotId];
+
+    pthread_mutex_lock(&s_coalesceMutex);
+    stats->received = slot->received;
+    stats->delivered = slot->delivered;
+    stats->suppressed = slot->suppressed;
+    pthread_mutex_unlock(&s_coalesceMutex);
+}
+
+// Kept out of the flush, which also runs on every radio and call state change
+void
+logRilStats(int slotId) {
+    if (slotId < 0 || slotId >= SIM_COUNT) {
+        return;
+    }
+
+    UnsolStats unsolStats;
+    getUnsolStats(slotId, &unsolStats);
+    RLOGI("slot %d indications: %u received, %u delivered, %u suppressed", slotId,
+            unsolStats.received, unsolStats.delivered, unsolStats.suppressed);
+
+    RequestStats requestStats;
+    getRequestStats(slotId, &requestStats);
+    RLOGI("slot %d requests: %u completed, mean %lld us, max %lld us, %u heap allocations",
+            slotId, requestStats.completed,
+            requestStats.completed > 0 ?
+                    (long long) (requestStats.totalLatencyUs / requestStats.completed) : 0LL,
+            (long long) requestStats.maxLatencyUs, requestStats.heapAllocs);
+
+    WakeLockStats stats;
+    getWakeLockStats(&stats);
+    RLOGI("wake lock: %u grabs, %u acquires, %u timeouts, held %lld ms", stats.grabs,
+            stats.acquires, stats.timeouts, (long long) stats.heldMs);
+}
+
+#if defined(ANDROID_MULTI_SIM)
+extern "C"
+void RIL_onUnsolicitedResponse(int unsolResponse, const void *data,
+                                size_t datalen, RIL_SOCKET_ID socket_id)
+#else
+extern "C"
+void RIL_onUnsolicitedResponse(int unsolResponse, const void *data,
+                                size_t datalen)
+#endif
+{
+    RIL_SOCKET_ID soc_id = RIL_SOCKET_1;
+    UnsolResponseInfo *pRI = NULL;
+#if defined(ANDROID_MULTI_SIM)
+    soc_id = socket_id;
+#endif
+
+
+    if (s_registerCalled == 0) {
+        // Ignore RIL_onUnsolicitedResponse before RIL_register
+        RLOGW("RIL_onUnsolicitedResponse called before RIL_register");
+        return;
+    }
+
+    pRI = findUnsolResponseInfo(unsolResponse);
+
+    if (pRI == NULL || pRI->responseFunction == NULL) {
+        RLOGE("unsupported unsolicited response code %d", unsolResponse);
+        return;
+    }
+
+    // The held back values may be stale after a radio or call state change
+    if (unsolResponse == RIL_UNSOL_RESPONSE_RADIO_STATE_CHANGED
+            || unsolResponse == RIL_UNSOL_RESPONSE_CALL_STATE_CHANGED) {
+        flushCoalescedUnsolResponses((int) soc_id);
+    }
+
+    if (coalesceUnsolicitedResponse(unsolResponse, data, datalen, soc_id)) {
+        return;
+    }
+
+    deliverUnsolicitedResponse(pRI, unsolResponse, data, datalen, soc_id);
+}
+
 /** FIXME generalize this if you track UserCAllbackInfo, clear it
     when the callback occurs
 */
@@ -24,7 +24,9 @@
 #include <utils/Log.h>
 #include <ril_event.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <sys/time.h>
+#include <sys/timerfd.h>
 #include <time.h>
 
 #include <pthread.h>
@@ -53,23 +55,20 @@ static pthread_mutex_t listMutex;
         : (a)->tv_sec op (b)->tv_sec)
 #endif
 
-#ifndef timersub
-#define timersub(a, b, res)                           \
-    do {                                              \
-        (res)->tv_sec = (a)->tv_sec - (b)->tv_sec;    \
-        (res)->tv_usec = (a)->tv_usec - (b)->tv_usec; \
-        if ((res)->tv_usec < 0) {                     \
-            (res)->tv_usec += 1000000;                \
-            (res)->tv_sec -= 1;                       \
-        }                                             \
-    } while(0);
-#endif
+// Max number of ready fd's handled per epoll_wait().  Not a limit on the
+// number of watched fd's; the rest are picked up by the next iteration.
+#define MAX_EPOLL_EVENTS 16
+// Initial size of the timer heap, grown on demand
+#define TIMER_HEAP_INIT_SIZE 16
 
-static fd_set readFds;
-static int nfds = 0;
+static int epollFd = -1;
+// Armed for the earliest timer, so the loop only wakes up when one is due
+static int timerFd = -1;
 
-static struct ril_event * watch_table[MAX_FD_EVENTS];
-static struct ril_event timer_list;
+// Min-heap of pending timers, ordered by timeout
+static struct ril_event ** timer_heap;
+static int timer_count = 0;
+static int timer_capacity = 0;
 static struct ril_event pending_list;
 
 #define DEBUG 0
@@ -130,68 +129,169 @@ static void removeFromList(struct ril_event * ev)
     dlog("~~~~ -removeFromList ~~~~");
 }
 
+static void heapSet(int index, struct ril_event * ev)
+{
+    timer_heap[index] = ev;
+    ev->index = index;
+}
 
-static void removeWatch(struct ril_event * ev, int index)
+static void heapSiftUp(int index)
 {
-    dlog("~~~~ +removeWatch ~~~~");
-    watch_table[index] = NULL;
-    ev->index = -1;
+    struct ril_event * ev = timer_heap[index];
+
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (!timercmp(&ev->timeout, &timer_heap[parent]->timeout, <)) {
+            break;
+        }
+        heapSet(index, timer_heap[parent]);
+        index = parent;
+    }
+    heapSet(index, ev);
+}
+
+static void heapSiftDown(int index)
+{
+    struct ril_event * ev = timer_heap[index];
+
+    for (;;) {
+        int child = 2 * index + 1;
+        if (child >= timer_count) {
+            break;
+        }
+        if (child + 1 < timer_count
+                && timercmp(&timer_heap[child + 1]->timeout, &timer_heap[child]->timeout, <)) {
+            child++;
+        }
+        if (!timercmp(&timer_heap[child]->timeout, &ev->timeout, <)) {
+            break;
+        }
+        heapSet(index, timer_heap[child]);
+        index = child;
+    }
+    heapSet(index, ev);
+}
 
-    FD_CLR(ev->fd, &readFds);
+static bool heapPush(struct ril_event * ev)
+{
+    if (timer_count == timer_capacity) {
+        int capacity = timer_capacity ? timer_capacity * 2 : TIMER_HEAP_INIT_SIZE;
+        struct ril_event ** heap = (struct ril_event **) realloc(timer_heap,
+                capacity * sizeof(struct ril_event *));
+        if (heap == NULL) {
+            return false;
+        }
+        timer_heap = heap;
+        timer_capacity = capacity;
+    }
+    heapSet(timer_count, ev);
+    timer_count++;
+    heapSiftUp(timer_count - 1);
+    return true;
+}
 
-    if (ev->fd+1 == nfds) {
-        int n = 0;
+static struct ril_event * heapPop()
+{
+    struct ril_event * ev = timer_heap[0];
 
-        for (int i = 0; i < MAX_FD_EVENTS; i++) {
-            struct ril_event * rev = watch_table[i];
+    timer_count--;
+    if (timer_count > 0) {
+        heapSet(0, timer_heap[timer_count]);
+        heapSiftDown(0);
+    }
+    ev->index = -1;
+    return ev;
+}
 
-            if ((rev != NULL) && (rev->fd > n)) {
-                n = rev->fd;
-            }
+// Arm timerFd for the earliest timer, or disarm it.  Called with listMutex held.
+static void armTimer()
+{
+    struct itimerspec its;
+
+    memset(&its, 0, sizeof(its));
+    if (timer_count > 0) {
+        its.it_value.tv_sec = timer_heap[0]->timeout.tv_sec;
+        its.it_value.tv_nsec = timer_heap[0]->timeout.tv_usec * 1000;
+        // An all-zero it_value would disarm the timer
+        if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) {
+            its.it_value.tv_nsec = 1;
         }
-        nfds = n + 1;
-        dlog("~~~~ nfds = %d ~~~~", nfds);
+    }
+    dlog("~~~~ arming timer for %ds + %dns ~~~~",
+            (int)its.it_value.tv_sec, (int)its.it_value.tv_nsec);
+    if (timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+        RLOGE("ril_event: timerfd_settime error (%d)", errno);
+    }
+}
+
+static void removeWatch(struct ril_event * ev)
+{
+    dlog("~~~~ +removeWatch ~~~~");
+    ev->index = -1;
+
+    // The fd may have been closed already, which dropped it from the epoll set
+    if (epoll_ctl(epollFd, EPOLL_CTL_DEL, ev->fd, NULL) < 0 && errno != EBADF) {
+        RLOGE("ril_event: failed to unwatch fd %d (%d)", ev->fd, errno);
     }
     dlog("~~~~ -removeWatch ~~~~");
 }
 
+// Consume the timerFd expirations before processTimeouts() walks the timer heap.  Draining
+// them afterwards would also eat the expiration of a timer it re-armed for a deadline that has
+// already passed, and that timer would never fire.
+static void drainTimer(struct epoll_event * events, int n)
+{
+    for (int i = 0; i < n; i++) {
+        if (events[i].data.ptr == NULL) {
+            uint64_t expirations;
+            while (read(timerFd, &expirations, sizeof(expirations)) < 0 && errno == EINTR);
+            return;
+        }
+    }
+}
+
 static void processTimeouts()
 {
     dlog("~~~~ +processTimeouts ~~~~");
     MUTEX_ACQUIRE();
     struct timeval now;
-    struct ril_event * tev = timer_list.next;
-    struct ril_event * next;
+    bool fired = false;
 
     getNow(&now);
-    // walk list, see if now >= ev->timeout for any events
+    // pop the heap while the earliest timer has expired
 
     dlog("~~~~ Looking for timers <= %ds + %dus ~~~~", (int)now.tv_sec, (int)now.tv_usec);
-    while ((tev != &timer_list) && (timercmp(&now, &tev->timeout, >))) {
+    while ((timer_count > 0) && !timercmp(&timer_heap[0]->timeout, &now, >)) {
         // Timer expired
         dlog("~~~~ firing timer ~~~~");
-        next = tev->next;
-        removeFromList(tev);
-        addToList(tev, &pending_list);
-        tev = next;
+        addToList(heapPop(), &pending_list);
+        fired = true;
+    }
+    if (fired) {
+        armTimer();
     }
     MUTEX_RELEASE();
     dlog("~~~~ -processTimeouts ~~~~");
 }
 
-static void processReadReadies(fd_set * rfds, int n)
+static void processReadReadies(struct epoll_event * events, int n)
 {
     dlog("~~~~ +processReadReadies (%d) ~~~~", n);
     MUTEX_ACQUIRE();
 
-    for (int i = 0; (i < MAX_FD_EVENTS) && (n > 0); i++) {
-        struct ril_event * rev = watch_table[i];
-        if (rev != NULL && FD_ISSET(rev->fd, rfds)) {
-            addToList(rev, &pending_list);
-            if (rev->persist == false) {
-                removeWatch(rev, i);
-            }
-            n--;
+    for (int i = 0; i < n; i++) {
+        struct ril_event * rev = (struct ril_event *) events[i].data.ptr;
+        if (rev == NULL) {
+            // timerFd, drained by drainTimer() and handled by processTimeouts()
+            continue;
+        }
+        // Deleted by a callback fired earlier in this iteration
+        if (rev->index < 0) {
+            continue;
+        }
+        addToList(rev, &pending_list);
+        if (rev->persist == false) {
+            removeWatch(rev);
         }
     }
 
@@ -212,40 +312,37 @@ static void firePending()
     dlog("~~~~ -firePending ~~~~");
 }
 
-static int calcNextTimeout(struct timeval * tv)
-{
-    struct ril_event * tev = timer_list.next;
-    struct timeval now;
-
-    getNow(&now);
-
-    // Sorted list, so calc based on first node
-    if (tev == &timer_list) {
-        // no pending timers
-        return -1;
-    }
-
-    dlog("~~~~ now = %ds + %dus ~~~~", (int)now.tv_sec, (int)now.tv_usec);
-    dlog("~~~~ next = %ds + %dus ~~~~",
-            (int)tev->timeout.tv_sec, (int)tev->timeout.tv_usec);
-    if (timercmp(&tev->timeout, &now, >)) {
-        timersub(&tev->timeout, &now, tv);
-    } else {
-        // timer already expired.
-        tv->tv_sec = tv->tv_usec = 0;
-    }
-    return 0;
-}
-
 // Initialize internal data structs
 void ril_event_init()
 {
     MUTEX_INIT();
 
-    FD_ZERO(&readFds);
-    init_list(&timer_list);
     init_list(&pending_list);
-    memset(watch_table, 0, sizeof(watch_table));
+    timer_count = 0;
+    timer_capacity = TIMER_HEAP_INIT_SIZE;
+    timer_heap = (struct ril_event **) calloc(timer_capacity, sizeof(struct ril_event *));
+    if (timer_heap == NULL) {
+        timer_capacity = 0;
+    }
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0) {
+        RLOGE("ril_event: epoll_create1 error (%d)", errno);
+        return;
+    }
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timerFd < 0) {
+        RLOGE("ril_event: timerfd_create error (%d)", errno);
+        return;
+    }
+
+    struct epoll_event eev;
+    memset(&eev, 0, sizeof(eev));
+    eev.events = EPOLLIN;
+    eev.data.ptr = NULL;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, timerFd, &eev) < 0) {
+        RLOGE("ril_event: failed to watch timerfd (%d)", errno);
+    }
 }
 
 // Initialize an event
@@ -266,17 +363,17 @@ void ril_event_add(struct ril_event * ev)
 {
     dlog("~~~~ +ril_event_add ~~~~");
     MUTEX_ACQUIRE();
-    for (int i = 0; i < MAX_FD_EVENTS; i++) {
-        if (watch_table[i] == NULL) {
-            watch_table[i] = ev;
-            ev->index = i;
-            dlog("~~~~ added at %d ~~~~", i);
-            dump_event(ev);
-            FD_SET(ev->fd, &readFds);
-            if (ev->fd >= nfds) nfds = ev->fd+1;
-            dlog("~~~~ nfds = %d ~~~~", nfds);
-            break;
-        }
+    struct epoll_event eev;
+    memset(&eev, 0, sizeof(eev));
+    eev.events = EPOLLIN;
+    eev.data.ptr = ev;
+    // epoll_wait() picks the fd up right away, even when called from another thread
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, ev->fd, &eev) < 0) {
+        RLOGE("ril_event: failed to watch fd %d (%d)", ev->fd, errno);
+    } else {
+        ev->index = 0;
+        dlog("~~~~ added fd %d ~~~~", ev->fd);
+        dump_event(ev);
     }
     MUTEX_RELEASE();
     dlog("~~~~ -ril_event_add ~~~~");
@@ -288,96 +385,87 @@ void ril_timer_add(struct ril_event * ev, struct timeval * tv)
     dlog("~~~~ +ril_timer_add ~~~~");
     MUTEX_ACQUIRE();
 
-    struct ril_event * list;
     if (tv != NULL) {
-        // add to timer list
-        list = timer_list.next;
+        // add to timer heap
         ev->fd = -1; // make sure fd is invalid
 
         struct timeval now;
         getNow(&now);
         timeradd(&now, tv, &ev->timeout);
 
-        // keep list sorted
-        while (timercmp(&list->timeout, &ev->timeout, < )
-                && (list != &timer_list)) {
-            list = list->next;
+        if (!heapPush(ev)) {
+            RLOGE("ril_event: no memory for timer");
+        } else if (ev->index == 0) {
+            // new earliest timer
+            armTimer();
         }
-        // list now points to the first event older than ev
-        addToList(ev, list);
     }
 
     MUTEX_RELEASE();
     dlog("~~~~ -ril_timer_add ~~~~");
 }
 
-// Remove event from watch or timer list
+// Remove event from watch list
 void ril_event_del(struct ril_event * ev)
 {
     dlog("~~~~ +ril_event_del ~~~~");
     MUTEX_ACQUIRE();
 
-    if (ev->index < 0 || ev->index >= MAX_FD_EVENTS) {
+    // Timers can't be removed, and neither can events which aren't watched
+    if (ev->fd < 0 || ev->index < 0) {
         MUTEX_RELEASE();
         return;
     }
 
-    removeWatch(ev, ev->index);
+    removeWatch(ev);
 
     MUTEX_RELEASE();
     dlog("~~~~ -ril_event_del ~~~~");
 }
 
 #if DEBUG
-static void printReadies(fd_set * rfds)
+static void printReadies(struct epoll_event * events, int n)
 {
-    for (int i = 0; (i < MAX_FD_EVENTS); i++) {
-        struct ril_event * rev = watch_table[i];
-        if (rev != NULL && FD_ISSET(rev->fd, rfds)) {
+    for (int i = 0; i < n; i++) {
+        struct ril_event * rev = (struct ril_event *) events[i].data.ptr;
+        if (rev != NULL) {
           dlog("DON: fd=%d is ready", rev->fd);
         }
     }
 }
 #else
-#define printReadies(rfds) do {} while(0)
+#define printReadies(events, n) do {} while(0)
 #endif
 
 void ril_event_loop()
 {
     int n;
-    fd_set rfds;
-    struct timeval tv;
-    struct timeval * ptv;
+    struct epoll_event events[MAX_EPOLL_EVENTS];
 
+    if (epollFd < 0 || timerFd < 0) {
+        RLOGE("ril_event: event loop not initialized");
+        return;
+    }
 
     for (;;) {
 
-        // make local copy of read fd_set
-        memcpy(&rfds, &readFds, sizeof(fd_set));
-        if (-1 == calcNextTimeout(&tv)) {
-            // no pending timers; block indefinitely
-            dlog("~~~~ no timers; blocking indefinitely ~~~~");
-            ptv = NULL;
-        } else {
-            dlog("~~~~ blocking for %ds + %dus ~~~~", (int)tv.tv_sec, (int)tv.tv_usec);
-            ptv = &tv;
-        }
-        printReadies(&rfds);
-        n = select(nfds, &rfds, NULL, NULL, ptv);
-        printReadies(&rfds);
+        // timerFd wakes us up for the next timer, so block indefinitely
+        n = epoll_wait(epollFd, events, MAX_EPOLL_EVENTS, -1);
+        printReadies(events, n);
         dlog("~~~~ %d events fired ~~~~", n);
         if (n < 0) {
             if (errno == EINTR) continue;
 
-            RLOGE("ril_event: select error (%d)", errno);
+            RLOGE("ril_event: epoll_wait error (%d)", errno);
             // bail?
             return;
         }
 
         // Check for timeouts
+        drainTimer(events, n);
         processTimeouts();
         // Check for read-ready
-        processReadReadies(&rfds, n);
+        processReadReadies(events, n);
         // Fire away
         firePending();
     }
@@ -77,6 +77,7 @@ typedef struct RequestInfo {
     char local;         // responses to local commands do not go back to command process
     RIL_SOCKET_ID socket_id;
     int wasAckSent;    // Indicates whether an ack was sent earlier
+    int64_t startNs;    // elapsedRealtimeNano() when the request was added
 } RequestInfo;
 
 typedef struct CommandInfo {
@@ -87,12 +88,50 @@ typedef struct CommandInfo {
 
 RequestInfo * addRequestToList(int serial, int slotId, int request);
 
+void flushCoalescedUnsolResponses(int slotId);
+
+// Log the indication, request and wake lock counters of a slot
+void logRilStats(int slotId);
+
 char * RIL_getServiceName();
 
 void releaseWakeLock();
 
+typedef struct WakeLockStats {
+    unsigned int grabs;         // grabPartialWakeLock() calls
+    unsigned int acquires;      // acquire_wake_lock() calls
+    unsigned int timeouts;      // released by the timer instead of an ack
+    int64_t heldMs;             // total time the kernel wake lock was held
+} WakeLockStats;
+
+void getWakeLockStats(WakeLockStats *stats);
+
+// RequestInfos preallocated per slot before addRequestToList() falls back to calloc()
+#define REQUEST_POOL_SIZE 128
+
+typedef struct RequestStats {
+    unsigned int completed;     // responses sent back, local requests excluded
+    unsigned int heapAllocs;    // RequestInfos calloc()ed because the pool ran out
+    int64_t totalLatencyUs;     // from addRequestToList() to the response being sent
+    int64_t maxLatencyUs;
+} RequestStats;
+
+void getRequestStats(int slotId, RequestStats *stats);
+
+typedef struct UnsolStats {
+    unsigned int received;      // RIL_onUnsolicitedResponse() calls with a supported URC
+    unsigned int delivered;     // indications sent up, held back copies once delivered
+    unsigned int suppressed;    // held back copies replaced by a newer one
+} UnsolStats;
+
+void getUnsolStats(int slotId, UnsolStats *stats);
+
 void onNewCommandConnect(RIL_SOCKET_ID socket_id);
 
+extern "C" void RIL_startEventLoop(void);
+
+extern "C" void RIL_registerForTest(const RIL_RadioFunctions *callbacks);
+
 }   // namespace android
 
 #endif //ANDROID_RIL_INTERNAL_H
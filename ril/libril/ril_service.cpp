@@ -29,6 +29,9 @@
 
 #define INVALID_HEX_CHAR 16
 
+// string arrays of at most this many entries are dispatched without a heap allocation
+#define DISPATCH_STRINGS_ON_STACK 8
+
 // Enable verbose logging
 #define VDBG 0
 
@@ -71,6 +74,26 @@ static CommandInfo *s_commands;
 struct RadioImpl;
 struct OemHookImpl;
 
+/*
+ * Cell info lists are converted into records kept per slot between calls.
+ * A vector is only resized when the number or the type of the cells
+ * changes, and MCC/MNC are printed into fixed buffers the records point
+ * to, so a steady stream of cell info does no heap work.
+ */
+#define MCC_MNC_BUF_SIZE 12     // any int with its sign and the NUL
+
+struct MccMncStrings {
+    char mcc[MCC_MNC_BUF_SIZE];
+    char mnc[MCC_MNC_BUF_SIZE];
+};
+
+struct CellInfoScratch {
+    hidl_vec<CellInfo> records;
+    hidl_vec<MccMncStrings> strings;
+    // held until the records are sent, indications and responses may come from different threads
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+};
+
 #if (SIM_COUNT >= 2)
 sp<RadioImpl> radioService[SIM_COUNT];
 sp<OemHookImpl> oemHookService[SIM_COUNT];
@@ -78,6 +101,7 @@ int64_t nitzTimeReceived[SIM_COUNT];
 // counter used for synchronization. It is incremented every time response callbacks are updated.
 volatile int32_t mCounterRadio[SIM_COUNT];
 volatile int32_t mCounterOemHook[SIM_COUNT];
+static CellInfoScratch cellInfoScratch[SIM_COUNT];
 #else
 sp<RadioImpl> radioService[1];
 sp<OemHookImpl> oemHookService[1];
@@ -85,8 +109,26 @@ int64_t nitzTimeReceived[1];
 // counter used for synchronization. It is incremented every time response callbacks are updated.
 volatile int32_t mCounterRadio[1];
 volatile int32_t mCounterOemHook[1];
+static CellInfoScratch cellInfoScratch[1];
 #endif
 
+/*
+ * Returns the records of the slot locked, or fallback while another thread is still sending
+ * them, so a conversion never waits behind an outgoing HIDL call.
+ */
+static CellInfoScratch& acquireCellInfoScratch(int slotId, CellInfoScratch& fallback) {
+    if (pthread_mutex_trylock(&cellInfoScratch[slotId].lock) == 0) {
+        return cellInfoScratch[slotId];
+    }
+    return fallback;
+}
+
+static void releaseCellInfoScratch(int slotId, CellInfoScratch& scratch) {
+    if (&scratch == &cellInfoScratch[slotId]) {
+        pthread_mutex_unlock(&scratch.lock);
+    }
+}
+
 static pthread_rwlock_t radioServiceRwlock = PTHREAD_RWLOCK_INITIALIZER;
 
 #if (SIM_COUNT >= 2)
@@ -121,7 +163,7 @@ void convertRilDataCallToHal(RIL_Data_Call_Response_v11 *dcResponse,
 void convertRilDataCallListToHal(void *response, size_t responseLen,
         hidl_vec<SetupDataCallResult>& dcResultList);
 
-void convertRilCellInfoListToHal(void *response, size_t responseLen, hidl_vec<CellInfo>& records);
+void convertRilCellInfoListToHal(void *response, size_t responseLen, CellInfoScratch& scratch);
 
 struct RadioImpl : public IRadio {
     int32_t mSlotId;
@@ -468,6 +510,14 @@ struct OemHookImpl : public IOemHook {
             const ::android::hardware::hidl_vec<::android::hardware::hidl_string>& data);
 };
 
+// hidl_vec::resize() always reallocates, even to the same size
+template <typename T>
+static void resizeHidlVec(hidl_vec<T>& vec, size_t size) {
+    if (vec.size() != size) {
+        vec.resize(size);
+    }
+}
+
 void memsetAndFreeStrings(int numPointers, ...) {
     va_list ap;
     va_start(ap, numPointers);
@@ -523,6 +573,15 @@ bool copyHidlStringToRil(char **dest, const hidl_string &src, RequestInfo *pRI)
     return copyHidlStringToRil(dest, src, pRI, false);
 }
 
+// Points dest at ptr without copying, ptr must outlive every use of dest.
+void setHidlStringToCharPtr(hidl_string &dest, const char *ptr) {
+    if (ptr != NULL) {
+        dest.setToExternal(ptr, strlen(ptr));
+    } else {
+        dest.clear();
+    }
+}
+
 hidl_string convertCharPtrToHidlString(const char *ptr) {
     hidl_string ret;
     if (ptr != NULL) {
@@ -558,18 +617,39 @@ bool dispatchString(int serial, int slotId, int request, const char * str) {
     return true;
 }
 
+/*
+ * The strings themselves are always copied: they may be PINs, passwords or USSD strings, the
+ * vendor RIL is not known to leave request data alone, and hwbinder maps incoming buffers
+ * read-only. Only the array of pointers lives on the stack for short requests.
+ */
+static void freeDispatchStrings(char **pStrings, char **stackStrings, int countStrings) {
+    for (int i = 0 ; i < countStrings ; i++) {
+        memsetAndFreeStrings(1, pStrings[i]);
+    }
+
+#ifdef MEMSET_FREED
+    memset(pStrings, 0, countStrings * sizeof(char *));
+#endif
+    if (pStrings != stackStrings) {
+        free(pStrings);
+    }
+}
+
 bool dispatchStrings(int serial, int slotId, int request, bool allowEmpty, int countStrings, ...) {
     RequestInfo *pRI = android::addRequestToList(serial, slotId, request);
     if (pRI == NULL) {
         return false;
     }
 
-    char **pStrings;
-    pStrings = (char **)calloc(countStrings, sizeof(char *));
-    if (pStrings == NULL) {
-        RLOGE("Memory allocation failed for request %s", requestToString(request));
-        sendErrorResponse(pRI, RIL_E_NO_MEMORY);
-        return false;
+    char *stackStrings[DISPATCH_STRINGS_ON_STACK];
+    char **pStrings = stackStrings;
+    if (countStrings > DISPATCH_STRINGS_ON_STACK) {
+        pStrings = (char **)calloc(countStrings, sizeof(char *));
+        if (pStrings == NULL) {
+            RLOGE("Memory allocation failed for request %s", requestToString(request));
+            sendErrorResponse(pRI, RIL_E_NO_MEMORY);
+            return false;
+        }
     }
     va_list ap;
     va_start(ap, countStrings);
@@ -577,10 +657,7 @@ bool dispatchStrings(int serial, int slotId, int request, bool allowEmpty, int c
         const char* str = va_arg(ap, const char *);
         if (!copyHidlStringToRil(&pStrings[i], hidl_string(str), pRI, allowEmpty)) {
             va_end(ap);
-            for (int j = 0; j < i; j++) {
-                memsetAndFreeStrings(1, pStrings[j]);
-            }
-            free(pStrings);
+            freeDispatchStrings(pStrings, stackStrings, i);
             return false;
         }
     }
@@ -588,16 +665,7 @@ bool dispatchStrings(int serial, int slotId, int request, bool allowEmpty, int c
 
     CALL_ONREQUEST(request, pStrings, countStrings * sizeof(char *), pRI, slotId);
 
-    if (pStrings != NULL) {
-        for (int i = 0 ; i < countStrings ; i++) {
-            memsetAndFreeStrings(1, pStrings[i]);
-        }
-
-#ifdef MEMSET_FREED
-        memset(pStrings, 0, countStrings * sizeof(char *));
-#endif
-        free(pStrings);
-    }
+    freeDispatchStrings(pStrings, stackStrings, countStrings);
     return true;
 }
 
@@ -608,36 +676,27 @@ bool dispatchStrings(int serial, int slotId, int request, const hidl_vec<hidl_st
     }
 
     int countStrings = data.size();
-    char **pStrings;
-    pStrings = (char **)calloc(countStrings, sizeof(char *));
-    if (pStrings == NULL) {
-        RLOGE("Memory allocation failed for request %s", requestToString(request));
-        sendErrorResponse(pRI, RIL_E_NO_MEMORY);
-        return false;
+    char *stackStrings[DISPATCH_STRINGS_ON_STACK];
+    char **pStrings = stackStrings;
+    if (countStrings > DISPATCH_STRINGS_ON_STACK) {
+        pStrings = (char **)calloc(countStrings, sizeof(char *));
+        if (pStrings == NULL) {
+            RLOGE("Memory allocation failed for request %s", requestToString(request));
+            sendErrorResponse(pRI, RIL_E_NO_MEMORY);
+            return false;
+        }
     }
 
     for (int i = 0; i < countStrings; i++) {
         if (!copyHidlStringToRil(&pStrings[i], data[i], pRI)) {
-            for (int j = 0; j < i; j++) {
-                memsetAndFreeStrings(1, pStrings[j]);
-            }
-            free(pStrings);
+            freeDispatchStrings(pStrings, stackStrings, i);
             return false;
         }
     }
 
     CALL_ONREQUEST(request, pStrings, countStrings * sizeof(char *), pRI, slotId);
 
-    if (pStrings != NULL) {
-        for (int i = 0 ; i < countStrings ; i++) {
-            memsetAndFreeStrings(1, pStrings[i]);
-        }
-
-#ifdef MEMSET_FREED
-        memset(pStrings, 0, countStrings * sizeof(char *));
-#endif
-        free(pStrings);
-    }
+    freeDispatchStrings(pStrings, stackStrings, countStrings);
     return true;
 }
 
@@ -2668,6 +2727,11 @@ Return<void> RadioImpl::sendDeviceState(int32_t serial, DeviceStateType deviceSt
 #if VDBG
     RLOGD("sendDeviceState: serial %d", serial);
 #endif
+    if (deviceStateType == DeviceStateType::LOW_DATA_EXPECTED && !state) {
+        // Screen on, the framework wants the current values now
+        android::flushCoalescedUnsolResponses(mSlotId);
+        android::logRilStats(mSlotId);
+    }
     if (s_vendorFunctions->version < 15) {
         if (deviceStateType ==  DeviceStateType::LOW_DATA_EXPECTED) {
             RLOGD("sendDeviceState: calling screen state %d", BOOL_TO_INT(!state));
@@ -5652,17 +5716,22 @@ int radio::getCellInfoListResponse(int slotId,
         RadioResponseInfo responseInfo = {};
         populateResponseInfo(responseInfo, serial, responseType, e);
 
-        hidl_vec<CellInfo> ret;
+        Return<void> retStatus;
         if ((response == NULL && responseLen != 0)
                 || responseLen % sizeof(RIL_CellInfo_v12) != 0) {
             RLOGE("getCellInfoListResponse: Invalid response");
             if (e == RIL_E_SUCCESS) responseInfo.error = RadioError::INVALID_RESPONSE;
+            hidl_vec<CellInfo> ret;
+            retStatus = radioService[slotId]->mRadioResponse->getCellInfoListResponse(
+                    responseInfo, ret);
         } else {
-            convertRilCellInfoListToHal(response, responseLen, ret);
+            CellInfoScratch fallback;
+            CellInfoScratch& scratch = acquireCellInfoScratch(slotId, fallback);
+            convertRilCellInfoListToHal(response, responseLen, scratch);
+            retStatus = radioService[slotId]->mRadioResponse->getCellInfoListResponse(
+                    responseInfo, scratch.records);
+            releaseCellInfoScratch(slotId, scratch);
         }
-
-        Return<void> retStatus = radioService[slotId]->mRadioResponse->getCellInfoListResponse(
-                responseInfo, ret);
         radioService[slotId]->checkReturnStatus(retStatus);
     } else {
         RLOGE("getCellInfoListResponse: radioService[%d]->mRadioResponse == NULL", slotId);
@@ -7088,16 +7157,16 @@ void convertRilDataCallToHal(RIL_Data_Call_Response_v6 *dcResponse,
     dcResult.suggestedRetryTime = dcResponse->suggestedRetryTime;
     dcResult.cid = dcResponse->cid;
     dcResult.active = dcResponse->active;
-    dcResult.type = convertCharPtrToHidlString(dcResponse->type);
-    dcResult.ifname = convertCharPtrToHidlString(dcResponse->ifname);
-    dcResult.addresses = convertCharPtrToHidlString(dcResponse->addresses);
-    dcResult.dnses = convertCharPtrToHidlString(dcResponse->dnses);
+    setHidlStringToCharPtr(dcResult.type, dcResponse->type);
+    setHidlStringToCharPtr(dcResult.ifname, dcResponse->ifname);
+    setHidlStringToCharPtr(dcResult.addresses, dcResponse->addresses);
+    setHidlStringToCharPtr(dcResult.dnses, dcResponse->dnses);
 #if defined(MODEM_TYPE_XMM6262) || defined(MODEM_TYPE_XMM6260)
-    dcResult.gateways = convertCharPtrToHidlString(dcResponse->addresses);
+    setHidlStringToCharPtr(dcResult.gateways, dcResponse->addresses);
 #else
-    dcResult.gateways = convertCharPtrToHidlString(dcResponse->gateways);
+    setHidlStringToCharPtr(dcResult.gateways, dcResponse->gateways);
 #endif
-    dcResult.pcscf = hidl_string();
+    dcResult.pcscf.clear();
     dcResult.mtu = 0;
 }
 
@@ -7107,12 +7176,12 @@ void convertRilDataCallToHal(RIL_Data_Call_Response_v9 *dcResponse,
     dcResult.suggestedRetryTime = dcResponse->suggestedRetryTime;
     dcResult.cid = dcResponse->cid;
     dcResult.active = dcResponse->active;
-    dcResult.type = convertCharPtrToHidlString(dcResponse->type);
-    dcResult.ifname = convertCharPtrToHidlString(dcResponse->ifname);
-    dcResult.addresses = convertCharPtrToHidlString(dcResponse->addresses);
-    dcResult.dnses = convertCharPtrToHidlString(dcResponse->dnses);
-    dcResult.gateways = convertCharPtrToHidlString(dcResponse->gateways);
-    dcResult.pcscf = convertCharPtrToHidlString(dcResponse->pcscf);
+    setHidlStringToCharPtr(dcResult.type, dcResponse->type);
+    setHidlStringToCharPtr(dcResult.ifname, dcResponse->ifname);
+    setHidlStringToCharPtr(dcResult.addresses, dcResponse->addresses);
+    setHidlStringToCharPtr(dcResult.dnses, dcResponse->dnses);
+    setHidlStringToCharPtr(dcResult.gateways, dcResponse->gateways);
+    setHidlStringToCharPtr(dcResult.pcscf, dcResponse->pcscf);
     dcResult.mtu = 0;
 }
 
@@ -7122,12 +7191,12 @@ void convertRilDataCallToHal(RIL_Data_Call_Response_v11 *dcResponse,
     dcResult.suggestedRetryTime = dcResponse->suggestedRetryTime;
     dcResult.cid = dcResponse->cid;
     dcResult.active = dcResponse->active;
-    dcResult.type = convertCharPtrToHidlString(dcResponse->type);
-    dcResult.ifname = convertCharPtrToHidlString(dcResponse->ifname);
-    dcResult.addresses = convertCharPtrToHidlString(dcResponse->addresses);
-    dcResult.dnses = convertCharPtrToHidlString(dcResponse->dnses);
-    dcResult.gateways = convertCharPtrToHidlString(dcResponse->gateways);
-    dcResult.pcscf = convertCharPtrToHidlString(dcResponse->pcscf);
+    setHidlStringToCharPtr(dcResult.type, dcResponse->type);
+    setHidlStringToCharPtr(dcResult.ifname, dcResponse->ifname);
+    setHidlStringToCharPtr(dcResult.addresses, dcResponse->addresses);
+    setHidlStringToCharPtr(dcResult.dnses, dcResponse->dnses);
+    setHidlStringToCharPtr(dcResult.gateways, dcResponse->gateways);
+    setHidlStringToCharPtr(dcResult.pcscf, dcResponse->pcscf);
     dcResult.mtu = dcResponse->mtu;
 }
 
@@ -7138,21 +7207,21 @@ void convertRilDataCallListToHal(void *response, size_t responseLen,
     if ((responseLen % sizeof(RIL_Data_Call_Response_v11)) == 0) {
         num = responseLen / sizeof(RIL_Data_Call_Response_v11);
         RIL_Data_Call_Response_v11 *dcResponse = (RIL_Data_Call_Response_v11 *) response;
-        dcResultList.resize(num);
+        resizeHidlVec(dcResultList, num);
         for (int i = 0; i < num; i++) {
             convertRilDataCallToHal(&dcResponse[i], dcResultList[i]);
         }
     } else if ((responseLen % sizeof(RIL_Data_Call_Response_v9)) == 0) {
         num = responseLen / sizeof(RIL_Data_Call_Response_v9);
         RIL_Data_Call_Response_v9 *dcResponse = (RIL_Data_Call_Response_v9 *) response;
-        dcResultList.resize(num);
+        resizeHidlVec(dcResultList, num);
         for (int i = 0; i < num; i++) {
             convertRilDataCallToHal(&dcResponse[i], dcResultList[i]);
         }
     } else if ((responseLen % sizeof(RIL_Data_Call_Response_v6)) == 0) {
         num = responseLen / sizeof(RIL_Data_Call_Response_v6);
         RIL_Data_Call_Response_v6 *dcResponse = (RIL_Data_Call_Response_v6 *) response;
-        dcResultList.resize(num);
+        resizeHidlVec(dcResultList, num);
         for (int i = 0; i < num; i++) {
             convertRilDataCallToHal(&dcResponse[i], dcResultList[i]);
         }
@@ -7912,9 +7981,23 @@ int radio::voiceRadioTechChangedInd(int slotId,
     return 0;
 }
 
-void convertRilCellInfoListToHal(void *response, size_t responseLen, hidl_vec<CellInfo>& records) {
+static void setMccMnc(hidl_string &mcc, hidl_string &mnc, MccMncStrings &strings,
+        int rilMcc, int rilMnc) {
+    int len = snprintf(strings.mcc, sizeof(strings.mcc), "%d", rilMcc);
+    mcc.setToExternal(strings.mcc, len);
+    len = snprintf(strings.mnc, sizeof(strings.mnc), "%d", rilMnc);
+    mnc.setToExternal(strings.mnc, len);
+}
+
+// scratch must come from acquireCellInfoScratch() and be released once the records are sent
+void convertRilCellInfoListToHal(void *response, size_t responseLen, CellInfoScratch& scratch) {
     int num = responseLen / sizeof(RIL_CellInfo_v12);
-    records.resize(num);
+    hidl_vec<CellInfo>& records = scratch.records;
+    resizeHidlVec(records, num);
+    // Every MCC/MNC is pointed at its buffer again below, so growing them is safe
+    if (scratch.strings.size() < (size_t) num) {
+        scratch.strings.resize(num);
+    }
 
     RIL_CellInfo_v12 *rillCellInfo = (RIL_CellInfo_v12 *) response;
     for (int i = 0; i < num; i++) {
@@ -7922,21 +8005,19 @@ void convertRilCellInfoListToHal(void *response, size_t responseLen, hidl_vec<Ce
         records[i].registered = rillCellInfo->registered;
         records[i].timeStampType = (TimeStampType) rillCellInfo->timeStampType;
         records[i].timeStamp = rillCellInfo->timeStamp;
-        // All vectors should be size 0 except one which will be size 1. Set everything to
-        // size 0 initially.
-        records[i].gsm.resize(0);
-        records[i].wcdma.resize(0);
-        records[i].cdma.resize(0);
-        records[i].lte.resize(0);
-        records[i].tdscdma.resize(0);
+        // All vectors should be size 0 except one which will be size 1.
+        int type = rillCellInfo->cellInfoType;
+        resizeHidlVec(records[i].gsm, type == RIL_CELL_INFO_TYPE_GSM ? 1 : 0);
+        resizeHidlVec(records[i].wcdma, type == RIL_CELL_INFO_TYPE_WCDMA ? 1 : 0);
+        resizeHidlVec(records[i].cdma, type == RIL_CELL_INFO_TYPE_CDMA ? 1 : 0);
+        resizeHidlVec(records[i].lte, type == RIL_CELL_INFO_TYPE_LTE ? 1 : 0);
+        resizeHidlVec(records[i].tdscdma, type == RIL_CELL_INFO_TYPE_TD_SCDMA ? 1 : 0);
         switch(rillCellInfo->cellInfoType) {
             case RIL_CELL_INFO_TYPE_GSM: {
-                records[i].gsm.resize(1);
                 CellInfoGsm *cellInfoGsm = &records[i].gsm[0];
-                cellInfoGsm->cellIdentityGsm.mcc =
-                        std::to_string(rillCellInfo->CellInfo.gsm.cellIdentityGsm.mcc);
-                cellInfoGsm->cellIdentityGsm.mnc =
-                        std::to_string(rillCellInfo->CellInfo.gsm.cellIdentityGsm.mnc);
+                setMccMnc(cellInfoGsm->cellIdentityGsm.mcc, cellInfoGsm->cellIdentityGsm.mnc,
+                        scratch.strings[i], rillCellInfo->CellInfo.gsm.cellIdentityGsm.mcc,
+                        rillCellInfo->CellInfo.gsm.cellIdentityGsm.mnc);
                 cellInfoGsm->cellIdentityGsm.lac =
                         rillCellInfo->CellInfo.gsm.cellIdentityGsm.lac;
                 cellInfoGsm->cellIdentityGsm.cid =
@@ -7955,12 +8036,10 @@ void convertRilCellInfoListToHal(void *response, size_t responseLen, hidl_vec<Ce
             }
 
             case RIL_CELL_INFO_TYPE_WCDMA: {
-                records[i].wcdma.resize(1);
                 CellInfoWcdma *cellInfoWcdma = &records[i].wcdma[0];
-                cellInfoWcdma->cellIdentityWcdma.mcc =
-                        std::to_string(rillCellInfo->CellInfo.wcdma.cellIdentityWcdma.mcc);
-                cellInfoWcdma->cellIdentityWcdma.mnc =
-                        std::to_string(rillCellInfo->CellInfo.wcdma.cellIdentityWcdma.mnc);
+                setMccMnc(cellInfoWcdma->cellIdentityWcdma.mcc, cellInfoWcdma->cellIdentityWcdma.mnc,
+                        scratch.strings[i], rillCellInfo->CellInfo.wcdma.cellIdentityWcdma.mcc,
+                        rillCellInfo->CellInfo.wcdma.cellIdentityWcdma.mnc);
                 cellInfoWcdma->cellIdentityWcdma.lac =
                         rillCellInfo->CellInfo.wcdma.cellIdentityWcdma.lac;
                 cellInfoWcdma->cellIdentityWcdma.cid =
@@ -7977,7 +8056,6 @@ void convertRilCellInfoListToHal(void *response, size_t responseLen, hidl_vec<Ce
             }
 
             case RIL_CELL_INFO_TYPE_CDMA: {
-                records[i].cdma.resize(1);
                 CellInfoCdma *cellInfoCdma = &records[i].cdma[0];
                 cellInfoCdma->cellIdentityCdma.networkId =
                         rillCellInfo->CellInfo.cdma.cellIdentityCdma.networkId;
@@ -8003,12 +8081,10 @@ void convertRilCellInfoListToHal(void *response, size_t responseLen, hidl_vec<Ce
             }
 
             case RIL_CELL_INFO_TYPE_LTE: {
-                records[i].lte.resize(1);
                 CellInfoLte *cellInfoLte = &records[i].lte[0];
-                cellInfoLte->cellIdentityLte.mcc =
-                        std::to_string(rillCellInfo->CellInfo.lte.cellIdentityLte.mcc);
-                cellInfoLte->cellIdentityLte.mnc =
-                        std::to_string(rillCellInfo->CellInfo.lte.cellIdentityLte.mnc);
+                setMccMnc(cellInfoLte->cellIdentityLte.mcc, cellInfoLte->cellIdentityLte.mnc,
+                        scratch.strings[i], rillCellInfo->CellInfo.lte.cellIdentityLte.mcc,
+                        rillCellInfo->CellInfo.lte.cellIdentityLte.mnc);
                 cellInfoLte->cellIdentityLte.ci =
                         rillCellInfo->CellInfo.lte.cellIdentityLte.ci;
                 cellInfoLte->cellIdentityLte.pci =
@@ -8033,12 +8109,10 @@ void convertRilCellInfoListToHal(void *response, size_t responseLen, hidl_vec<Ce
             }
 
             case RIL_CELL_INFO_TYPE_TD_SCDMA: {
-                records[i].tdscdma.resize(1);
                 CellInfoTdscdma *cellInfoTdscdma = &records[i].tdscdma[0];
-                cellInfoTdscdma->cellIdentityTdscdma.mcc =
-                        std::to_string(rillCellInfo->CellInfo.tdscdma.cellIdentityTdscdma.mcc);
-                cellInfoTdscdma->cellIdentityTdscdma.mnc =
-                        std::to_string(rillCellInfo->CellInfo.tdscdma.cellIdentityTdscdma.mnc);
+                setMccMnc(cellInfoTdscdma->cellIdentityTdscdma.mcc, cellInfoTdscdma->cellIdentityTdscdma.mnc,
+                        scratch.strings[i], rillCellInfo->CellInfo.tdscdma.cellIdentityTdscdma.mcc,
+                        rillCellInfo->CellInfo.tdscdma.cellIdentityTdscdma.mnc);
                 cellInfoTdscdma->cellIdentityTdscdma.lac =
                         rillCellInfo->CellInfo.tdscdma.cellIdentityTdscdma.lac;
                 cellInfoTdscdma->cellIdentityTdscdma.cid =
@@ -8066,14 +8140,16 @@ int radio::cellInfoListInd(int slotId,
             return 0;
         }
 
-        hidl_vec<CellInfo> records;
-        convertRilCellInfoListToHal(response, responseLen, records);
+        CellInfoScratch fallback;
+        CellInfoScratch& scratch = acquireCellInfoScratch(slotId, fallback);
+        convertRilCellInfoListToHal(response, responseLen, scratch);
 
 #if VDBG
         RLOGD("cellInfoListInd");
 #endif
         Return<void> retStatus = radioService[slotId]->mRadioIndication->cellInfoList(
-                convertIntToRadioIndicationType(indicationType), records);
+                convertIntToRadioIndicationType(indicationType), scratch.records);
+        releaseCellInfoScratch(slotId, scratch);
         radioService[slotId]->checkReturnStatus(retStatus);
     } else {
         RLOGE("cellInfoListInd: radioService[%d]->mRadioIndication == NULL", slotId);
@@ -8509,6 +8585,30 @@ void radio::registerService(RIL_RadioFunctions *callbacks, CommandInfo *commands
     }
 }
 
+// Used for testing purpose only: the services of registerService(), without registering them
+void radio::createServicesForTest(RIL_RadioFunctions *callbacks, CommandInfo *commands) {
+    int simCount = 1;
+
+    #if (SIM_COUNT >= 2)
+    simCount = SIM_COUNT;
+    #endif
+
+    s_vendorFunctions = callbacks;
+    s_commands = commands;
+
+    for (int i = 0; i < simCount; i++) {
+        pthread_rwlock_t *radioServiceRwlockPtr = getRadioServiceRwlock(i);
+        int ret = pthread_rwlock_wrlock(radioServiceRwlockPtr);
+        assert(ret == 0);
+
+        radioService[i] = new RadioImpl;
+        radioService[i]->mSlotId = i;
+
+        ret = pthread_rwlock_unlock(radioServiceRwlockPtr);
+        assert(ret == 0);
+    }
+}
+
 void rilc_thread_pool() {
     joinRpcThreadpool();
 }
@@ -22,6 +22,7 @@
 
 namespace radio {
 void registerService(RIL_RadioFunctions *callbacks, android::CommandInfo *commands);
+void createServicesForTest(RIL_RadioFunctions *callbacks, android::CommandInfo *commands);
 
 int getIccCardStatusResponse(int slotId, int responseType,
                             int token, RIL_Errno e, void *response, size_t responselen);
@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "RILC_TEST"
+
+#include "mock_vendor_ril.h"
+
+#include <ril_internal.h>
+#include <utils/SystemClock.h>
+
+namespace android {
+
+namespace {
+
+// Per dispatching thread, onRequest() runs on the thread that dispatched
+thread_local int64_t tResponseDelayUs = 0;
+
+}  // namespace
+
+MockVendorRil &MockVendorRil::get() {
+    static MockVendorRil *mock = new MockVendorRil();
+    return *mock;
+}
+
+void MockVendorRil::registerWithLibril() {
+    std::call_once(registered_, [this] {
+        responder_ = std::thread(&MockVendorRil::responderLoop, this);
+        responder_.detach();
+        RIL_startEventLoop();
+        RIL_registerForTest(functions());
+    });
+}
+
+void MockVendorRil::sendUnsol(int slotId, int unsolResponse) {
+#if defined(ANDROID_MULTI_SIM)
+    RIL_onUnsolicitedResponse(unsolResponse, NULL, 0, (RIL_SOCKET_ID) slotId);
+#else
+    RIL_onUnsolicitedResponse(unsolResponse, NULL, 0);
+#endif
+}
+
+void MockVendorRil::setResponseDelayUs(int64_t delayUs) {
+    tResponseDelayUs = delayUs;
+}
+
+void MockVendorRil::hold() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    held_ = true;
+}
+
+void MockVendorRil::release() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    held_ = false;
+    cond_.notify_one();
+}
+
+void MockVendorRil::waitIdle() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idleCond_.wait(lock, [this] { return responses_.empty() && !sending_; });
+}
+
+void MockVendorRil::queueResponse(RIL_Token t) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    responses_.push({elapsedRealtimeNano() + tResponseDelayUs * 1000, t});
+    cond_.notify_one();
+}
+
+void MockVendorRil::responderLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        if (held_ || responses_.empty()) {
+            cond_.wait(lock);
+            continue;
+        }
+        int64_t waitNs = responses_.top().dueNs - elapsedRealtimeNano();
+        if (waitNs > 0) {
+            cond_.wait_for(lock, std::chrono::nanoseconds(waitNs));
+            continue;
+        }
+
+        RIL_Token t = responses_.top().token;
+        responses_.pop();
+        sending_ = true;
+        lock.unlock();
+        RIL_onRequestComplete(t, RIL_E_SUCCESS, NULL, 0);
+        lock.lock();
+        sending_ = false;
+        if (responses_.empty()) {
+            idleCond_.notify_all();
+        }
+    }
+}
+
+#if defined(ANDROID_MULTI_SIM)
+void MockVendorRil::onRequest(int /* request */, void * /* data */, size_t /* datalen */,
+                              RIL_Token t, RIL_SOCKET_ID /* socket_id */) {
+#else
+void MockVendorRil::onRequest(int /* request */, void * /* data */, size_t /* datalen */,
+                              RIL_Token t) {
+#endif
+    if (tResponseDelayUs == 0) {
+        RIL_onRequestComplete(t, RIL_E_SUCCESS, NULL, 0);
+    } else {
+        get().queueResponse(t);
+    }
+}
+
+#if defined(ANDROID_MULTI_SIM)
+RIL_RadioState MockVendorRil::onStateRequest(RIL_SOCKET_ID /* socket_id */) {
+#else
+RIL_RadioState MockVendorRil::onStateRequest() {
+#endif
+    return RADIO_STATE_ON;
+}
+
+int MockVendorRil::supports(int /* requestCode */) {
+    return 1;
+}
+
+void MockVendorRil::onCancel(RIL_Token /* t */) {
+}
+
+const char *MockVendorRil::getVersion() {
+    return "libril mock vendor RIL";
+}
+
+const RIL_RadioFunctions *MockVendorRil::functions() {
+    static const RIL_RadioFunctions functions = {
+        RIL_VERSION,
+        onRequest,
+        onStateRequest,
+        supports,
+        onCancel,
+        getVersion,
+    };
+    return &functions;
+}
+
+bool dispatchMockRequest(int serial, int slotId, int request) {
+    RequestInfo *pRI = addRequestToList(serial, slotId, request);
+    if (pRI == NULL) {
+        return false;
+    }
+
+#if defined(ANDROID_MULTI_SIM)
+    MockVendorRil::onRequest(request, NULL, 0, pRI, (RIL_SOCKET_ID) slotId);
+#else
+    MockVendorRil::onRequest(request, NULL, 0, pRI);
+#endif
+    return true;
+}
+
+}  // namespace android
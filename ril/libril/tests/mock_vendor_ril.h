@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MOCK_VENDOR_RIL_H
+#define MOCK_VENDOR_RIL_H
+
+#include <telephony/ril.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace android {
+
+/*
+ * A vendor RIL answering every request with RIL_E_SUCCESS and no payload. A request is
+ * answered from onRequest() itself, or after a delay from a responder thread, the way a
+ * vendor RIL answers from its modem reader thread. URCs are sent without payload from the
+ * calling thread.
+ */
+class MockVendorRil {
+  public:
+    static MockVendorRil &get();
+
+    // Start the libril event loop, which runs the URC coalescing and wake lock timers, and hand
+    // the mock to libril through RIL_registerForTest(). Only the first call does anything.
+    void registerWithLibril();
+
+    // Send a URC of the slot through RIL_onUnsolicitedResponse()
+    void sendUnsol(int slotId, int unsolResponse);
+
+    // How requests dispatched from the calling thread are answered, 0 answers them inline
+    void setResponseDelayUs(int64_t delayUs);
+
+    // While held, responses are queued but not sent, to keep requests outstanding
+    void hold();
+    void release();
+
+    // Blocks until every queued response has been sent
+    void waitIdle();
+
+  private:
+    struct PendingResponse {
+        int64_t dueNs;
+        RIL_Token token;
+        bool operator>(const PendingResponse &other) const { return dueNs > other.dueNs; }
+    };
+
+    friend bool dispatchMockRequest(int serial, int slotId, int request);
+
+    MockVendorRil() = default;
+    static const RIL_RadioFunctions *functions();
+    void queueResponse(RIL_Token t);
+    void responderLoop();
+
+#if defined(ANDROID_MULTI_SIM)
+    static void onRequest(int request, void *data, size_t datalen, RIL_Token t,
+                          RIL_SOCKET_ID socket_id);
+    static RIL_RadioState onStateRequest(RIL_SOCKET_ID socket_id);
+#else
+    static void onRequest(int request, void *data, size_t datalen, RIL_Token t);
+    static RIL_RadioState onStateRequest();
+#endif
+    static int supports(int requestCode);
+    static void onCancel(RIL_Token t);
+    static const char *getVersion();
+
+    std::once_flag registered_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::condition_variable idleCond_;
+    std::priority_queue<PendingResponse, std::vector<PendingResponse>,
+                        std::greater<PendingResponse>> responses_;
+    bool held_ = false;
+    // A response popped from the queue whose RIL_onRequestComplete() has not returned yet
+    bool sending_ = false;
+    std::thread responder_;
+};
+
+/*
+ * Dispatches a request without payload the way ril_service.cpp's dispatchVoid() does,
+ * returns false if libril had no RequestInfo for it.
+ */
+bool dispatchMockRequest(int serial, int slotId, int request);
+
+}  // namespace android
+
+#endif  // MOCK_VENDOR_RIL_H
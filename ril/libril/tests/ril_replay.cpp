@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "RILC_TEST"
+
+#include "ril_replay.h"
+
+#include <utils/Log.h>
+#include <utils/SystemClock.h>
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include "mock_vendor_ril.h"
+
+namespace android {
+
+namespace {
+
+// Serials only need to be unique among the outstanding requests of a slot
+std::atomic<int> sNextSerial(1);
+
+}  // namespace
+
+bool ParseRilTrace(const std::string &path, std::vector<RilTraceEntry> *trace) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        RLOGE("Failed to open trace %s", path.c_str());
+        return false;
+    }
+
+    trace->clear();
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) {
+            line.erase(comment);
+        }
+        std::istringstream fields(line);
+        RilTraceEntry entry;
+        std::string kind;
+        if (!(fields >> entry.atUs)) {
+            continue;   // blank or comment line
+        }
+        if (!(fields >> entry.slotId >> kind)) {
+            RLOGE("%s:%d: invalid trace line", path.c_str(), lineNumber);
+            return false;
+        }
+        entry.unsol = kind == "urc";
+        entry.responseDelayUs = 0;
+        bool valid;
+        if (entry.unsol) {
+            valid = static_cast<bool>(fields >> entry.request);
+        } else {
+            std::istringstream request(kind);
+            valid = request >> entry.request && fields >> entry.responseDelayUs;
+        }
+        if (!valid || entry.slotId < 0 || entry.atUs < 0 || entry.responseDelayUs < 0) {
+            RLOGE("%s:%d: invalid trace line", path.c_str(), lineNumber);
+            return false;
+        }
+        if (!trace->empty() && entry.atUs < trace->back().atUs) {
+            RLOGE("%s:%d: trace goes back in time", path.c_str(), lineNumber);
+            return false;
+        }
+        if (entry.slotId >= SIM_COUNT) {
+            continue;
+        }
+        trace->push_back(entry);
+    }
+    return true;
+}
+
+bool ReplayRilTrace(const std::vector<RilTraceEntry> &trace, bool realtime,
+                    RilReplayResult *result) {
+    MockVendorRil &mock = MockVendorRil::get();
+    mock.registerWithLibril();
+
+    RequestStats before[SIM_COUNT];
+    UnsolStats unsolBefore[SIM_COUNT];
+    WakeLockStats wakeLockBefore;
+    for (int i = 0; i < SIM_COUNT; i++) {
+        getRequestStats(i, &before[i]);
+        getUnsolStats(i, &unsolBefore[i]);
+    }
+    getWakeLockStats(&wakeLockBefore);
+
+    result->dispatched = 0;
+    result->sent = 0;
+    int64_t startNs = elapsedRealtimeNano();
+    for (const RilTraceEntry &entry : trace) {
+        if (realtime) {
+            int64_t waitNs = startNs + entry.atUs * 1000 - elapsedRealtimeNano();
+            if (waitNs > 0) {
+                std::this_thread::sleep_for(std::chrono::nanoseconds(waitNs));
+            }
+        }
+        if (entry.unsol) {
+            mock.sendUnsol(entry.slotId, entry.request);
+            result->sent++;
+            continue;
+        }
+        mock.setResponseDelayUs(entry.responseDelayUs);
+        if (!dispatchMockRequest(sNextSerial++, entry.slotId, entry.request)) {
+            RLOGE("Failed to dispatch request %d on slot %d", entry.request, entry.slotId);
+            mock.setResponseDelayUs(0);
+            mock.waitIdle();
+            return false;
+        }
+        result->dispatched++;
+    }
+    mock.setResponseDelayUs(0);
+    mock.waitIdle();
+    result->wallUs = (elapsedRealtimeNano() - startNs) / 1000;
+
+    for (int i = 0; i < SIM_COUNT; i++) {
+        flushCoalescedUnsolResponses(i);
+
+        RequestStats after;
+        getRequestStats(i, &after);
+        result->stats[i].completed = after.completed - before[i].completed;
+        result->stats[i].heapAllocs = after.heapAllocs - before[i].heapAllocs;
+        result->stats[i].totalLatencyUs = after.totalLatencyUs - before[i].totalLatencyUs;
+        result->stats[i].maxLatencyUs = after.maxLatencyUs;
+
+        UnsolStats unsolAfter;
+        getUnsolStats(i, &unsolAfter);
+        result->unsolStats[i].received = unsolAfter.received - unsolBefore[i].received;
+        result->unsolStats[i].delivered = unsolAfter.delivered - unsolBefore[i].delivered;
+        result->unsolStats[i].suppressed = unsolAfter.suppressed - unsolBefore[i].suppressed;
+    }
+
+    WakeLockStats wakeLockAfter;
+    getWakeLockStats(&wakeLockAfter);
+    result->wakeLockStats.grabs = wakeLockAfter.grabs - wakeLockBefore.grabs;
+    result->wakeLockStats.acquires = wakeLockAfter.acquires - wakeLockBefore.acquires;
+    result->wakeLockStats.timeouts = wakeLockAfter.timeouts - wakeLockBefore.timeouts;
+    result->wakeLockStats.heldMs = wakeLockAfter.heldMs - wakeLockBefore.heldMs;
+    return true;
+}
+
+}  // namespace android
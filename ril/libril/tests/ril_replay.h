@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef RIL_REPLAY_H
+#define RIL_REPLAY_H
+
+#include <telephony/ril.h>
+#include <ril_internal.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace android {
+
+// One request or URC of a recorded trace
+struct RilTraceEntry {
+    int64_t atUs;               // when it is dispatched, from the start of the trace
+    int slotId;
+    bool unsol;
+    int request;                // RIL_REQUEST_*, or RIL_UNSOL_* for a URC
+    int64_t responseDelayUs;    // how long the vendor RIL takes to answer, 0 answers inline
+};
+
+// Parse a trace: '#' comments, then in dispatch order one line per request or URC:
+//   <at_us> <slot> <request> <response_delay_us>
+//   <at_us> <slot> urc <unsol_response>
+// Lines of a slot this build does not have are skipped, so one trace serves single and dual
+// SIM builds.
+bool ParseRilTrace(const std::string &path, std::vector<RilTraceEntry> *trace);
+
+// What replaying a trace cost. The counters are deltas of getRequestStats(), getUnsolStats()
+// and getWakeLockStats() over the replay, except maxLatencyUs which libril only keeps over the
+// lifetime of the process.
+struct RilReplayResult {
+    int64_t wallUs;             // from the first dispatch to the last response
+    unsigned int dispatched;    // requests
+    unsigned int sent;          // URCs
+    RequestStats stats[SIM_COUNT];
+    UnsolStats unsolStats[SIM_COUNT];
+    WakeLockStats wakeLockStats;
+};
+
+// Replay a trace through libril and the mock vendor RIL, registering it first if needed.
+// Without realtime, requests and URCs are dispatched back to back and only the response delays
+// are kept. The URCs still held back by coalescing are flushed at the end, the way screen on
+// does, so every URC of the trace is either delivered or suppressed.
+bool ReplayRilTrace(const std::vector<RilTraceEntry> &trace, bool realtime,
+                    RilReplayResult *result);
+
+}  // namespace android
+
+#endif  // RIL_REPLAY_H
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Replay a request and URC trace through libril against a mock vendor RIL, and print what
+ * the request and indication paths cost per slot, from the libril request, indication and
+ * wake lock counters:
+ *
+ *   ril_replay --trace ril_trace.txt [--realtime] [--repeat <n>]
+ *
+ * No HIDL service is published, so this can run next to the real rild. URCs do take the
+ * libril wake lock, whose name rild shares, so the wake lock counters only describe this
+ * process.
+ */
+
+#include <getopt.h>
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "ril_replay.h"
+
+using ::android::ParseRilTrace;
+using ::android::ReplayRilTrace;
+using ::android::RilReplayResult;
+using ::android::RilTraceEntry;
+
+namespace {
+
+void PrintUsage(const char *argv0) {
+    fprintf(stderr, "Usage: %s --trace <ril_trace.txt> [--realtime] [--repeat <n>]\n", argv0);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    std::string tracePath;
+    bool realtime = false;
+    int repeat = 1;
+
+    static const struct option kOptions[] = {
+            {"trace", required_argument, nullptr, 't'},
+            {"realtime", no_argument, nullptr, 'R'},
+            {"repeat", required_argument, nullptr, 'n'},
+            {nullptr, 0, nullptr, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", kOptions, nullptr)) != -1) {
+        switch (opt) {
+            case 't':
+                tracePath = optarg;
+                break;
+            case 'R':
+                realtime = true;
+                break;
+            case 'n':
+                repeat = atoi(optarg);
+                break;
+            default:
+                PrintUsage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (tracePath.empty() || repeat <= 0) {
+        PrintUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<RilTraceEntry> trace;
+    if (!ParseRilTrace(tracePath, &trace)) {
+        fprintf(stderr, "Failed to parse trace %s\n", tracePath.c_str());
+        return EXIT_FAILURE;
+    }
+
+    printf("run,slot,dispatched,completed,heap_allocs,mean_latency_us,max_latency_us,"
+           "urcs_sent,urcs_received,urcs_delivered,urcs_suppressed,"
+           "wake_lock_grabs,wake_lock_acquires,wake_lock_timeouts,wake_lock_held_ms,wall_us\n");
+    for (int run = 0; run < repeat; run++) {
+        RilReplayResult result;
+        if (!ReplayRilTrace(trace, realtime, &result)) {
+            fprintf(stderr, "Failed to replay run %d\n", run);
+            return EXIT_FAILURE;
+        }
+        // The wake lock is shared by the slots, its counters are repeated on every row
+        const android::WakeLockStats &wakeLockStats = result.wakeLockStats;
+        for (int slot = 0; slot < SIM_COUNT; slot++) {
+            const android::RequestStats &stats = result.stats[slot];
+            const android::UnsolStats &unsolStats = result.unsolStats[slot];
+            printf("%d,%d,%u,%u,%u,%" PRId64 ",%" PRId64 ",%u,%u,%u,%u,%u,%u,%u,%" PRId64
+                   ",%" PRId64 "\n", run, slot,
+                   result.dispatched, stats.completed, stats.heapAllocs,
+                   stats.completed ? stats.totalLatencyUs / stats.completed : 0,
+                   stats.maxLatencyUs, result.sent, unsolStats.received, unsolStats.delivered,
+                   unsolStats.suppressed, wakeLockStats.grabs, wakeLockStats.acquires,
+                   wakeLockStats.timeouts, wakeLockStats.heldMs, result.wallUs);
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <telephony/ril.h>
+#include <ril_internal.h>
+
+#include <vector>
+
+#include "mock_vendor_ril.h"
+
+namespace android {
+
+namespace {
+
+// Adds the request path counters of libril for the slot over the run to the benchmark output
+class RequestStatsCounters {
+  public:
+    explicit RequestStatsCounters(int slotId) : slotId_(slotId) {
+        getRequestStats(slotId_, &before_);
+    }
+
+    void report(benchmark::State &state) {
+        RequestStats after;
+        getRequestStats(slotId_, &after);
+        unsigned int completed = after.completed - before_.completed;
+        state.SetItemsProcessed(completed);
+        state.counters["heap_allocs"] = after.heapAllocs - before_.heapAllocs;
+        state.counters["mean_latency_us"] = completed == 0 ? 0 :
+                static_cast<double>(after.totalLatencyUs - before_.totalLatencyUs) / completed;
+    }
+
+  private:
+    const int slotId_;
+    RequestStats before_;
+};
+
+// Adds the indication and wake lock counters of libril over the run to the benchmark output
+class UnsolStatsCounters {
+  public:
+    explicit UnsolStatsCounters(int slotId) : slotId_(slotId) {
+        getUnsolStats(slotId_, &before_);
+        getWakeLockStats(&wakeLockBefore_);
+    }
+
+    void report(benchmark::State &state) {
+        UnsolStats after;
+        WakeLockStats wakeLockAfter;
+        getUnsolStats(slotId_, &after);
+        getWakeLockStats(&wakeLockAfter);
+        state.SetItemsProcessed(after.received - before_.received);
+        state.counters["delivered"] = after.delivered - before_.delivered;
+        state.counters["suppressed"] = after.suppressed - before_.suppressed;
+        state.counters["wake_lock_grabs"] = wakeLockAfter.grabs - wakeLockBefore_.grabs;
+        state.counters["wake_lock_acquires"] = wakeLockAfter.acquires - wakeLockBefore_.acquires;
+    }
+
+  private:
+    const int slotId_;
+    UnsolStats before_;
+    WakeLockStats wakeLockBefore_;
+};
+
+// Every slot the build has, as the last argument of a benchmark
+void ForEachSlot(benchmark::internal::Benchmark *b, const std::vector<int64_t> &args) {
+    for (int slot = 0; slot < SIM_COUNT; slot++) {
+        std::vector<int64_t> slotArgs(args);
+        slotArgs.push_back(slot);
+        b->Args(slotArgs);
+    }
+}
+
+// A request answered from onRequest() itself: addRequestToList(), the response dispatch and
+// the return of the RequestInfo to the free list
+void BM_InlineRequest(benchmark::State &state) {
+    const int slot = state.range(0);
+    MockVendorRil::get().registerWithLibril();
+    RequestStatsCounters counters(slot);
+    int serial = 1;
+
+    for (auto _ : state) {
+        dispatchMockRequest(serial++, slot, RIL_REQUEST_SIGNAL_STRENGTH);
+    }
+    counters.report(state);
+}
+BENCHMARK(BM_InlineRequest)->Apply([](benchmark::internal::Benchmark *b) {
+    ForEachSlot(b, {});
+});
+
+// Bursts of requests outstanding at once and answered from the responder thread, past
+// REQUEST_POOL_SIZE the pending list gets long and the pool overflows to the heap
+void BM_RequestBurst(benchmark::State &state) {
+    const int slot = state.range(1);
+    MockVendorRil &mock = MockVendorRil::get();
+    mock.registerWithLibril();
+    RequestStatsCounters counters(slot);
+    int serial = 1;
+
+    mock.setResponseDelayUs(1);
+    for (auto _ : state) {
+        mock.hold();
+        for (int i = 0; i < state.range(0); i++) {
+            dispatchMockRequest(serial++, slot, RIL_REQUEST_GET_CURRENT_CALLS);
+        }
+        mock.release();
+        mock.waitIdle();
+    }
+    mock.setResponseDelayUs(0);
+    counters.report(state);
+}
+BENCHMARK(BM_RequestBurst)->Apply([](benchmark::internal::Benchmark *b) {
+    for (int64_t burst : {8, 64, REQUEST_POOL_SIZE, 4 * REQUEST_POOL_SIZE}) {
+        ForEachSlot(b, {burst});
+    }
+});
+
+// URCs sent back to back from the vendor RIL. Signal strength is coalesced and does not wake,
+// cell info is coalesced and wakes, call state changes are neither and flush the held back
+// copies. Whatever is still held back at the end is flushed outside of the timing.
+void BM_Urc(benchmark::State &state) {
+    const int unsolResponse = state.range(0);
+    const int slot = state.range(1);
+    MockVendorRil &mock = MockVendorRil::get();
+    mock.registerWithLibril();
+    flushCoalescedUnsolResponses(slot);
+    UnsolStatsCounters counters(slot);
+
+    for (auto _ : state) {
+        mock.sendUnsol(slot, unsolResponse);
+    }
+    flushCoalescedUnsolResponses(slot);
+    counters.report(state);
+    state.SetLabel(requestToString(unsolResponse));
+}
+BENCHMARK(BM_Urc)->Apply([](benchmark::internal::Benchmark *b) {
+    for (int64_t unsolResponse : {RIL_UNSOL_SIGNAL_STRENGTH, RIL_UNSOL_CELL_INFO_LIST,
+                                  RIL_UNSOL_RESPONSE_CALL_STATE_CHANGED}) {
+        ForEachSlot(b, {unsolResponse});
+    }
+});
+
+}  // namespace
+
+}  // namespace android
+
+BENCHMARK_MAIN();
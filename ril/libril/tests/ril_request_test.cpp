@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mock_vendor_ril.h"
+#include "ril_replay.h"
+
+namespace android {
+
+namespace {
+
+// Per slot counts of tests/data/ril_trace.txt
+constexpr unsigned int kTraceRequests[] = {16, 7};
+constexpr unsigned int kTraceUrcs[] = {9, 7};
+// Back to back, at least one of each run of signal strength and network state URCs is
+// replaced before it is delivered
+constexpr unsigned int kTraceMinSuppressed[] = {2, 1};
+// The new SMS and call state URCs, and one delivery of each waking coalesced URC
+constexpr unsigned int kTraceMinWakeLocks[] = {3, 4};
+static_assert(SIM_COUNT <= 2, "the trace only has two slots");
+
+// ANDROID_WAKE_LOCK_SECS and ANDROID_WAKE_LOCK_USECS of ril.cpp
+constexpr std::chrono::milliseconds kWakeLockTimeout(200);
+
+std::string GetTestDataPath(const std::string &name) {
+    return ::android::base::GetExecutableDirectory() + "/tests/data/" + name;
+}
+
+class RilRequestTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        MockVendorRil::get().registerWithLibril();
+        for (int i = 0; i < SIM_COUNT; i++) {
+            // Nothing held back by an earlier test is delivered during this one
+            flushCoalescedUnsolResponses(i);
+            getRequestStats(i, &before_[i]);
+            getUnsolStats(i, &unsolBefore_[i]);
+        }
+        getWakeLockStats(&wakeLockBefore_);
+    }
+
+    void TearDown() override {
+        MockVendorRil::get().release();
+        MockVendorRil::get().setResponseDelayUs(0);
+        MockVendorRil::get().waitIdle();
+    }
+
+    RequestStats delta(int slotId) {
+        RequestStats after;
+        getRequestStats(slotId, &after);
+        after.completed -= before_[slotId].completed;
+        after.heapAllocs -= before_[slotId].heapAllocs;
+        after.totalLatencyUs -= before_[slotId].totalLatencyUs;
+        return after;
+    }
+
+    UnsolStats unsolDelta(int slotId) {
+        UnsolStats after;
+        getUnsolStats(slotId, &after);
+        after.received -= unsolBefore_[slotId].received;
+        after.delivered -= unsolBefore_[slotId].delivered;
+        after.suppressed -= unsolBefore_[slotId].suppressed;
+        return after;
+    }
+
+    WakeLockStats wakeLockDelta() {
+        WakeLockStats after;
+        getWakeLockStats(&after);
+        after.grabs -= wakeLockBefore_.grabs;
+        after.acquires -= wakeLockBefore_.acquires;
+        after.timeouts -= wakeLockBefore_.timeouts;
+        after.heldMs -= wakeLockBefore_.heldMs;
+        return after;
+    }
+
+    RequestStats before_[SIM_COUNT];
+    UnsolStats unsolBefore_[SIM_COUNT];
+    WakeLockStats wakeLockBefore_;
+    int serial_ = 1;
+};
+
+TEST_F(RilRequestTest, InlineResponsesAreCounted) {
+    for (int slot = 0; slot < SIM_COUNT; slot++) {
+        for (int i = 0; i < 10; i++) {
+            ASSERT_TRUE(dispatchMockRequest(serial_++, slot, RIL_REQUEST_SIGNAL_STRENGTH));
+        }
+    }
+
+    for (int slot = 0; slot < SIM_COUNT; slot++) {
+        RequestStats stats = delta(slot);
+        EXPECT_EQ(stats.completed, 10u) << "slot " << slot;
+        EXPECT_EQ(stats.heapAllocs, 0u) << "slot " << slot;
+        EXPECT_GE(stats.totalLatencyUs, 0) << "slot " << slot;
+    }
+}
+
+TEST_F(RilRequestTest, DelayedResponsesAreCounted) {
+    MockVendorRil::get().setResponseDelayUs(5000);
+    for (int slot = 0; slot < SIM_COUNT; slot++) {
+        for (int i = 0; i < 4; i++) {
+            ASSERT_TRUE(dispatchMockRequest(serial_++, slot, RIL_REQUEST_OPERATOR));
+        }
+    }
+    MockVendorRil::get().waitIdle();
+
+    for (int slot = 0; slot < SIM_COUNT; slot++) {
+        RequestStats stats = delta(slot);
+        EXPECT_EQ(stats.completed, 4u) << "slot " << slot;
+        // Every request waited out its response delay between addRequestToList() and the
+        // response
+        EXPECT_GE(stats.totalLatencyUs, 4 * 5000) << "slot " << slot;
+        EXPECT_GE(stats.maxLatencyUs, 5000) << "slot " << slot;
+    }
+}
+
+TEST_F(RilRequestTest, PoolOverflowIsReused) {
+    constexpr unsigned int kOverflow = 8;
+    constexpr unsigned int kBurst = REQUEST_POOL_SIZE + kOverflow;
+
+    for (int slot = 0; slot < SIM_COUNT; slot++) {
+        for (int burst = 0; burst < 2; burst++) {
+            getRequestStats(slot, &before_[slot]);
+            MockVendorRil::get().hold();
+            MockVendorRil::get().setResponseDelayUs(1);
+            for (unsigned int i = 0; i < kBurst; i++) {
+                ASSERT_TRUE(dispatchMockRequest(serial_++, slot, RIL_REQUEST_GET_CURRENT_CALLS));
+            }
+            MockVendorRil::get().release();
+            MockVendorRil::get().waitIdle();
+
+            RequestStats stats = delta(slot);
+            EXPECT_EQ(stats.completed, kBurst) << "slot " << slot;
+            if (burst == 0) {
+                // Nothing else keeps more than the pool outstanding, so only the overflow is new
+                EXPECT_LE(stats.heapAllocs, kOverflow) << "slot " << slot;
+            } else {
+                // The overflow entries went back to the free list instead of being freed
+                EXPECT_EQ(stats.heapAllocs, 0u) << "slot " << slot;
+            }
+        }
+    }
+}
+
+TEST_F(RilRequestTest, CoalescedUrcsAreSuppressed) {
+    constexpr unsigned int kUrcs = 10;
+
+    for (int slot = 0; slot < SIM_COUNT; slot++) {
+        for (unsigned int i = 0; i < kUrcs; i++) {
+            MockVendorRil::get().sendUnsol(slot, RIL_UNSOL_SIGNAL_STRENGTH);
+        }
+        flushCoalescedUnsolResponses(slot);
+    }
+
+    for (int slot = 0; slot < SIM_COUNT; slot++) {
+        UnsolStats stats = unsolDelta(slot);
+        EXPECT_EQ(stats.received, kUrcs) << "slot " << slot;
+        EXPECT_EQ(stats.delivered + stats.suppressed, kUrcs) << "slot " << slot;
+        // At most the first one of the window and the flushed one went up
+        EXPECT_LE(stats.delivered, 2u) << "slot " << slot;
+    }
+    // Signal strength does not wake the device
+    EXPECT_EQ(wakeLockDelta().grabs, 0u);
+}
+
+TEST_F(RilRequestTest, WakingUrcsTakeTheWakeLock) {
+    constexpr unsigned int kUrcs = 3;
+
+    for (int slot = 0; slot < SIM_COUNT; slot++) {
+        for (unsigned int i = 0; i < kUrcs; i++) {
+            MockVendorRil::get().sendUnsol(slot, RIL_UNSOL_RESPONSE_CALL_STATE_CHANGED);
+        }
+    }
+
+    for (int slot = 0; slot < SIM_COUNT; slot++) {
+        UnsolStats stats = unsolDelta(slot);
+        EXPECT_EQ(stats.received, kUrcs) << "slot " << slot;
+        EXPECT_EQ(stats.delivered, kUrcs) << "slot " << slot;
+        EXPECT_EQ(stats.suppressed, 0u) << "slot " << slot;
+    }
+    WakeLockStats wakeLockStats = wakeLockDelta();
+    EXPECT_GE(wakeLockStats.grabs, kUrcs * SIM_COUNT);
+    EXPECT_LE(wakeLockStats.acquires, wakeLockStats.grabs);
+
+    // Nothing acks the indications, so the timer of the event loop releases the wake lock
+    std::this_thread::sleep_for(2 * kWakeLockTimeout);
+    EXPECT_GE(wakeLockDelta().timeouts, 1u);
+}
+
+TEST_F(RilRequestTest, TraceReplay) {
+    std::vector<RilTraceEntry> trace;
+    ASSERT_TRUE(ParseRilTrace(GetTestDataPath("ril_trace.txt"), &trace));
+    unsigned int requests = 0;
+    unsigned int urcs = 0;
+    for (int slot = 0; slot < SIM_COUNT; slot++) {
+        requests += kTraceRequests[slot];
+        urcs += kTraceUrcs[slot];
+    }
+    ASSERT_EQ(trace.size(), requests + urcs);
+
+    RilReplayResult result;
+    ASSERT_TRUE(ReplayRilTrace(trace, false, &result));
+    EXPECT_EQ(result.dispatched, requests);
+    EXPECT_EQ(result.sent, urcs);
+    unsigned int minWakeLocks = 0;
+    for (int slot = 0; slot < SIM_COUNT; slot++) {
+        const RequestStats &stats = result.stats[slot];
+        EXPECT_EQ(stats.completed, kTraceRequests[slot]) << "slot " << slot;
+        EXPECT_EQ(stats.heapAllocs, 0u) << "slot " << slot;
+
+        // Every URC was delivered or replaced, nothing is left held back
+        const UnsolStats &unsolStats = result.unsolStats[slot];
+        EXPECT_EQ(unsolStats.received, kTraceUrcs[slot]) << "slot " << slot;
+        EXPECT_EQ(unsolStats.delivered + unsolStats.suppressed, kTraceUrcs[slot])
+                << "slot " << slot;
+        EXPECT_GE(unsolStats.suppressed, kTraceMinSuppressed[slot]) << "slot " << slot;
+        minWakeLocks += kTraceMinWakeLocks[slot];
+    }
+    // The longest response delay of the trace is 8ms
+    EXPECT_GE(result.stats[0].maxLatencyUs, 8000);
+    EXPECT_GE(result.wallUs, 8000);
+    EXPECT_GE(result.wakeLockStats.grabs, minWakeLocks);
+    EXPECT_LE(result.wakeLockStats.acquires, result.wakeLockStats.grabs);
+}
+
+}  // namespace
+
+}  // namespace android